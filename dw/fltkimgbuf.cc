@@ -25,6 +25,12 @@
 
 #include <FL/fl_draw.H>
 
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif
+
 #define IMAGE_MAX_AREA (6000 * 6000)
 
 namespace dw {
@@ -32,6 +38,281 @@ namespace fltk {
 
 using namespace lout::container::typed;
 
+unsigned int FltkImgbuf::useCounter = 0;
+unsigned int FltkImgbuf::frameStart = 0;
+
+/*
+ * Row kernels for scaling. They work on n bytes (i.e. width * bpp) and
+ * use SSE2 or NEON when available.
+ */
+
+/**
+ * \brief acc[i] += src[i]
+ */
+static void accumulateRow (unsigned int *acc, const uchar *src, int n)
+{
+   int i = 0;
+
+#if defined(__SSE2__)
+   const __m128i zero = _mm_setzero_si128 ();
+   for (; i + 16 <= n; i += 16) {
+      __m128i s = _mm_loadu_si128 ((const __m128i*)(src + i));
+      __m128i s16[2] = { _mm_unpacklo_epi8 (s, zero),
+                         _mm_unpackhi_epi8 (s, zero) };
+      for (int k = 0; k < 4; k++) {
+         __m128i *a = (__m128i*)(acc + i + 4 * k);
+         __m128i s32 = (k & 1) ? _mm_unpackhi_epi16 (s16[k / 2], zero) :
+                                 _mm_unpacklo_epi16 (s16[k / 2], zero);
+         _mm_storeu_si128 (a, _mm_add_epi32 (_mm_loadu_si128 (a), s32));
+      }
+   }
+#elif defined(__ARM_NEON)
+   for (; i + 16 <= n; i += 16) {
+      uint8x16_t s = vld1q_u8 (src + i);
+      uint16x8_t lo = vmovl_u8 (vget_low_u8 (s));
+      uint16x8_t hi = vmovl_u8 (vget_high_u8 (s));
+      vst1q_u32 (acc + i, vaddw_u16 (vld1q_u32 (acc + i), vget_low_u16 (lo)));
+      vst1q_u32 (acc + i + 4,
+                 vaddw_u16 (vld1q_u32 (acc + i + 4), vget_high_u16 (lo)));
+      vst1q_u32 (acc + i + 8,
+                 vaddw_u16 (vld1q_u32 (acc + i + 8), vget_low_u16 (hi)));
+      vst1q_u32 (acc + i + 12,
+                 vaddw_u16 (vld1q_u32 (acc + i + 12), vget_high_u16 (hi)));
+   }
+#endif
+
+   for (; i < n; i++)
+      acc[i] += src[i];
+}
+
+/**
+ * \brief dst[i] = acc[i] / count, rounded
+ */
+static void averageRow (uchar *dst, const unsigned int *acc, int n, int count)
+{
+   int i = 0;
+
+#if defined(__SSE2__)
+   const __m128 scale = _mm_set1_ps (1.0f / count);
+   for (; i + 16 <= n; i += 16) {
+      __m128i q[4];
+      for (int k = 0; k < 4; k++) {
+         __m128 a = _mm_cvtepi32_ps (_mm_loadu_si128 ((const __m128i*)
+                                                      (acc + i + 4 * k)));
+         q[k] = _mm_cvtps_epi32 (_mm_mul_ps (a, scale));
+      }
+      _mm_storeu_si128 ((__m128i*)(dst + i),
+                        _mm_packus_epi16 (_mm_packs_epi32 (q[0], q[1]),
+                                          _mm_packs_epi32 (q[2], q[3])));
+   }
+#elif defined(__ARM_NEON)
+   const float32x4_t scale = vdupq_n_f32 (1.0f / count);
+   const float32x4_t half = vdupq_n_f32 (0.5f);
+   for (; i + 16 <= n; i += 16) {
+      uint16x4_t q[4];
+      for (int k = 0; k < 4; k++) {
+         float32x4_t a = vcvtq_f32_u32 (vld1q_u32 (acc + i + 4 * k));
+         q[k] = vqmovn_u32 (vcvtq_u32_f32 (vmlaq_f32 (half, a, scale)));
+      }
+      vst1q_u8 (dst + i,
+                vcombine_u8 (vqmovn_u16 (vcombine_u16 (q[0], q[1])),
+                             vqmovn_u16 (vcombine_u16 (q[2], q[3]))));
+   }
+#endif
+
+   for (; i < n; i++)
+      dst[i] = (acc[i] + count / 2) / count;
+}
+
+/**
+ * \brief dst[i] = a[i] * (256 - w) / 256 + b[i] * w / 256, rounded
+ */
+static void blendRows (uchar *dst, const uchar *a, const uchar *b, int n,
+                       int w)
+{
+   int i = 0;
+
+#if defined(__SSE2__)
+   const __m128i zero = _mm_setzero_si128 ();
+   const __m128i wa = _mm_set1_epi16 (256 - w), wb = _mm_set1_epi16 (w);
+   const __m128i round = _mm_set1_epi16 (128);
+   for (; i + 16 <= n; i += 16) {
+      __m128i va = _mm_loadu_si128 ((const __m128i*)(a + i));
+      __m128i vb = _mm_loadu_si128 ((const __m128i*)(b + i));
+      __m128i r[2];
+      for (int k = 0; k < 2; k++) {
+         __m128i a16 = k ? _mm_unpackhi_epi8 (va, zero) :
+                           _mm_unpacklo_epi8 (va, zero);
+         __m128i b16 = k ? _mm_unpackhi_epi8 (vb, zero) :
+                           _mm_unpacklo_epi8 (vb, zero);
+         __m128i sum = _mm_add_epi16 (_mm_mullo_epi16 (a16, wa),
+                                      _mm_mullo_epi16 (b16, wb));
+         r[k] = _mm_srli_epi16 (_mm_add_epi16 (sum, round), 8);
+      }
+      _mm_storeu_si128 ((__m128i*)(dst + i), _mm_packus_epi16 (r[0], r[1]));
+   }
+#elif defined(__ARM_NEON)
+   for (; i + 16 <= n; i += 16) {
+      uint8x16_t va = vld1q_u8 (a + i), vb = vld1q_u8 (b + i);
+      uint16x8_t lo = vmulq_n_u16 (vmovl_u8 (vget_low_u8 (va)), 256 - w);
+      uint16x8_t hi = vmulq_n_u16 (vmovl_u8 (vget_high_u8 (va)), 256 - w);
+      lo = vmlaq_n_u16 (lo, vmovl_u8 (vget_low_u8 (vb)), w);
+      hi = vmlaq_n_u16 (hi, vmovl_u8 (vget_high_u8 (vb)), w);
+      vst1q_u8 (dst + i, vcombine_u8 (vrshrn_n_u16 (lo, 8),
+                                      vrshrn_n_u16 (hi, 8)));
+   }
+#endif
+
+   for (; i < n; i++)
+      dst[i] = (a[i] * (256 - w) + b[i] * w + 128) >> 8;
+}
+
+/*
+ * Scratch rows shared by all scaled buffers.
+ */
+static uchar *scratchLine[2] = { NULL, NULL };
+static unsigned int *scratchAcc = NULL;
+static int scratchSize = 0;
+
+/*
+ * Rows composited for drawing, shared by all buffers.
+ */
+static uchar *compositeBuf = NULL;
+static int compositeSize = 0;
+
+/*
+ * Divide a product of two 8 bit values by 255, rounded.
+ */
+static inline int div255 (int x)
+{
+   x += 128;
+   return (x + (x >> 8)) >> 8;
+}
+
+/*
+ * Convert an RGBA row to premultiplied alpha. Returns whether any pixel
+ * is not opaque.
+ */
+static bool premultiplyRow (uchar *dst, const uchar *src, int width)
+{
+   bool translucent = false;
+
+   for (int x = 0; x < width; x++, dst += 4, src += 4) {
+      int a = src[3];
+
+      if (a == 255) {
+         memcpy (dst, src, 4);
+      } else {
+         dst[0] = div255 (src[0] * a);
+         dst[1] = div255 (src[1] * a);
+         dst[2] = div255 (src[2] * a);
+         dst[3] = a;
+         translucent = true;
+      }
+   }
+   return translucent;
+}
+
+/*
+ * Composite a premultiplied RGBA row over a solid background into RGB.
+ */
+static void compositeRow (uchar *dst, const uchar *src, int width,
+                          int bgRed, int bgGreen, int bgBlue)
+{
+   for (int x = 0; x < width; x++, dst += 3, src += 4) {
+      int t = 255 - src[3];
+
+      if (t == 0) {
+         dst[0] = src[0];
+         dst[1] = src[1];
+         dst[2] = src[2];
+      } else {
+         dst[0] = src[0] + div255 (bgRed * t);
+         dst[1] = src[1] + div255 (bgGreen * t);
+         dst[2] = src[2] + div255 (bgBlue * t);
+      }
+   }
+}
+
+static void ensureScratch (int n)
+{
+   if (n > scratchSize) {
+      delete[] scratchLine[0];
+      delete[] scratchLine[1];
+      delete[] scratchAcc;
+      scratchSize = n;
+      scratchLine[0] = new uchar[n];
+      scratchLine[1] = new uchar[n];
+      scratchAcc = new unsigned int[n];
+   }
+}
+
+/*
+ * Pool of pixel data of deleted scaled buffers, for the next ones.
+ *
+ * Resizing a page with scaled images creates a new scaled buffer for
+ * every intermediate size, just before the previous one is freed. The
+ * data sizes are rounded up to buckets (about an eighth apart), so that
+ * a buffer of a similar size can take over the memory instead of going
+ * through the allocator. The pool is bounded, and emptied when image
+ * data is dropped to save memory (see FltkImgbuf::dropData).
+ */
+enum { POOL_SLOTS = 8, POOL_MAX_BYTES = 16 * 1024 * 1024 };
+
+static struct {
+   uchar *data;
+   int size;
+} pool[POOL_SLOTS];
+static int poolCount = 0, poolBytes = 0;
+
+static int bucketSize (int n)
+{
+   int step = 1;
+
+   while (step * 8 < n)
+      step <<= 1;
+   return (n + step - 1) / step * step;
+}
+
+static uchar *poolGet (int size)
+{
+   for (int i = poolCount - 1; i >= 0; i--) {
+      if (pool[i].size == size) {
+         uchar *data = pool[i].data;
+         poolBytes -= size;
+         pool[i] = pool[--poolCount];
+         return data;
+      }
+   }
+   return new uchar[size];
+}
+
+static void poolPut (uchar *data, int size)
+{
+   if (size > POOL_MAX_BYTES / 2) {
+      delete[] data;
+      return;
+   }
+   // Make room, oldest first.
+   while (poolCount > 0 &&
+          (poolCount == POOL_SLOTS || poolBytes + size > POOL_MAX_BYTES)) {
+      delete[] pool[0].data;
+      poolBytes -= pool[0].size;
+      memmove (pool, pool + 1, --poolCount * sizeof (pool[0]));
+   }
+   pool[poolCount].data = data;
+   pool[poolCount].size = size;
+   poolCount++;
+   poolBytes += size;
+}
+
+static void poolFlush ()
+{
+   while (poolCount > 0)
+      delete[] pool[--poolCount].data;
+   poolBytes = 0;
+}
+
 FltkImgbuf::FltkImgbuf (Type type, int width, int height)
 {
    _MSG("FltkImgbuf: new root %p\n", this);
@@ -58,13 +339,18 @@ void FltkImgbuf::init (Type type, int width, int height, FltkImgbuf *root)
       default:   bpp = 1; break;
    }
    _MSG("FltkImgbuf::init width=%d height=%d bpp=%d\n", width, height, bpp);
-   rawdata = new uchar[bpp * width * height];
-   // Set light-gray as interim background color.
-   memset(rawdata, 222, width*height*bpp);
+   rawdata = NULL;
+   allocData ();
 
    refCount = 1;
    deleteOnUnref = true;
    copiedRows = new lout::misc::BitSet (height);
+   translucent = false;
+   reloader = NULL;
+   largerWanted = false;
+   animation = NULL;
+   lastUse = ++useCounter;
+   renderers = new lout::misc::SimpleVector <Renderer*> (1);
 
    // The list is only used for root buffers.
    if (isRoot())
@@ -72,11 +358,19 @@ void FltkImgbuf::init (Type type, int width, int height, FltkImgbuf *root)
    else
       scaledBuffers = NULL;
 
-   if (!isRoot()) {
-      // Scaling
-      for (int row = 0; row < root->height; row++) {
-         if (root->copiedRows->get (row))
-            scaleRow (row, root->rawdata + row*root->width*root->bpp);
+   xSrc = xFrac = ySrc = yFrac = NULL;
+   if (!isRoot())
+      initScaling ();
+
+   if (!isRoot() && root->rawdata) {
+      // Scaling, a run of copied rows at a time
+      for (int row = 0; row < root->height; ) {
+         int n = 0;
+         while (row + n < root->height && root->copiedRows->get (row + n))
+            n++;
+         if (n > 0)
+            scaleRows (row, n);
+         row += n + 1;
       }
    }
 }
@@ -88,8 +382,13 @@ FltkImgbuf::~FltkImgbuf ()
    if (!isRoot())
       root->detachScaledBuf (this);
 
-   delete[] rawdata;
+   freeData ();
    delete copiedRows;
+   delete[] xSrc;
+   delete[] xFrac;
+   delete[] ySrc;
+   delete[] yFrac;
+   delete renderers;
 
    if (scaledBuffers)
       delete scaledBuffers;
@@ -113,46 +412,319 @@ void FltkImgbuf::detachScaledBuf (FltkImgbuf *scaledBuf)
       delete this;
 }
 
+/**
+ * \brief Allocate the pixel data, if it has been freed.
+ */
+void FltkImgbuf::allocData ()
+{
+   if (rawdata == NULL) {
+      rawdata = isRoot () ? new uchar[bpp * width * height] :
+                            poolGet (bucketSize (bpp * width * height));
+      // Set light-gray as interim background color.
+      memset(rawdata, 222, width*height*bpp);
+   }
+}
+
+/**
+ * \brief Free the pixel data; all rows have to be copied again.
+ */
+void FltkImgbuf::freeData ()
+{
+   if (isRoot ())
+      delete[] rawdata;
+   else if (rawdata)
+      poolPut (rawdata, bucketSize (bpp * width * height));
+   rawdata = NULL;
+   copiedRows->clear ();
+}
+
+/**
+ * \brief Allocate the pixel data of a root buffer and its scaled buffers
+ *    again after dropData(), and let the reloader refill it.
+ *
+ * The reloader may do so later; until then, the buffers show the
+ * placeholder set by allocData().
+ */
+void FltkImgbuf::restoreData ()
+{
+   assert (isRoot());
+
+   allocData ();
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); )
+      it.getNext()->allocData ();
+
+   if (reloader)
+      reloader->reload (this);
+}
+
 void FltkImgbuf::setCMap (int *colors, int num_colors)
 {
 }
 
-inline void FltkImgbuf::scaleRow (int row, const core::byte *data)
+/**
+ * \brief Fill one scaling table, for \em dstSize pixels out of
+ *    \em srcSize.
+ *
+ * When shrinking, src[i] is the first source pixel averaged into pixel i,
+ * and src[dstSize] == srcSize. When enlarging, src[i] is the source pixel
+ * left of (or above) the center of pixel i, and frac[i] the weight of
+ * the next one, in 1/256.
+ */
+static void initScalingTable (int srcSize, int dstSize, int **src, int **frac)
+{
+   if (dstSize <= srcSize) {
+      *src = new int[dstSize + 1];
+      *frac = NULL;
+      for (int i = 0; i <= dstSize; i++)
+         (*src)[i] = (int) ((long long) i * srcSize / dstSize);
+   } else {
+      *src = new int[dstSize];
+      *frac = new int[dstSize];
+      for (int i = 0; i < dstSize; i++) {
+         double pos = (i + 0.5) * srcSize / dstSize - 0.5;
+         if (pos < 0)
+            pos = 0;
+         (*src)[i] = (int) pos;
+         (*frac)[i] = (int) ((pos - (*src)[i]) * 256);
+         if ((*src)[i] >= srcSize - 1) {
+            (*src)[i] = srcSize - 1;
+            (*frac)[i] = 0;
+         }
+      }
+   }
+}
+
+/**
+ * \brief Return the first i < n with table[i] >= value, or n.
+ */
+static int lowerBound (const int *table, int n, int value)
+{
+   int lo = 0, hi = n;
+
+   while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (table[mid] < value)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+void FltkImgbuf::initScaling ()
+{
+   initScalingTable (root->width, width, &xSrc, &xFrac);
+   initScalingTable (root->height, height, &ySrc, &yFrac);
+}
+
+/**
+ * \brief Return the range of rows of this scaled buffer, which depend on
+ *    the given row of the root buffer.
+ */
+void FltkImgbuf::scaledRows (int row, int *first, int *last)
+{
+   if (height <= root->height) {
+      // The row whose source rows include this one.
+      *first = *last = (int) (((long long) (row + 1) * height - 1)
+                              / root->height);
+   } else {
+      // The rows interpolated between row - 1 and row, or row and row + 1.
+      int lo = 0, hi = height;
+      while (lo < hi) {
+         int mid = (lo + hi) / 2;
+         if (ySrc[mid] < row - 1)
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+      *first = lo;
+      if (ySrc[lo] > row)
+         *last = lo - 1;
+      else
+         for (*last = lo; *last + 1 < height && ySrc[*last + 1] <= row; )
+            (*last)++;
+   }
+}
+
+/**
+ * \brief Scale a row of the root buffer horizontally, for the columns
+ *    px0 ... px1 - 1 of this buffer.
+ */
+void FltkImgbuf::scaleLine (const core::byte *src, core::byte *dst,
+                            int px0, int px1)
+{
+   if (width == root->width) {
+      memcpy (dst + px0 * bpp, src + px0 * bpp, (px1 - px0) * bpp);
+   } else if (width < root->width) {
+      // Area averaging.
+      for (int px = px0; px < px1; px++) {
+         int x0 = xSrc[px], n = xSrc[px + 1] - x0;
+         const core::byte *s = src + x0 * bpp;
+         for (int c = 0; c < bpp; c++) {
+            unsigned int sum = 0;
+            for (int x = 0; x < n; x++)
+               sum += s[x * bpp + c];
+            dst[px * bpp + c] = (sum + n / 2) / n;
+         }
+      }
+   } else {
+      // Bilinear interpolation.
+      int last = root->width - 1;
+      for (int px = px0; px < px1; px++) {
+         int x0 = xSrc[px], w = xFrac[px];
+         const core::byte *s0 = src + x0 * bpp;
+         const core::byte *s1 = src + (x0 < last ? x0 + 1 : x0) * bpp;
+         for (int c = 0; c < bpp; c++)
+            dst[px * bpp + c] = (s0[c] * (256 - w) + s1[c] * w + 128) >> 8;
+      }
+   }
+}
+
+/**
+ * \brief Update this scaled buffer after the rows row ... row + numRows - 1
+ *    of the root buffer have been copied.
+ *
+ * When shrinking, a row is the average of all source rows it covers; it
+ * is calculated when the last of them has arrived. When enlarging, a row
+ * is interpolated between the two nearest source rows. Until all needed
+ * source rows are there, the latest incoming row is shown instead, so
+ * that progressive and interlaced images are still displayed while
+ * loading. Each scaled row is calculated once per batch.
+ */
+void FltkImgbuf::scaleRows (int row, int numRows)
 {
-   int sr1 = scaledY (row);
-   int sr2 = scaledY (row + 1);
+   int n = width * bpp, rootN = root->width * bpp, first, last, dummy;
+   int lastRow = row + numRows - 1;
 
-   for (int sr = sr1; sr < sr2; sr++) {
-      // Avoid multiple passes.
-      if (copiedRows->get(sr)) continue;
+   ensureScratch (n);
+   scaledRows (row, &first, &dummy);
+   scaledRows (lastRow, &dummy, &last);
 
-      copiedRows->set (sr, true);
-      if (sr == sr1) {
-         for (int px = 0; px < root->width; px++) {
-            int px1 = px * width / root->width;
-            int px2 = (px+1) * width / root->width;
-            for (int sp = px1; sp < px2; sp++) {
-               memcpy(rawdata + (sr*width + sp)*bpp, data + px*bpp, bpp);
+   for (int sr = first; sr <= last; sr++) {
+      core::byte *dst = rawdata + sr * n;
+
+      if (height <= root->height) {
+         int y0 = ySrc[sr], y1 = ySrc[sr + 1];
+         bool complete = true;
+         for (int y = y0; complete && y < y1; y++)
+            complete = root->copiedRows->get (y);
+
+         if (complete && (lastRow >= y1 - 1 || !copiedRows->get (sr))) {
+            if (y1 - y0 == 1) {
+               scaleLine (root->rawdata + y0 * rootN, dst, 0, width);
+            } else {
+               memset (scratchAcc, 0, n * sizeof (unsigned int));
+               for (int y = y0; y < y1; y++) {
+                  scaleLine (root->rawdata + y * rootN, scratchLine[0],
+                             0, width);
+                  accumulateRow (scratchAcc, scratchLine[0], n);
+               }
+               averageRow (dst, scratchAcc, n, y1 - y0);
             }
+            copiedRows->set (sr, true);
+         } else if (!complete && !copiedRows->get (sr)) {
+            int y = lastRow < y1 - 1 ? lastRow : y1 - 1;
+            scaleLine (root->rawdata + y * rootN, dst, 0, width);
          }
       } else {
-         memcpy(rawdata + sr*width*bpp, rawdata + sr1*width*bpp, width*bpp);
+         int y0 = ySrc[sr];
+         int y1 = y0 < root->height - 1 ? y0 + 1 : y0;
+         bool has0 = root->copiedRows->get (y0),
+              has1 = root->copiedRows->get (y1);
+
+         if (has0 && has1) {
+            scaleLine (root->rawdata + y0 * rootN, scratchLine[0], 0, width);
+            scaleLine (root->rawdata + y1 * rootN, scratchLine[1], 0, width);
+            blendRows (dst, scratchLine[0], scratchLine[1], n, yFrac[sr]);
+            copiedRows->set (sr, true);
+         } else if (!copiedRows->get (sr) && (has0 || has1)) {
+            scaleLine (root->rawdata + (has0 ? y0 : y1) * rootN, dst,
+                       0, width);
+         }
       }
    }
 }
 
+/**
+ * \brief Update the part of this scaled buffer, which depends on the
+ *    given area of the (complete) root buffer, and have it drawn again.
+ *
+ * Unlike scaleRows(), only the columns concerned are calculated.
+ */
+void FltkImgbuf::scaleArea (int x, int y, int width, int height)
+{
+   bool shrinkX = this->width <= root->width,
+        shrinkY = this->height <= root->height;
+   // The scaled pixels whose sources intersect the area.
+   int px0 = shrinkX ? lowerBound (xSrc + 1, this->width, x + 1) :
+                       lowerBound (xSrc, this->width, x - 1);
+   int px1 = lowerBound (xSrc, this->width, x + width);
+   int sr0 = shrinkY ? lowerBound (ySrc + 1, this->height, y + 1) :
+                       lowerBound (ySrc, this->height, y - 1);
+   int sr1 = lowerBound (ySrc, this->height, y + height);
+   int n = (px1 - px0) * bpp, off = px0 * bpp, rootN = root->width * bpp;
+
+   if (rawdata == NULL || px0 >= px1 || sr0 >= sr1)
+      return;
+
+   ensureScratch (this->width * bpp);
+   for (int sr = sr0; sr < sr1; sr++) {
+      core::byte *dst = rawdata + sr * this->width * bpp;
+
+      if (shrinkY) {
+         int y0 = ySrc[sr], y1 = ySrc[sr + 1];
+         if (y1 - y0 == 1) {
+            scaleLine (root->rawdata + y0 * rootN, dst, px0, px1);
+         } else {
+            memset (scratchAcc, 0, n * sizeof (unsigned int));
+            for (int yy = y0; yy < y1; yy++) {
+               scaleLine (root->rawdata + yy * rootN, scratchLine[0],
+                          px0, px1);
+               accumulateRow (scratchAcc, scratchLine[0] + off, n);
+            }
+            averageRow (dst + off, scratchAcc, n, y1 - y0);
+         }
+      } else {
+         int y0 = ySrc[sr];
+         int y1 = y0 < root->height - 1 ? y0 + 1 : y0;
+         scaleLine (root->rawdata + y0 * rootN, scratchLine[0], px0, px1);
+         scaleLine (root->rawdata + y1 * rootN, scratchLine[1], px0, px1);
+         blendRows (dst + off, scratchLine[0] + off, scratchLine[1] + off, n,
+                    yFrac[sr]);
+      }
+   }
+
+   areaChanged (px0, sr0, px1 - px0, sr1 - sr0);
+}
+
 void FltkImgbuf::copyRow (int row, const core::byte *data)
+{
+   copyRows (row, 1, data, width * bpp);
+}
+
+void FltkImgbuf::copyRows (int row, int numRows, const core::byte *data,
+                           int stride)
 {
    assert (isRoot());
 
-   // Flag the row done and copy its data.
-   copiedRows->set (row, true);
-   memcpy(rawdata + row * width * bpp, data, width * bpp);
+   // Flag the rows done and copy their data (RGBA is kept premultiplied,
+   // so that scaling and drawing needn't care about the alpha).
+   for (int i = 0; i < numRows; i++) {
+      copiedRows->set (row + i, true);
+      if (type == RGBA) {
+         if (premultiplyRow (rawdata + (row + i) * width * bpp,
+                             data + i * stride, width))
+            translucent = true;
+      } else {
+         memcpy(rawdata + (row + i) * width * bpp, data + i * stride,
+                width * bpp);
+      }
+   }
 
    // Update all the scaled buffers of this root image.
    for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); ) {
       FltkImgbuf *sb = it.getNext ();
-      sb->scaleRow(row, data);
+      sb->scaleRows(row, numRows);
    }
 }
 
@@ -176,6 +748,13 @@ core::Imgbuf* FltkImgbuf::getScaledBuf (int width, int height)
       return this;
    }
 
+   // The image may have been decoded at a reduced size.
+   if (width > this->width || height > this->height) {
+      largerWanted = true;
+      if (reloader)
+         reloader->enlarge (this);
+   }
+
    for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); ) {
       FltkImgbuf *sb = it.getNext ();
       if (sb->width == width && sb->height == height) {
@@ -216,13 +795,13 @@ void FltkImgbuf::getRowArea (int row, dw::core::Rectangle *area)
            area->x, area->y, area->width, area->height);
    } else {
       // scaled buffer
-      int sr1 = scaledY (row);
-      int sr2 = scaledY (row + 1);
+      int sr1, sr2;
+      scaledRows (row, &sr1, &sr2);
 
       area->x = 0;
       area->y = sr1;
       area->width = width;
-      area->height = sr2 - sr1;
+      area->height = sr2 - sr1 + 1;
       _MSG("::getRowArea: area x=%d y=%d width=%d height=%d\n",
            area->x, area->y, area->width, area->height);
    }
@@ -238,6 +817,173 @@ int  FltkImgbuf::getRootHeight ()
    return root ? root->height : height;
 }
 
+void FltkImgbuf::addRenderer (Renderer *renderer)
+{
+   renderers->increase ();
+   renderers->set (renderers->size () - 1, renderer);
+}
+
+void FltkImgbuf::removeRenderer (Renderer *renderer)
+{
+   for (int i = 0; i < renderers->size (); i++) {
+      if (renderers->get (i) == renderer) {
+         renderers->set (i, renderers->get (renderers->size () - 1));
+         renderers->setSize (renderers->size () - 1);
+         break;
+      }
+   }
+}
+
+/**
+ * \brief Tell the renderers of this buffer, that an area has changed.
+ */
+void FltkImgbuf::areaChanged (int x, int y, int width, int height)
+{
+   for (int i = 0; i < renderers->size (); i++)
+      renderers->get(i)->areaChanged (x, y, width, height);
+}
+
+int FltkImgbuf::getDataSize ()
+{
+   assert (isRoot());
+
+   int size = rawdata ? bpp * width * height : 0;
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); ){
+      FltkImgbuf *sb = it.getNext ();
+      if (sb->rawdata)
+         size += sb->bpp * sb->width * sb->height;
+   }
+   return size;
+}
+
+unsigned int FltkImgbuf::getLastUse ()
+{
+   return root ? root->lastUse : lastUse;
+}
+
+bool FltkImgbuf::isDrawnInFrame ()
+{
+   return getLastUse () > frameStart;
+}
+
+/**
+ * \brief Called when a view starts drawing; the buffers drawn from now on
+ *    are those of the current frame.
+ */
+void FltkImgbuf::startFrame ()
+{
+   frameStart = useCounter;
+}
+
+/**
+ * \brief Free the pixel data of this root buffer and all its scaled
+ *    buffers. It is restored, via the reloader, when the image is drawn
+ *    the next time.
+ */
+void FltkImgbuf::dropData ()
+{
+   assert (isRoot());
+
+   freeData ();
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); )
+      it.getNext()->freeData ();
+   // Memory is wanted back, so don't hold any in the pool either.
+   poolFlush ();
+}
+
+void FltkImgbuf::setReloader (Reloader *reloader)
+{
+   assert (isRoot());
+   this->reloader = reloader;
+   // (a larger buffer may have been asked for while it was decoded)
+   if (reloader && largerWanted)
+      reloader->enlarge (this);
+}
+
+void FltkImgbuf::setRootSize (int width, int height)
+{
+   assert (isRoot());
+
+   if (width == this->width && height == this->height)
+      return;
+
+   freeData ();
+   this->width = width;
+   this->height = height;
+   delete copiedRows;
+   copiedRows = new lout::misc::BitSet (height);
+   allocData ();
+   largerWanted = false;
+
+   // The scaled buffers show what they have until the new rows arrive.
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); ){
+      FltkImgbuf *sb = it.getNext ();
+      delete[] sb->xSrc;
+      delete[] sb->xFrac;
+      delete[] sb->ySrc;
+      delete[] sb->yFrac;
+      sb->initScaling ();
+      sb->allocData ();
+      sb->copiedRows->clear ();
+   }
+
+   // Widgets that showed this buffer itself take one of their size. (They
+   // remove themselves, and may add themselves again at the end.)
+   for (int i = renderers->size () - 1; i >= 0; i--)
+      renderers->get(i)->rootSizeChanged ();
+}
+
+/**
+ * \brief Replace an area of the complete image, and update the scaled
+ *    buffers for it.
+ *
+ * When the data has been dropped, nothing is done; the reloader brings
+ * back the first frame.
+ */
+void FltkImgbuf::copyArea (int x, int y, int width, int height,
+                           const core::byte *data, int stride)
+{
+   assert (isRoot());
+   assert (x >= 0 && y >= 0 && x + width <= this->width &&
+           y + height <= this->height);
+
+   if (rawdata == NULL)
+      return;
+
+   for (int i = 0; i < height; i++) {
+      uchar *dst = rawdata + ((y + i) * this->width + x) * bpp;
+      if (type == RGBA) {
+         if (premultiplyRow (dst, data + i * stride, width))
+            translucent = true;
+      } else {
+         memcpy (dst, data + i * stride, width * bpp);
+      }
+   }
+
+   areaChanged (x, y, width, height);
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); )
+      it.getNext()->scaleArea (x, y, width, height);
+}
+
+bool FltkImgbuf::isVisible ()
+{
+   for (int i = 0; i < renderers->size (); i++)
+      if (renderers->get(i)->isVisible ())
+         return true;
+   if (isRoot ())
+      for (Iterator <FltkImgbuf> it = scaledBuffers->iterator();
+           it.hasNext(); )
+         if (it.getNext()->isVisible ())
+            return true;
+   return false;
+}
+
+void FltkImgbuf::setAnimation (Animation *animation)
+{
+   assert (isRoot());
+   this->animation = animation;
+}
+
 void FltkImgbuf::ref ()
 {
    refCount++;
@@ -292,15 +1038,14 @@ bool FltkImgbuf::isReferred ()
 }
 
 
-int FltkImgbuf::scaledY(int ySrc)
-{
-   // TODO: May have to be adjusted.
-   assert (root != NULL);
-   return ySrc * height / root->height;
-}
-
+/**
+ * \brief Draw a part of the buffer.
+ *
+ * RGBA buffers with transparent pixels are composited over \em bgColor
+ * (0xrrggbb) here, so that one decoded image serves any background.
+ */
 void FltkImgbuf::draw (Fl_Widget *target, int xRoot, int yRoot,
-                       int x, int y, int width, int height)
+                       int x, int y, int width, int height, int bgColor)
 {
    // TODO: Clarify the question, whether "target" is the current widget
    //       (and so has not to be passed at all).
@@ -313,6 +1058,13 @@ void FltkImgbuf::draw (Fl_Widget *target, int xRoot, int yRoot,
       return;
    }
 
+   FltkImgbuf *rootBuf = isRoot() ? this : root;
+   rootBuf->lastUse = ++useCounter;
+   if (rootBuf->rawdata == NULL)
+      rootBuf->restoreData ();
+   if (rootBuf->animation)
+      rootBuf->animation->drawn (rootBuf);
+
    if (x + width > this->width) {
       width = this->width - x;
    }
@@ -321,8 +1073,33 @@ void FltkImgbuf::draw (Fl_Widget *target, int xRoot, int yRoot,
       height = this->height - y;
    }
 
-   fl_draw_image(rawdata+bpp*(y*this->width + x), xRoot + x, yRoot + y, width,
-                 height, bpp, this->width * bpp);
+   if (bpp == 4 && rootBuf->translucent) {
+      // Composite a strip of rows at a time.
+      const int stripRows = 32;
+      int n = width * 3 * stripRows;
+      int bgRed = (bgColor >> 16) & 0xff, bgGreen = (bgColor >> 8) & 0xff,
+          bgBlue = bgColor & 0xff;
+
+      if (n > compositeSize) {
+         delete[] compositeBuf;
+         compositeSize = n;
+         compositeBuf = new uchar[n];
+      }
+      for (int y0 = y; y0 < y + height; y0 += stripRows) {
+         int rows = lout::misc::min (stripRows, y + height - y0);
+         for (int r = 0; r < rows; r++)
+            compositeRow (compositeBuf + r * width * 3,
+                          rawdata + bpp * ((y0 + r) * this->width + x),
+                          width, bgRed, bgGreen, bgBlue);
+         fl_draw_image(compositeBuf, xRoot + x, yRoot + y0, width, rows,
+                       3, width * 3);
+      }
+   } else {
+      // (Opaque RGBA is the same premultiplied or not; the alpha byte
+      // is skipped.)
+      fl_draw_image(rawdata+bpp*(y*this->width + x), xRoot + x, yRoot + y,
+                    width, height, bpp, this->width * bpp);
+   }
 
 }
 
@@ -28,11 +28,35 @@ private:
    // the image buffer.
    lout::misc::BitSet *copiedRows;
 
+   // Scaling tables, only used for scaled buffers. When shrinking, xSrc
+   // and ySrc hold the first source column/row averaged into each pixel
+   // (plus the end as last element); when enlarging, the left/upper
+   // source pixel, and xFrac/yFrac its weight (0..256) of the next one.
+   int *xSrc, *xFrac, *ySrc, *yFrac;
+
+   lout::misc::SimpleVector <Renderer*> *renderers;
+
+   // Only used for root buffers.
+   bool translucent;       // Some RGBA pixel copied is not opaque
+   Reloader *reloader;
+   bool largerWanted;      // A larger scaled buffer was asked for
+   Animation *animation;
+   unsigned int lastUse;
+   static unsigned int useCounter;
+   static unsigned int frameStart;  // useCounter when the frame began
+
    FltkImgbuf (Type type, int width, int height, FltkImgbuf *root);
    void init (Type type, int width, int height, FltkImgbuf *root);
-   int scaledY(int ySrc);
+   void initScaling ();
+   void scaledRows (int row, int *first, int *last);
+   void scaleLine (const core::byte *src, core::byte *dst, int px0, int px1);
+   void scaleArea (int x, int y, int width, int height);
+   void areaChanged (int x, int y, int width, int height);
    int isRoot() { return (root == NULL); }
    void detachScaledBuf (FltkImgbuf *scaledBuf);
+   void allocData ();
+   void freeData ();
+   void restoreData ();
 
 protected:
    ~FltkImgbuf ();
@@ -41,13 +65,26 @@ public:
    FltkImgbuf (Type type, int width, int height);
 
    void setCMap (int *colors, int num_colors);
-   inline void scaleRow (int row, const core::byte *data);
+   void scaleRows (int row, int numRows);
    void newScan ();
    void copyRow (int row, const core::byte *data);
+   void copyRows (int row, int numRows, const core::byte *data, int stride);
    core::Imgbuf* getScaledBuf (int width, int height);
    void getRowArea (int row, dw::core::Rectangle *area);
    int  getRootWidth ();
    int  getRootHeight ();
+   void addRenderer (Renderer *renderer);
+   void removeRenderer (Renderer *renderer);
+   int  getDataSize ();
+   unsigned int getLastUse ();
+   bool isDrawnInFrame ();
+   void dropData ();
+   void setReloader (Reloader *reloader);
+   void setRootSize (int width, int height);
+   void copyArea (int x, int y, int width, int height, const core::byte *data,
+                  int stride);
+   bool isVisible ();
+   void setAnimation (Animation *animation);
    void ref ();
    void unref ();
 
@@ -56,7 +93,9 @@ public:
    bool isReferred ();
 
    void draw (Fl_Widget *target, int xRoot, int yRoot,
-              int x, int y, int width, int height);
+              int x, int y, int width, int height, int bgColor);
+
+   static void startFrame ();
 };
 
 } // namespace dw
@@ -155,7 +155,8 @@ void FltkPreview::drawSimpleWrappedText (core::style::Font *font,
 }
 
 void FltkPreview::drawImage (core::Imgbuf *imgbuf, int xRoot, int yRoot,
-                int x, int y, int width, int height)
+                int x, int y, int width, int height,
+                core::style::Color *bgColor)
 {
 }
 
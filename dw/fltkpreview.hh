@@ -48,7 +48,8 @@ public:
                                int x, int y, int w, int h,
                                const char *text);
    void drawImage (core::Imgbuf *imgbuf, int xRoot, int yRoot,
-                   int x, int y, int width, int height);
+                   int x, int y, int width, int height,
+                   core::style::Color *bgColor);
 
    bool usesFltkWidgets ();
    void drawFltkWidget (Fl_Widget *widget, core::Rectangle *area);
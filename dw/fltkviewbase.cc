@@ -73,6 +73,7 @@ FltkViewBase::FltkViewBase (int x, int y, int w, int h, const char *label):
    mouse_x = mouse_y = 0;
    focused_child = NULL;
    exposeArea = NULL;
+   drawOffsetX = drawOffsetY = 0;
    if (backBuffer == NULL) {
       backBuffer = new BackBuffer ();
    }
@@ -98,11 +99,13 @@ void FltkViewBase::draw ()
 {
    int d = damage ();
 
+   FltkImgbuf::startFrame ();
+
    if ((d & FL_DAMAGE_USER1) && !(d & FL_DAMAGE_EXPOSE)) {
       lout::container::typed::Iterator <core::Rectangle> it;
 
       for (it = drawRegion.rectangles (); it.hasNext (); ) {
-         draw (it.getNext (), DRAW_BUFFERED);
+         draw (it.getNext (), DRAW_BUFFERED, false);
       }
 
       drawRegion.clear ();
@@ -122,17 +125,24 @@ void FltkViewBase::draw ()
          h ());
 
       if (d == FL_DAMAGE_SCROLL) {
-         // a clipping rectangle has already been set by fltk::scrollrect ()
-         draw (&rect, DRAW_PLAIN);
+         // Called back by fl_scroll () for a newly exposed strip; a clipping
+         // rectangle has already been set, so that only the strip is drawn.
+         // It is drawn buffered, since it is visible while scrolling.
+         draw (&rect, DRAW_BUFFERED, true);
       } else {
-         draw (&rect, DRAW_CLIPPED);
+         draw (&rect, DRAW_CLIPPED, true);
          drawRegion.clear ();
       }
    }
 }
 
+/*
+ * Draw a rectangle of the canvas. When \em tiled is set, the view may use
+ * pre-rendered parts (see drawTiled ()); this is not done for queued draws,
+ * since the parts affected by them have just become invalid.
+ */
 void FltkViewBase::draw (const core::Rectangle *rect,
-                         DrawType type)
+                         DrawType type, bool tiled)
 {
    int X = translateCanvasXToViewX (rect->x);
    int Y = translateCanvasYToViewY (rect->y);
@@ -155,6 +165,11 @@ void FltkViewBase::draw (const core::Rectangle *rect,
 
    exposeArea = &r;
 
+   if (tiled && drawTiled (&r, type, X, Y, W, H)) {
+      exposeArea = NULL;
+      return;
+   }
+
    if (type == DRAW_BUFFERED && backBuffer && !backBufferInUse) {
       backBufferInUse = true;
       backBuffer->setSize (X + W, Y + H); // would be nicer to use (W, H)...
@@ -386,10 +401,7 @@ void FltkViewBase::drawLine (core::style::Color *color,
    // However it's still better than no clipping at all.
    clipPoint (&x1, &y1, 5000);
    clipPoint (&x2, &y2, 5000);
-   fl_line (translateCanvasXToViewX (x1),
-            translateCanvasYToViewY (y1),
-            translateCanvasXToViewX (x2),
-            translateCanvasYToViewY (y2));
+   fl_line (drawX (x1), drawY (y1), drawX (x2), drawY (y2));
 }
 
 void FltkViewBase::drawTypedLine (core::style::Color *color,
@@ -451,10 +463,10 @@ void FltkViewBase::drawRectangle (core::style::Color *color,
    clipPoint (&x1, &y1, 1);
    clipPoint (&x2, &y2, 1);
 
-   x1 = translateCanvasXToViewX (x1);
-   y1 = translateCanvasYToViewY (y1);
-   x2 = translateCanvasXToViewX (x2);
-   y2 = translateCanvasYToViewY (y2);
+   x1 = drawX (x1);
+   y1 = drawY (y1);
+   x2 = drawX (x2);
+   y2 = drawY (y2);
 
    if (filled)
       fl_rectf (x1, y1, x2 - x1, y2 - y1);
@@ -468,8 +480,8 @@ void FltkViewBase::drawArc (core::style::Color *color,
                             int angle1, int angle2)
 {
    fl_color(((FltkColor*)color)->colors[shading]);
-   int x = translateCanvasXToViewX (centerX) - width / 2;
-   int y = translateCanvasYToViewY (centerY) - height / 2;
+   int x = drawX (centerX) - width / 2;
+   int y = drawY (centerY) - height / 2;
 
    fl_arc(x, y, width, height, angle1, angle2);
    if (filled)
@@ -493,8 +505,7 @@ void FltkViewBase::drawPolygon (core::style::Color *color,
          fl_begin_loop();
 
       for (int i = 0; i < npoints; i++) {
-         fl_vertex(translateCanvasXToViewX(points[i].x),
-                   translateCanvasYToViewY(points[i].y));
+         fl_vertex(drawX(points[i].x), drawY(points[i].y));
       }
       if (filled) {
          if (convex)
@@ -508,7 +519,7 @@ void FltkViewBase::drawPolygon (core::style::Color *color,
 
 core::View *FltkViewBase::getClippingView (int x, int y, int width, int height)
 {
-   fl_push_clip (translateCanvasXToViewX (x), translateCanvasYToViewY (y),
+   fl_push_clip (drawX (x), drawY (y),
                  width, height);
    return this;
 }
@@ -541,11 +552,10 @@ void FltkWidgetView::drawText (core::style::Font *font,
 
    if (!font->letterSpacing && !font->fontVariant) {
       fl_draw(text, len,
-              translateCanvasXToViewX (X), translateCanvasYToViewY (Y));
+              drawX (X), drawY (Y));
    } else {
       /* Nonzero letter spacing adjustment, draw each glyph individually */
-      int viewX = translateCanvasXToViewX (X),
-          viewY = translateCanvasYToViewY (Y);
+      int viewX = drawX (X), viewY = drawY (Y);
       int curr = 0, next = 0, nb;
       char chbuf[4];
       int c, cu;
@@ -596,17 +606,19 @@ void FltkWidgetView::drawSimpleWrappedText (core::style::Font *font,
    fl_font(ff->font, ff->size);
    fl_color(((FltkColor*)color)->colors[shading]);
    fl_draw(text,
-           translateCanvasXToViewX (X), translateCanvasYToViewY (Y),
+           drawX (X), drawY (Y),
            W, H, FL_ALIGN_TOP|FL_ALIGN_LEFT|FL_ALIGN_WRAP, NULL, 0);
 }
 
 void FltkWidgetView::drawImage (core::Imgbuf *imgbuf, int xRoot, int yRoot,
-                              int X, int Y, int width, int height)
+                              int X, int Y, int width, int height,
+                              core::style::Color *bgColor)
 {
    ((FltkImgbuf*)imgbuf)->draw (this,
-                                translateCanvasXToViewX (xRoot),
-                                translateCanvasYToViewY (yRoot),
-                                X, Y, width, height);
+                                drawX (xRoot),
+                                drawY (yRoot),
+                                X, Y, width, height,
+                                bgColor ? bgColor->getColor () : 0xffffff);
 }
 
 bool FltkWidgetView::usesFltkWidgets ()
@@ -29,15 +29,10 @@ private:
          void setSize(int w, int h);
    };
 
-   typedef enum { DRAW_PLAIN, DRAW_CLIPPED, DRAW_BUFFERED } DrawType;
-
-   int bgColor;
    core::Region drawRegion;
-   core::Rectangle *exposeArea;
    static BackBuffer *backBuffer;
    static bool backBufferInUse;
 
-   void draw (const core::Rectangle *rect, DrawType type);
    void drawChildWidgets ();
    inline void clipPoint (int *x, int *y, int border) {
       if (exposeArea) {
@@ -52,6 +47,10 @@ private:
       }
    }
 protected:
+   typedef enum { DRAW_PLAIN, DRAW_CLIPPED, DRAW_BUFFERED } DrawType;
+
+   int bgColor;
+   core::Rectangle *exposeArea;
    core::Layout *theLayout;
    int canvasWidth, canvasHeight;
    int mouse_x, mouse_y;
@@ -62,6 +61,34 @@ protected:
    virtual int translateCanvasXToViewX (int x) = 0;
    virtual int translateCanvasYToViewY (int y) = 0;
 
+   /**
+    * \brief Where the drawing primitives put the view origin, relative to
+    *    the current drawable.
+    *
+    * This is 0, 0, except while the view draws into an offscreen which does
+    * not start at its origin (see drawX () and drawY ()).
+    */
+   int drawOffsetX, drawOffsetY;
+
+   /** \brief The position where a canvas x coordinate is drawn. */
+   inline int drawX (int x)
+   { return translateCanvasXToViewX (x) - drawOffsetX; }
+   /** \brief The position where a canvas y coordinate is drawn. */
+   inline int drawY (int y)
+   { return translateCanvasYToViewY (y) - drawOffsetY; }
+
+   /**
+    * \brief Draw \em area (in canvas coordinates, and at X, Y, W, H in
+    *    view coordinates) from pre-rendered parts, if supported; what is
+    *    not pre-rendered is drawn as \em type tells.
+    *
+    * Returns false, when the area has not been drawn.
+    */
+   virtual bool drawTiled (core::Rectangle *area, DrawType type,
+                           int X, int Y, int W, int H)
+   { return false; }
+   void draw (const core::Rectangle *rect, DrawType type, bool tiled);
+
 public:
    FltkViewBase (int x, int y, int w, int h, const char *label = 0);
    ~FltkViewBase ();
@@ -131,7 +158,8 @@ public:
                                int x, int y, int w, int h,
                                const char *text);
    void drawImage (core::Imgbuf *imgbuf, int xRoot, int yRoot,
-                   int x, int y, int width, int height);
+                   int x, int y, int width, int height,
+                   core::style::Color *bgColor);
 
    bool usesFltkWidgets ();
    void addFltkWidget (Fl_Widget *widget, core::Allocation *allocation);
@@ -50,6 +50,116 @@ public:
    }
 };
 
+// ----------------------------------------------------------------------
+
+FltkViewport::TileCache::TileCache ()
+{
+   tiles = new misc::SimpleVector <Tile> (8);
+   useCount = 0;
+}
+
+FltkViewport::TileCache::~TileCache ()
+{
+   setMaxTiles (0);
+   delete tiles;
+}
+
+void FltkViewport::TileCache::setMaxTiles (int maxTiles)
+{
+   for (int i = maxTiles; i < tiles->size (); i++)
+      if (tiles->getRef(i)->created)
+         fl_delete_offscreen (tiles->getRef(i)->offscreen);
+
+   int oldSize = tiles->size ();
+   tiles->setSize (maxTiles);
+   for (int i = oldSize; i < maxTiles; i++) {
+      tiles->getRef(i)->viewport = NULL;
+      tiles->getRef(i)->created = false;
+   }
+}
+
+/*
+ * Return the offscreen of the tile at x, y, or NULL, when it is not cached.
+ */
+Fl_Offscreen *FltkViewport::TileCache::lookup (FltkViewport *viewport,
+                                               int x, int y)
+{
+   for (int i = 0; i < tiles->size (); i++) {
+      Tile *tile = tiles->getRef (i);
+      if (tile->viewport == viewport && tile->x == x && tile->y == y) {
+         tile->lastUsed = ++useCount;
+         return &tile->offscreen;
+      }
+   }
+
+   return NULL;
+}
+
+/*
+ * Return an offscreen for the tile at x, y, to be drawn by the caller. A
+ * free tile is used, or the least recently used one.
+ */
+Fl_Offscreen *FltkViewport::TileCache::add (FltkViewport *viewport,
+                                            int x, int y)
+{
+   Tile *tile = NULL;
+
+   for (int i = 0; i < tiles->size (); i++) {
+      Tile *t = tiles->getRef (i);
+      if (t->viewport == NULL) {
+         tile = t;
+         break;
+      } else if (tile == NULL || t->lastUsed < tile->lastUsed)
+         tile = t;
+   }
+
+   if (!tile->created) {
+      tile->offscreen = fl_create_offscreen (TILE_SIZE, TILE_SIZE);
+      tile->created = true;
+   }
+
+   tile->viewport = viewport;
+   tile->x = x;
+   tile->y = y;
+   tile->lastUsed = ++useCount;
+   return &tile->offscreen;
+}
+
+void FltkViewport::TileCache::remove (FltkViewport *viewport, int x, int y)
+{
+   for (int i = 0; i < tiles->size (); i++) {
+      Tile *tile = tiles->getRef (i);
+      if (tile->viewport == viewport && tile->x == x && tile->y == y)
+         tile->viewport = NULL;
+   }
+}
+
+/*
+ * Free all tiles of the viewport intersecting with area (given in canvas
+ * coordinates), or all its tiles, when area is NULL. The offscreens are
+ * kept for reuse.
+ */
+void FltkViewport::TileCache::invalidate (FltkViewport *viewport,
+                                          core::Rectangle *area)
+{
+   for (int i = 0; i < tiles->size (); i++) {
+      Tile *tile = tiles->getRef (i);
+      if (tile->viewport == viewport &&
+          (area == NULL ||
+           (tile->x < area->x + area->width &&
+            tile->x + TILE_SIZE > area->x &&
+            tile->y < area->y + area->height &&
+            tile->y + TILE_SIZE > area->y)))
+         tile->viewport = NULL;
+   }
+}
+
+FltkViewport::TileCache *FltkViewport::tileCache = NULL;
+misc::SimpleVector <FltkViewport*> *FltkViewport::tiledViewports = NULL;
+int FltkViewport::tileCacheBytes = 0;
+
+// ----------------------------------------------------------------------
+
 FltkViewport::FltkViewport (int X, int Y, int W, int H, const char *label):
    FltkWidgetView (X, Y, W, H, label)
 {
@@ -68,6 +178,7 @@ FltkViewport::FltkViewport (int X, int Y, int W, int H, const char *label):
    hasDragScroll = 1;
    scrollX = scrollY = scrollDX = scrollDY = 0;
    horScrolling = verScrolling = dragScrolling = 0;
+   renderingTile = tileHasWidgets = false;
 
    gadgetOrientation[0] = GADGET_HORIZONTAL;
    gadgetOrientation[1] = GADGET_HORIZONTAL;
@@ -77,10 +188,28 @@ FltkViewport::FltkViewport (int X, int Y, int W, int H, const char *label):
    gadgets =
       new container::typed::List <object::TypedPointer < Fl_Widget> >
       (true);
+
+   if (tiledViewports == NULL)
+      tiledViewports = new misc::SimpleVector <FltkViewport*> (4);
+   tiledViewports->increase ();
+   tiledViewports->set (tiledViewports->size () - 1, this);
+   updateTileCacheSize ();
 }
 
 FltkViewport::~FltkViewport ()
 {
+   for (int i = 0; i < tiledViewports->size (); i++) {
+      if (tiledViewports->get (i) == this) {
+         tiledViewports->set (i, tiledViewports->get (tiledViewports->size ()
+                                                      - 1));
+         tiledViewports->setSize (tiledViewports->size () - 1);
+         break;
+      }
+   }
+   if (tileCache) {
+      tileCache->invalidate (this, NULL);
+      updateTileCacheSize ();
+   }
    delete gadgets;
 }
 
@@ -172,6 +301,7 @@ void FltkViewport::resize(int X, int Y, int W, int H)
    if (dimension_changed) {
       theLayout->viewportSizeChanged (this, W, H);
       adjustScrollbarsAndGadgetsAllocation ();
+      updateTileCacheSize ();
    }
 }
 
@@ -199,10 +329,15 @@ void FltkViewport::draw ()
    int d = damage();
 
    if (d & FL_DAMAGE_SCROLL) {
+      /* Copy the still valid part of the view; only the newly exposed
+       * strips are drawn by draw_area(). Below, the layout is exposed
+       * again only for other damage; FL_DAMAGE_CHILD, which is set for
+       * the scrollbars, just redraws the FLTK widgets. */
       clear_damage (FL_DAMAGE_SCROLL);
       fl_scroll(x(), y(), w() - hdiff, h() - vdiff,
                 -scrollDX, -scrollDY, draw_area, this);
-      clear_damage (d & ~FL_DAMAGE_SCROLL);
+      d &= ~FL_DAMAGE_SCROLL;
+      clear_damage (d);
    }
 
    if (d) {
@@ -323,10 +458,146 @@ int FltkViewport::handle (int event)
 
 void FltkViewport::setCanvasSize (int width, int ascent, int descent)
 {
+   /* Not all changes of the layout are queued as draws for areas outside
+    * of the viewport, so the tiles are not trusted after a resize. */
+   if (tileCache &&
+       (width != canvasWidth || ascent + descent != canvasHeight))
+      tileCache->invalidate (this, NULL);
+
    FltkWidgetView::setCanvasSize (width, ascent, descent);
    adjustScrollbarValues ();
 }
 
+void FltkViewport::setBgColor (core::style::Color *color)
+{
+   if (tileCache)
+      tileCache->invalidate (this, NULL);
+   FltkWidgetView::setBgColor (color);
+}
+
+void FltkViewport::queueDraw (core::Rectangle *area)
+{
+   if (tileCache)
+      tileCache->invalidate (this, area);
+   FltkWidgetView::queueDraw (area);
+}
+
+void FltkViewport::queueDrawTotal ()
+{
+   if (tileCache)
+      tileCache->invalidate (this, NULL);
+   FltkWidgetView::queueDrawTotal ();
+}
+
+/*
+ * FLTK widgets are drawn by FLTK and may change at any time, so they must
+ * not become part of a tile. A tile containing them is drawn directly.
+ */
+void FltkViewport::drawFltkWidget (Fl_Widget *widget, core::Rectangle *area)
+{
+   if (renderingTile)
+      tileHasWidgets = true;
+   else
+      FltkWidgetView::drawFltkWidget (widget, area);
+}
+
+/*
+ * Draw area (in canvas coordinates; X, Y, W, H in view coordinates) from
+ * the tile cache. Re-exposing a part of the page which has been seen
+ * recently (after scrolling back, or switching tabs) is so only a copy.
+ *
+ * A missing tile is rendered when it is exposed as a whole, or when at
+ * least half of it is visible: then it will mostly be drawn anyway (as the
+ * strips exposed by scrolling move over it), and scrolling back finds it.
+ * Of the other ones, only the exposed part is drawn, as \em type tells
+ * (i.e., buffered for scroll strips). When the cache cannot even hold the
+ * visible tiles, they would evict each other, so it is not used at all.
+ */
+bool FltkViewport::drawTiled (core::Rectangle *area, DrawType type,
+                              int X, int Y, int W, int H)
+{
+   if (tileCache == NULL || renderingTile ||
+       visibleTiles () > tileCache->getMaxTiles ())
+      return false;
+
+   int hdiff = vscrollbar->visible () ? SCROLLBAR_THICKNESS : 0;
+   int vdiff = hscrollbar->visible () ? SCROLLBAR_THICKNESS : 0;
+   core::Rectangle visible (translateViewXToCanvasX (x ()),
+                            translateViewYToCanvasY (y ()),
+                            w () - hdiff, h () - vdiff);
+   int x1 = area->x - area->x % TILE_SIZE - (area->x < 0 ? TILE_SIZE : 0);
+   int y1 = area->y - area->y % TILE_SIZE - (area->y < 0 ? TILE_SIZE : 0);
+
+   fl_push_clip (X, Y, W, H);
+
+   for (int ty = y1; ty < area->y + area->height; ty += TILE_SIZE) {
+      for (int tx = x1; tx < area->x + area->width; tx += TILE_SIZE) {
+         core::Rectangle tile (tx, ty, TILE_SIZE, TILE_SIZE), r;
+         if (!area->intersectsWith (&tile, &r))
+            continue;
+
+         Fl_Offscreen *offscreen = tileCache->lookup (this, tx, ty);
+         if (offscreen == NULL) {
+            core::Rectangle v;
+            if ((r.width == TILE_SIZE && r.height == TILE_SIZE) ||
+                (visible.intersectsWith (&tile, &v) &&
+                 v.width * v.height >= TILE_SIZE * TILE_SIZE / 2))
+               offscreen = renderTile (tx, ty);
+         }
+
+         if (offscreen) {
+            fl_copy_offscreen (translateCanvasXToViewX (tx),
+                               translateCanvasYToViewY (ty),
+                               TILE_SIZE, TILE_SIZE, *offscreen, 0, 0);
+         } else {
+            core::Rectangle *oldExposeArea = exposeArea;
+            FltkViewBase::draw (&r, type, false);
+            exposeArea = oldExposeArea;
+         }
+      }
+   }
+
+   fl_pop_clip ();
+   return true;
+}
+
+/*
+ * Render the tile at x, y (in canvas coordinates) into the tile cache.
+ * Returns its offscreen, or NULL, when the tile cannot be cached.
+ */
+Fl_Offscreen *FltkViewport::renderTile (int x, int y)
+{
+   Fl_Offscreen *offscreen = tileCache->add (this, x, y);
+   core::Rectangle area (x, y, TILE_SIZE, TILE_SIZE);
+   core::Rectangle *oldExposeArea = exposeArea;
+
+   /* Draw the tile at the origin of the offscreen. The scroll position is
+    * left alone, since what is called back while drawing (e.g. queueDraw ()
+    * for an animation) works in view coordinates. */
+   drawOffsetX = translateCanvasXToViewX (x);
+   drawOffsetY = translateCanvasYToViewY (y);
+   exposeArea = &area;
+   renderingTile = true;
+   tileHasWidgets = false;
+
+   fl_begin_offscreen (*offscreen);
+   fl_color (bgColor);
+   fl_rectf (0, 0, TILE_SIZE, TILE_SIZE);
+   theLayout->expose (this, &area);
+   fl_end_offscreen ();
+
+   renderingTile = false;
+   exposeArea = oldExposeArea;
+   drawOffsetX = drawOffsetY = 0;
+
+   if (tileHasWidgets) {
+      tileCache->remove (this, x, y);
+      offscreen = NULL;
+   }
+
+   return offscreen;
+}
+
 /*
  * This is used to simulate mouse motion (e.g., when scrolling).
  */
@@ -500,6 +771,53 @@ void FltkViewport::addGadget (Fl_Widget *gadget)
    adjustScrollbarsAndGadgetsAllocation ();
 }
 
+/**
+ * \brief Set the most memory, in bytes, used for pre-rendered tiles,
+ *    shared by all viewports. 0 disables the tile cache.
+ *
+ * Four bytes per pixel are assumed. Within this limit, the cache is sized
+ * after the viewports (see updateTileCacheSize ()).
+ */
+void FltkViewport::setTileCacheSize (int size)
+{
+   if (tileCache == NULL)
+      tileCache = new TileCache ();
+   tileCacheBytes = size;
+   updateTileCacheSize ();
+}
+
+/*
+ * The number of tiles the viewport may show at once.
+ */
+int FltkViewport::visibleTiles ()
+{
+   return ((w () + TILE_SIZE - 1) / TILE_SIZE + 1) *
+          ((h () + TILE_SIZE - 1) / TILE_SIZE + 1);
+}
+
+/*
+ * Size the tile cache so that what every viewport (i.e., tab) shows stays
+ * cached, and another screen of the largest one, for scrolling back; but
+ * not beyond the limit set by setTileCacheSize ().
+ */
+void FltkViewport::updateTileCacheSize ()
+{
+   int tiles = 0, most = 0;
+
+   if (tileCache == NULL)
+      return;
+
+   for (int i = 0; i < tiledViewports->size (); i++) {
+      int n = tiledViewports->get(i)->visibleTiles ();
+      tiles += n;
+      most = misc::max (most, n);
+   }
+
+   tileCache->setMaxTiles (misc::min (tiles + most,
+                                      tileCacheBytes /
+                                      (TILE_SIZE * TILE_SIZE * 4)));
+}
+
 
 } // namespace fltk
 } // namespace dw
@@ -17,12 +17,48 @@ public:
    enum GadgetOrientation { GADGET_VERTICAL, GADGET_HORIZONTAL };
 
 private:
-   enum { SCROLLBAR_THICKNESS = 15 };
+   enum { SCROLLBAR_THICKNESS = 15, TILE_SIZE = 256 };
+
+   /**
+    * \brief Pre-rendered tiles of the canvas, shared by all viewports.
+    *
+    * The tiles are TILE_SIZE x TILE_SIZE pixels large, aligned at multiples
+    * of TILE_SIZE in canvas coordinates. When the cache is full, the least
+    * recently used tile is reused.
+    */
+   class TileCache {
+      private:
+         struct Tile {
+            FltkViewport *viewport;  // NULL, when the tile is free
+            int x, y;                // in canvas coordinates
+            unsigned int lastUsed;
+            bool created;
+            Fl_Offscreen offscreen;
+         };
+
+         lout::misc::SimpleVector <Tile> *tiles;
+         unsigned int useCount;
+
+      public:
+         TileCache ();
+         ~TileCache ();
+         void setMaxTiles (int maxTiles);
+         inline int getMaxTiles () { return tiles->size (); }
+         Fl_Offscreen *lookup (FltkViewport *viewport, int x, int y);
+         Fl_Offscreen *add (FltkViewport *viewport, int x, int y);
+         void remove (FltkViewport *viewport, int x, int y);
+         void invalidate (FltkViewport *viewport, core::Rectangle *area);
+   };
+
+   static TileCache *tileCache;
+   static lout::misc::SimpleVector <FltkViewport*> *tiledViewports;
+   static int tileCacheBytes;
 
    int scrollX, scrollY;
    int scrollDX, scrollDY;
    int hasDragScroll, dragScrolling, dragX, dragY;
    int horScrolling, verScrolling;
+   bool renderingTile, tileHasWidgets;
 
    Fl_Scrollbar *vscrollbar, *hscrollbar;
 
@@ -41,12 +77,17 @@ private:
 
    void updateCanvasWidgets (int oldScrollX, int oldScrollY);
    static void draw_area (void *data, int x, int y, int w, int h);
+   Fl_Offscreen *renderTile (int x, int y);
+   int visibleTiles ();
+   static void updateTileCacheSize ();
 
 protected:
    int translateViewXToCanvasX (int x);
    int translateViewYToCanvasY (int y);
    int translateCanvasXToViewX (int x);
    int translateCanvasYToViewY (int y);
+   bool drawTiled (core::Rectangle *area, DrawType type,
+                   int X, int Y, int W, int H);
 
 public:
    FltkViewport (int x, int y, int w, int h, const char *label = 0);
@@ -57,6 +98,10 @@ public:
    int handle (int event);
 
    void setCanvasSize (int width, int ascent, int descent);
+   void setBgColor (core::style::Color *color);
+   void queueDraw (core::Rectangle *area);
+   void queueDrawTotal ();
+   void drawFltkWidget (Fl_Widget *widget, core::Rectangle *area);
 
    bool usesViewport ();
    int getHScrollbarThickness ();
@@ -72,6 +117,8 @@ public:
                               GadgetOrientation gadgetOrientation);
    void setDragScroll (bool enable) { hasDragScroll = enable ? 1 : 0; }
    void addGadget (Fl_Widget *gadget);
+
+   static void setTileCacheSize (int size);
 };
 
 } // namespace fltk
@@ -158,8 +158,10 @@ Image::~Image()
 {
    if (altText)
       free(altText);
-   if (buffer)
+   if (buffer) {
+      buffer->removeRenderer (this);
       buffer->unref ();
+   }
    if (mapKey)
       delete mapKey;
 }
@@ -239,7 +241,9 @@ void Image::sizeAllocateImpl (core::Allocation *allocation)
       buffer = oldBuffer->getScaledBuf (allocation->width - dx,
                                         allocation->ascent
                                         + allocation->descent - dy);
+      oldBuffer->removeRenderer (this);
       oldBuffer->unref ();
+      buffer->addRenderer (this);
    }
 }
 
@@ -361,7 +365,8 @@ void Image::draw (core::View *view, core::Rectangle *area)
          view->drawImage (buffer,
                           allocation.x + dx, allocation.y + dy,
                           intersection.x - dx, intersection.y - dy,
-                          intersection.width, intersection.height);
+                          intersection.width, intersection.height,
+                          getBgColor ());
    } else {
       core::View *clippingView;
 
@@ -433,23 +438,85 @@ void Image::setBuffer (core::Imgbuf *buffer, bool resize)
       buffer->ref ();
    }
 
-   if (oldBuf)
+   if (oldBuf) {
+      oldBuf->removeRenderer (this);
       oldBuf->unref ();
+   }
+   this->buffer->addRenderer (this);
 }
 
 void Image::drawRow (int row)
 {
-   core::Rectangle area;
+   drawRows (row, 1);
+}
+
+/**
+ * \brief Queue the redrawing of the consecutive rows row ...
+ *    row + numRows - 1 (in root buffer coordinates) at once.
+ */
+void Image::drawRows (int row, int numRows)
+{
+   core::Rectangle first, last;
+   int y1, y2;
 
    assert (buffer != NULL);
 
-   buffer->getRowArea (row, &area);
-   if (area.width && area.height)
-      queueDrawArea (area.x + getStyle()->boxOffsetX (),
-                     area.y + getStyle()->boxOffsetY (),
-                     area.width, area.height);
+   // Rows map to areas going downwards, so the first and the last one
+   // span all of them.
+   buffer->getRowArea (row, &first);
+   buffer->getRowArea (row + numRows - 1, &last);
+   y1 = first.height ? first.y : last.y;
+   y2 = last.height ? last.y + last.height : first.y + first.height;
+
+   if (first.width && y2 > y1)
+      queueDrawArea (first.x + getStyle()->boxOffsetX (),
+                     y1 + getStyle()->boxOffsetY (),
+                     first.width, y2 - y1);
 }
 
+/**
+ * \brief Queue the redrawing of an area of the buffer, which has been
+ *    changed by dw::core::Imgbuf::copyArea.
+ */
+void Image::areaChanged (int x, int y, int width, int height)
+{
+   queueDrawArea (x + getStyle()->boxOffsetX (), y + getStyle()->boxOffsetY (),
+                  width, height);
+}
+
+/**
+ * \brief Return whether the image is (partly) within the viewport.
+ */
+bool Image::isVisible ()
+{
+   if (layout == NULL || !wasAllocated ())
+      return false;
+
+   int x = layout->getScrollPosX (), y = layout->getScrollPosY ();
+   return allocation.x < x + layout->getWidthViewport () &&
+          allocation.x + allocation.width > x &&
+          allocation.y < y + layout->getHeightViewport () &&
+          allocation.y + getHeight () > y;
+}
+
+
+/**
+ * \brief Take a buffer of the content size again, when the root buffer
+ *    shown so far got another size.
+ */
+void Image::rootSizeChanged ()
+{
+   if (wasAllocated () && getContentWidth () > 0 && getContentHeight () > 0) {
+      core::Imgbuf *oldBuffer = buffer;
+
+      buffer = oldBuffer->getScaledBuf (getContentWidth (),
+                                        getContentHeight ());
+      oldBuffer->removeRenderer (this);
+      oldBuffer->unref ();
+      buffer->addRenderer (this);
+   }
+   queueDraw ();
+}
 
 /**
  * \brief Sets image as server side image map.
@@ -116,7 +116,7 @@ public:
  *
  * \sa\ref dw-images-and-backgrounds
  */
-class Image: public core::Widget
+class Image: public core::Widget, public core::Imgbuf::Renderer
 {
 private:
    char *altText;
@@ -156,6 +156,11 @@ public:
    void setBuffer (core::Imgbuf *buffer, bool resize = false);
 
    void drawRow (int row);
+   void drawRows (int row, int numRows);
+
+   void areaChanged (int x, int y, int width, int height);
+   bool isVisible ();
+   void rootSizeChanged ();
 
    void setIsMap ();
    void setUseMap (ImageMapsList *list, Object *key);
@@ -49,6 +49,17 @@ namespace core {
  * unsigned integers, which have the format 0xrrbbgg (for indexed
  * images), or 0xaarrggbb (for indexed alpha), respectively.
  *
+ * RGBA data is passed with plain (not premultiplied) alpha. The image is
+ * kept with its alpha channel, and composited over the background of the
+ * widget when drawn (see dw::core::View::drawImage), so one buffer serves
+ * images on any background.
+ *
+ * Several consecutive rows may be passed at once with
+ * dw::core::Imgbuf::copyRows, \em stride being the distance between the
+ * starts of two rows in \em data. This is what decoders should use when
+ * they have more than one row ready, since the scaled buffers are then
+ * updated once for the whole batch.
+ *
  *
  * <h3>Scaling</h3>
  *
@@ -154,6 +165,44 @@ namespace core {
  *      to dw::core::View::drawImage.
  * </ol>
  *
+ * <h3>Dropping and Reloading Data</h3>
+ *
+ * To keep the memory used by decoded images within a budget, the image
+ * cache may call dw::core::Imgbuf::dropData for a root buffer which has
+ * not been drawn for a while. This frees the pixel data of the root
+ * buffer and of all its scaled buffers, but keeps the buffers
+ * themselves, so that widgets referring to them are not affected.
+ *
+ * When such a buffer is drawn again, the dw::core::Imgbuf::Reloader set
+ * by dw::core::Imgbuf::setReloader is asked to refill it; it is expected
+ * to decode the image again and to pass the rows to
+ * dw::core::Imgbuf::copyRow, as during the first decoding. This may
+ * happen later (the reloader is called while drawing); the buffer shows
+ * a placeholder until then. Buffers that are visible, or were drawn in
+ * the current frame (dw::core::Imgbuf::isDrawnInFrame), should not be
+ * dropped.
+ *
+ * The image cache may also have decoded an image at a reduced size, when
+ * it was to be shown smaller. When a larger scaled buffer is asked for
+ * later, the reloader is told (dw::core::Imgbuf::Reloader::enlarge), and
+ * may decode the image again at a larger size, after changing the size
+ * of the root buffer with dw::core::Imgbuf::setRootSize. The scaled
+ * buffers keep their size, and are filled again from the new rows.
+ *
+ * <h3>Animations</h3>
+ *
+ * After an animated image has been decoded completely, the following
+ * frames are shown by passing only the changed area of each one to
+ * dw::core::Imgbuf::copyArea of the root buffer. The scaled buffers are
+ * updated for the corresponding area, and every buffer tells its
+ * dw::core::Imgbuf::Renderer's (added by the widgets showing it, see
+ * dw::core::Imgbuf::addRenderer) which part has to be drawn again.
+ *
+ * The dw::core::Imgbuf::Animation set by dw::core::Imgbuf::setAnimation
+ * is told whenever the buffer, or one of its scaled buffers, is drawn;
+ * together with dw::core::Imgbuf::isVisible, this lets it pause while
+ * the image cannot be seen.
+ *
  * \sa \ref dw-images-and-backgrounds
  */
 class Imgbuf: public lout::object::Object, public lout::signal::ObservedObject
@@ -161,12 +210,56 @@ class Imgbuf: public lout::object::Object, public lout::signal::ObservedObject
 public:
    enum Type { RGB, RGBA, GRAY, INDEXED, INDEXED_ALPHA };
 
+   /**
+    * \brief Refills a root buffer after dw::core::Imgbuf::dropData.
+    */
+   class Reloader
+   {
+   public:
+      virtual void reload (Imgbuf *imgbuf) = 0;
+
+      /**
+       * \brief Called when a scaled buffer larger than the root buffer
+       *    is wanted.
+       */
+      virtual void enlarge (Imgbuf *imgbuf) = 0;
+   };
+
+   /**
+    * \brief Shows the changes made by dw::core::Imgbuf::copyArea.
+    *
+    * The coordinates are those of the buffer the renderer was added to.
+    */
+   class Renderer
+   {
+   public:
+      virtual void areaChanged (int x, int y, int width, int height) = 0;
+      virtual bool isVisible () = 0;
+
+      /**
+       * \brief Called when the root buffer the renderer was added to got
+       *    another size (see dw::core::Imgbuf::setRootSize).
+       */
+      virtual void rootSizeChanged () = 0;
+   };
+
+   /**
+    * \brief Plays an animation in a root buffer.
+    */
+   class Animation
+   {
+   public:
+      virtual void drawn (Imgbuf *imgbuf) = 0;
+   };
+
    /*
     * Methods called from the image decoding
     */
 
    virtual void setCMap (int *colors, int num_colors) = 0;
    virtual void copyRow (int row, const byte *data) = 0;
+   virtual void copyRows (int row, int numRows, const byte *data,
+                          int stride) = 0;
    virtual void newScan () = 0;
 
    /*
@@ -177,6 +270,59 @@ public:
    virtual void getRowArea (int row, dw::core::Rectangle *area) = 0;
    virtual int  getRootWidth () = 0;
    virtual int  getRootHeight () = 0;
+   virtual void addRenderer (Renderer *renderer) = 0;
+   virtual void removeRenderer (Renderer *renderer) = 0;
+
+   /*
+    * Methods called from the image cache (root buffers only)
+    */
+
+   /**
+    * \brief Return the memory taken by the pixel data of this buffer and
+    *    its scaled buffers, in bytes.
+    */
+   virtual int  getDataSize () = 0;
+
+   /**
+    * \brief Return a counter value, which grows each time the buffer, or
+    *    one of its scaled buffers, is drawn.
+    */
+   virtual unsigned int getLastUse () = 0;
+
+   /**
+    * \brief Return whether the buffer, or one of its scaled buffers, has
+    *    been drawn in the current frame (i.e., since a view last started
+    *    drawing).
+    */
+   virtual bool isDrawnInFrame () = 0;
+
+   virtual void dropData () = 0;
+   virtual void setReloader (Reloader *reloader) = 0;
+
+   /**
+    * \brief Change the size of the complete image, before it's decoded
+    *    again at that size; all rows have to be copied again.
+    */
+   virtual void setRootSize (int width, int height) = 0;
+
+   /*
+    * Methods called by animations (root buffers only)
+    */
+
+   /**
+    * \brief Replace the area at \em x, \em y of the complete image by
+    *    \em data, and have it drawn again where it is shown.
+    */
+   virtual void copyArea (int x, int y, int width, int height,
+                          const byte *data, int stride) = 0;
+
+   /**
+    * \brief Return whether the buffer, or one of its scaled buffers, is
+    *    shown in a visible part of a view.
+    */
+   virtual bool isVisible () = 0;
+
+   virtual void setAnimation (Animation *animation) = 0;
 
    /*
     * Reference counting.
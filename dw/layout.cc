@@ -24,6 +24,7 @@
 #include "../lout/msg.h"
 #include "../lout/debug.hh"
 #include "../lout/misc.hh"
+#include "../lout/perf.h"
 
 using namespace lout;
 using namespace lout::container;
@@ -36,6 +37,10 @@ void Layout::Receiver::canvasSizeChanged (int width, int ascent, int descent)
 {
 }
 
+void Layout::Receiver::viewportChanged (int x, int y, int width, int height)
+{
+}
+
 // ----------------------------------------------------------------------
 
 bool Layout::Emitter::emitToReceiver (lout::signal::Receiver *receiver,
@@ -51,6 +56,13 @@ bool Layout::Emitter::emitToReceiver (lout::signal::Receiver *receiver,
                                          ((Integer*)argv[2])->getValue ());
       break;
 
+   case VIEWPORT_CHANGED:
+      layoutReceiver->viewportChanged (((Integer*)argv[0])->getValue (),
+                                       ((Integer*)argv[1])->getValue (),
+                                       ((Integer*)argv[2])->getValue (),
+                                       ((Integer*)argv[3])->getValue ());
+      break;
+
    default:
       misc::assertNotReached ();
    }
@@ -66,6 +78,14 @@ void Layout::Emitter::emitCanvasSizeChanged (int width,
    emitVoid (CANVAS_SIZE_CHANGED, 3, argv);
 }
 
+void Layout::Emitter::emitViewportChanged (int x, int y,
+                                           int width, int height)
+{
+   Integer ix (x), iy (y), w (width), h (height);
+   Object *argv[4] = { &ix, &iy, &w, &h };
+   emitVoid (VIEWPORT_CHANGED, 4, argv);
+}
+
 // ----------------------------------------------------------------------
 
 bool Layout::LinkReceiver::enter (Widget *widget, int link, int img,
@@ -461,6 +481,8 @@ void Layout::scrollIdle ()
          drawAfterScrollReq = false;
          view->queueDrawTotal ();
       }
+      emitter.emitViewportChanged (scrollX, scrollY,
+                                   viewportWidth, viewportHeight);
    }
 
    scrollIdleId = -1;
@@ -528,7 +550,11 @@ void Layout::draw (View *view, Rectangle *area)
          widgetDrawArea.width = intersection.width;
          widgetDrawArea.height = intersection.height;
 
+         PERF_TIMER(t);
+         PERF_START(t);
          topLevel->draw (view, &widgetDrawArea);
+         PERF_STOP(PERF_DRAW, t);
+         PERF_MARK(PERF_MARK_PAINT);
 
          view->finishDrawing (&intersection);
       }
@@ -643,6 +669,8 @@ void Layout::resizeIdle ()
 {
    //static int calls = 0;
    //MSG(" Layout::resizeIdle calls = %d\n", ++calls);
+   PERF_TIMER(t);
+   PERF_START(t);
 
    while (resizeIdleId != -1) {
       // Reset already here, since in this function, queueResize() may be
@@ -699,6 +727,8 @@ void Layout::resizeIdle ()
    }
 
    updateAnchor ();
+   PERF_STOP(PERF_RESIZE, t);
+   PERF_MARK(PERF_MARK_LAYOUT);
 }
 
 void Layout::setSizeHints ()
@@ -990,6 +1020,8 @@ void Layout::scrollPosChanged (View *view, int x, int y)
 
       setAnchor (NULL);
       updateAnchor ();
+      emitter.emitViewportChanged (scrollX, scrollY,
+                                   viewportWidth, viewportHeight);
    }
 }
 
@@ -1009,13 +1041,17 @@ void Layout::viewportSizeChanged (View *view, int width, int height)
 
    /* if size changes, redraw this view.
     * TODO: this is a resize call (redraw/resize code needs a review). */
-   if (viewportWidth != width || viewportHeight != height)
+   bool changed = viewportWidth != width || viewportHeight != height;
+   if (changed)
       queueResize();
 
    viewportWidth = width;
    viewportHeight = height;
 
    setSizeHints ();
+   if (changed)
+      emitter.emitViewportChanged (scrollX, scrollY,
+                                   viewportWidth, viewportHeight);
 }
 
 } // namespace dw
@@ -27,6 +27,13 @@ public:
    {
    public:
       virtual void canvasSizeChanged (int width, int ascent, int descent);
+
+      /**
+       * \brief Called, when the visible part of the canvas has changed,
+       *    by scrolling (either by the user or by the layout) or by
+       *    resizing the viewport.
+       */
+      virtual void viewportChanged (int x, int y, int width, int height);
    };
 
    class LinkReceiver: public lout::signal::Receiver
@@ -105,7 +112,7 @@ private:
    class Emitter: public lout::signal::Emitter
    {
    private:
-      enum { CANVAS_SIZE_CHANGED };
+      enum { CANVAS_SIZE_CHANGED, VIEWPORT_CHANGED };
 
    protected:
       bool emitToReceiver (lout::signal::Receiver *receiver, int signalNo,
@@ -115,6 +122,7 @@ private:
       inline void connectLayout (Receiver *receiver) { connect (receiver); }
 
       void emitCanvasSizeChanged (int width, int ascent, int descent);
+      void emitViewportChanged (int x, int y, int width, int height);
    };
 
    Emitter emitter;
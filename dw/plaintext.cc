@@ -0,0 +1,514 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "plaintext.hh"
+#include "../lout/msg.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/* Columns between tab stops */
+#define TAB_SIZE 8
+
+/* Whether a byte starts a character (as UTF-8) */
+#define IS_CHAR_START(c) (((c) & 0xc0) != 0x80)
+
+using namespace lout;
+
+namespace dw {
+
+int PlainText::CLASS_ID = -1;
+
+PlainText::PlainText (Source *source, core::style::Style *textStyle)
+{
+   registerName ("dw::PlainText", &CLASS_ID);
+   setFlags (BLOCK_LEVEL);
+   setButtonSensitive(true);
+
+   this->source = source;
+   this->textStyle = textStyle;
+   textStyle->ref ();
+
+   lines = new misc::SimpleVector <Line> (1);
+   maxColumns = 0;
+   charWidth = lineHeight = 1;
+   mustQueueResize = false;
+
+   for (int layer = 0; layer < core::HIGHLIGHT_NUM_LAYERS; layer++) {
+      /* hlStart[layer].index > hlEnd[layer].index means no highlighting */
+      hlStart[layer].index = 1;
+      hlStart[layer].nChar = 0;
+      hlEnd[layer].index = 0;
+      hlEnd[layer].nChar = 0;
+   }
+}
+
+PlainText::~PlainText ()
+{
+   _MSG("PlainText::~PlainText\n");
+   delete lines;
+   textStyle->unref ();
+}
+
+/**
+ * Add a line, given by where it starts and ends (not including the EOL)
+ * within the source's text, which is passed as it is now.
+ */
+void PlainText::addLine (const char *text, int start, int end)
+{
+   int column = 0;
+
+   for (int i = start; i < end; i++) {
+      if (text[i] == '\t')
+         column += TAB_SIZE - column % TAB_SIZE;
+      else if (IS_CHAR_START (text[i]))
+         column++;
+   }
+   maxColumns = misc::max (maxColumns, column);
+
+   lines->increase ();
+   lines->getRef(lines->size () - 1)->start = start;
+   lines->getRef(lines->size () - 1)->end = end;
+   mustQueueResize = true;
+}
+
+/**
+ * Make the lines added so far show up.
+ */
+void PlainText::flush ()
+{
+   if (mustQueueResize) {
+      queueResize (0, true);
+      mustQueueResize = false;
+   }
+}
+
+/**
+ * Return a new string with the text of a line, with the tabs expanded.
+ */
+char *PlainText::getLineText (int lineNo)
+{
+   Line *line = lines->getRef (lineNo);
+   int i, n, length, column = 0, size = 0;
+   const char *text = source->getText (&length);
+   char *lineText;
+
+   if (text == NULL || line->end > length)
+      return strdup ("");
+
+   /* Find the size first */
+   for (i = line->start; i < line->end; i++) {
+      if (text[i] == '\t') {
+         n = TAB_SIZE - column % TAB_SIZE;
+         column += n;
+         size += n;
+      } else {
+         if (IS_CHAR_START (text[i]))
+            column++;
+         size++;
+      }
+   }
+
+   lineText = (char*) malloc (size + 1);
+   for (column = 0, size = 0, i = line->start; i < line->end; i++) {
+      if (text[i] == '\t') {
+         for (n = TAB_SIZE - column % TAB_SIZE; n > 0; n--, column++)
+            lineText[size++] = ' ';
+      } else {
+         if (IS_CHAR_START (text[i]))
+            column++;
+         lineText[size++] = text[i];
+      }
+   }
+   lineText[size] = '\0';
+   return lineText;
+}
+
+/**
+ * The column where a character (given by its byte position) of a line
+ * text starts.
+ */
+int PlainText::columnOfChar (const char *text, int nChar)
+{
+   int column = 0;
+
+   for (int i = 0; i < nChar && text[i]; i++)
+      if (IS_CHAR_START (text[i]))
+         column++;
+   return column;
+}
+
+/**
+ * The byte position of the character at a column of a line text (or the
+ * end of the text).
+ */
+int PlainText::charOfColumn (const char *text, int column)
+{
+   int i;
+
+   for (i = 0; text[i]; i++)
+      if (IS_CHAR_START (text[i]) && column-- == 0)
+         break;
+   return i;
+}
+
+int PlainText::lineYOffsetWidget (int lineNo)
+{
+   return getStyle()->boxOffsetY () + lineNo * lineHeight;
+}
+
+void PlainText::sizeRequestImpl (core::Requisition *requisition)
+{
+   core::style::Font *font = textStyle->font;
+
+   charWidth = misc::max (layout->textWidth (font, "0", 1), 1);
+   lineHeight = misc::max (font->ascent + font->descent, 1);
+
+   requisition->width = maxColumns * charWidth + getStyle()->boxDiffWidth ();
+   requisition->ascent = lines->size () * lineHeight +
+                         getStyle()->boxOffsetY ();
+   requisition->descent = getStyle()->boxRestHeight ();
+}
+
+/**
+ * Draw the part of a line which is within the area.
+ */
+void PlainText::drawLine (int lineNo, core::View *view, core::Rectangle *area)
+{
+   core::style::Font *font = textStyle->font;
+   int xWidget = getStyle()->boxOffsetX ();
+   int yWorldBase = allocation.y + lineYOffsetWidget (lineNo) + font->ascent;
+   int firstColumn, lastColumn, from, to, len;
+   char *text;
+
+   if (area->x + area->width <= xWidget)
+      return;
+
+   /* Only the columns within the area are drawn (which also keeps the
+    * coordinates small, as with extremely long lines) */
+   text = getLineText (lineNo);
+   len = strlen (text);
+   firstColumn = misc::max (area->x - xWidget, 0) / charWidth;
+   lastColumn = (area->x + area->width - xWidget) / charWidth + 1;
+   from = charOfColumn (text, firstColumn);
+   to = from + charOfColumn (text + from, lastColumn - firstColumn);
+
+   if (to > from)
+      view->drawText (font, textStyle->color,
+                      core::style::Color::SHADING_NORMAL,
+                      allocation.x + xWidget + firstColumn * charWidth,
+                      yWorldBase, text + from, to - from);
+
+   for (int layer = 0; layer < core::HIGHLIGHT_NUM_LAYERS; layer++) {
+      if (hlStart[layer].index <= 2 * lineNo &&
+          hlEnd[layer].index >= 2 * lineNo) {
+         int firstCharIdx = 0, lastCharIdx = len;
+
+         if (2 * lineNo == hlStart[layer].index)
+            firstCharIdx = misc::min (hlStart[layer].nChar, len);
+         if (2 * lineNo == hlEnd[layer].index)
+            lastCharIdx = misc::min (hlEnd[layer].nChar, len);
+         firstCharIdx = misc::max (firstCharIdx, from);
+         lastCharIdx = misc::min (lastCharIdx, to);
+
+         if (lastCharIdx > firstCharIdx) {
+            int xStart = allocation.x + xWidget +
+                         columnOfChar (text, firstCharIdx) * charWidth;
+            int width = columnOfChar (text + firstCharIdx,
+                                      lastCharIdx - firstCharIdx) * charWidth;
+            core::style::Color *bgColor;
+
+            if (!(bgColor = textStyle->backgroundColor))
+               bgColor = getBgColor();
+
+            /* Draw background for highlighted text. */
+            view->drawRectangle (bgColor, core::style::Color::SHADING_INVERSE,
+                                 true, xStart, yWorldBase - font->ascent,
+                                 width, font->ascent + font->descent);
+
+            /* Highlight the text. */
+            view->drawText (font, textStyle->color,
+                            core::style::Color::SHADING_INVERSE, xStart,
+                            yWorldBase, text + firstCharIdx,
+                            lastCharIdx - firstCharIdx);
+         }
+      }
+   }
+   free (text);
+}
+
+void PlainText::draw (core::View *view, core::Rectangle *area)
+{
+   int lineNo, lastLineNo;
+
+   drawWidgetBox (view, area, false);
+
+   lineNo = misc::max (area->y - getStyle()->boxOffsetY (), 0) / lineHeight;
+   lastLineNo = misc::min ((area->y + area->height -
+                            getStyle()->boxOffsetY ()) / lineHeight,
+                           lines->size () - 1);
+   for (; lineNo <= lastLineNo; lineNo++)
+      drawLine (lineNo, view, area);
+}
+
+void PlainText::queueDrawRange (int index1, int index2)
+{
+   int from = misc::min (index1, index2) / 2;
+   int to = misc::max (index1, index2) / 2;
+
+   from = misc::max (misc::min (from, lines->size () - 1), 0);
+   to = misc::max (misc::min (to, lines->size () - 1), 0);
+
+   queueDrawArea (0, lineYOffsetWidget (from), allocation.width,
+                  (to - from + 1) * lineHeight);
+}
+
+bool PlainText::buttonPressImpl (core::EventButton *event)
+{
+   return sendSelectionEvent (core::SelectionState::BUTTON_PRESS, event);
+}
+
+bool PlainText::buttonReleaseImpl (core::EventButton *event)
+{
+   return sendSelectionEvent (core::SelectionState::BUTTON_RELEASE, event);
+}
+
+bool PlainText::motionNotifyImpl (core::EventMotion *event)
+{
+   if (event->state & core::BUTTON1_MASK)
+      return sendSelectionEvent (core::SelectionState::BUTTON_MOTION, event);
+   return false;
+}
+
+/**
+ * \brief Send event to selection.
+ */
+bool PlainText::sendSelectionEvent (core::SelectionState::EventType eventType,
+                                    core::MousePositionEvent *event)
+{
+   core::Iterator *it;
+   int lineNo, column, charPos = 0, index = -1;
+   bool r;
+
+   if (lines->size () > 0) {
+      int y = event->yWidget - getStyle()->boxOffsetY ();
+
+      if (y < 0) {
+         // Above the first line: take its start.
+         index = 0;
+      } else if ((lineNo = y / lineHeight) >= lines->size ()) {
+         // Below the last line: take its end.
+         index = 2 * (lines->size () - 1);
+         charPos = core::SelectionState::END_OF_WORD;
+      } else {
+         char *text = getLineText (lineNo);
+
+         // The nearest boundary between characters.
+         column = (event->xWidget - getStyle()->boxOffsetX () +
+                   charWidth / 2) / charWidth;
+         index = 2 * lineNo;
+         charPos = charOfColumn (text, misc::max (column, 0));
+         free (text);
+      }
+   }
+   it = new PlainTextIterator (this, core::Content::SELECTION_CONTENT, index);
+   r = selectionHandleEvent (eventType, it, charPos, -1, event);
+   it->unref ();
+   return r;
+}
+
+core::Iterator *PlainText::iterator (core::Content::Type mask, bool atEnd)
+{
+   return new PlainTextIterator (this, mask, atEnd);
+}
+
+// ----------------------------------------------------------------------
+
+PlainText::PlainTextIterator::PlainTextIterator (PlainText *plainText,
+                                                 core::Content::Type mask,
+                                                 bool atEnd):
+   core::Iterator (plainText, mask, atEnd)
+{
+   index = atEnd ? 2 * plainText->lines->size () : -1;
+   text = NULL;
+   content.type = atEnd ? core::Content::END : core::Content::START;
+}
+
+PlainText::PlainTextIterator::PlainTextIterator (PlainText *plainText,
+                                                 core::Content::Type mask,
+                                                 int index):
+   core::Iterator (plainText, mask, false)
+{
+   this->index = index;
+   text = NULL;
+   setContent ();
+}
+
+PlainText::PlainTextIterator::~PlainTextIterator ()
+{
+   free (text);
+}
+
+/**
+ * Set the content for the index.
+ */
+void PlainText::PlainTextIterator::setContent ()
+{
+   PlainText *plainText = (PlainText*)getWidget();
+
+   free (text);
+   text = NULL;
+   content.space = false;
+   if (index < 0) {
+      content.type = core::Content::START;
+   } else if (index >= 2 * plainText->lines->size ()) {
+      content.type = core::Content::END;
+   } else if (index % 2) {
+      content.type = core::Content::BREAK;
+      content.breakSpace = 0;
+   } else {
+      content.type = core::Content::TEXT;
+      content.text = text = plainText->getLineText (index / 2);
+   }
+}
+
+object::Object *PlainText::PlainTextIterator::clone()
+{
+   return new PlainTextIterator ((PlainText*)getWidget(), getMask(), index);
+}
+
+int PlainText::PlainTextIterator::compareTo(misc::Comparable *other)
+{
+   return index - ((PlainTextIterator*)other)->index;
+}
+
+bool PlainText::PlainTextIterator::next ()
+{
+   PlainText *plainText = (PlainText*)getWidget();
+   int last = 2 * plainText->lines->size ();
+
+   if (content.type == core::Content::END)
+      return false;
+
+   do
+      index++;
+   while (index < last && ((index % 2 ? core::Content::BREAK :
+                            core::Content::TEXT) & getMask()) == 0);
+   setContent ();
+   return content.type != core::Content::END;
+}
+
+bool PlainText::PlainTextIterator::prev ()
+{
+   if (content.type == core::Content::START)
+      return false;
+
+   do
+      index--;
+   while (index >= 0 && ((index % 2 ? core::Content::BREAK :
+                          core::Content::TEXT) & getMask()) == 0);
+   setContent ();
+   return content.type != core::Content::START;
+}
+
+void PlainText::PlainTextIterator::highlight (int start, int end,
+                                              core::HighlightLayer layer)
+{
+   PlainText *plainText = (PlainText*)getWidget();
+   int index1 = index, index2 = index;
+
+   if (plainText->hlStart[layer].index > plainText->hlEnd[layer].index) {
+      /* nothing is highlighted */
+      plainText->hlStart[layer].index = index;
+      plainText->hlEnd[layer].index = index;
+   }
+
+   if (plainText->hlStart[layer].index >= index) {
+      index2 = plainText->hlStart[layer].index;
+      plainText->hlStart[layer].index = index;
+      plainText->hlStart[layer].nChar = start;
+   }
+
+   if (plainText->hlEnd[layer].index <= index) {
+      index2 = plainText->hlEnd[layer].index;
+      plainText->hlEnd[layer].index = index;
+      plainText->hlEnd[layer].nChar = end;
+   }
+
+   plainText->queueDrawRange (index1, index2);
+}
+
+void PlainText::PlainTextIterator::unhighlight (int direction,
+                                                core::HighlightLayer layer)
+{
+   PlainText *plainText = (PlainText*)getWidget();
+   int index1 = index, index2 = index;
+
+   if (plainText->hlStart[layer].index > plainText->hlEnd[layer].index)
+      return;
+
+   if (direction == 0) {
+      index1 = plainText->hlStart[layer].index;
+      index2 = plainText->hlEnd[layer].index;
+      plainText->hlStart[layer].index = 1;
+      plainText->hlEnd[layer].index = 0;
+   } else if (direction > 0 && plainText->hlStart[layer].index <= index) {
+      index1 = plainText->hlStart[layer].index;
+      plainText->hlStart[layer].index = index + 1;
+      plainText->hlStart[layer].nChar = 0;
+   } else if (direction < 0 && plainText->hlEnd[layer].index >= index) {
+      index1 = plainText->hlEnd[layer].index;
+      plainText->hlEnd[layer].index = index - 1;
+      plainText->hlEnd[layer].nChar = INT_MAX;
+   }
+
+   plainText->queueDrawRange (index1, index2);
+}
+
+void PlainText::PlainTextIterator::getAllocation (int start, int end,
+                                                  core::Allocation *allocation)
+{
+   PlainText *plainText = (PlainText*)getWidget();
+   core::style::Font *font = plainText->textStyle->font;
+   int lineNo = misc::max (misc::min (index / 2,
+                                      plainText->lines->size () - 1), 0);
+   int column1 = 0, column2 = 0;
+
+   if (content.type == core::Content::TEXT) {
+      column1 = plainText->columnOfChar (text, start);
+      column2 = plainText->columnOfChar (text, end); /* end may be INT_MAX */
+   } else if (content.type == core::Content::BREAK) {
+      /* At the end of the line */
+      char *lineText = plainText->getLineText (lineNo);
+      column1 = column2 = plainText->columnOfChar (lineText, INT_MAX);
+      free (lineText);
+   }
+
+   allocation->x = plainText->allocation.x +
+                   plainText->getStyle()->boxOffsetX () +
+                   column1 * plainText->charWidth;
+   allocation->y = plainText->allocation.y +
+                   plainText->lineYOffsetWidget (lineNo);
+   allocation->width = (column2 - column1) * plainText->charWidth;
+   allocation->ascent = font->ascent;
+   allocation->descent = font->descent;
+}
+
+} // namespace dw
@@ -0,0 +1,127 @@
+#ifndef __DW_PLAINTEXT_HH__
+#define __DW_PLAINTEXT_HH__
+
+#include "core.hh"
+#include "../lout/misc.hh"
+
+namespace dw {
+
+/**
+ * \brief A widget for plain text documents, which may be huge.
+ *
+ * The widget does not copy the text: it only keeps where each line
+ * starts and ends within it, and gets the text from a
+ * dw::PlainText::Source whenever it's needed (so that the text may move,
+ * e.g. while it's still growing). This way, it takes a couple of integers
+ * per line, instead of a dw::Textblock word per word and line.
+ *
+ * All characters are taken to be as wide as the digits of the font (which
+ * is meant to be a monospace one), so that the size of the text is
+ * calculated arithmetically, and only the part of the visible lines that
+ * is within the drawing area is drawn. Tabs are expanded to the next
+ * multiple of eight columns.
+ *
+ * For the iterators, each line is a text content followed by a break, so
+ * that the text can be selected and searched for.
+ */
+class PlainText: public core::Widget
+{
+public:
+   /**
+    * \brief Where the text of a dw::PlainText comes from.
+    */
+   class Source
+   {
+   public:
+      virtual ~Source () { }
+
+      /**
+       * \brief Return the text as it is now (or NULL), and its length.
+       *
+       * The pointer is only used until control returns to the main loop.
+       */
+      virtual const char *getText (int *length) = 0;
+   };
+
+private:
+   class PlainTextIterator: public core::Iterator
+   {
+   private:
+      /* Even: the text of line index / 2; odd: the break after it */
+      int index;
+      char *text;
+
+      void setContent ();
+
+   public:
+      PlainTextIterator (PlainText *plainText, core::Content::Type mask,
+                         bool atEnd);
+      PlainTextIterator (PlainText *plainText, core::Content::Type mask,
+                         int index);
+      ~PlainTextIterator ();
+
+      lout::object::Object *clone();
+      int compareTo(lout::misc::Comparable *other);
+
+      bool next ();
+      bool prev ();
+      void highlight (int start, int end, core::HighlightLayer layer);
+      void unhighlight (int direction, core::HighlightLayer layer);
+      void getAllocation (int start, int end, core::Allocation *allocation);
+   };
+
+   friend class PlainTextIterator;
+
+   struct Line
+   {
+      int start, end;   /* Offsets of the line in the text, without EOL */
+   };
+
+   struct HighlightPosition
+   {
+      int index;        /* Of the iterator */
+      int nChar;
+   };
+
+   Source *source;
+   core::style::Style *textStyle;
+   lout::misc::SimpleVector <Line> *lines;
+   int maxColumns;
+   int charWidth, lineHeight;
+   bool mustQueueResize;
+
+   HighlightPosition hlStart[core::HIGHLIGHT_NUM_LAYERS],
+      hlEnd[core::HIGHLIGHT_NUM_LAYERS];
+
+   char *getLineText (int lineNo);
+   int columnOfChar (const char *text, int nChar);
+   int charOfColumn (const char *text, int column);
+   int lineYOffsetWidget (int lineNo);
+   void drawLine (int lineNo, core::View *view, core::Rectangle *area);
+   void queueDrawRange (int index1, int index2);
+   bool sendSelectionEvent (core::SelectionState::EventType eventType,
+                            core::MousePositionEvent *event);
+
+protected:
+   void sizeRequestImpl (core::Requisition *requisition);
+   void draw (core::View *view, core::Rectangle *area);
+
+   bool buttonPressImpl (core::EventButton *event);
+   bool buttonReleaseImpl (core::EventButton *event);
+   bool motionNotifyImpl (core::EventMotion *event);
+
+public:
+   static int CLASS_ID;
+
+   PlainText (Source *source, core::style::Style *textStyle);
+   ~PlainText ();
+
+   core::Iterator *iterator (core::Content::Type mask, bool atEnd);
+
+   void addLine (const char *text, int start, int end);
+   void flush ();
+};
+
+} // namespace dw
+
+#endif // __DW_PLAINTEXT_HH__
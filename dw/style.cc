@@ -52,6 +52,7 @@ void StyleAttrs::initValues ()
    borderWidth.setVal (0);
    padding.setVal (0);
    borderCollapse = BORDER_MODEL_SEPARATE;
+   tableLayout = TABLE_LAYOUT_AUTO;
    setBorderColor (NULL);
    setBorderStyle (BORDER_NONE);
    hBorderSpacing = 0;
@@ -84,6 +85,7 @@ void StyleAttrs::resetValues ()
    setBorderStyle (BORDER_NONE);
    hBorderSpacing = 0;
    vBorderSpacing = 0;
+   tableLayout = TABLE_LAYOUT_AUTO;
 
    display = DISPLAY_INLINE;
 }
@@ -128,6 +130,7 @@ bool StyleAttrs::equals (object::Object *other) {
        borderWidth.equals (&otherAttrs->borderWidth) &&
        padding.equals (&otherAttrs->padding) &&
        borderCollapse == otherAttrs->borderCollapse &&
+       tableLayout == otherAttrs->tableLayout &&
        borderColor.top == otherAttrs->borderColor.top &&
        borderColor.right == otherAttrs->borderColor.right &&
        borderColor.bottom == otherAttrs->borderColor.bottom &&
@@ -165,6 +168,7 @@ int StyleAttrs::hashValue () {
       borderWidth.hashValue () +
       padding.hashValue () +
       borderCollapse +
+      tableLayout +
       (intptr_t) borderColor.top +
       (intptr_t) borderColor.right +
       (intptr_t) borderColor.bottom  +
@@ -255,6 +259,7 @@ void Style::copyAttrs (StyleAttrs *attrs)
    borderWidth = attrs->borderWidth;
    padding = attrs->padding;
    borderCollapse = attrs->borderCollapse;
+   tableLayout = attrs->tableLayout;
    borderColor = attrs->borderColor;
    borderStyle = attrs->borderStyle;
    display = attrs->display;
@@ -215,6 +215,11 @@ enum BorderCollapse {
    BORDER_MODEL_COLLAPSE
 };
 
+enum TableLayout {
+   TABLE_LAYOUT_AUTO,
+   TABLE_LAYOUT_FIXED
+};
+
 enum BorderStyle {
    BORDER_NONE,
    BORDER_HIDDEN,
@@ -447,6 +452,7 @@ public:
 
    Box margin, borderWidth, padding;
    BorderCollapse borderCollapse;
+   TableLayout tableLayout;
    struct { Color *top, *right, *bottom, *left; } borderColor;
    struct { BorderStyle top, right, bottom, left; } borderStyle;
 
@@ -54,6 +54,8 @@ Table::Table(bool limitTextWidth)
 
    children = new misc::SimpleVector <Child*> (16);
    colExtremes = new misc::SimpleVector<core::Extremes> (8);
+   colSpecWidths = new misc::SimpleVector<core::style::Length> (8);
+   colBaseExtremes = new misc::SimpleVector<core::Extremes> (8);
    colWidths = new misc::SimpleVector <int> (8);
    cumHeight = new misc::SimpleVector <int> (8);
    rowSpanCells = new misc::SimpleVector <int> (8);
@@ -66,6 +68,12 @@ Table::Table(bool limitTextWidth)
 
    redrawX = 0;
    redrawY = 0;
+
+   extremesDirtyRows = new misc::SimpleVector <int> (8);
+   rowExtremesDirty = new misc::BitSet (8);
+   allExtremesDirty = true;
+   sizeDirtyRow = 0;
+   colWidthsChanged = false;
 }
 
 
@@ -91,6 +99,10 @@ Table::~Table()
 
    delete children;
    delete colExtremes;
+   delete colSpecWidths;
+   delete colBaseExtremes;
+   delete extremesDirtyRows;
+   delete rowExtremesDirty;
    delete colWidths;
    delete cumHeight;
    delete rowSpanCells;
@@ -200,6 +212,39 @@ void Table::resizeDrawImpl ()
    redrawY = getHeight ();
 }
 
+/**
+ * \brief The cells in row \em ref, and all rows below, must be sized again.
+ *
+ * \em ref is the row a cell starts in (its parentRef), so the rows a cell
+ * with rowspan > 1 spans are sized again as well, and its height is
+ * apportioned to them anew.
+ */
+void Table::markSizeChange (int ref)
+{
+   sizeDirtyRow = misc::min (sizeDirtyRow, misc::max (ref, 0));
+}
+
+/**
+ * \brief The extremes of the cells in row \em ref have changed.
+ */
+void Table::markExtremesChange (int ref)
+{
+   if (ref < 0 || ref >= numRows)
+      allExtremesDirty = true;
+   else if (!rowExtremesDirty->get (ref)) {
+      rowExtremesDirty->set (ref, true);
+      extremesDirtyRows->increase ();
+      extremesDirtyRows->set (extremesDirtyRows->size () - 1, ref);
+   }
+}
+
+void Table::setStyle (core::style::Style *style)
+{
+   // The border spacing is part of the extremes of all cells.
+   allExtremesDirty = true;
+   core::Widget::setStyle (style);
+}
+
 void Table::setWidth (int width)
 {
    // If limitTextWidth is set, a queueResize may also be necessary.
@@ -228,7 +273,6 @@ void Table::setDescent (int descent)
 
 void Table::draw (core::View *view, core::Rectangle *area)
 {
-   // Can be optimized, by iterating on the lines in area.
    drawWidgetBox (view, area, false);
 
 #if 0
@@ -248,14 +292,104 @@ void Table::draw (core::View *view, core::Rectangle *area)
    }
 #endif
 
-   for (int i = 0; i < children->size (); i++) {
-      if (childDefined (i)) {
-         Widget *child = children->get(i)->cell.widget;
-         core::Rectangle childArea;
-         if (child->intersects (area, &childArea))
-            child->draw (view, &childArea);
+   /* Only the rows within the area are examined; see findRowIndex(). */
+   int offy = getStyle()->boxOffsetY () + getStyle()->vBorderSpacing;
+   int numAllocRows = misc::min (numRows, cumHeight->size () - 1);
+   int firstRow = findRowIndex (area->y);
+
+   for (int row = firstRow; row < numAllocRows; row++) {
+      if (cumHeight->get (row) + offy >= area->y + area->height)
+         break;
+
+      for (int col = 0; col < numCols; col++) {
+         int n = row * numCols + col;
+         Child *c = children->get (n);
+
+         if (c && c->type == Child::SPAN_SPACE) {
+            /* A cell spanning down from above the first row in the area
+             * is drawn once, from the column where it starts. */
+            if (row == firstRow && c->spanSpace.startRow < firstRow &&
+                c->spanSpace.startCol == col)
+               n = c->spanSpace.startRow * numCols + col;
+            else
+               continue;
+         }
+
+         if (childDefined (n)) {
+            Widget *child = children->get(n)->cell.widget;
+            core::Rectangle childArea;
+            if (child->intersects (area, &childArea))
+               child->draw (view, &childArea);
+         }
+      }
+   }
+}
+
+/**
+ * \brief Find the first row that includes y, relative to the top of the
+ *    widget.
+ *
+ * The rows are sorted by dw::Table::cumHeight, so this is a binary search,
+ * like dw::Textblock::findLineIndex. Returns a value >= the number of
+ * allocated rows, when y is below the last one.
+ */
+int Table::findRowIndex (int y)
+{
+   int offy = getStyle()->boxOffsetY () + getStyle()->vBorderSpacing;
+   int low = 0, high = misc::min (numRows, cumHeight->size () - 1);
+
+   /* Search for the first row whose bottom is below y. */
+   while (low < high) {
+      int row = (low + high) / 2;
+      if (cumHeight->get (row + 1) + offy <= y)
+         low = row + 1;
+      else
+         high = row;
+   }
+
+   return low;
+}
+
+/**
+ * \brief Search the rows around (x, y) for a child widget.
+ *
+ * This is an optimized version of the general
+ * dw::core::Widget::getWidgetAtPoint method, see dw::Table::findRowIndex.
+ */
+core::Widget *Table::getWidgetAtPoint (int x, int y, int level)
+{
+   if (x < allocation.x ||
+       y < allocation.y ||
+       x > allocation.x + allocation.width ||
+       y > allocation.y + getHeight ()) {
+      return NULL;
+   }
+
+   int numAllocRows = misc::min (numRows, cumHeight->size () - 1);
+   int row = findRowIndex (y - allocation.y);
+
+   /* The point may be within the border spacing below a row, so the next
+    * row is examined, too. Cells spanning from rows above are found via
+    * their span space. */
+   for (int r = row; r < numAllocRows && r <= row + 1; r++) {
+      for (int col = 0; col < numCols; col++) {
+         int n = r * numCols + col;
+         Child *c = children->get (n);
+
+         if (c && c->type == Child::SPAN_SPACE)
+            n = c->spanSpace.startRow * numCols + c->spanSpace.startCol;
+
+         if (childDefined (n)) {
+            Widget *childAtPoint =
+               children->get(n)->cell.widget->getWidgetAtPoint (x, y,
+                                                                 level + 1);
+            if (childAtPoint)
+               return childAtPoint;
+         }
       }
    }
+
+   return this;
 }
 
 void Table::removeChild (Widget *child)
@@ -271,7 +405,7 @@ core::Iterator *Table::iterator (core::Content::Type mask, bool atEnd)
 void Table::addCell (Widget *widget, int colspan, int rowspan)
 {
    Child *child;
-   int colspanEff;
+   int colspanEff, oldNumCols = numCols;
 
    // We limit the values for colspan and rowspan to 50, to avoid
    // attacks by malicious web pages.
@@ -342,14 +476,18 @@ void Table::addCell (Widget *widget, int colspan, int rowspan)
    child->cell.colspanOrig = colspan;
    child->cell.colspanEff = colspanEff;
    child->cell.rowspan = rowspan;
+   child->cell.extremesUsed = false;
    children->set (curRow * numCols + curCol, child);
 
    curCol += colspanEff;
 
    widget->setParent (this);
+   widget->parentRef = curRow;
    if (rowStyle->get (curRow))
       widget->setBgColor (rowStyle->get(curRow)->backgroundColor);
-   queueResize (0, true);
+   // With fixed layout, the column extremes only depend on the first row.
+   queueResize (curRow,
+                !fixedLayout () || curRow == 0 || numCols != oldNumCols);
 
 #if 0
    // show table structure in stdout
@@ -390,6 +528,28 @@ void Table::addRow (core::style::Style *style)
    rowClosed = false;
 }
 
+/**
+ * \brief Add \em span columns with the specified width.
+ *
+ * This corresponds to the HTML element \<col\>, and must be called
+ * before the first row is added (see dw::Table::getNumRows). The widths
+ * are only regarded for fixed layout, see "Fixed Layout" in the dw::Table
+ * documentation.
+ */
+void Table::addCol (core::style::Length width, int span)
+{
+   assert (numRows == 0);
+
+   for (int i = 0; i < span; i++) {
+      colSpecWidths->increase ();
+      colSpecWidths->set (colSpecWidths->size () - 1, width);
+   }
+
+   if (colSpecWidths->size () > numCols)
+      reallocChildren (colSpecWidths->size (), numRows);
+   queueResize (0, true);
+}
+
 TableCell *Table::getCellRef ()
 {
    core::Widget *child;
@@ -522,9 +682,8 @@ void Table::forceCalcCellSizes ()
    _MSG(" totalWidth2 = %d curCol=%d\n", totalWidth,curCol);
 
 
+   colWidthsChanged = colWidths->size () != numCols;
    colWidths->setSize (numCols, 0);
-   cumHeight->setSize (numRows + 1, 0);
-   rowSpanCells->setSize (0);
    baseline->setSize (numRows);
 
    _MSG(" extremes = %d,%d\n", extremes.minWidth, extremes.maxWidth);
@@ -532,12 +691,36 @@ void Table::forceCalcCellSizes ()
    _MSG(" getStyle()->hBorderSpacing = %d\n", getStyle()->hBorderSpacing);
 
 
-   apportion_percentages2 (totalWidth, forceTotalWidth);
-   if (!hasColPercent)
-      apportion2 (totalWidth, forceTotalWidth);
+   if (fixedLayout ()) {
+      apportionFixed (totalWidth);
+   } else {
+      apportion_percentages2 (totalWidth, forceTotalWidth);
+      if (!hasColPercent)
+         apportion2 (totalWidth, forceTotalWidth);
+   }
+
+   // Rows above sizeDirtyRow keep their heights, unless the column widths
+   // have changed, or a cell spans from there into the changed rows.
+   int startRow = colWidthsChanged ? 0 :
+      misc::max (misc::min (sizeDirtyRow, cumHeight->size () - 1), 0);
+   int numSpanCells = rowSpanCells->size ();
+   for (int c = rowSpanCells->size () - 1; c >= 0; c--) {
+      int n = rowSpanCells->get(c), row = n / numCols;
+      if (row >= startRow)
+         numSpanCells = c;
+      else if (row + children->get(n)->cell.rowspan > startRow) {
+         startRow = row;
+         numSpanCells = c;
+      }
+   }
+   rowSpanCells->setSize (numSpanCells);
+   cumHeight->setSize (numRows + 1, 0);
+   sizeDirtyRow = numRows;
+
+   _MSG(" startRow = %d\n", startRow);
 
    setCumHeight (0, 0);
-   for (int row = 0; row < numRows; row++) {
+   for (int row = startRow; row < numRows; row++) {
       /**
        * \bug dw::Table::baseline is not filled.
        */
@@ -644,6 +827,9 @@ void Table::calcColumnExtremes ()
 
 /**
  * \brief Fills dw::Table::colExtremes in all cases.
+ *
+ * Only the rows marked by dw::Table::markExtremesChange are examined, when
+ * possible; see "Incremental Calculation" in the dw::Table documentation.
  */
 void Table::forceCalcColumnExtremes ()
 {
@@ -652,90 +838,51 @@ void Table::forceCalcColumnExtremes ()
    if (numCols == 0)
       return;
 
-   colExtremes->setSize (numCols);
-   colPercents->setSize (numCols);
-   colSpanCells->setSize (0);
-   /* 1. cells with colspan = 1 */
-   for (int col = 0; col < numCols; col++) {
-      colExtremes->getRef(col)->minWidth = 0;
-      colExtremes->getRef(col)->maxWidth = 0;
-      colPercents->set(col, LEN_AUTO);
-
-      for (int row = 0; row < numRows; row++) {
-         int n = row * numCols + col;
-         if (!childDefined (n))
-            continue;
-         if (children->get(n)->cell.colspanEff == 1) {
-            core::Extremes cellExtremes;
-            int cellMinW, cellMaxW, pbm;
-            core::style::Length width =
-               children->get(n)->cell.widget->getStyle()->width;
-            pbm = (numCols + 1) * getStyle()->hBorderSpacing
-                  + children->get(n)->cell.widget->getStyle()->boxDiffWidth ();
-            children->get(n)->cell.widget->getExtremes (&cellExtremes);
-            if (core::style::isAbsLength (width)) {
-               // Fixed lengths include table padding, border and margin.
-               cellMinW = cellExtremes.minWidth;
-               cellMaxW = MAX (cellMinW,
-                               core::style::absLengthVal(width) - pbm);
-            } else {
-               cellMinW = cellExtremes.minWidth;
-               cellMaxW = cellExtremes.maxWidth;
-            }
+   if (fixedLayout ()) {
+      calcFixedColumnExtremes ();
+      return;
+   }
 
-            _MSG("FCCE, col%d colMin,colMax,cellMin,cellMax = %d,%d,%d,%d\n",
-                col,
-                colExtremes->getRef(col)->minWidth,
-                colExtremes->getRef(col)->maxWidth,
-                cellMinW, cellMaxW);
-
-            colExtremes->getRef(col)->minWidth =
-               MAX (colExtremes->getRef(col)->minWidth, cellMinW);
-            colExtremes->getRef(col)->maxWidth =
-               MAX (colExtremes->getRef(col)->minWidth, MAX (
-                    colExtremes->getRef(col)->maxWidth,
-                    cellMaxW));
-
-            // Also fill the colPercents array in this pass
-            if (core::style::isPerLength (width)) {
-               hasColPercent = 1;
-               if (colPercents->get(col) == LEN_AUTO)
-                  colPercents->set(col, core::style::perLengthVal(width));
-            } else if (core::style::isAbsLength (width)) {
-               // We treat LEN_ABS as a special case of LEN_AUTO.
-               /*
-                * if (colPercents->get(col) == LEN_AUTO)
-                *   colPercents->set(col, LEN_ABS);
-                */
-            }
-         } else {
-            colSpanCells->increase();
-            colSpanCells->set(colSpanCells->size()-1, n);
-         }
+   /* 1. cells with colspan = 1 */
+   bool all = allExtremesDirty || colBaseExtremes->size () != numCols;
+   for (int i = 0; !all && i < extremesDirtyRows->size (); i++)
+      all = !addRowExtremes (extremesDirtyRows->get (i), false);
+
+   if (all) {
+      colBaseExtremes->setSize (numCols);
+      colPercents->setSize (numCols);
+      colSpanCells->setSize (0);
+      for (int col = 0; col < numCols; col++) {
+         colBaseExtremes->getRef(col)->minWidth = 0;
+         colBaseExtremes->getRef(col)->maxWidth = 0;
+         colPercents->set(col, LEN_AUTO);
       }
+
+      for (int row = 0; row < numRows; row++)
+         addRowExtremes (row, true);
    }
 
+   _MSG("  Table::forceCalcColumnExtremes  all=%d dirtyRows=%d\n",
+        all, extremesDirtyRows->size ());
+
+   for (int i = 0; i < extremesDirtyRows->size (); i++)
+      rowExtremesDirty->set (extremesDirtyRows->get (i), false);
+   extremesDirtyRows->setSize (0);
+   allExtremesDirty = false;
+
+   colExtremes->setSize (numCols);
+   for (int col = 0; col < numCols; col++)
+      colExtremes->set (col, colBaseExtremes->get (col));
+
    /* 2. cells with colspan > 1 */
    /* If needed, here we set proportionally apportioned col maximums */
    for (int c = 0; c < colSpanCells->size(); ++c) {
       core::Extremes cellExtremes;
-      int cellMinW, cellMaxW, pbm;
       int n = colSpanCells->get(c);
       int col = n % numCols;
       int cs = children->get(n)->cell.colspanEff;
-      core::style::Length width =
-         children->get(n)->cell.widget->getStyle()->width;
-      pbm = (numCols + 1) * getStyle()->hBorderSpacing
-            + children->get(n)->cell.widget->getStyle()->boxDiffWidth ();
-      children->get(n)->cell.widget->getExtremes (&cellExtremes);
-      if (core::style::isAbsLength (width)) {
-         // Fixed lengths include table padding, border and margin.
-         cellMinW = cellExtremes.minWidth;
-         cellMaxW = MAX (cellMinW, core::style::absLengthVal(width) - pbm);
-      } else {
-         cellMinW = cellExtremes.minWidth;
-         cellMaxW = cellExtremes.maxWidth;
-      }
+      getCellExtremes (children->get(n), &cellExtremes);
+      int cellMinW = cellExtremes.minWidth, cellMaxW = cellExtremes.maxWidth;
       int minSumCols = 0, maxSumCols = 0;
       for (int i = 0; i < cs; ++i) {
          minSumCols += colExtremes->getRef(col+i)->minWidth;
@@ -830,6 +977,210 @@ void Table::forceCalcColumnExtremes ()
    }
 }
 
+/**
+ * \brief Get the extremes of a cell, as used for the column extremes.
+ */
+void Table::getCellExtremes (Child *child, core::Extremes *extremes)
+{
+   core::style::Length width = child->cell.widget->getStyle()->width;
+   int pbm = (numCols + 1) * getStyle()->hBorderSpacing
+             + child->cell.widget->getStyle()->boxDiffWidth ();
+
+   child->cell.widget->getExtremes (extremes);
+   if (core::style::isAbsLength (width)) {
+      // Fixed lengths include table padding, border and margin.
+      extremes->maxWidth =
+         MAX (extremes->minWidth, core::style::absLengthVal(width) - pbm);
+   }
+}
+
+/**
+ * \brief Add the cells of a row to dw::Table::colBaseExtremes,
+ *    dw::Table::colPercents and dw::Table::colSpanCells.
+ *
+ * With \em all set, all rows are added anew, in ascending order. Otherwise,
+ * the row has changed, and the column extremes are updated in place. This
+ * fails, when the contribution of a cell has become smaller, or a
+ * percentage width conflicts with the one used for the column; false is
+ * returned then, and all rows must be added again.
+ */
+bool Table::addRowExtremes (int row, bool all)
+{
+   for (int col = 0; col < numCols; col++) {
+      int n = row * numCols + col;
+      if (!childDefined (n))
+         continue;
+
+      Child *child = children->get (n);
+      core::style::Length width = child->cell.widget->getStyle()->width;
+      float percent = core::style::isPerLength (width) ?
+         core::style::perLengthVal (width) : (float)LEN_AUTO;
+      bool used = child->cell.extremesUsed && !all;
+      core::Extremes cellExtremes;
+
+      getCellExtremes (child, &cellExtremes);
+
+      if (child->cell.colspanEff == 1) {
+         if (used &&
+             (cellExtremes.minWidth < child->cell.usedExtremes.minWidth ||
+              cellExtremes.maxWidth < child->cell.usedExtremes.maxWidth ||
+              percent != child->cell.usedPercent))
+            return false;
+         if (!used && !all && percent >= 0.0f &&
+             colPercents->get(col) != LEN_AUTO &&
+             colPercents->get(col) != percent)
+            return false;
+
+         _MSG("FCCE, col%d colMin,colMax,cellMin,cellMax = %d,%d,%d,%d\n",
+             col,
+             colBaseExtremes->getRef(col)->minWidth,
+             colBaseExtremes->getRef(col)->maxWidth,
+             cellExtremes.minWidth, cellExtremes.maxWidth);
+
+         colBaseExtremes->getRef(col)->minWidth =
+            MAX (colBaseExtremes->getRef(col)->minWidth,
+                 cellExtremes.minWidth);
+         colBaseExtremes->getRef(col)->maxWidth =
+            MAX (colBaseExtremes->getRef(col)->minWidth, MAX (
+                 colBaseExtremes->getRef(col)->maxWidth,
+                 cellExtremes.maxWidth));
+
+         // Also fill the colPercents array in this pass
+         if (percent >= 0.0f) {
+            hasColPercent = 1;
+            if (colPercents->get(col) == LEN_AUTO)
+               colPercents->set(col, percent);
+         } else if (core::style::isAbsLength (width)) {
+            // We treat LEN_ABS as a special case of LEN_AUTO.
+            /*
+             * if (colPercents->get(col) == LEN_AUTO)
+             *   colPercents->set(col, LEN_ABS);
+             */
+         }
+      } else if (!used) {
+         // Apportioned again after each change, see forceCalcColumnExtremes.
+         colSpanCells->increase();
+         colSpanCells->set(colSpanCells->size()-1, n);
+      }
+
+      child->cell.extremesUsed = true;
+      child->cell.usedExtremes = cellExtremes;
+      child->cell.usedPercent = percent;
+   }
+
+   return true;
+}
+
+/**
+ * \brief Return the specified width of a column, for fixed layout.
+ *
+ * This is either the width passed to dw::Table::addCol, or the width of
+ * the cell in the first row; a cell spanning over multiple columns is
+ * divided equally. Only absolute and percentage lengths are returned,
+ * dw::core::style::LENGTH_AUTO otherwise.
+ */
+core::style::Length Table::getFixedColWidth (int col)
+{
+   core::style::Length width = core::style::LENGTH_AUTO;
+   int n = col;
+
+   if (col < colSpecWidths->size ())
+      width = colSpecWidths->get (col);
+
+   if (width == core::style::LENGTH_AUTO) {
+      if (n < children->size () && children->get (n) &&
+          children->get(n)->type == Child::SPAN_SPACE)
+         n = children->get(n)->spanSpace.startCol;
+      if (!childDefined (n))
+         return core::style::LENGTH_AUTO;
+
+      int cs = children->get(n)->cell.colspanEff;
+      width = children->get(n)->cell.widget->getStyle()->width;
+      if (core::style::isAbsLength (width))
+         width = core::style::createAbsLength (
+                    core::style::absLengthVal (width) / cs);
+      else if (core::style::isPerLength (width))
+         width = core::style::createPerLength (
+                    core::style::perLengthVal (width) / cs);
+   }
+
+   if (core::style::isAbsLength (width) || core::style::isPerLength (width))
+      return width;
+   else
+      return core::style::LENGTH_AUTO;
+}
+
+/**
+ * \brief Fills dw::Table::colExtremes for fixed layout.
+ *
+ * Only the absolute column widths are regarded, the cells are not
+ * examined at all.
+ */
+void Table::calcFixedColumnExtremes ()
+{
+   colExtremes->setSize (numCols);
+   for (int col = 0; col < numCols; col++) {
+      core::style::Length width = getFixedColWidth (col);
+      int w = core::style::isAbsLength (width) ?
+         core::style::absLengthVal (width) : 0;
+      colExtremes->getRef(col)->minWidth = w;
+      colExtremes->getRef(col)->maxWidth = w;
+   }
+
+   // The changed rows are of no interest here. Switching back to the auto
+   // layout needs a new style, so that dw::Table::setStyle takes care of
+   // dw::Table::colBaseExtremes.
+   for (int i = 0; i < extremesDirtyRows->size (); i++)
+      rowExtremesDirty->set (extremesDirtyRows->get (i), false);
+   extremesDirtyRows->setSize (0);
+}
+
+/**
+ * \brief Apportionment function for fixed layout.
+ *
+ * Columns with a specified width get it, the rest of \em totalWidth is
+ * divided equally among the other columns, or among all columns, if there
+ * are no others.
+ */
+void Table::apportionFixed (int totalWidth)
+{
+   int sumWidth = 0, numAutoCols = 0;
+
+   for (int col = 0; col < numCols; col++) {
+      core::style::Length width = getFixedColWidth (col);
+      if (width == core::style::LENGTH_AUTO)
+         numAutoCols++;
+      else
+         sumWidth += core::style::isAbsLength (width) ?
+            core::style::absLengthVal (width) :
+            (int)(totalWidth * core::style::perLengthVal (width));
+   }
+
+   int extraWidth = MAX (totalWidth - sumWidth, 0);
+   int numExtraCols = numAutoCols ? numAutoCols : numCols;
+
+   for (int col = 0; col < numCols; col++) {
+      core::style::Length width = getFixedColWidth (col);
+      int w = 0;
+
+      if (core::style::isAbsLength (width))
+         w = core::style::absLengthVal (width);
+      else if (core::style::isPerLength (width))
+         w = (int)(totalWidth * core::style::perLengthVal (width));
+
+      if (numAutoCols == 0 || width == core::style::LENGTH_AUTO) {
+         int d = extraWidth / numExtraCols--;
+         extraWidth -= d;
+         w += d;
+      }
+
+      setColWidth (col, w);
+   }
+
+   _MSG("apportionFixed, totalWidth=%d sumWidth=%d numAutoCols=%d\n",
+        totalWidth, sumWidth, numAutoCols);
+}
+
 /**
  * \brief Apportionment function for AUTO-length columns.
  * 'extremes' comes filled, 'result' comes defined for percentage columns.
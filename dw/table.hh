@@ -73,6 +73,44 @@ namespace dw {
  * [C] Whether this function is called, depends on NEEDS_RESIZE /
  * EXTREMES_CHANGED.
  *
+ * <h4>Incremental Calculation</h4>
+ *
+ * As for dw::Textblock, the parentRef of a cell is used for incremental
+ * resizing; here it is the row the cell starts in. dw::Table::markSizeChange
+ * and dw::Table::markExtremesChange record the changed rows, so that
+ * appending rows to a long table does not require to examine all cells
+ * again:
+ *
+ * <ul>
+ * <li> Row heights are only recalculated down from the first changed row,
+ *      unless the column widths have changed. A cell spanning over this row
+ *      moves the start up to the row of the cell.
+ *
+ * <li> Column extremes from cells with colspan = 1 are kept in
+ *      dw::Table::colBaseExtremes, and only the cells of the changed rows
+ *      are added. This is only possible, as long as the cell extremes have
+ *      not become smaller, and no percentage width has changed; otherwise,
+ *      and when the number of columns has changed, all cells are examined
+ *      again. Cells with colspan > 1 are always apportioned again, starting
+ *      from dw::Table::colBaseExtremes.
+ * </ul>
+ *
+ * <h4>Fixed Layout</h4>
+ *
+ * If the style attribute dw::core::style::StyleAttrs::tableLayout is
+ * dw::core::style::TABLE_LAYOUT_FIXED, and the table has a width (see CSS
+ * 2.1, section 17.5.2.1), the column widths do not depend on the contents
+ * of the cells. Instead, they are taken from the widths passed to
+ * dw::Table::addCol (for the HTML element \<col\>), or, if not specified
+ * there, from the widths of the cells in the first row. The remaining width
+ * is divided equally among the other columns, or among all columns, when
+ * all widths are specified.
+ *
+ * Since adding a row below the first one does neither change the column
+ * extremes nor the column widths, only the heights of the new rows have to
+ * be calculated, so that even huge tables can be rendered in linear time,
+ * while they are loaded.
+ *
  *
  * <h4>Apportionment</h4>
  *
@@ -345,6 +383,11 @@ private:
          struct {
             core::Widget *widget;
             int colspanOrig, colspanEff, rowspan;
+            // What the cell has contributed to the column extremes, see
+            // dw::Table::addRowExtremes.
+            bool extremesUsed;
+            core::Extremes usedExtremes;
+            float usedPercent;
          } cell;
          struct {
             int startCol, startRow;  // where the cell starts
@@ -386,6 +429,39 @@ private:
     */
    lout::misc::SimpleVector<core::Extremes> *colExtremes;
 
+   /**
+    * \brief The column widths specified by dw::Table::addCol, only used
+    *    for fixed layout.
+    */
+   lout::misc::SimpleVector<core::style::Length> *colSpecWidths;
+
+   /**
+    * \brief The column extremes, as far as they result from cells with
+    *    colspan = 1.
+    *
+    * Kept between calls of dw::Table::forceCalcColumnExtremes, so that
+    * they can be updated incrementally.
+    */
+   lout::misc::SimpleVector<core::Extremes> *colBaseExtremes;
+
+   /**
+    * \brief The rows containing cells, whose extremes have changed since
+    *    the last call of dw::Table::forceCalcColumnExtremes.
+    *
+    * rowExtremesDirty contains the same rows, to avoid duplicates. If
+    * allExtremesDirty is set, all rows are regarded as changed.
+    */
+   lout::misc::SimpleVector<int> *extremesDirtyRows;
+   lout::misc::BitSet *rowExtremesDirty;
+   bool allExtremesDirty;
+
+   /**
+    * \brief The first row, whose height has to be recalculated by
+    *    dw::Table::forceCalcCellSizes.
+    */
+   int sizeDirtyRow;
+   bool colWidthsChanged;
+
    /**
     * \brief The widths of all columns.
     */
@@ -417,6 +493,12 @@ private:
    int hasColPercent;
    lout::misc::SimpleVector<float> *colPercents;
 
+   inline bool fixedLayout ()
+   {
+      return getStyle()->tableLayout == core::style::TABLE_LAYOUT_FIXED &&
+         getStyle()->width != core::style::LENGTH_AUTO;
+   }
+
    inline bool childDefined(int n)
    {
       return n < children->size() && children->get(n) != NULL &&
@@ -431,6 +513,14 @@ private:
 
    void calcColumnExtremes ();
    void forceCalcColumnExtremes ();
+   void getCellExtremes (Child *child, core::Extremes *extremes);
+   bool addRowExtremes (int row, bool all);
+
+   core::style::Length getFixedColWidth (int col);
+   void calcFixedColumnExtremes ();
+   void apportionFixed (int totalWidth);
+
+   int findRowIndex (int y);
 
    void apportion2 (int totalWidth, int forceTotalWidth);
    void apportion_percentages2 (int totalWidth, int forceTotalWidth);
@@ -448,6 +538,7 @@ private:
       if (value != colWidths->get (col)) {
          redrawX = lout::misc::min<int> (redrawX, value);
          colWidths->set (col, value);
+         colWidthsChanged = true;
       }
    }
 
@@ -457,6 +548,8 @@ protected:
    void sizeAllocateImpl (core::Allocation *allocation);
    void resizeDrawImpl ();
 
+   void markSizeChange (int ref);
+   void markExtremesChange (int ref);
    void setWidth (int width);
    void setAscent (int ascent);
    void setDescent (int descent);
@@ -475,9 +568,13 @@ public:
    ~Table();
 
    core::Iterator *iterator (core::Content::Type mask, bool atEnd);
+   core::Widget *getWidgetAtPoint (int x, int y, int level);
+   void setStyle (core::style::Style *style);
 
    void addCell (Widget *widget, int colspan, int rowspan);
    void addRow (core::style::Style *style);
+   void addCol (core::style::Length width, int span);
+   inline int getNumRows () { return numRows; }
    TableCell *getCellRef ();
 };
 
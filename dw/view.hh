@@ -184,7 +184,8 @@ public:
                                        int x, int y, int w, int h,
                                        const char *text) = 0;
    virtual void drawImage (Imgbuf *imgbuf, int xRoot, int yRoot,
-                           int x, int y, int width, int height) = 0;
+                           int x, int y, int width, int height,
+                           style::Color *bgColor) = 0;
 
    /*
     * --------------
@@ -0,0 +1,177 @@
+/*
+ * File: perf.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Performance counters (see perf.h). The last PERF_PAGES page loads are
+ * kept in a ring; whatever is measured goes to the current one.
+ */
+
+#include <config.h>
+
+#ifdef ENABLE_PERF
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "perf.h"
+
+static PerfPage pages[PERF_PAGES];
+static int current = 0;   /* Index of the page being loaded in 'pages' */
+
+static const char *const names[PERF_NUM] = {
+   "DNS resolve",
+   "Connect",
+   "First byte",
+   "Bytes read",
+   "Cache queue",
+   "HTML parse",
+   "Style",
+   "Layout",
+   "Draw",
+   "Image decode"
+};
+
+/*
+ * Return the time in microseconds, from a monotonic clock if there's one.
+ */
+int64_t a_Perf_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+   struct timespec ts;
+
+   if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+      return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Add a measured time to the current page load.
+ */
+void a_Perf_add(PerfId id, int64_t usec)
+{
+   PerfPage *page = &pages[current];
+   PerfStat *stat = &page->stat[id];
+
+   stat->count++;
+   stat->usec += usec;
+   if (usec > stat->max)
+      stat->max = usec;
+   page->last = a_Perf_now();
+}
+
+/*
+ * Add 'n' to a counter of the current page load.
+ */
+void a_Perf_count(PerfId id, int n)
+{
+   pages[current].stat[id].count += n;
+}
+
+/*
+ * Add the decoding time of an image to the current page load, which
+ * keeps those of its PERF_IMAGES slowest images.
+ */
+void a_Perf_image(const char *url, int64_t usec)
+{
+   PerfPage *page = &pages[current];
+   int i;
+
+   a_Perf_add(PERF_IMAGE_DECODE, usec);
+
+   for (i = page->num_images; i > 0 && page->image[i - 1].usec < usec; --i)
+      ;
+   if (i == PERF_IMAGES)
+      return;
+   if (page->num_images == PERF_IMAGES)
+      free(page->image[--page->num_images].url);
+   memmove(&page->image[i + 1], &page->image[i],
+           (page->num_images - i) * sizeof(PerfImage));
+   page->image[i].url = strdup(url);
+   page->image[i].usec = usec;
+   page->num_images++;
+}
+
+/*
+ * Note a moment of the current page load. The paint and layout ones only
+ * count once its widget is set, and the paint one only the first time.
+ */
+void a_Perf_mark(PerfMark mark)
+{
+   PerfPage *page = &pages[current];
+
+   if (!page->url ||
+       (mark != PERF_MARK_WIDGET && !page->mark[PERF_MARK_WIDGET]) ||
+       (mark == PERF_MARK_PAINT && page->mark[PERF_MARK_PAINT]))
+      return;
+   page->mark[mark] = a_Perf_now();
+}
+
+/*
+ * Free the data of a page load, and clear it.
+ */
+static void Perf_page_free(PerfPage *page)
+{
+   int i;
+
+   free(page->url);
+   for (i = 0; i < page->num_images; ++i)
+      free(page->image[i].url);
+   memset(page, 0, sizeof(PerfPage));
+}
+
+/*
+ * A new page load starts: what's measured from now on goes to it.
+ */
+void a_Perf_page_start(const char *url)
+{
+   current = (current + 1) % PERF_PAGES;
+   Perf_page_free(&pages[current]);
+   pages[current].url = strdup(url);
+   pages[current].start = pages[current].last = a_Perf_now();
+}
+
+/*
+ * Return the n-th last page load (0 is the current one), or NULL.
+ */
+const PerfPage *a_Perf_page(int n)
+{
+   const PerfPage *page;
+
+   if (n < 0 || n >= PERF_PAGES)
+      return NULL;
+   page = &pages[(current - n + PERF_PAGES) % PERF_PAGES];
+   return (page->url) ? page : NULL;
+}
+
+/*
+ * Return a name for what's measured.
+ */
+const char *a_Perf_name(PerfId id)
+{
+   return names[id];
+}
+
+/*
+ * Free the page loads.
+ */
+void a_Perf_freeall(void)
+{
+   int i;
+
+   for (i = 0; i < PERF_PAGES; ++i)
+      Perf_page_free(&pages[i]);
+}
+
+#endif /* ENABLE_PERF */
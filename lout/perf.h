@@ -0,0 +1,112 @@
+#ifndef __LOUT_PERF_H__
+#define __LOUT_PERF_H__
+
+/*
+ * Performance counters: time spent at a few key points, aggregated per
+ * page load, and shown on the about:perf page.
+ *
+ * It's all compiled in with ENABLE_PERF only (configure --enable-perf);
+ * otherwise, the PERF_* macros expand to nothing. As dw and src use it,
+ * it lives here, with a C interface, and is meant for the main thread.
+ */
+
+#ifdef ENABLE_PERF
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* What's measured (the times include those of the nested ones) */
+typedef enum {
+   PERF_DNS,            /* From the DNS query to its answer */
+   PERF_CONNECT,        /* From connecting to the query being sent */
+   PERF_FIRST_BYTE,     /* From connecting to the first byte read */
+   PERF_NET_READ,       /* Bytes read (a counter) */
+   PERF_CACHE_QUEUE,    /* Cache_process_queue() */
+   PERF_HTML_WRITE,     /* Html_write_raw() */
+   PERF_STYLE,          /* StyleEngine::style0() */
+   PERF_RESIZE,         /* Layout::resizeIdle() */
+   PERF_DRAW,           /* Layout::draw() */
+   PERF_IMAGE_DECODE,   /* Image decoders */
+   PERF_NUM
+} PerfId;
+
+/* Moments of a page load (the first paint and the last layout of its
+ * widget) */
+typedef enum {
+   PERF_MARK_WIDGET,    /* The page's widget is set */
+   PERF_MARK_PAINT,     /* It is drawn for the first time */
+   PERF_MARK_LAYOUT,    /* It is laid out (the last time) */
+   PERF_MARK_NUM
+} PerfMark;
+
+/* Number of page loads kept, and of slowest images kept for each one */
+#define PERF_PAGES   8
+#define PERF_IMAGES  10
+
+typedef struct {
+   int count;           /* Times measured (or total, for a counter) */
+   int64_t usec, max;   /* Total and longest time */
+} PerfStat;
+
+typedef struct {
+   char *url;
+   int64_t usec;        /* Decoding time */
+} PerfImage;
+
+typedef struct {
+   char *url;           /* The page's */
+   int64_t start, last; /* When it started, and the last thing measured */
+   PerfStat stat[PERF_NUM];
+   PerfImage image[PERF_IMAGES];   /* Slowest first */
+   int num_images;
+   int64_t mark[PERF_MARK_NUM];    /* When they happened (or 0) */
+} PerfPage;
+
+int64_t a_Perf_now(void);
+void a_Perf_add(PerfId id, int64_t usec);
+void a_Perf_count(PerfId id, int n);
+void a_Perf_image(const char *url, int64_t usec);
+void a_Perf_mark(PerfMark mark);
+void a_Perf_page_start(const char *url);
+const PerfPage *a_Perf_page(int n);
+const char *a_Perf_name(PerfId id);
+void a_Perf_freeall(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#  define PERF_TIMER(t)           int64_t t
+#  define PERF_START(t)           ((t) = a_Perf_now())
+#  define PERF_STOP(id, t)        a_Perf_add((id), a_Perf_now() - (t))
+/* For a start time that's measured against only once (cleared then) */
+#  define PERF_STOP_ONCE(id, t)                         \
+   do {                                                 \
+      if (t) {                                          \
+         a_Perf_add((id), a_Perf_now() - (t));          \
+         (t) = 0;                                       \
+      }                                                 \
+   } while (0)
+#  define PERF_COUNT(id, n)       a_Perf_count((id), (n))
+/* For a time measured in parts, until it's reported */
+#  define PERF_ACCUM(sum, t)      ((sum) += a_Perf_now() - (t))
+#  define PERF_IMAGE(url, usec)   a_Perf_image((url), (usec))
+#  define PERF_MARK(mark)         a_Perf_mark(mark)
+
+#else /* ENABLE_PERF */
+
+#  define PERF_TIMER(t)
+#  define PERF_START(t)           ((void) 0)
+#  define PERF_STOP(id, t)        ((void) 0)
+#  define PERF_STOP_ONCE(id, t)   ((void) 0)
+#  define PERF_COUNT(id, n)       ((void) 0)
+#  define PERF_ACCUM(sum, t)      ((void) 0)
+#  define PERF_IMAGE(url, usec)   ((void) 0)
+#  define PERF_MARK(mark)         ((void) 0)
+
+#endif /* ENABLE_PERF */
+
+#endif /* __LOUT_PERF_H__ */
@@ -24,6 +24,7 @@
 
 #include "dlib/dfcntl.h"
 #include "dlib/dsock.h"
+#include "lout/perf.h"
 
 /*
  * Symbolic defines for shutdown() function
@@ -41,6 +42,9 @@ typedef struct {
    int Flags;             /* Flag array (look definitions above) */
    int Status;            /* errno code */
    Dstr *Buf;             /* Internal buffer */
+#ifdef ENABLE_PERF
+   int64_t Submitted;     /* When it was submitted (until measured) */
+#endif
 
    void *Info;            /* CCC Info structure for this IO */
 } IOData_t;
@@ -203,6 +207,8 @@ static bool_t IO_read(IOData_t *io)
    }
 
    if (io->Buf->len > 0) {
+      PERF_STOP_ONCE(PERF_FIRST_BYTE, io->Submitted);
+      PERF_COUNT(PERF_NET_READ, io->Buf->len);
       /* send what we've got so far */
       a_IO_ccc(OpSend, 2, FWD, io->Info, io, NULL);
    }
@@ -258,6 +264,8 @@ static bool_t IO_write(IOData_t *io)
          break;
       }
    }
+   if (io->Buf->len == 0 && io->Status == 0)
+      PERF_STOP_ONCE(PERF_CONNECT, io->Submitted);
 
    return ret;
 }
@@ -332,6 +340,7 @@ static void IO_submit(IOData_t *r_io)
 
    /* Insert this IO in ValidIOs */
    IO_ins(r_io);
+   PERF_START(r_io->Submitted);
 
    _MSG("IO_submit:: (%s) FD = %d\n",
         (r_io->Op == IORead) ? "IORead" : "IOWrite", r_io->FD);
@@ -29,12 +29,13 @@
  * Exported functions
  */
 /* Note: a_IO_ccc() is defined in Url.h together with the *_ccc() set */
+Dstr *a_About_perf(void);
 
 
 /*
  * Exported data
  */
-extern const char *AboutSplash;
+extern const char *const AboutSplash;
 
 
 #endif /* __IO_H__ */
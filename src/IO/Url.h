@@ -27,6 +27,18 @@ void a_IO_ccc   (int Op, int Branch, int Dir, ChainLink *Info,
 void a_Dpi_ccc  (int Op, int Branch, int Dir, ChainLink *Info,
                  void *Data1, void *Data2);
 
+#ifdef ENABLE_PERF
+int a_Replay_record_init(const char *filename);
+int a_Replay_play_init(const char *filename, float scale);
+int a_Replay_playing(void);
+void a_Replay_record_start(const DilloUrl *url);
+void a_Replay_record_data(const DilloUrl *url, const char *buf, size_t size);
+void a_Replay_record_end(const DilloUrl *url, int complete);
+void a_Replay_freeall(void);
+void a_Replay_ccc(int Op, int Branch, int Dir, ChainLink *Info,
+                  void *Data1, void *Data2);
+#endif /* ENABLE_PERF */
+
 
 #ifdef __cplusplus
 }
@@ -12,6 +12,10 @@
 
 #include <config.h>
 
+#include "IO.h"
+#include "../misc.h"
+#include "../../lout/perf.h"
+
 /*
  * HTML text for startup screen
  */
@@ -69,3 +73,121 @@ const char *const AboutSplash=
 "<div>&nbsp;</div>\n"
 "</body>\n"
 "</html>";
+
+/*
+ * Print a time in milliseconds.
+ */
+#ifdef ENABLE_PERF
+static void About_perf_ms(Dstr *ds, int64_t usec)
+{
+   dStr_sprintfa(ds, "%d.%03d", (int)(usec / 1000), (int)(usec % 1000));
+}
+
+/*
+ * Print a table cell with a time in milliseconds.
+ */
+static void About_perf_ms_cell(Dstr *ds, int64_t usec)
+{
+   dStr_append(ds, "<td align='right'>");
+   About_perf_ms(ds, usec);
+   dStr_append(ds, "</td>");
+}
+
+/*
+ * Print when a moment of a page load happened, if it did.
+ */
+static void About_perf_mark(Dstr *ds, const PerfPage *page, PerfMark mark)
+{
+   if (page->mark[mark]) {
+      About_perf_ms(ds, page->mark[mark] - page->start);
+      dStr_append(ds, " ms");
+   } else {
+      dStr_append(ds, "not yet");
+   }
+}
+
+/*
+ * Print a URL, with the characters that HTML minds escaped as %XX.
+ */
+static void About_perf_url(Dstr *ds, const char *url)
+{
+   char *esc_url = a_Misc_escape_chars(url, "<>&'\"");
+
+   dStr_append(ds, esc_url);
+   dFree(esc_url);
+}
+#endif /* ENABLE_PERF */
+
+/*
+ * Return the HTML text for about:perf: what the performance counters
+ * measured for each of the last page loads.
+ */
+Dstr *a_About_perf(void)
+{
+   Dstr *ds = dStr_new(
+"<!DOCTYPE HTML PUBLIC '-//W3C//DTD HTML 4.01 Transitional//EN'>\n"
+"<html>\n<head>\n<title>Performance counters</title>\n</head>\n"
+"<body bgcolor='white' text='black' link='#0000c0' alink='#c00000' "
+"vlink='#800080'>\n<h1>Performance counters</h1>\n");
+
+#ifdef ENABLE_PERF
+   const PerfPage *page;
+   int i, j;
+
+   dStr_append(ds,
+"<p>Times are in milliseconds. They include those of what's done within\n"
+"(parsing includes styling, for instance), and whatever else was loading\n"
+"meanwhile is counted in too.\n");
+
+   for (i = 0; (page = a_Perf_page(i)); ++i) {
+      dStr_append(ds, "<h2>");
+      About_perf_url(ds, page->url);
+      dStr_append(ds, "</h2>\n<p>First paint at ");
+      About_perf_mark(ds, page, PERF_MARK_PAINT);
+      dStr_append(ds, ", last layout at ");
+      About_perf_mark(ds, page, PERF_MARK_LAYOUT);
+      dStr_append(ds, ", last activity at ");
+      About_perf_ms(ds, page->last - page->start);
+      dStr_append(ds, " ms.\n"
+"<table border='1' cellpadding='3' cellspacing='0'>\n"
+"<tr bgcolor='#d3d3d3'><th align='left'>What</th><th>Count</th>"
+"<th>Total</th><th>Longest</th></tr>\n");
+      for (j = 0; j < PERF_NUM; ++j) {
+         const PerfStat *stat = &page->stat[j];
+         dStr_sprintfa(ds, "<tr><td>%s</td><td align='right'>%d</td>",
+                       a_Perf_name(j), stat->count);
+         if (j == PERF_NET_READ) {
+            dStr_append(ds, "<td></td><td></td>");
+         } else {
+            About_perf_ms_cell(ds, stat->usec);
+            About_perf_ms_cell(ds, stat->max);
+         }
+         dStr_append(ds, "</tr>\n");
+      }
+      dStr_append(ds, "</table>\n");
+
+      if (page->num_images) {
+         dStr_append(ds,
+"<p>Slowest images to decode:\n"
+"<table border='1' cellpadding='3' cellspacing='0'>\n");
+         for (j = 0; j < page->num_images; ++j) {
+            dStr_append(ds, "<tr><td>");
+            About_perf_url(ds, page->image[j].url);
+            dStr_append(ds, "</td>");
+            About_perf_ms_cell(ds, page->image[j].usec);
+            dStr_append(ds, "</tr>\n");
+         }
+         dStr_append(ds, "</table>\n");
+      }
+   }
+   if (i == 0)
+      dStr_append(ds, "<p>No page has been loaded yet.\n");
+#else
+   dStr_append(ds,
+"<p>This build has no performance counters; configure it with\n"
+"<code>--enable-perf</code> to have them.\n");
+#endif /* ENABLE_PERF */
+
+   dStr_append(ds, "</body>\n</html>");
+   return ds;
+}
@@ -38,6 +38,7 @@
 
 #include "../../dlib/dsock.h"
 #include "../../dlib/dfcntl.h"
+#include "../../lout/perf.h"
 
 /* Used to send a message to the bw's status bar */
 #define MSG_BW(web, root, ...)                                        \
@@ -62,6 +63,9 @@ typedef struct {
    int Err;                /* Holds the errno of the connect() call */
    ChainLink *Info;        /* Used for CCC asynchronous operations */
    char *connected_to;     /* Used for per-host connection limit */
+#ifdef ENABLE_PERF
+   int64_t DnsStart;       /* When the DNS query was made */
+#endif
 } SocketData_t;
 
 /* Data structures and functions to queue sockets that need to be
@@ -666,6 +670,7 @@ static void Http_dns_cb(int Status, Dlist *addr_list, void *data)
 
    S = a_Klist_get_data(ValidSocks, SKey);
    if (S) {
+      PERF_STOP(PERF_DNS, S->DnsStart);
       if (!a_Web_valid(S->web)) {
          a_Chain_bfcb(OpAbort, S->Info, NULL, "Both");
          dFree(S->Info);
@@ -727,6 +732,7 @@ static int Http_get(ChainLink *Info, void *Data1)
 
    /* Let the DNS engine resolve the hostname, and when done,
     * we'll try to connect the socket from the callback function */
+   PERF_START(S->DnsStart);
    a_Dns_resolve(hostname, Http_dns_cb, Info->LocalKey);
 
    dFree(hostname);
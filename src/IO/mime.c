@@ -11,6 +11,7 @@
 
 #include "mime.h"
 #include "../list.h"
+#include "../dicache.h"
 
 
 typedef struct {
@@ -95,18 +96,14 @@ static Viewer_t Mime_major_type_fetch(const char *Key, uint_t Size)
  */
 void a_Mime_init()
 {
-#ifdef ENABLE_GIF
-   Mime_add_minor_type("image/gif", a_Dicache_gif_image);
-#endif
-#ifdef ENABLE_JPEG
-   Mime_add_minor_type("image/jpeg", a_Dicache_jpeg_image);
-   Mime_add_minor_type("image/pjpeg", a_Dicache_jpeg_image);
-   Mime_add_minor_type("image/jpg", a_Dicache_jpeg_image);
-#endif
-#ifdef ENABLE_PNG
-   Mime_add_minor_type("image/png", a_Dicache_png_image);
-   Mime_add_minor_type("image/x-png", a_Dicache_png_image);    /* deprecated */
-#endif
+   const DilloImgDecoder *dec;
+   int i, j;
+
+   /* The image types there are decoders for */
+   for (i = 0; (dec = a_Dicache_get_decoder(i)); ++i)
+      for (j = 0; dec->mime_types[j]; ++j)
+         Mime_add_minor_type(dec->mime_types[j], a_Dicache_image);
+
    Mime_add_minor_type("text/html", a_Html_text);
    Mime_add_minor_type("application/xhtml+xml", a_Html_text);
 
@@ -0,0 +1,600 @@
+/*
+ * File: replay.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Network record & replay, for load time benchmarks.
+ *
+ * When recording, the raw bytes read for each HTTP(S) URL are saved with
+ * the time they arrived (since the query was started) into an archive.
+ * When replaying, a_Replay_ccc stands in for a_Http_ccc: it serves those
+ * bytes through a pipe, with the recorded (or scaled) latency, so that
+ * IO, the cache and rendering work just as they do with the network.
+ * Once the pages settle, the time to first paint and to the last layout
+ * of each one is printed, and dillo quits.
+ *
+ * The archive has a "dplus-replay 1" line, and then, for each URL:
+ *    url <URL>
+ *    data <usec> <size>
+ *    <size bytes>
+ *    ...
+ *    end
+ * (when a URL is there more than once, the last one is used).
+ */
+
+#include <config.h>
+
+#ifdef ENABLE_PERF
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "IO.h"
+#include "Url.h"
+#include "iowatch.hh"
+#include "../msg.h"
+#include "../klist.h"
+#include "../web.hh"
+#include "../bw.h"
+#include "../uicmd.hh"
+#include "../timeout.hh"
+
+#include "../../dlib/dfcntl.h"
+#include "../../lout/perf.h"
+
+#define REPLAY_MAGIC       "dplus-replay 1"
+/* How often to check if the pages settled, and for how long there has to
+ * be nothing to measure */
+#define REPLAY_POLL        0.25
+#define REPLAY_SETTLE      1000000
+
+/* What's served for URLs missing from the archive */
+#define REPLAY_NOT_FOUND \
+   "HTTP/1.0 404 Not Found\r\n" \
+   "Content-Type: text/plain\r\n" \
+   "\r\n" \
+   "Not in the replay archive.\n"
+
+typedef struct {
+   int64_t usec;           /* When it was read, since the query started */
+   int size;
+   char *buf;
+} ReplayChunk_t;
+
+typedef struct {
+   char *url;
+   Dlist *chunks;
+} ReplayEntry_t;
+
+/* A URL being recorded */
+typedef struct {
+   char *url;
+   int64_t start;
+   Dstr *data;             /* Its "data" lines, as they'll be written */
+} RecordEntry_t;
+
+/* A replayed connection */
+typedef struct {
+   int Key;
+   ChainLink *Info;
+   ReplayEntry_t *entry;   /* NULL if the URL isn't in the archive */
+   int next;               /* The next chunk to be sent */
+   int64_t start;
+   int ReadFD, WriteFD;    /* The pipe (IO reads and closes ReadFD) */
+   Dstr *pending;          /* Data not written yet */
+   bool_t watched;         /* Waiting for WriteFD to be writable */
+} ReplayConn_t;
+
+/*
+ * Local data
+ */
+static FILE *RecordFile = NULL;
+static Dlist *Recording = NULL;    /* RecordEntry_t */
+static Dlist *Entries = NULL;      /* ReplayEntry_t (when replaying) */
+static Klist_t *ValidConns = NULL;
+static float Scale = 1.0;
+static int Active = 0;             /* Connections not ended yet */
+static bool_t Settling = FALSE;
+
+static void Replay_send(ReplayConn_t *conn);
+static void Replay_write_cb(int fd, void *data);
+
+
+/*
+ * Read a line into 'ds', without its newline. Return FALSE at EOF.
+ */
+static bool_t Replay_read_line(FILE *fp, Dstr *ds)
+{
+   int c;
+
+   dStr_truncate(ds, 0);
+   while ((c = getc(fp)) != EOF && c != '\n')
+      dStr_append_c(ds, c);
+   return (c != EOF || ds->len > 0);
+}
+
+/*
+ * Find the archive entry for a URL.
+ */
+static ReplayEntry_t *Replay_entry_find(const char *url)
+{
+   int i;
+   ReplayEntry_t *e;
+
+   for (i = 0; (e = dList_nth_data(Entries, i)); ++i)
+      if (strcmp(e->url, url) == 0)
+         return e;
+   return NULL;
+}
+
+/*
+ * Free the chunks of an archive entry.
+ */
+static void Replay_entry_clear(ReplayEntry_t *e)
+{
+   ReplayChunk_t *c;
+
+   while ((c = dList_nth_data(e->chunks, 0))) {
+      dList_remove_fast(e->chunks, c);
+      dFree(c->buf);
+      dFree(c);
+   }
+}
+
+/*
+ * Load the archive to replay. Return 0 on success.
+ */
+static int Replay_load(const char *filename)
+{
+   FILE *fp;
+   Dstr *line;
+   ReplayEntry_t *e = NULL;
+   ReplayChunk_t *c;
+   long long usec;
+   int size, ret = -1;
+
+   if (!(fp = fopen(filename, "rb"))) {
+      MSG_ERR("Replay: can't open %s: %s\n", filename, dStrerror(errno));
+      return -1;
+   }
+   line = dStr_new("");
+   if (!Replay_read_line(fp, line) || strcmp(line->str, REPLAY_MAGIC)) {
+      MSG_ERR("Replay: %s isn't a replay archive\n", filename);
+   } else {
+      while (Replay_read_line(fp, line)) {
+         if (!strncmp(line->str, "url ", 4)) {
+            if (!(e = Replay_entry_find(line->str + 4))) {
+               e = dNew(ReplayEntry_t, 1);
+               e->url = dStrdup(line->str + 4);
+               e->chunks = dList_new(16);
+               dList_append(Entries, e);
+            } else {
+               Replay_entry_clear(e);
+            }
+         } else if (e && sscanf(line->str, "data %lld %d", &usec, &size) == 2
+                    && size >= 0) {
+            c = dNew(ReplayChunk_t, 1);
+            c->usec = usec;
+            c->size = size;
+            c->buf = dNew(char, size + 1);
+            dList_append(e->chunks, c);
+            if (fread(c->buf, 1, size, fp) != (size_t)size)
+               break;
+         } else if (e && !strcmp(line->str, "end")) {
+            e = NULL;
+         } else {
+            break;
+         }
+      }
+      if (feof(fp) && !e)
+         ret = 0;
+      else
+         MSG_ERR("Replay: %s is corrupt\n", filename);
+   }
+   dStr_free(line, 1);
+   fclose(fp);
+   return ret;
+}
+
+/*
+ * Start recording the page loads into 'filename'. Return 0 on success.
+ */
+int a_Replay_record_init(const char *filename)
+{
+   if (!(RecordFile = fopen(filename, "wb"))) {
+      MSG_ERR("Replay: can't create %s: %s\n", filename, dStrerror(errno));
+      return -1;
+   }
+   fputs(REPLAY_MAGIC "\n", RecordFile);
+   fflush(RecordFile);
+   Recording = dList_new(8);
+   return 0;
+}
+
+/*
+ * Serve the HTTP(S) page loads from 'filename', with its latencies
+ * multiplied by 'scale'. Return 0 on success.
+ */
+int a_Replay_play_init(const char *filename, float scale)
+{
+   Entries = dList_new(32);
+   Scale = (scale > 0.0) ? scale : 0.0;
+   if (Replay_load(filename) != 0)
+      return -1;
+   MSG("Replay: %d URLs in %s\n", dList_length(Entries), filename);
+   return 0;
+}
+
+/*
+ * Whether HTTP(S) is served from an archive.
+ */
+int a_Replay_playing(void)
+{
+   return Entries != NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Find the URL being recorded.
+ */
+static RecordEntry_t *Replay_record_find(const DilloUrl *url)
+{
+   int i;
+   RecordEntry_t *r;
+
+   for (i = 0; (r = dList_nth_data(Recording, i)); ++i)
+      if (strcmp(r->url, URL_STR(url)) == 0)
+         return r;
+   return NULL;
+}
+
+/*
+ * The query for a URL is started: its times count from now.
+ */
+void a_Replay_record_start(const DilloUrl *url)
+{
+   RecordEntry_t *r;
+
+   if (!RecordFile)
+      return;
+   if (!(r = Replay_record_find(url))) {
+      r = dNew(RecordEntry_t, 1);
+      r->url = dStrdup(URL_STR(url));
+      r->data = dStr_sized_new(4096);
+      dList_append(Recording, r);
+   }
+   dStr_truncate(r->data, 0);
+   r->start = a_Perf_now();
+}
+
+/*
+ * Record the bytes just read for a URL.
+ */
+void a_Replay_record_data(const DilloUrl *url, const char *buf, size_t size)
+{
+   RecordEntry_t *r;
+
+   if (RecordFile && (r = Replay_record_find(url))) {
+      dStr_sprintfa(r->data, "data %lld %d\n",
+                    (long long)(a_Perf_now() - r->start), (int)size);
+      dStr_append_l(r->data, buf, size);
+   }
+}
+
+/*
+ * The URL is done: write it to the archive when it was read through.
+ */
+void a_Replay_record_end(const DilloUrl *url, int complete)
+{
+   RecordEntry_t *r;
+
+   if (!RecordFile || !(r = Replay_record_find(url)))
+      return;
+   if (complete) {
+      fprintf(RecordFile, "url %s\n", r->url);
+      fwrite(r->data->str, 1, r->data->len, RecordFile);
+      fputs("end\n", RecordFile);
+      fflush(RecordFile);
+   }
+   dList_remove(Recording, r);
+   dFree(r->url);
+   dStr_free(r->data, 1);
+   dFree(r);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Print when each page load was first painted and last laid out (in ms,
+ * since it started), oldest first.
+ */
+static void Replay_report(void)
+{
+   const PerfPage *page;
+   char paint[32], layout[32];
+   int n;
+
+   for (n = PERF_PAGES - 1; n >= 0; --n) {
+      if (!(page = a_Perf_page(n)))
+         continue;
+      strcpy(paint, "-");
+      strcpy(layout, "-");
+      if (page->mark[PERF_MARK_PAINT])
+         snprintf(paint, sizeof(paint), "%.1f",
+                  (page->mark[PERF_MARK_PAINT] - page->start) / 1000.0);
+      if (page->mark[PERF_MARK_LAYOUT])
+         snprintf(layout, sizeof(layout), "%.1f",
+                  (page->mark[PERF_MARK_LAYOUT] - page->start) / 1000.0);
+      printf("replay\t%s\t%s\t%s\n", page->url, paint, layout);
+   }
+   fflush(stdout);
+}
+
+/*
+ * Poll until all is served and nothing was measured for a while; then
+ * report, and quit.
+ */
+static void Replay_settle_cb(void *data)
+{
+   const PerfPage *page = a_Perf_page(0);
+   BrowserWindow *bw;
+
+   if (Active > 0 ||
+       (page && a_Perf_now() - page->last < REPLAY_SETTLE)) {
+      a_Timeout_repeat(REPLAY_POLL, Replay_settle_cb, NULL);
+      return;
+   }
+   Settling = FALSE;
+   Replay_report();
+   while ((bw = a_Bw_get(0)))
+      a_UIcmd_close_bw(bw);
+}
+
+/*
+ * Return how many chunks there are to send.
+ */
+static int Replay_num_chunks(ReplayConn_t *conn)
+{
+   return conn->entry ? dList_length(conn->entry->chunks) : 0;
+}
+
+/*
+ * Close the writing end of the pipe.
+ */
+static void Replay_close(ReplayConn_t *conn)
+{
+   if (conn->watched) {
+      a_IOwatch_remove_fd(conn->WriteFD, DIO_WRITE);
+      conn->watched = FALSE;
+   }
+   if (conn->WriteFD != -1) {
+      close(conn->WriteFD);
+      conn->WriteFD = -1;
+   }
+}
+
+/*
+ * Write the pending data, and close the pipe (so that IO gets EOF) when
+ * everything was sent.
+ */
+static void Replay_flush(ReplayConn_t *conn)
+{
+   ssize_t st;
+
+   while (conn->pending->len > 0 && conn->WriteFD != -1) {
+      st = write(conn->WriteFD, conn->pending->str, conn->pending->len);
+      if (st < 0) {
+         if (errno == EINTR)
+            continue;
+         if (errno != EAGAIN) {
+            /* The reader is gone */
+            dStr_truncate(conn->pending, 0);
+            conn->next = Replay_num_chunks(conn);
+         }
+         break;
+      }
+      dStr_erase(conn->pending, 0, st);
+   }
+
+   if (conn->pending->len > 0) {
+      if (!conn->watched) {
+         a_IOwatch_add_fd(conn->WriteFD, DIO_WRITE, Replay_write_cb,
+                          INT2VOIDP(conn->Key));
+         conn->watched = TRUE;
+      }
+   } else if (conn->next >= Replay_num_chunks(conn)) {
+      Replay_close(conn);
+   } else if (conn->watched) {
+      a_IOwatch_remove_fd(conn->WriteFD, DIO_WRITE);
+      conn->watched = FALSE;
+   }
+}
+
+/*
+ * The pipe can take more data.
+ */
+static void Replay_write_cb(int fd, void *data)
+{
+   ReplayConn_t *conn = a_Klist_get_data(ValidConns, VOIDP2INT(data));
+
+   if (conn)
+      Replay_flush(conn);
+}
+
+/*
+ * The next chunk is due.
+ */
+static void Replay_timeout_cb(void *data)
+{
+   ReplayConn_t *conn = a_Klist_get_data(ValidConns, VOIDP2INT(data));
+
+   if (conn)
+      Replay_send(conn);
+}
+
+/*
+ * Send the chunks that are due, and wait for the next one.
+ */
+static void Replay_send(ReplayConn_t *conn)
+{
+   ReplayChunk_t *c;
+   int64_t due;
+
+   while ((c = dList_nth_data(conn->entry->chunks, conn->next))) {
+      due = conn->start + (int64_t)(c->usec * Scale);
+      if (due > a_Perf_now()) {
+         a_Timeout_add((due - a_Perf_now()) / 1000000.0, Replay_timeout_cb,
+                       INT2VOIDP(conn->Key));
+         break;
+      }
+      dStr_append_l(conn->pending, c->buf, c->size);
+      conn->next++;
+   }
+   Replay_flush(conn);
+}
+
+/*
+ * Start serving a URL through a pipe, whose reading end is passed up the
+ * chain as if it were the socket.
+ */
+static ReplayConn_t *Replay_conn_new(ChainLink *Info, const DilloUrl *url)
+{
+   ReplayConn_t *conn;
+   int fds[2];
+
+   if (pipe(fds) < 0) {
+      MSG_ERR("Replay: pipe: %s\n", dStrerror(errno));
+      return NULL;
+   }
+   dFcntl(fds[1], F_SETFL, O_NONBLOCK | dFcntl(fds[1], F_GETFL));
+   dFcntl(fds[1], F_SETFD, FD_CLOEXEC | dFcntl(fds[1], F_GETFD));
+
+   conn = dNew0(ReplayConn_t, 1);
+   conn->Info = Info;
+   conn->entry = Replay_entry_find(URL_STR(url));
+   conn->start = a_Perf_now();
+   conn->ReadFD = fds[0];
+   conn->WriteFD = fds[1];
+   conn->pending = dStr_sized_new(4096);
+   conn->Key = a_Klist_insert(&ValidConns, conn);
+   Active++;
+
+   if (!conn->entry) {
+      MSG("Replay: not in the archive: %s\n", URL_STR(url));
+      dStr_append(conn->pending, REPLAY_NOT_FOUND);
+   }
+   return conn;
+}
+
+/*
+ * Stop serving, and check when the pages settle once all is served.
+ */
+static void Replay_conn_free(int Key)
+{
+   ReplayConn_t *conn = a_Klist_get_data(ValidConns, Key);
+
+   if (!conn)
+      return;
+   a_Klist_remove(ValidConns, Key);
+   a_Timeout_remove(Replay_timeout_cb, INT2VOIDP(Key));
+   Replay_close(conn);
+   dStr_free(conn->pending, 1);
+   dFree(conn);
+
+   if (--Active == 0 && !Settling) {
+      Settling = TRUE;
+      a_Timeout_add(REPLAY_POLL, Replay_settle_cb, NULL);
+   }
+}
+
+/*
+ * CCC function for the replayed HTTP query branch (it stands in for
+ * a_Http_ccc)
+ */
+void a_Replay_ccc(int Op, int Branch, int Dir, ChainLink *Info,
+                  void *Data1, void *Data2)
+{
+   int Key = VOIDP2INT(Info->LocalKey);
+   ReplayConn_t *conn;
+
+   (void)Data2; /* suppress unused parameter warning */
+
+   dReturn_if_fail( a_Chain_check("a_Replay_ccc", Op, Branch, Dir, Info) );
+
+   if (Branch == 1) {
+      if (Dir == BCK) {
+         switch (Op) {
+         case OpStart:
+            /* ( Data1 = Web ) */
+            if (!(conn = Replay_conn_new(Info, ((DilloWeb *)Data1)->url))) {
+               a_Chain_fcb(OpAbort, Info, NULL, "Both");
+               dFree(Info);
+               break;
+            }
+            Info->LocalKey = INT2VOIDP(conn->Key);
+            a_Chain_fcb(OpSend, Info, &conn->ReadFD, "FD");
+            if (conn->entry)
+               Replay_send(conn);
+            else
+               Replay_flush(conn);
+            break;
+         case OpEnd:
+         case OpAbort:
+            Replay_conn_free(Key);
+            dFree(Info);
+            break;
+         }
+      } else {  /* 1 FWD */
+         switch (Op) {
+         default:
+            MSG_WARN("Unused CCC\n");
+            break;
+         }
+      }
+   }
+}
+
+/*
+ * Deallocate memory used by replay module
+ */
+void a_Replay_freeall(void)
+{
+   ReplayEntry_t *e;
+   RecordEntry_t *r;
+
+   a_Klist_free(&ValidConns);
+   a_Timeout_remove(Replay_settle_cb, NULL);
+
+   while ((e = dList_nth_data(Entries, 0))) {
+      dList_remove_fast(Entries, e);
+      Replay_entry_clear(e);
+      dList_free(e->chunks);
+      dFree(e->url);
+      dFree(e);
+   }
+   dList_free(Entries);
+   Entries = NULL;
+
+   while ((r = dList_nth_data(Recording, 0))) {
+      dList_remove_fast(Recording, r);
+      dFree(r->url);
+      dStr_free(r->data, 1);
+      dFree(r);
+   }
+   dList_free(Recording);
+   Recording = NULL;
+   if (RecordFile) {
+      fclose(RecordFile);
+      RecordFile = NULL;
+   }
+}
+
+#endif /* ENABLE_PERF */
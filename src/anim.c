@@ -0,0 +1,294 @@
+/*
+ * File: anim.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Playback of animated images.
+ *
+ * The decoder passes the complete image after each frame, and only the
+ * area that differs from the previous one is kept, with its pixels.
+ * When the image is done, the frames are played into its root imgbuf,
+ * which redraws just the changed area; so a frame costs as much as the
+ * pixels it changes, not the size of the image. An animation pauses
+ * while its image isn't visible, and goes on when it's drawn again.
+ */
+
+#include <string.h>
+
+#include "msg.h"
+#include "list.h"
+#include "anim.h"
+#include "imgbuf.hh"
+#include "timeout.hh"
+
+/* Delays below this (in ms, often zero) mean "as fast as possible", and
+ * get the default one, as in other browsers. */
+#define ANIM_MIN_DELAY      20
+#define ANIM_DEFAULT_DELAY 100
+
+/*
+ * The change from the previous frame to this one (for the first frame,
+ * from the last one).
+ */
+typedef struct {
+   uint_t x, y, width, height;   /* Changed area (width is 0 if none) */
+   uchar_t *data;                /* Its pixels, in the imgbuf's format */
+   int delay;                    /* Time this frame is shown, in ms */
+} DilloAnimFrame;
+
+struct _DilloAnim {
+   uint_t width, height, bpp;
+   int loops;                    /* Times to repeat (0 = forever) */
+   DilloAnimFrame *frames;
+   int num_frames, num_frames_max;
+
+   /* Only while frames are added */
+   uchar_t *first, *last;        /* The first and the latest frame */
+
+   /* Only while playing */
+   void *v_imgbuf;               /* Root imgbuf (held by the dicache) */
+   int current;                  /* Frame shown */
+   int played;                   /* Times the first frame came back */
+   int ticking;                  /* A timeout is pending */
+};
+
+/*
+ * Local data
+ */
+static Dlist *Anims = NULL;      /* Animations being played */
+
+
+/*
+ * Create an animation of images of the given size, whose pixels take
+ * 'bpp' bytes (as in the imgbuf).
+ */
+DilloAnim *a_Anim_new(uint_t width, uint_t height, uint_t bpp)
+{
+   DilloAnim *anim = dNew0(DilloAnim, 1);
+
+   anim->width = width;
+   anim->height = height;
+   anim->bpp = bpp;
+   anim->num_frames_max = 4;
+   return anim;
+}
+
+/*
+ * Find the area where two complete images differ.
+ * Return value: whether there is any.
+ */
+static int Anim_diff(DilloAnim *anim, const uchar_t *a, const uchar_t *b,
+                     DilloAnimFrame *frame)
+{
+   uint_t bpp = anim->bpp, stride = anim->width * bpp;
+   uint_t y0, y1, x0, x1, y, l, r;
+
+   for (y0 = 0; y0 < anim->height; ++y0)
+      if (memcmp(a + y0 * stride, b + y0 * stride, stride))
+         break;
+   if (y0 == anim->height)
+      return 0;
+   for (y1 = anim->height; y1 > y0 + 1; --y1)
+      if (memcmp(a + (y1 - 1) * stride, b + (y1 - 1) * stride, stride))
+         break;
+
+   /* Only the columns outside of the area found so far are compared */
+   x0 = anim->width;
+   x1 = 0;
+   for (y = y0; y < y1; ++y) {
+      const uchar_t *ra = a + y * stride, *rb = b + y * stride;
+
+      for (l = 0; l < x0 && !memcmp(ra + l * bpp, rb + l * bpp, bpp); ++l) ;
+      for (r = anim->width; r > MAX(l, x1) &&
+           !memcmp(ra + (r - 1) * bpp, rb + (r - 1) * bpp, bpp); --r) ;
+      x0 = MIN(x0, l);
+      x1 = MAX(x1, r);
+   }
+
+   frame->x = x0;
+   frame->y = y0;
+   frame->width = x1 - x0;
+   frame->height = y1 - y0;
+   return 1;
+}
+
+/*
+ * Copy the pixels of the changed area out of a complete image.
+ */
+static void Anim_frame_set_data(DilloAnim *anim, DilloAnimFrame *frame,
+                                const uchar_t *image)
+{
+   uint_t y, n = frame->width * anim->bpp, stride = anim->width * anim->bpp;
+
+   frame->data = dNew(uchar_t, n * frame->height);
+   for (y = 0; y < frame->height; ++y)
+      memcpy(frame->data + y * n,
+             image + (frame->y + y) * stride + frame->x * anim->bpp, n);
+}
+
+/*
+ * Add the next frame, given as the complete image it results in, and the
+ * time it's shown, in milliseconds.
+ */
+void a_Anim_add_frame(DilloAnim *anim, const uchar_t *image, int delay)
+{
+   uint_t size = anim->width * anim->height * anim->bpp;
+   DilloAnimFrame frame;
+
+   if (delay < ANIM_MIN_DELAY)
+      delay = ANIM_DEFAULT_DELAY;
+
+   memset(&frame, 0, sizeof(frame));
+   if (!anim->first) {
+      anim->first = dNew(uchar_t, size);
+      anim->last = dNew(uchar_t, size);
+      memcpy(anim->first, image, size);
+      memcpy(anim->last, image, size);
+   } else if (!Anim_diff(anim, anim->last, image, &frame)) {
+      /* Nothing changed; the previous frame is shown longer */
+      anim->frames[anim->num_frames - 1].delay += delay;
+      return;
+   } else {
+      uint_t y, n = frame.width * anim->bpp, stride = anim->width * anim->bpp;
+
+      Anim_frame_set_data(anim, &frame, image);
+      for (y = frame.y; y < frame.y + frame.height; ++y)
+         memcpy(anim->last + y * stride + frame.x * anim->bpp,
+                image + y * stride + frame.x * anim->bpp, n);
+   }
+   frame.delay = delay;
+   a_List_add(anim->frames, anim->num_frames, anim->num_frames_max);
+   anim->frames[anim->num_frames++] = frame;
+}
+
+/*
+ * Set how many times the animation is repeated (0 means forever).
+ */
+void a_Anim_set_loops(DilloAnim *anim, int loops)
+{
+   anim->loops = MAX(loops, 0);
+}
+
+/*
+ * Finish adding frames: find the change from the last frame back to the
+ * first one.
+ * Return value: whether there is anything to animate.
+ */
+int a_Anim_finish(DilloAnim *anim)
+{
+   DilloAnimFrame *frame;
+
+   if (anim->num_frames > 1) {
+      frame = &anim->frames[0];
+      if (Anim_diff(anim, anim->last, anim->first, frame))
+         Anim_frame_set_data(anim, frame, anim->first);
+   }
+   dFree(anim->first);
+   dFree(anim->last);
+   anim->first = anim->last = NULL;
+   return anim->num_frames > 1;
+}
+
+/*
+ * Show the next frame, when the image is visible.
+ */
+static void Anim_timeout(void *data)
+{
+   DilloAnim *anim = data;
+   DilloAnimFrame *frame;
+   int next = (anim->current + 1) % anim->num_frames;
+
+   if (!a_Imgbuf_is_visible(anim->v_imgbuf) ||
+       (next == 0 && anim->loops > 0 && ++anim->played > anim->loops)) {
+      /* Paused until drawn again (see a_Anim_drawn()), or over */
+      anim->ticking = 0;
+      return;
+   }
+
+   frame = &anim->frames[next];
+   if (frame->width > 0)
+      a_Imgbuf_update_area(anim->v_imgbuf, frame->data, frame->x, frame->y,
+                           frame->width, frame->height,
+                           frame->width * anim->bpp);
+   anim->current = next;
+   a_Timeout_repeat(frame->delay / 1000.0, Anim_timeout, anim);
+}
+
+/*
+ * Start playing a finished animation in the root imgbuf that shows its
+ * first frame. The imgbuf must outlive the animation.
+ */
+void a_Anim_start(DilloAnim *anim, void *v_imgbuf)
+{
+   dReturn_if_fail(anim->num_frames > 1 && anim->v_imgbuf == NULL);
+
+   if (!Anims)
+      Anims = dList_new(8);
+   dList_append(Anims, anim);
+   anim->v_imgbuf = v_imgbuf;
+   anim->current = 0;
+   a_Imgbuf_set_animated(v_imgbuf, 1);
+   a_Timeout_add(anim->frames[0].delay / 1000.0, Anim_timeout, anim);
+   anim->ticking = 1;
+}
+
+/*
+ * The imgbuf shows the first frame again (after its data was dropped
+ * and decoded again).
+ */
+void a_Anim_rewind(DilloAnim *anim)
+{
+   anim->current = 0;
+}
+
+/*
+ * Compare function for searching an animation by imgbuf
+ */
+static int Anim_by_imgbuf_cmp(const void *v1, const void *v2)
+{
+   return ((const DilloAnim *)v1)->v_imgbuf != v2;
+}
+
+/*
+ * An animated imgbuf is being drawn: go on, if paused.
+ */
+void a_Anim_drawn(void *v_imgbuf)
+{
+   DilloAnim *anim = dList_find_custom(Anims, v_imgbuf, Anim_by_imgbuf_cmp);
+
+   if (anim && !anim->ticking &&
+       (anim->loops == 0 || anim->played <= anim->loops)) {
+      _MSG("a_Anim_drawn: resuming %p\n", anim);
+      a_Timeout_add(anim->frames[anim->current].delay / 1000.0,
+                    Anim_timeout, anim);
+      anim->ticking = 1;
+   }
+}
+
+/*
+ * Stop an animation and free it.
+ */
+void a_Anim_free(DilloAnim *anim)
+{
+   int i;
+
+   if (!anim)
+      return;
+   if (anim->v_imgbuf) {
+      if (anim->ticking)
+         a_Timeout_remove(Anim_timeout, anim);
+      a_Imgbuf_set_animated(anim->v_imgbuf, 0);
+      dList_remove(Anims, anim);
+   }
+   for (i = 0; i < anim->num_frames; ++i)
+      dFree(anim->frames[i].data);
+   dFree(anim->frames);
+   dFree(anim->first);
+   dFree(anim->last);
+   dFree(anim);
+}
@@ -0,0 +1,31 @@
+#ifndef __ANIM_H__
+#define __ANIM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "d_size.h"
+
+typedef struct _DilloAnim DilloAnim;
+
+
+/*
+ * Function prototypes
+ */
+DilloAnim *a_Anim_new(uint_t width, uint_t height, uint_t bpp);
+void a_Anim_add_frame(DilloAnim *anim, const uchar_t *image, int delay);
+void a_Anim_set_loops(DilloAnim *anim, int loops);
+int a_Anim_finish(DilloAnim *anim);
+void a_Anim_free(DilloAnim *anim);
+
+void a_Anim_start(DilloAnim *anim, void *v_imgbuf);
+void a_Anim_rewind(DilloAnim *anim);
+void a_Anim_drawn(void *v_imgbuf);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __ANIM_H__ */
@@ -170,6 +170,16 @@ void a_Bw_close_client(BrowserWindow *bw, int ClientKey)
    }
 }
 
+/*
+ * Tell whether a cache-client is still in the bw's list
+ * (i.e., its retrieval hasn't finished or been stopped yet).
+ */
+int a_Bw_has_client(BrowserWindow *bw, int ClientKey)
+{
+   return dList_find(bw->RootClients, INT2VOIDP(ClientKey)) ||
+          dList_find(bw->ImageClients, INT2VOIDP(ClientKey));
+}
+
 /*
  * Stop the active clients of this bw's top page.
  * Note: rendering stops, but the cache continues to be fed.
@@ -78,6 +78,7 @@ int a_Bw_num();
 void a_Bw_add_client(BrowserWindow *bw, int Key, int Root);
 int a_Bw_remove_client(BrowserWindow *bw, int ClientKey);
 void a_Bw_close_client(BrowserWindow *bw, int ClientKey);
+int a_Bw_has_client(BrowserWindow *bw, int ClientKey);
 void a_Bw_stop_clients(BrowserWindow *bw, int flags);
 void a_Bw_add_doc(BrowserWindow *bw, void *vdoc);
 void *a_Bw_get_current_doc(BrowserWindow *bw);
@@ -34,6 +34,7 @@
 
 #include "timeout.hh"
 #include "uicmd.hh"
+#include "../lout/perf.h"
 
 #define NULLKey 0
 
@@ -41,6 +42,8 @@
 #define MAX_INIT_BUF  1024*1024
 /* Maximum filesize for a URL, before offering a download */
 #define HUGE_FILESIZE 15*1024*1024
+/* Amount of a local file handed to the clients at a time */
+#define FILE_CHUNK    64*1024
 
 /*
  *  Local data types
@@ -57,13 +60,18 @@ typedef struct {
    Dlist *Auth;              /* Authentication fields */
    Dstr *Data;               /* Pointer to raw data */
    Dstr *UTF8Data;           /* Data after charset translation */
+   char *Map;                /* Mapped file being copied into Data */
+   size_t MapSize;           /* Size of the mapped file */
+   void *File;               /* File being read into Data (or NULL) */
    int DataRefcount;         /* Reference count */
+   int HoldCount;            /* References from a_Cache_hold_buf() */
    Decode *TransferDecoder;  /* Transfer decoder (e.g., chunked) */
    Decode *ContentDecoder;   /* Data decoder (e.g., gzip) */
    Decode *CharsetDecoder;   /* Translates text to UTF-8 encoding */
    int ExpectedSize;         /* Goal size of the HTTP transfer (0 if unknown)*/
    int TransferSize;         /* Actual length of the HTTP transfer */
    uint_t Flags;             /* See Flag Defines in cache.h */
+   int Serial;               /* Tells this entry from later ones */
 } CacheEntry_t;
 
 
@@ -82,6 +90,16 @@ static Dlist *ClientQueue;
 static Dlist *DelayedQueue;
 static uint_t DelayedQueueIdleId = 0;
 
+/* A list of the file: entries whose content is being handed to clients */
+static Dlist *FileLoads;
+static uint_t FileLoadsTimeoutId = 0;
+
+static int Cache_serial = 0;
+
+/* Entries that were replaced or removed while their data was held (see
+ * a_Cache_hold_buf); each one is freed when it's released */
+static Dlist *RetiredEntries;
+
 
 /*
  *  Forward declarations
@@ -91,6 +109,9 @@ static void Cache_delayed_process_queue(CacheEntry_t *entry);
 static void Cache_auth_entry(CacheEntry_t *entry, BrowserWindow *bw);
 static void Cache_entry_inject(const DilloUrl *Url, Dstr *data_ds);
 static void Cache_inject_file(const DilloUrl *url);
+static void Cache_ref_data(CacheEntry_t *entry);
+static void Cache_unref_data(CacheEntry_t *entry);
+static void Cache_entry_free(CacheEntry_t *entry);
 
 /*
  * Determine if two cache entries are equal (used by CachedURLs)
@@ -120,6 +141,8 @@ void a_Cache_init(void)
 {
    ClientQueue = dList_new(32);
    DelayedQueue = dList_new(32);
+   FileLoads = dList_new(8);
+   RetiredEntries = dList_new(4);
    CachedURLs = dList_new(256);
 
    /* inject the splash screen in the cache */
@@ -214,13 +237,18 @@ static void Cache_entry_init(CacheEntry_t *NewEntry, const DilloUrl *Url)
    NewEntry->Auth = NULL;
    NewEntry->Data = dStr_sized_new(8*1024);
    NewEntry->UTF8Data = NULL;
+   NewEntry->Map = NULL;
+   NewEntry->MapSize = 0;
+   NewEntry->File = NULL;
    NewEntry->DataRefcount = 0;
+   NewEntry->HoldCount = 0;
    NewEntry->TransferDecoder = NULL;
    NewEntry->ContentDecoder = NULL;
    NewEntry->CharsetDecoder = NULL;
    NewEntry->ExpectedSize = 0;
    NewEntry->TransferSize = 0;
    NewEntry->Flags = CA_IsEmpty;
+   NewEntry->Serial = ++Cache_serial;
 }
 
 /*
@@ -294,17 +322,167 @@ static void Cache_entry_inject(const DilloUrl *Url, Dstr *data_ds)
 }
 
 /*
- * Inject file:/ protocol content directly into the cache.
+ * Stop handing a file: entry's content to its clients.
+ */
+static void Cache_file_load_stop(CacheEntry_t *entry)
+{
+   dList_remove(FileLoads, entry);
+   if (entry->Map) {
+      a_File_unmap(entry->Map, entry->MapSize);
+      entry->Map = NULL;
+      entry->MapSize = 0;
+   }
+   if (entry->File) {
+      a_File_close(entry->File);
+      entry->File = NULL;
+   }
+}
+
+/*
+ * Does anybody want this entry's data?
+ */
+static int Cache_entry_has_clients(CacheEntry_t *entry)
+{
+   int i;
+   CacheClient_t *Client;
+
+   for (i = 0; (Client = dList_nth_data(ClientQueue, i)); ++i)
+      if (Client->Url == entry->Url)
+         return 1;
+   return 0;
+}
+
+/*
+ * Hand the next part of every file being loaded to its clients, as the
+ * network data is: a mapped file is copied a chunk at a time, and other
+ * files are read as their content comes. When the clients are gone, a
+ * mapped file is completed at once, and reading another one stops.
+ */
+static void Cache_file_load_cb(void *data)
+{
+   CacheEntry_t *entry;
+   int i, len, more, wanted, progress = 0;
+
+   for (i = 0; (entry = dList_nth_data(FileLoads, i)); ++i) {
+      len = entry->Data->len;
+      wanted = Cache_entry_has_clients(entry);
+      if (entry->Map) {
+         int size = (int)entry->MapSize;
+
+         dStr_append_l(entry->Data, entry->Map + len,
+                       wanted ? MIN(FILE_CHUNK, size - len) : size - len);
+         more = (entry->Data->len < size);
+      } else {
+         more = wanted && a_File_read(entry->File, entry->Data);
+      }
+
+      if (entry->Data->len > len) {
+         progress = 1;
+         entry->TransferSize = entry->Data->len;
+         entry->Flags &= ~CA_IsEmpty;
+         if (entry->CharsetDecoder && entry->UTF8Data) {
+            Dstr *dstr = a_Decode_process(entry->CharsetDecoder,
+                                          entry->Data->str + len,
+                                          entry->Data->len - len);
+            dStr_append_l(entry->UTF8Data, dstr->str, dstr->len);
+            dStr_free(dstr, 1);
+         }
+      }
+
+      if (!more) {
+         Cache_file_load_stop(entry);
+         --i; /* Keep the index value in the next iteration */
+         dStr_fit(entry->Data);
+         entry->Flags |= CA_GotData;
+         if ((entry = Cache_process_queue(entry)))
+            Cache_unref_data(entry);
+      } else if (entry->Data->len > len) {
+         Cache_process_queue(entry);
+      }
+   }
+
+   if (dList_length(FileLoads) == 0) {
+      FileLoadsTimeoutId = 0;
+   } else {
+      /* (don't spin on files that are waiting for their writer) */
+      a_Timeout_repeat(progress ? 0.0 : 0.1, Cache_file_load_cb, NULL);
+   }
+}
+
+/*
+ * Free an entry that has left the cache, or keep it (out of the cache)
+ * while its data is held.
+ */
+static void Cache_entry_retire(CacheEntry_t *entry)
+{
+   if (entry->HoldCount > 0)
+      dList_append(RetiredEntries, entry);
+   else
+      Cache_entry_free(entry);
+}
+
+/*
+ * Replace an entry with a new one (which has a new serial number), for new
+ * content. The clients that are still waiting move to the new entry.
+ */
+static CacheEntry_t *Cache_entry_renew(CacheEntry_t *old)
+{
+   CacheEntry_t *entry;
+   CacheClient_t *Client;
+   int i;
+
+   dList_remove(DelayedQueue, old);
+   dList_remove(CachedURLs, old);
+   a_Dicache_invalidate_entry(old->Url);
+
+   entry = Cache_entry_add(old->Url);
+   for (i = 0; (Client = dList_nth_data(ClientQueue, i)); ++i)
+      if (Client->Url == old->Url)
+         Client->Url = entry->Url;
+   Cache_entry_retire(old);
+   return entry;
+}
+
+/*
+ * Inject file:/ protocol content into the cache. A regular file is copied
+ * from a mapping instead of being read, and its content is handed to the
+ * clients bit by bit from Cache_file_load_cb(), as any other file's, so
+ * that big files don't hold up the browser.
  */
 static void Cache_inject_file(const DilloUrl *url)
 {
    const char *url_str = URL_STR(url);
-   const char *content_type = a_File_content_type(url_str);
-   void *file = a_File_open(url_str);
+   const char *content_type;
+   CacheEntry_t *entry = Cache_entry_search(url);
+   void *file;
+
+   if (entry && dList_find(FileLoads, entry))
+      return;   /* it's being loaded; the new client just joins in */
+
+   content_type = a_File_content_type(url_str);
+   file = a_File_open(url_str);
+   /* (the old data may still be in use, so it's left alone) */
+   entry = entry ? Cache_entry_renew(entry) : Cache_entry_add(url);
 
-   Cache_entry_inject(url, a_File_read(file));
+   if ((entry->Map = a_File_map(file, &entry->MapSize))) {
+      dStr_free(entry->Data, 1);
+      entry->Data = dStr_sized_new((int)entry->MapSize + 1);
+      entry->ExpectedSize = (int)entry->MapSize;
+      entry->Flags |= CA_GotLength;
+      a_File_close(file);
+   } else {
+      entry->File = file;
+   }
+   entry->Flags |= CA_GotHeader + CA_InternalUrl;
    a_Cache_set_content_type(url, content_type, "http");
-   a_File_close(file);
+
+   /* Hold the data while it's being loaded, as a connection does */
+   Cache_ref_data(entry);
+   dList_append(FileLoads, entry);
+   if (FileLoadsTimeoutId == 0) {
+      a_Timeout_add(0.0, Cache_file_load_cb, NULL);
+      FileLoadsTimeoutId = 1;
+   }
 }
 
 /*
@@ -332,6 +510,7 @@ static void Cache_entry_free(CacheEntry_t *entry)
    dStr_free(entry->Header, TRUE);
    a_Url_free((DilloUrl *)entry->Location);
    Cache_auth_free(entry->Auth);
+   Cache_file_load_stop(entry);
    dStr_free(entry->Data, 1);
    dStr_free(entry->UTF8Data, 1);
    if (entry->CharsetDecoder)
@@ -374,7 +553,7 @@ static void Cache_entry_remove(CacheEntry_t *entry, DilloUrl *url)
 
    /* remove from cache */
    dList_remove(CachedURLs, entry);
-   Cache_entry_free(entry);
+   Cache_entry_retire(entry);
 }
 
 /*
@@ -415,6 +594,11 @@ int a_Cache_open_url(void *web, CA_Callback_t Call, void *CbData)
       /* inject the file contents into the cache (putting this
        * here lets us avoid exposing the cache injection function) */
       Cache_inject_file(Url);
+   } else if (!strcmp(URL_STR(Url), "about:perf")) {
+      /* it's made anew every time it's opened */
+      Dstr *ds = a_About_perf();
+      Cache_entry_inject(Url, ds);
+      dStr_free(ds, 1);
    }
 
    if ((entry = Cache_entry_search(Url))) {
@@ -600,6 +784,78 @@ void a_Cache_unref_buf(const DilloUrl *Url)
    Cache_unref_data(Cache_entry_search_with_redirect(Url));
 }
 
+/*
+ * Reference the data buffer until a_Cache_release_buf() (as for a view of
+ * it). When the entry is removed or replaced meanwhile (e.g., to reload
+ * it), it's kept until then, and a_Cache_get_held_buf() still finds it.
+ * Return: the serial number of the entry (0 if not cached).
+ */
+int a_Cache_hold_buf(const DilloUrl *Url)
+{
+   CacheEntry_t *entry = Cache_entry_search_with_redirect(Url);
+
+   if (!entry)
+      return 0;
+   Cache_ref_data(entry);
+   entry->HoldCount++;
+   return entry->Serial;
+}
+
+/*
+ * Find a held entry: the URL's current one, or a retired one.
+ */
+static CacheEntry_t *Cache_entry_held(const DilloUrl *Url, int Serial)
+{
+   CacheEntry_t *entry = Cache_entry_search_with_redirect(Url);
+   int i;
+
+   if (entry && entry->Serial == Serial)
+      return entry;
+   for (i = 0; (entry = dList_nth_data(RetiredEntries, i)); ++i)
+      if (entry->Serial == Serial)
+         return entry;
+   return NULL;
+}
+
+/*
+ * Get the data buffer held by a_Cache_hold_buf() (which may no longer be
+ * the URL's current one), and its size.
+ * Return: 1 if found, 0 otherwise.
+ */
+int a_Cache_get_held_buf(const DilloUrl *Url, int Serial,
+                         char **PBuf, int *BufSize)
+{
+   CacheEntry_t *entry = Cache_entry_held(Url, Serial);
+   Dstr *data;
+
+   if (!entry) {
+      *PBuf = NULL;
+      *BufSize = 0;
+      return 0;
+   }
+   data = Cache_data(entry);
+   *PBuf = data->str;
+   *BufSize = data->len;
+   return 1;
+}
+
+/*
+ * Drop the reference taken by a_Cache_hold_buf(); a retired entry is freed
+ * when nobody holds it anymore.
+ */
+void a_Cache_release_buf(const DilloUrl *Url, int Serial)
+{
+   CacheEntry_t *entry = Cache_entry_held(Url, Serial);
+
+   if (!entry)
+      return;
+   Cache_unref_data(entry);
+   if (--entry->HoldCount == 0 && dList_find(RetiredEntries, entry)) {
+      dList_remove(RetiredEntries, entry);
+      Cache_entry_free(entry);
+   }
+}
+
 
 /*
  * Extract a single field from the header, allocating and storing the value
@@ -1077,17 +1333,26 @@ static void Cache_null_client(int Op, CacheClient_t *Client)
 typedef struct {
    BrowserWindow *bw;
    DilloUrl *url;
+   bool_t live;      /* The entry is kept (and maybe still transferring) */
 } Cache_savelink_t;
 
 /*
  * Save link from behind a timeout so that Cache_process_queue() can
  * get on with its work.
+ * A live entry gets saved from the cache (with what's already there
+ * written at once), so it's only dropped if the user doesn't save it.
  */
 static void Cache_savelink_cb(void *vdata)
 {
    Cache_savelink_t *data = (Cache_savelink_t*) vdata;
+   CacheEntry_t *entry;
 
    a_UIcmd_save_link(data->bw, data->url);
+   if (data->live && (entry = Cache_entry_search(data->url)) &&
+       !Cache_entry_has_clients(entry)) {
+      a_Capi_conn_abort_by_url(data->url);
+      Cache_entry_remove(NULL, data->url);
+   }
    a_Url_free(data->url);
    dFree(data);
 }
@@ -1117,6 +1382,7 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
    bool_t AbortEntry = FALSE;
    bool_t OfferDownload = FALSE;
    bool_t TypeMismatch = FALSE;
+   PERF_TIMER(t);
 
    if (Busy)
       MSG_ERR("FATAL!: >>>> Cache_process_queue Caught busy!!! <<<<\n");
@@ -1139,6 +1405,7 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
    }
 
    Busy = TRUE;
+   PERF_START(t);
    for (i = 0; (Client = dList_nth_data(ClientQueue, i)); ++i) {
       if (Client->Url == entry->Url) {
          ClientWeb = Client->Web;    /* It was a (void*) */
@@ -1241,7 +1508,15 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
       }
    } /* for */
 
-   if (AbortEntry) {
+   if (AbortEntry && OfferDownload && prefs.download_from_cache &&
+       !(entry->Flags & CA_HugeFile) && a_Cache_download_enabled(entry->Url)) {
+      /* Let the transfer go on, and offer to save the entry */
+      Cache_savelink_t *data = dNew(Cache_savelink_t, 1);
+      data->bw = Client_bw;
+      data->url = a_Url_dup(entry->Url);
+      data->live = TRUE;
+      a_Timeout_add(0.0, Cache_savelink_cb, data);
+   } else if (AbortEntry) {
       /* Abort the entry, remove it from cache, and maybe offer download. */
       DilloUrl *url = a_Url_dup(entry->Url);
       a_Capi_conn_abort_by_url(url);
@@ -1253,6 +1528,7 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
             Cache_savelink_t *data = dNew(Cache_savelink_t, 1);
             data->bw = Client_bw;
             data->url = a_Url_dup(url);
+            data->live = FALSE;
             a_Timeout_add(0.0, Cache_savelink_cb, data);
          }
       }
@@ -1267,6 +1543,7 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
       a_Dicache_cleanup();
    }
 
+   PERF_STOP(PERF_CACHE_QUEUE, t);
    Busy = FALSE;
    _MSG("QueueSize ====> %d\n", dList_length(ClientQueue));
    return entry;
@@ -1352,6 +1629,8 @@ void a_Cache_stop_client(int Key)
       Cache_client_dequeue(Client, NULLKey);
 
    } else {
+      /* It may be waiting for an image decoding thread */
+      a_Dicache_stop_client(Key);
       _MSG("WARNING: Cache_stop_client, nonexistent client\n");
    }
 }
@@ -1376,4 +1655,15 @@ void a_Cache_freeall(void)
    }
    /* Remove the cache list */
    dList_free(CachedURLs);
+
+   while ((data = dList_nth_data(RetiredEntries, 0))) {
+      dList_remove_fast(RetiredEntries, data);
+      Cache_entry_free(data);
+   }
+   dList_free(RetiredEntries);
+
+   /* (the entries are gone, so no file is being loaded) */
+   if (FileLoadsTimeoutId)
+      a_Timeout_remove(Cache_file_load_cb, NULL);
+   dList_free(FileLoads);
 }
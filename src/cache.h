@@ -61,6 +61,10 @@ void a_Cache_init(void);
 int a_Cache_open_url(void *Web, CA_Callback_t Call, void *CbData);
 int a_Cache_get_buf(const DilloUrl *Url, char **PBuf, int *BufSize);
 void a_Cache_unref_buf(const DilloUrl *Url);
+int a_Cache_hold_buf(const DilloUrl *Url);
+int a_Cache_get_held_buf(const DilloUrl *Url, int Serial,
+                         char **PBuf, int *BufSize);
+void a_Cache_release_buf(const DilloUrl *Url, int Serial);
 const char *a_Cache_get_content_type(const DilloUrl *url);
 const char *a_Cache_set_content_type(const DilloUrl *url, const char *ctype,
                                      const char *from);
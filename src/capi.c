@@ -25,6 +25,7 @@
 #include "history.h"
 #include "nav.h"
 #include "uicmd.hh"
+#include "../lout/perf.h"
 
 #ifdef ENABLE_DOWNLOADS
 #  include "download.hh"
@@ -241,6 +242,13 @@ int a_Capi_open_url(DilloWeb *web, CA_Callback_t Call, void *CbData)
    reload = (!(a_Capi_get_flags(web->url) & CAPI_IsCached) ||
              (URL_FLAGS(web->url) & URL_E2EQuery));
 
+#ifdef ENABLE_PERF
+   /* a page load starts (about:perf shows the previous ones) */
+   if ((web->flags & WEB_RootUrl) && !(web->flags & WEB_Download) &&
+       dStrcasecmp(scheme, "about"))
+      a_Perf_page_start(URL_STR(web->url));
+#endif /* ENABLE_PERF */
+
    if (web->flags & WEB_Download) {
      /* download request: if cached save from cache, else
       * for http, ftp or https, call a_Download_start() */
@@ -424,6 +432,15 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             Info->LocalKey = conn;
             conn->InfoSend = Info;
             if (strcmp(conn->server, "http") == 0) {
+#ifdef ENABLE_PERF
+               if (a_Replay_playing()) {
+                  /* serve it from the replay archive */
+                  a_Chain_link_new(Info, a_Capi_ccc, BCK, a_Replay_ccc, 1, 1);
+                  a_Chain_bcb(OpStart, Info, Data2, NULL);
+                  break;
+               }
+               a_Replay_record_start(conn->url);
+#endif /* ENABLE_PERF */
                a_Chain_link_new(Info, a_Capi_ccc, BCK, a_Http_ccc, 1, 1);
                a_Chain_bcb(OpStart, Info, Data2, NULL);
 #ifdef ENABLE_SSL
@@ -512,6 +529,9 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             conn = Info->LocalKey;
             conn->InfoRecv = NULL;
             a_Chain_bcb(OpAbort, Info, NULL, NULL);
+#ifdef ENABLE_PERF
+            a_Replay_record_end(conn->url, 0);
+#endif
             /* remove the cache entry for this URL */
             a_Cache_entry_remove_by_url(conn->url);
             Capi_conn_unref(conn);
@@ -529,6 +549,9 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             if (strcmp(Data2, "send_page_2eof") == 0) {
                /* Data1 = dbuf */
                DataBuf *dbuf = Data1;
+#ifdef ENABLE_PERF
+               a_Replay_record_data(conn->url, dbuf->Buf, dbuf->Size);
+#endif
                a_Cache_process_dbuf(IORead, dbuf->Buf, dbuf->Size, conn->url);
             } else if (strcmp(Data2, "send_status_message") == 0) {
                a_UIcmd_set_msg(conn->bw, "%s", Data1);
@@ -546,6 +569,9 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             conn = Info->LocalKey;
             conn->InfoRecv = NULL;
 
+#ifdef ENABLE_PERF
+            a_Replay_record_end(conn->url, 1);
+#endif
             a_Cache_process_dbuf(IOClose, NULL, 0, conn->url);
 
             if (conn->InfoSend) {
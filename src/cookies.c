@@ -11,7 +11,20 @@
  * (at your option) any later version.
  */
 
-/* Handling of cookies takes place here. */
+/*
+ * Handling of cookies takes place here.
+ *
+ * The cookies are kept in a hash table of domain nodes, keyed by the
+ * registrable domain (e.g. "example.co.uk"), so that a request finds all
+ * of the cookies that may go to its host in one lookup; a node's cookies
+ * are sorted by path length, longest first, which is the order they are
+ * sent in. The cookiesrc rules are compiled into a trie of domain labels.
+ *
+ * cookies.txt is a journal: each change to a persistent cookie is appended
+ * to it as a line (a removal is a line that has already expired), and
+ * loading it replays them. When most of its lines are stale, it's
+ * compacted by writing the live cookies out again.
+ */
 
 #include "msg.h"
 
@@ -61,24 +74,39 @@ void a_Cookies_init(void)
 /* The maximum length of a line in the cookie file */
 #define LINE_MAXLEN 4096
 
-#define MAX_DOMAIN_COOKIES 20
+#define MAX_DOMAIN_COOKIES 50
 #define MAX_TOTAL_COOKIES 1200
 
+/* cookies.txt is compacted when it has this many lines beyond twice the
+ * number of the cookies in it */
+#define COOKIES_JOURNAL_SLACK 256
+
 typedef enum {
    COOKIE_ACCEPT,
    COOKIE_ACCEPT_SESSION,
    COOKIE_DENY
 } CookieControlAction;
 
+/*
+ * A node of the cookiesrc rules trie. The root is for the empty domain,
+ * and each node's children are for its subdomains one label longer
+ * (e.g. "com" -> "example.com").
+ */
 typedef struct {
-   CookieControlAction action;
-   char *domain;
-} CookieControl;
+   char *label;         /* Lowercase */
+   int exact;           /* Action for the domain itself (or -1) */
+   int suffix;          /* Action for its subdomains (or -1) */
+   Dlist *children;     /* Sorted by label */
+} CookieRule;
 
-typedef struct {
-   char *domain;
-   Dlist *cookies;
-} DomainNode;
+typedef struct _DomainNode DomainNode;
+
+struct _DomainNode {
+   char *domain;        /* Registrable domain (lowercase) */
+   uint_t hash;
+   Dlist *cookies;      /* Sorted by path length, longest first */
+   DomainNode *next;    /* Next node in the hash bucket */
+};
 
 typedef struct {
    char *name;
@@ -98,18 +126,20 @@ typedef struct {
 
 static Dlist *all_cookies;
 
-/* List of DomainNode. Each node holds a domain and its list of cookies */
-static Dlist *domains;
+/* Hash table of DomainNode. Each node holds a registrable domain and the
+ * list of its cookies */
+static DomainNode **domain_table;
+static uint_t domain_table_size, num_domains;
 
 /* Variables for access control */
-static CookieControl *ccontrol = NULL;
-static int num_ccontrol = 0;
-static int num_ccontrol_max = 1;
+static CookieRule *rules = NULL;
 static CookieControlAction default_action = COOKIE_ACCEPT_SESSION;
 
 static long cookies_use_counter = 0;
 static bool_t disabled;
 static FILE *file_stream;
+static bool_t journal_on = FALSE;   /* Changes go to cookies.txt */
+static int journal_lines = 0;       /* Cookie lines in cookies.txt */
 static const char *const cookies_txt_header_str =
 "# HTTP Cookie File\n"
 "# This is a generated file!  Do not edit.\n"
@@ -133,26 +163,110 @@ static int Cookie_control_init(void);
 
 static void Cookies_add_cookie(CookieData_t *cookie);
 static int Cookies_cmp(const void *a, const void *b);
+static bool_t Cookies_domain_is_ip(const char *domain);
+static uint_t Cookies_internal_dots_required(const char *host);
 
 /*
- * Compare function for searching a domain node
+ * Find the registrable domain of a domain or host name, i.e., the part
+ * the node of its cookies is keyed by (e.g. ".www.example.com" ->
+ * "example.com"). Its length goes to 'len'.
  */
-static int Domain_node_cmp(const void *v1, const void *v2)
+static const char *Cookies_domain_key(const char *domain, uint_t *len)
 {
-   const DomainNode *n1 = v1, *n2 = v2;
+   const char *p;
+   uint_t n, labels;
+
+   if (*domain == '.')
+      domain++;
+   n = strlen(domain);
+   if (n > 0 && domain[n - 1] == '.')
+      n--;
+
+   p = domain;
+   if (!Cookies_domain_is_ip(domain)) {
+      labels = Cookies_internal_dots_required(domain) + 1;
+      for (p = domain + n; p > domain; p--)
+         if (p[-1] == '.' && --labels == 0)
+            break;
+   }
+   *len = domain + n - p;
+   return p;
+}
 
-   return dStrcasecmp(n1->domain, n2->domain);
+/*
+ * Hash a domain key (FNV-1a, ignoring case).
+ */
+static uint_t Cookies_domain_hash(const char *key, uint_t len)
+{
+   uint_t i, hash = 2166136261U;
+
+   for (i = 0; i < len; i++)
+      hash = (hash ^ (uchar_t)tolower((uchar_t)key[i])) * 16777619U;
+   return hash;
+}
+
+/*
+ * Find the node for the cookies that may go to a domain or host name.
+ */
+static DomainNode *Cookies_find_node(const char *domain)
+{
+   DomainNode *node;
+   uint_t len, hash;
+   const char *key = Cookies_domain_key(domain, &len);
+
+   if (!domain_table)
+      return NULL;
+   hash = Cookies_domain_hash(key, len);
+   for (node = domain_table[hash & (domain_table_size - 1)]; node;
+        node = node->next) {
+      if (node->hash == hash && !dStrncasecmp(node->domain, key, len) &&
+          node->domain[len] == '\0')
+         return node;
+   }
+   return NULL;
 }
 
 /*
- * Compare function for searching a domain node by domain
+ * Double the size of the hash table.
  */
-static int Domain_node_by_domain_cmp(const void *v1, const void *v2)
+static void Cookies_grow_table(void)
 {
-   const DomainNode *node = v1;
-   const char *domain = v2;
+   uint_t i, size = domain_table_size * 2;
+   DomainNode **table = dNew0(DomainNode *, size), *node, *next;
+
+   for (i = 0; i < domain_table_size; i++) {
+      for (node = domain_table[i]; node; node = next) {
+         next = node->next;
+         node->next = table[node->hash & (size - 1)];
+         table[node->hash & (size - 1)] = node;
+      }
+   }
+   dFree(domain_table);
+   domain_table = table;
+   domain_table_size = size;
+}
 
-   return dStrcasecmp(node->domain, domain);
+/*
+ * Create the (empty) node for a domain's cookies.
+ */
+static DomainNode *Cookies_new_node(const char *domain)
+{
+   uint_t i, len;
+   const char *key = Cookies_domain_key(domain, &len);
+   DomainNode *node = dNew(DomainNode, 1), **bucket;
+
+   node->domain = dStrndup(key, len);
+   for (i = 0; i < len; i++)
+      node->domain[i] = tolower((uchar_t)node->domain[i]);
+   node->hash = Cookies_domain_hash(key, len);
+   node->cookies = dList_new(5);
+
+   if (++num_domains > domain_table_size)
+      Cookies_grow_table();
+   bucket = &domain_table[node->hash & (domain_table_size - 1)];
+   node->next = *bucket;
+   *bucket = node;
+   return node;
 }
 
 /*
@@ -160,7 +274,12 @@ static int Domain_node_by_domain_cmp(const void *v1, const void *v2)
  */
 static void Cookies_delete_node(DomainNode *node)
 {
-   dList_remove(domains, node);
+   DomainNode **p = &domain_table[node->hash & (domain_table_size - 1)];
+
+   while (*p != node)
+      p = &(*p)->next;
+   *p = node->next;
+   num_domains--;
    dFree(node->domain);
    dList_free(node->cookies);
    dFree(node);
@@ -230,14 +349,98 @@ static void Cookies_tm_init(struct tm *tm)
 }
 
 /*
- * Read in cookies from 'stream' (cookies.txt)
+ * Write a cookie as a line of cookies.txt, expiring at 'expires'
+ * (in seconds since the epoch).
+ */
+static void Cookies_write_line(CookieData_t *cookie, long expires)
+{
+   fprintf(file_stream, "%s\t%s\t%s\t%s\t%ld\t%s\t%s\n",
+           cookie->domain,
+           cookie->host_only ? "FALSE" : "TRUE",
+           cookie->path,
+           cookie->secure ? "TRUE" : "FALSE",
+           expires,
+           cookie->name,
+           cookie->value);
+}
+
+/*
+ * Write the persistent cookies to cookies.txt anew, dropping the journal.
+ */
+static void Cookies_compact(void)
+{
+   int i, saved = 0;
+   CookieData_t *cookie;
+   time_t now = time(NULL);
+
+   rewind(file_stream);
+   if (ftruncate(fileno(file_stream), 0) == -1)
+      MSG("Cookies: Truncate file stream failed: %s\n", dStrerror(errno));
+   fprintf(file_stream, "%s", cookies_txt_header_str);
+
+   for (i = 0; (cookie = dList_nth_data(all_cookies, i)); ++i) {
+      if (!cookie->session_only && difftime(cookie->expires_at, now) > 0) {
+         Cookies_write_line(cookie,
+                  (long)difftime(cookie->expires_at, cookies_epoch_time));
+         saved++;
+      }
+   }
+   if (fflush(file_stream) != 0)
+      MSG("Cookies: Could not write cookies.txt: %s\n", dStrerror(errno));
+   _MSG("Cookies: compacted %d lines into %d.\n", journal_lines, saved);
+   journal_lines = saved;
+}
+
+/*
+ * Compact cookies.txt when most of its lines are stale.
+ */
+static void Cookies_journal_check(void)
+{
+   int i, live = 0;
+   CookieData_t *cookie;
+
+   if (journal_lines <= COOKIES_JOURNAL_SLACK)
+      return;
+   for (i = 0; (cookie = dList_nth_data(all_cookies, i)); ++i)
+      if (!cookie->session_only)
+         live++;
+   if (journal_lines > 2 * live + COOKIES_JOURNAL_SLACK)
+      Cookies_compact();
+}
+
+/*
+ * Append a change to a persistent cookie to cookies.txt: either the cookie
+ * was set, or it was removed (which is saved as having expired already).
+ * A removed cookie must be out of the lists by now.
+ */
+static void Cookies_journal(CookieData_t *cookie, bool_t removed)
+{
+   long expires;
+
+   if (!journal_on || !file_stream || cookie->session_only)
+      return;
+
+   expires = removed ? 0 :
+             (long)difftime(cookie->expires_at, cookies_epoch_time);
+   fseek(file_stream, 0, SEEK_END);
+   Cookies_write_line(cookie, expires);
+   if (fflush(file_stream) != 0)
+      MSG("Cookies: Could not write cookies.txt: %s\n", dStrerror(errno));
+   journal_lines++;
+   Cookies_journal_check();
+}
+
+/*
+ * Read in cookies from 'stream' (cookies.txt), replaying its journal.
  */
 static void Cookies_load_cookies(FILE *stream)
 {
    char line[LINE_MAXLEN];
 
    all_cookies = dList_new(32);
-   domains = dList_new(32);
+   domain_table_size = 64;
+   domain_table = dNew0(DomainNode *, domain_table_size);
+   num_domains = 0;
 
    if (!stream)
       return;   /* no sense continuing, is there? */
@@ -269,6 +472,7 @@ static void Cookies_load_cookies(FILE *stream)
          char *line_marker = line;
          CookieData_t *cookie = dNew0(CookieData_t, 1);
 
+         journal_lines++;
          cookie->session_only = FALSE;
          cookie->domain = dStrdup(dStrsep(&line_marker, "\t"));
          piece = dStrsep(&line_marker, "\t");
@@ -316,6 +520,10 @@ static void Cookies_load_cookies(FILE *stream)
       }
    }
    MSG("Cookies loaded: %d.\n", dList_length(all_cookies));
+
+   /* From now on, changes are appended */
+   journal_on = TRUE;
+   Cookies_journal_check();
 }
 
 /*
@@ -380,14 +588,30 @@ void a_Cookies_init(void)
 }
 
 /*
- * Flush cookies to disk and free all the memory allocated.
+ * Free a cookiesrc rules (sub)trie.
+ */
+static void Cookies_free_rule(CookieRule *rule)
+{
+   int i;
+   CookieRule *child;
+
+   for (i = 0; (child = dList_nth_data(rule->children, i)); ++i)
+      Cookies_free_rule(child);
+   dList_free(rule->children);
+   dFree(rule->label);
+   dFree(rule);
+}
+
+/*
+ * Compact cookies.txt if needed, and free all the memory allocated.
+ * (The cookies are already on disk.)
  */
 void a_Cookies_freeall()
 {
-   int i, fd, saved = 0;
+   uint_t i;
+   int j;
    DomainNode *node;
    CookieData_t *cookie;
-   time_t now;
 
 #ifndef HAVE_LOCKF
    struct flock lck;
@@ -396,41 +620,27 @@ void a_Cookies_freeall()
    if (disabled)
       return;
 
-   now = time(NULL);
+   if (file_stream)
+      Cookies_journal_check();
+   journal_on = FALSE;
 
-   if (file_stream) {
-      rewind(file_stream);
-      fd = fileno(file_stream);
-      if (ftruncate(fd, 0) == -1)
-         MSG("Cookies: Truncate file stream failed: %s\n", dStrerror(errno));
-      fprintf(file_stream, "%s", cookies_txt_header_str);
-   }
-
-   /* Iterate cookies per domain, saving and freeing */
-   while ((node = dList_nth_data(domains, 0))) {
-      for (i = 0; (cookie = dList_nth_data(node->cookies, i)); ++i) {
-         if (file_stream && !cookie->session_only &&
-	     difftime(cookie->expires_at, now) > 0) {
-            fprintf(file_stream, "%s\t%s\t%s\t%s\t%ld\t%s\t%s\n",
-                    cookie->domain,
-                    cookie->host_only ? "FALSE" : "TRUE",
-                    cookie->path,
-                    cookie->secure ? "TRUE" : "FALSE",
-                    (long)difftime(cookie->expires_at, cookies_epoch_time),
-                    cookie->name,
-                    cookie->value);
-            saved++;
-         }
-         Cookies_free_cookie(cookie);
+   /* Iterate cookies per domain, freeing */
+   for (i = 0; i < domain_table_size; i++) {
+      while ((node = domain_table[i])) {
+         for (j = 0; (cookie = dList_nth_data(node->cookies, j)); ++j)
+            Cookies_free_cookie(cookie);
+         Cookies_delete_node(node);
       }
-      Cookies_delete_node(node);
    }
-   dList_free(domains);
+   dFree(domain_table);
+   domain_table = NULL;
    dList_free(all_cookies);
+   if (rules)
+      Cookies_free_rule(rules);
 
    if (file_stream) {
 #ifdef HAVE_LOCKF
-      lockf(fd, F_ULOCK, 0);
+      lockf(fileno(file_stream), F_ULOCK, 0);
 #else  /* POSIX file lock */
       lck.l_start = 0; /* start at beginning of file */
       lck.l_len = 0;  /* lock entire file */
@@ -441,7 +651,7 @@ void a_Cookies_freeall()
 #endif
       fclose(file_stream);
 
-      MSG("Cookies saved: %d.\n", saved);
+      MSG("Cookies: %d lines in cookies.txt.\n", journal_lines);
    }
 }
 
@@ -575,8 +785,7 @@ static int Cookies_rm_expired_cookies(DomainNode *node)
       CookieData_t *c = dList_nth_data(cookies, i);
 
       if (difftime(c->expires_at, now) < 0) {
-         DomainNode *currnode = node ? node :
-              dList_find_sorted(domains, c->domain, Domain_node_by_domain_cmp);
+         DomainNode *currnode = node ? node : Cookies_find_node(c->domain);
          dList_remove(currnode->cookies, c);
          if (dList_length(currnode->cookies) == 0)
             Cookies_delete_node(currnode);
@@ -603,35 +812,58 @@ static void Cookies_too_many(DomainNode *node)
        "Removing LRU cookie for \'%s\': \'%s=%s\'\n", lru->domain,
        lru->name, lru->value);
    if (!node)
-      node = dList_find_sorted(domains, lru->domain,Domain_node_by_domain_cmp);
+      node = Cookies_find_node(lru->domain);
 
    dList_remove(node->cookies, lru);
    dList_remove_fast(all_cookies, lru);
+   Cookies_journal(lru, TRUE);
    Cookies_free_cookie(lru);
    if (dList_length(node->cookies) == 0)
       Cookies_delete_node(node);
 }
 
+/*
+ * Add a cookie to its domain node's list, after those with paths at least
+ * as long.
+ */
+static void Cookies_insert_by_path(Dlist *cookies, CookieData_t *cookie)
+{
+   int j;
+   CookieData_t *curr;
+   uint_t path_length = strlen(cookie->path);
+
+   for (j = dList_length(cookies);
+        j > 0 && (curr = dList_nth_data(cookies, j - 1)) &&
+         strlen(curr->path) < path_length;
+        j--) ;
+   dList_insert_pos(cookies, cookie, j);
+}
+
 static void Cookies_add_cookie(CookieData_t *cookie)
 {
    Dlist *domain_cookies;
    CookieData_t *c;
    DomainNode *node;
+   bool_t expired = (cookie->expires_at == (time_t) -1) ||
+                    (difftime(cookie->expires_at, time(NULL)) <= 0);
 
-   node = dList_find_sorted(domains, cookie->domain,Domain_node_by_domain_cmp);
+   node = Cookies_find_node(cookie->domain);
    domain_cookies = (node) ? node->cookies : NULL;
 
    if (domain_cookies) {
-      /* Remove any cookies with the same name, path, and host-only values. */
+      /* Remove any cookies with the same domain, name, path, and host-only
+       * values. */
       while ((c = dList_find_custom(domain_cookies, cookie, Cookies_cmp))) {
          dList_remove(domain_cookies, c);
          dList_remove_fast(all_cookies, c);
+         /* (a new persistent cookie's own line replaces it on disk) */
+         if (expired || cookie->session_only)
+            Cookies_journal(c, TRUE);
          Cookies_free_cookie(c);
       }
    }
 
-   if ((cookie->expires_at == (time_t) -1) ||
-       (difftime(cookie->expires_at, time(NULL)) <= 0)) {
+   if (expired) {
       /*
        * Don't add an expired cookie. Whether expiring now == expired, exactly,
        * is arguable, but we definitely do not want to add a Max-Age=0 cookie.
@@ -647,8 +879,7 @@ static void Cookies_add_cookie(CookieData_t *cookie)
             Cookies_too_many(node);
          } else if (removed >= MAX_DOMAIN_COOKIES) {
             /* So many were removed that the node might have been deleted. */
-            node = dList_find_sorted(domains, cookie->domain,
-                                                    Domain_node_by_domain_cmp);
+            node = Cookies_find_node(cookie->domain);
             domain_cookies = (node) ? node->cookies : NULL;
          }
       }
@@ -657,8 +888,7 @@ static void Cookies_add_cookie(CookieData_t *cookie)
             Cookies_too_many(NULL);
          } else if (domain_cookies) {
             /* Our own node might have just been deleted. */
-            node = dList_find_sorted(domains, cookie->domain,
-                                                    Domain_node_by_domain_cmp);
+            node = Cookies_find_node(cookie->domain);
             domain_cookies = (node) ? node->cookies : NULL;
          }
       }
@@ -669,15 +899,11 @@ static void Cookies_add_cookie(CookieData_t *cookie)
       dList_append(all_cookies, cookie);
 
       if (!domain_cookies) {
-         domain_cookies = dList_new(5);
-         dList_append(domain_cookies, cookie);
-         node = dNew(DomainNode, 1);
-         node->domain = dStrdup(cookie->domain);
-         node->cookies = domain_cookies;
-         dList_insert_sorted(domains, node, Domain_node_cmp);
-      } else {
-         dList_append(domain_cookies, cookie);
+         node = Cookies_new_node(cookie->domain);
+         domain_cookies = node->cookies;
       }
+      Cookies_insert_by_path(domain_cookies, cookie);
+      Cookies_journal(cookie, FALSE);
    }
    if (domain_cookies && (dList_length(domain_cookies) == 0))
       Cookies_delete_node(node);
@@ -885,13 +1111,14 @@ static CookieData_t *Cookies_parse(char *cookie_str, const char *server_date)
 }
 
 /*
- * Compare cookies by host_only, name, and path. Return 0 if equal.
+ * Compare cookies by domain, host_only, name, and path. Return 0 if equal.
  */
 static int Cookies_cmp(const void *a, const void *b)
 {
    const CookieData_t *ca = a, *cb = b;
 
    return (ca->host_only != cb->host_only) ||
+          (dStrcasecmp(ca->domain, cb->domain) != 0) ||
           (strcmp(ca->name, cb->name) != 0) ||
           (strcmp(ca->path, cb->path) != 0);
 }
@@ -1130,10 +1357,18 @@ static int Cookies_set(char *cookie_string, const char *url_host,
 /*
  * Compare the cookie with the supplied data to see whether it matches
  */
-static bool_t Cookies_match(CookieData_t *cookie, const char *url_path,
-                            bool_t host_only_val, bool_t is_ssl)
+static bool_t Cookies_match(CookieData_t *cookie, const char *url_host,
+                            const char *url_path, bool_t is_ssl)
 {
-   if (cookie->host_only != host_only_val)
+   /* If a cookie is set that lacks a Domain attribute, its domain is set to
+    * the server's host and the host_only flag is set for that cookie. Such a
+    * cookie can only be sent back to that host. Cookies with Domain attrs do
+    * not have the host_only flag set, and may be sent to subdomains. Domain
+    * attrs can have leading dots, which should be ignored for matching
+    * purposes.
+    */
+   if (cookie->host_only ? dStrcasecmp(cookie->domain, url_host) != 0 :
+                           !Cookies_domain_matches(url_host, cookie->domain))
       return FALSE;
 
    /* Insecure cookies matches both secure and insecure urls, secure
@@ -1148,61 +1383,18 @@ static bool_t Cookies_match(CookieData_t *cookie, const char *url_path,
    return TRUE;
 }
 
-static void Cookies_add_matching_cookies(const char *domain,
-                                         const char *url_path,
-                                         bool_t host_only_val,
-                                         Dlist *matching_cookies,
-                                         bool_t is_ssl)
-{
-   DomainNode *node = dList_find_sorted(domains, domain,
-                                        Domain_node_by_domain_cmp);
-   if (node) {
-      int i;
-      CookieData_t *cookie;
-      Dlist *domain_cookies = node->cookies;
-
-      for (i = 0; (cookie = dList_nth_data(domain_cookies, i)); ++i) {
-         /* Remove expired cookie. */
-         if (difftime(cookie->expires_at, time(NULL)) < 0) {
-            _MSG("Goodbye, expired cookie %s=%s d:%s p:%s\n", cookie->name,
-                 cookie->value, cookie->domain, cookie->path);
-            dList_remove(domain_cookies, cookie);
-            dList_remove_fast(all_cookies, cookie);
-            Cookies_free_cookie(cookie);
-            --i; continue;
-         }
-         /* Check if the cookie matches the requesting URL */
-         if (Cookies_match(cookie, url_path, host_only_val, is_ssl)) {
-            int j;
-            CookieData_t *curr;
-            uint_t path_length = strlen(cookie->path);
-
-            cookie->last_used = cookies_use_counter;
-
-            /* Longest cookies go first */
-            for (j = 0;
-                 (curr = dList_nth_data(matching_cookies, j)) &&
-                  strlen(curr->path) >= path_length;
-                 j++) ;
-            dList_insert_pos(matching_cookies, cookie, j);
-         }
-      }
-
-      if (dList_length(domain_cookies) == 0)
-         Cookies_delete_node(node);
-   }
-}
-
 /*
  * Return a string that contains all relevant cookies as headers.
  */
 static char *Cookies_get(const char *url_host, const char *url_path,
                          const char *url_scheme)
 {
-   char *domain_str, *str;
+   char *str;
    CookieData_t *cookie;
+   DomainNode *node;
    Dlist *matching_cookies;
-   bool_t is_ssl, is_ip_addr, host_only_val;
+   bool_t is_ssl;
+   time_t now;
 
    Dstr *cookie_dstring;
    int i;
@@ -1215,46 +1407,28 @@ static char *Cookies_get(const char *url_host, const char *url_path,
    /* Check if the protocol is secure or not */
    is_ssl = (!dStrcasecmp(url_scheme, "https"));
 
-   is_ip_addr = Cookies_domain_is_ip(url_host);
-
-   /* If a cookie is set that lacks a Domain attribute, its domain is set to
-    * the server's host and the host_only flag is set for that cookie. Such a
-    * cookie can only be sent back to that host. Cookies with Domain attrs do
-    * not have the host_only flag set, and may be sent to subdomains. Domain
-    * attrs can have leading dots, which should be ignored for matching
-    * purposes.
-    */
-   host_only_val = FALSE;
-   if (!is_ip_addr) {
-      /* e.g., sub.example.com set a cookie with domain ".sub.example.com". */
-      domain_str = dStrconcat(".", url_host, NULL);
-      Cookies_add_matching_cookies(domain_str, url_path, host_only_val,
-                                   matching_cookies, is_ssl);
-      dFree(domain_str);
-   }
-   host_only_val = TRUE;
-   /* e.g., sub.example.com set a cookie with no domain attribute. */
-   Cookies_add_matching_cookies(url_host, url_path, host_only_val,
-                                matching_cookies, is_ssl);
-   host_only_val = FALSE;
-   /* e.g., sub.example.com set a cookie with domain "sub.example.com". */
-   Cookies_add_matching_cookies(url_host, url_path, host_only_val,
-                                matching_cookies, is_ssl);
-
-   if (!is_ip_addr) {
-      for (domain_str = strchr(url_host+1, '.');
-           domain_str != NULL && *domain_str;
-           domain_str = strchr(domain_str+1, '.')) {
-         /* e.g., sub.example.com set a cookie with domain ".example.com". */
-         Cookies_add_matching_cookies(domain_str, url_path, host_only_val,
-                                      matching_cookies, is_ssl);
-         if (domain_str[1]) {
-            domain_str++;
-            /* e.g., sub.example.com set a cookie with domain "example.com".*/
-            Cookies_add_matching_cookies(domain_str, url_path, host_only_val,
-                                         matching_cookies, is_ssl);
+   /* All of the cookies that may go to the host are in its registrable
+    * domain's node, longest paths first (the order they're sent in). */
+   if ((node = Cookies_find_node(url_host))) {
+      now = time(NULL);
+      for (i = 0; (cookie = dList_nth_data(node->cookies, i)); ++i) {
+         /* Remove expired cookie. */
+         if (difftime(cookie->expires_at, now) < 0) {
+            _MSG("Goodbye, expired cookie %s=%s d:%s p:%s\n", cookie->name,
+                 cookie->value, cookie->domain, cookie->path);
+            dList_remove(node->cookies, cookie);
+            dList_remove_fast(all_cookies, cookie);
+            Cookies_free_cookie(cookie);
+            --i; continue;
+         }
+         /* Check if the cookie matches the requesting URL */
+         if (Cookies_match(cookie, url_host, url_path, is_ssl)) {
+            cookie->last_used = cookies_use_counter;
+            dList_append(matching_cookies, cookie);
          }
       }
+      if (dList_length(node->cookies) == 0)
+         Cookies_delete_node(node);
    }
 
    /* Found the cookies, now make the string */
@@ -1336,6 +1510,82 @@ char *a_Cookies_get_query(const DilloUrl *request_url)
  * ------------------------------------------------------------- */
 
 
+/*
+ * Compare function for searching a rule by label
+ */
+static int Cookies_rule_by_label_cmp(const void *v1, const void *v2)
+{
+   return strcmp(((const CookieRule *)v1)->label, (const char *)v2);
+}
+
+/*
+ * Compare function for sorting rules
+ */
+static int Cookies_rule_cmp(const void *v1, const void *v2)
+{
+   return strcmp(((const CookieRule *)v1)->label,
+                 ((const CookieRule *)v2)->label);
+}
+
+/*
+ * Create a rules trie node for a label.
+ */
+static CookieRule *Cookies_new_rule(const char *label)
+{
+   CookieRule *rule = dNew(CookieRule, 1);
+
+   rule->label = dStrdup(label);
+   rule->exact = rule->suffix = -1;
+   rule->children = dList_new(4);
+   return rule;
+}
+
+/*
+ * Return a lowercase copy of a domain, and the end of its last label.
+ */
+static char *Cookies_domain_labels(const char *domain, char **end)
+{
+   char *labels = dStrdup(domain), *p;
+
+   for (p = labels; *p; p++)
+      *p = tolower((uchar_t)*p);
+   *end = p;
+   return labels;
+}
+
+/*
+ * Put the rule for a domain in the trie. A domain starting with a dot
+ * stands for its subdomains.
+ */
+static void Cookies_add_rule(const char *domain, CookieControlAction action)
+{
+   CookieRule *rule = rules, *child;
+   bool_t suffix = (*domain == '.');
+   char *end, *p, *labels = Cookies_domain_labels(domain + suffix, &end);
+   int *set;
+
+   /* Walk down from the last label */
+   while (1) {
+      for (p = end; p > labels && p[-1] != '.'; p--) ;
+      *end = '\0';
+      if (!(child = dList_find_sorted(rule->children, p,
+                                      Cookies_rule_by_label_cmp))) {
+         child = Cookies_new_rule(p);
+         dList_insert_sorted(rule->children, child, Cookies_rule_cmp);
+      }
+      rule = child;
+      if (p == labels)
+         break;
+      end = p - 1;
+   }
+
+   /* The first rule given for a domain is the one that holds */
+   set = suffix ? &rule->suffix : &rule->exact;
+   if (*set == -1)
+      *set = action;
+   dFree(labels);
+}
+
 /*
  * Get the cookie control rules (from cookiesrc).
  * Return value:
@@ -1345,7 +1595,7 @@ char *a_Cookies_get_query(const DilloUrl *request_url)
  */
 static int Cookie_control_init(void)
 {
-   CookieControl cc;
+   CookieControlAction action;
    FILE *stream;
    char *filename, *rc;
    char line[LINE_MAXLEN];
@@ -1353,6 +1603,8 @@ static int Cookie_control_init(void)
    char rule[LINE_MAXLEN];
    bool_t enabled = FALSE;
 
+   rules = Cookies_new_rule("");
+
    /* Get a file pointer */
    filename = dStrconcat(dGetprofdir(), "/" PATHS_RC_COOKIES, NULL);
    stream = Cookies_fopen(filename, "r", "DEFAULT ACCEPT_SESSION\n");
@@ -1398,37 +1650,25 @@ static int Cookie_control_init(void)
          rule[j] = '\0';
 
          if (dStrcasecmp(rule, "ACCEPT") == 0)
-            cc.action = COOKIE_ACCEPT;
+            action = COOKIE_ACCEPT;
          else if (dStrcasecmp(rule, "ACCEPT_SESSION") == 0)
-            cc.action = COOKIE_ACCEPT_SESSION;
+            action = COOKIE_ACCEPT_SESSION;
          else if (dStrcasecmp(rule, "DENY") == 0)
-            cc.action = COOKIE_DENY;
+            action = COOKIE_DENY;
          else {
             MSG("Cookies: rule '%s' for domain '%s' is not recognised.\n",
                 rule, domain);
             continue;
          }
 
-         cc.domain = dStrdup(domain);
-         if (dStrcasecmp(cc.domain, "DEFAULT") == 0) {
+         if (dStrcasecmp(domain, "DEFAULT") == 0) {
             /* Set the default action */
-            default_action = cc.action;
-            dFree(cc.domain);
+            default_action = action;
          } else {
-            int i;
-            uint_t len = strlen(cc.domain);
-
-            /* Insert into list such that longest rules come first. */
-            a_List_add(ccontrol, num_ccontrol, num_ccontrol_max);
-            for (i = num_ccontrol++;
-                 i > 0 && (len > strlen(ccontrol[i-1].domain));
-                 i--) {
-               ccontrol[i] = ccontrol[i-1];
-            }
-            ccontrol[i] = cc;
+            Cookies_add_rule(domain, action);
          }
 
-         if (cc.action != COOKIE_DENY)
+         if (action != COOKIE_DENY)
             enabled = TRUE;
       }
    }
@@ -1440,32 +1680,37 @@ static int Cookie_control_init(void)
 
 /*
  * Check the rules for an appropriate action for this domain.
- * The rules are ordered by domain length, with longest first, so the
- * first match is the most specific.
+ * The trie is walked down from the last label of the domain, so the
+ * deepest rule found is the most specific match.
  */
 static CookieControlAction Cookies_control_check_domain(const char *domain)
 {
-   int i, diff;
-
-   for (i = 0; i < num_ccontrol; i++) {
-      if (ccontrol[i].domain[0] == '.') {
-         diff = strlen(domain) - strlen(ccontrol[i].domain);
-         if (diff >= 0) {
-            if (dStrcasecmp(domain + diff, ccontrol[i].domain) != 0)
-               continue;
-         } else {
-            continue;
-         }
-      } else {
-         if (dStrcasecmp(domain, ccontrol[i].domain) != 0)
-            continue;
+   CookieRule *rule = rules;
+   int action = default_action;
+   char *end, *p, *labels;
+
+   if (!rules || dList_length(rules->children) == 0)
+      return default_action;
+
+   labels = Cookies_domain_labels(domain, &end);
+   while (1) {
+      for (p = end; p > labels && p[-1] != '.'; p--) ;
+      *end = '\0';
+      if (!(rule = dList_find_sorted(rule->children, p,
+                                     Cookies_rule_by_label_cmp)))
+         break;
+      if (p == labels) {
+         if (rule->exact != -1)
+            action = rule->exact;
+         break;
       }
-
-      /* If we got here we have a match */
-      return( ccontrol[i].action );
+      if (rule->suffix != -1)
+         action = rule->suffix;
+      end = p - 1;
    }
+   dFree(labels);
 
-   return default_action;
+   return action;
 }
 
 /*
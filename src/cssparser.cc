@@ -113,6 +113,10 @@ static const char *const Css_list_style_type_enum_vals[] = {
    "katakana-iroha", "none", NULL
 };
 
+static const char *const Css_table_layout_enum_vals[] = {
+   "auto", "fixed", NULL
+};
+
 static const char *const Css_text_align_enum_vals[] = {
    "left", "right", "center", "justify", "string", NULL
 };
@@ -223,6 +227,8 @@ const CssPropertyInfo Css_property_info[CSS_PROPERTY_LAST] = {
    {"position", {CSS_TYPE_UNUSED}, NULL},
    {"quotes", {CSS_TYPE_UNUSED}, NULL},
    {"right", {CSS_TYPE_UNUSED}, NULL},
+   {"table-layout", {CSS_TYPE_ENUM, CSS_TYPE_UNUSED},
+    Css_table_layout_enum_vals},
    {"text-align", {CSS_TYPE_ENUM, CSS_TYPE_UNUSED}, Css_text_align_enum_vals},
    {"text-decoration", {CSS_TYPE_MULTI_ENUM, CSS_TYPE_UNUSED},
     Css_text_decoration_enum_vals},
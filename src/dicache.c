@@ -11,30 +11,51 @@
 
 #include <string.h>         /* for memset */
 #include <stdlib.h>
+#ifdef D_IMG_THREADED
+#  include <pthread.h>
+#endif
 
 #include "msg.h"
 #include "image.hh"
 #include "imgbuf.hh"
 #include "web.hh"
+#include "prefs.h"
+#include "capi.h"
 #include "dicache.h"
+#include "timeout.hh"
 #include "dpng.h"
 #include "dgif.h"
 #include "djpeg.h"
+#include "dwebp.h"
 
 typedef struct _DICacheNode DICacheNode;
 
-enum {
-   DIC_Gif,
-   DIC_Png,
-   DIC_Jpeg
-};
-
 struct _DICacheNode {
    int valid;            /* flag */
    DilloUrl *url;        /* primary "Key" for this dicache entry */
    DICacheEntry *first;  /* pointer to the first dicache entry in this list */
 };
 
+/*
+ * A completely decoded image, whose pixel data may be dropped and decoded
+ * again from the cached data when needed.
+ */
+typedef struct {
+   void *v_imgbuf;         /* Root Imgbuf (one reference is held) */
+   DilloUrl *url;          /* Where the compressed data is cached */
+   BrowserWindow *bw;      /* The window it was fetched for */
+   int Format;             /* Decoder to use */
+   int32_t bg_color;
+   DilloImgType type;
+   uint_t width, height;   /* As decoded (maybe reduced by the decoder) */
+   uint_t ScaleDenom;
+   DilloAnim *Anim;        /* Played in the imgbuf, if animated */
+   DICacheEntry *Reload;   /* Its decoding again (DIC_Reload), or NULL */
+   int Queued;             /* Waiting in ReloadQueue */
+   int Refetched;          /* Its data had to be fetched again */
+   int WantFull;           /* To be decoded again at full size */
+} DICacheKept;
+
 /*
  * List of DICacheNode. One node per URL. Each node may have several
  * versions of the same image in a linked list.
@@ -45,6 +66,93 @@ static uint_t dicache_size_total; /* invariant: dicache_size_total is
                                    * the sum of the image sizes (3*w*h)
                                    * of all the images in the dicache. */
 
+/*
+ * List of DICacheKept: decoded images that are subject to the memory
+ * budget (prefs.image_cache_size).
+ */
+static Dlist *KeptIMGs = NULL;
+
+/*
+ * Kept images waiting to be decoded again (see a_Dicache_reload()), and
+ * those being decoded again (at most one per URL, since their entries are
+ * found by URL as DIC_Reload).
+ */
+static Dlist *ReloadQueue = NULL;
+static Dlist *Reloads = NULL;
+static int ReloadActive = 0;     /* Dicache_reload_cb() is scheduled */
+
+/* Interval for checking on the data of images being fetched again */
+#define DICACHE_REFETCH_POLL 0.5
+
+#ifdef D_IMG_THREADED
+
+/* Number of image decoding threads */
+#define D_IMG_WORKERS 2
+/* Interval for handing decoded rows over to the main thread */
+#define D_IMG_POLL_INTERVAL 0.05
+/* Images still arriving aren't decoded until this much of them is in, in
+ * the hope that all of it comes first and a worker can decode it */
+#define D_IMG_WAIT_SIZE (64 * 1024)
+
+/*
+ * An image whose compressed data was complete when decoding started,
+ * being decoded on a worker thread. The decoder there sees 'entry'
+ * (version DIC_Worker) instead of the real dicache entry, and the main
+ * thread hands what it produced over to the real one when polling.
+ */
+typedef struct {
+   DICacheEntry entry;     /* The worker's entry (must be the first member) */
+   DilloUrl *url;          /* The real entry's URL and version */
+   int version;
+   DilloImage *Image;      /* The first client's image (one reference held) */
+   DilloUrl *DataUrl;      /* The compressed data, held in the cache */
+   int DataSerial;         /* (see a_Cache_hold_buf) */
+   char *Data;
+   int DataSize;
+   CA_Callback_t Decoder;
+   void *DecoderData;
+   Dlist *Clients;         /* DICacheJobClient: cache clients taken over */
+
+   /* Filled in by the worker and protected by JobMutex */
+   uchar_t *Rows;          /* Rows as passed to a_Dicache_write() */
+   uint_t RowSize;
+   bitvec_t *NewRows;      /* Rows written since the last hand-over */
+   uchar_t *cmap;          /* Color map as passed to a_Dicache_set_cmap() */
+   uint_t num_colors;
+   int num_colors_max, bg_index;
+   int NewCmap;
+   int Running, Done, Cancelled;
+} DICacheJob;
+
+/*
+ * A cache client that got all its data before the decoding finished;
+ * it's closed when the job is done.
+ */
+typedef struct {
+   int Key;                /* Cache client key */
+   DilloWeb *Web;          /* Taken over from the cache client */
+} DICacheJobClient;
+
+static pthread_mutex_t JobMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t JobCond = PTHREAD_COND_INITIALIZER;
+static pthread_key_t JobKey;     /* The job of a worker thread */
+static Dlist *JobQueue = NULL;   /* Jobs waiting for a worker (JobMutex) */
+static Dlist *Jobs = NULL;       /* All the jobs (main thread only) */
+static int JobPollActive = 0;
+
+#endif /* D_IMG_THREADED */
+
+/*
+ * Forward declarations
+ */
+static void Dicache_keep(DICacheEntry *DicEntry, BrowserWindow *bw);
+static int Dicache_kept_by_url_cmp(const void *v1, const void *v2);
+static void Dicache_reload_done(DICacheKept *kept);
+#ifdef D_IMG_THREADED
+static int Dicache_job_wait(DICacheEntry *DicEntry, CacheClient_t *Client);
+static int Dicache_job_start(DICacheEntry *DicEntry, CacheClient_t *Client);
+#endif
+
 /*
  * Compare two dicache nodes
  */
@@ -72,7 +180,14 @@ static int Dicache_node_by_url_cmp(const void *v1, const void *v2)
 void a_Dicache_init(void)
 {
    CachedIMGs = dList_new(256);
+   KeptIMGs = dList_new(256);
+   ReloadQueue = dList_new(8);
+   Reloads = dList_new(4);
    dicache_size_total = 0;
+#ifdef D_IMG_THREADED
+   JobQueue = dList_new(8);
+   Jobs = dList_new(8);
+#endif
 }
 
 /*
@@ -84,7 +199,12 @@ static DICacheEntry *Dicache_entry_new(void)
 
    entry->width = 0;
    entry->height = 0;
+   entry->HintWidth = 0;
+   entry->HintHeight = 0;
+   entry->ScaleDenom = 1;
    entry->type = DILLO_IMG_TYPE_NOTSET;
+   entry->Format = -1;
+   entry->bg_color = 0;
    entry->cmap = NULL;
    entry->v_imgbuf = NULL;
    entry->RefCount = 1;
@@ -97,6 +217,10 @@ static DICacheEntry *Dicache_entry_new(void)
    entry->Decoder = NULL;
    entry->DecoderData = NULL;
    entry->DecodedSize = 0;
+   entry->Anim = NULL;
+#ifdef ENABLE_PERF
+   entry->DecodeTime = 0;
+#endif
 
    entry->next = NULL;
 
@@ -151,6 +275,16 @@ DICacheEntry *a_Dicache_get_entry(const DilloUrl *Url, int version)
 
    dReturn_val_if_fail(version != 0, NULL);
 
+   if (version == DIC_Reload) {
+      DICacheKept *kept = dList_find_custom(Reloads, Url,
+                                            Dicache_kept_by_url_cmp);
+      return kept ? kept->Reload : NULL;
+   }
+#ifdef D_IMG_THREADED
+   if (version == DIC_Worker)
+      return pthread_getspecific(JobKey);
+#endif
+
    node = dList_find_sorted(CachedIMGs, Url, Dicache_node_by_url_cmp);
    if (node) {
       if (version == DIC_Last) {
@@ -188,6 +322,7 @@ static void Dicache_remove(const DilloUrl *Url, int version)
       /* Eliminate this dicache entry */
       dFree(entry->cmap);
       a_Bitvec_free(entry->BitVec);
+      a_Anim_free(entry->Anim);
       a_Imgbuf_unref(entry->v_imgbuf);
       if (entry->Decoder) {
          entry->Decoder(CA_Abort, entry->DecoderData);
@@ -253,6 +388,83 @@ void a_Dicache_invalidate_entry(const DilloUrl *Url)
 }
 
 
+/* ------------------------------------------------------------------------- */
+
+#ifdef D_IMG_THREADED
+/*
+ * Decoding on a worker thread: the decoder calls the a_Dicache methods
+ * as usual, and they record what it produced into its job.
+ */
+
+/*
+ * Record the image parameters in the job
+ */
+static void Dicache_job_set_parms(DICacheJob *job, uint_t width,
+                                  uint_t height, DilloImgType type)
+{
+   uint_t bpp = (type == DILLO_IMG_TYPE_RGB) ? 3 :
+                (type == DILLO_IMG_TYPE_CMYK_INV ||
+                 type == DILLO_IMG_TYPE_RGBA) ? 4 : 1;
+
+   pthread_mutex_lock(&JobMutex);
+   job->RowSize = width * bpp;
+   job->Rows = dNew(uchar_t, job->RowSize * height);
+   job->NewRows = a_Bitvec_new((int)height);
+   job->entry.width = width;
+   job->entry.height = height;
+   job->entry.type = type;
+   job->entry.State = DIC_SetParms;
+   pthread_mutex_unlock(&JobMutex);
+}
+
+/*
+ * Record the color map in the job
+ */
+static void Dicache_job_set_cmap(DICacheJob *job, const uchar_t *cmap,
+                                 uint_t num_colors, int num_colors_max,
+                                 int bg_index)
+{
+   pthread_mutex_lock(&JobMutex);
+   dFree(job->cmap);
+   job->cmap = dNew0(uchar_t, 3 * num_colors_max);
+   memcpy(job->cmap, cmap, 3 * num_colors);
+   job->num_colors = num_colors;
+   job->num_colors_max = num_colors_max;
+   job->bg_index = bg_index;
+   job->NewCmap = 1;
+   job->entry.State = DIC_SetCmap;
+   pthread_mutex_unlock(&JobMutex);
+}
+
+/*
+ * Record a new scan in the job
+ */
+static void Dicache_job_new_scan(DICacheJob *job)
+{
+   pthread_mutex_lock(&JobMutex);
+   job->entry.ScanNumber++;
+   pthread_mutex_unlock(&JobMutex);
+}
+
+/*
+ * Record decoded rows in the job
+ */
+static void Dicache_job_write_rows(DICacheJob *job, const uchar_t *buf,
+                                   uint_t y0, uint_t nrows, uint_t stride)
+{
+   uint_t y;
+
+   pthread_mutex_lock(&JobMutex);
+   for (y = y0; y < y0 + nrows; ++y, buf += stride) {
+      memcpy(job->Rows + y * job->RowSize, buf, job->RowSize);
+      a_Bitvec_set_bit(job->NewRows, (int)y);
+   }
+   job->entry.State = DIC_Write;
+   pthread_mutex_unlock(&JobMutex);
+}
+
+#endif /* D_IMG_THREADED */
+
 /* ------------------------------------------------------------------------- */
 
 /*
@@ -263,6 +475,7 @@ void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
                          uint_t width, uint_t height, DilloImgType type)
 {
    DICacheEntry *DicEntry;
+   int alpha;
 
    _MSG("a_Dicache_set_parms (%s)\n", URL_STR(url));
    dReturn_if_fail ( Image != NULL && width && height );
@@ -271,14 +484,32 @@ void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
    dReturn_if_fail ( DicEntry != NULL );
    /* Parameters already set? */
    dReturn_if_fail ( DicEntry->State < DIC_SetParms );
+#ifdef D_IMG_THREADED
+   if (version == DIC_Worker) {
+      Dicache_job_set_parms((DICacheJob *)DicEntry, width, height, type);
+      return;
+   }
+#endif
+   if (version == DIC_Reload) {
+      /* A kept image is decoded again at another size */
+      dReturn_if_fail ( type == DicEntry->type );
+      a_Imgbuf_set_root_size(DicEntry->v_imgbuf, width, height);
+      DicEntry->width = width;
+      DicEntry->height = height;
+      DicEntry->BitVec = a_Bitvec_new((int)height);
+      DicEntry->State = DIC_SetParms;
+      return;
+   }
 
    _MSG("  RefCount=%d version=%d\n", DicEntry->RefCount, DicEntry->version);
 
-   /* BUG: there's just one image-type now */
-   #define I_RGB 0
-   DicEntry->v_imgbuf = a_Imgbuf_new(Image->dw, I_RGB, width, height);
+   /* Images with transparency keep it; they're composited when drawn */
+   alpha = (type == DILLO_IMG_TYPE_RGBA ||
+            type == DILLO_IMG_TYPE_INDEXED_ALPHA);
+   DicEntry->v_imgbuf = a_Imgbuf_new(Image->dw, alpha ? I_RGBA : I_RGB,
+                                     width, height);
 
-   DicEntry->TotalSize = width * height * 3;
+   DicEntry->TotalSize = width * height * (alpha ? 4 : 3);
    DicEntry->width = width;
    DicEntry->height = height;
    DicEntry->type = type;
@@ -299,11 +530,32 @@ void a_Dicache_set_cmap(DilloUrl *url, int version, DilloImage *Image,
 
    _MSG("a_Dicache_set_cmap\n");
    dReturn_if_fail ( DicEntry != NULL );
+#ifdef D_IMG_THREADED
+   if (version == DIC_Worker) {
+      Dicache_job_set_cmap((DICacheJob *)DicEntry, cmap, num_colors,
+                           num_colors_max, bg_index);
+      return;
+   }
+#endif
 
    dFree(DicEntry->cmap);
-   DicEntry->cmap = dNew0(uchar_t, 3 * num_colors_max);
-   memcpy(DicEntry->cmap, cmap, 3 * num_colors);
-   if (bg_index >= 0 && (uint_t)bg_index < num_colors) {
+   if (DicEntry->type == DILLO_IMG_TYPE_INDEXED_ALPHA) {
+      /* RGBA entries, with the transparent color's alpha at zero */
+      uint_t i;
+
+      DicEntry->cmap = dNew0(uchar_t, 4 * num_colors_max);
+      for (i = 0; i < num_colors; i++) {
+         memcpy(DicEntry->cmap + i * 4, cmap + i * 3, 3);
+         DicEntry->cmap[i * 4 + 3] = ((int)i == bg_index) ? 0 : 255;
+      }
+   } else {
+      /* (with a spare byte for the 32-bit copies in
+       * a_Imgbuf_update_rows()) */
+      DicEntry->cmap = dNew0(uchar_t, 3 * num_colors_max + 1);
+      memcpy(DicEntry->cmap, cmap, 3 * num_colors);
+   }
+   if (DicEntry->type != DILLO_IMG_TYPE_INDEXED_ALPHA &&
+       bg_index >= 0 && (uint_t)bg_index < num_colors) {
       DicEntry->cmap[bg_index * 3]     = (Image->bg_color >> 16) & 0xff;
       DicEntry->cmap[bg_index * 3 + 1] = (Image->bg_color >> 8) & 0xff;
       DicEntry->cmap[bg_index * 3 + 2] = (Image->bg_color) & 0xff;
@@ -327,6 +579,12 @@ void a_Dicache_new_scan(const DilloUrl *url, int version)
       MSG("a_Dicache_new_scan before DIC_SetParms\n");
       exit(1);
    }
+#ifdef D_IMG_THREADED
+   if (version == DIC_Worker) {
+      Dicache_job_new_scan((DICacheJob *)DicEntry);
+      return;
+   }
+#endif
    a_Bitvec_clear(DicEntry->BitVec);
    DicEntry->ScanNumber++;
    a_Imgbuf_new_scan(DicEntry->v_imgbuf);
@@ -339,22 +597,61 @@ void a_Dicache_new_scan(const DilloUrl *url, int version)
  * Y  : row number
  */
 void a_Dicache_write(DilloUrl *url, int version, const uchar_t *buf, uint_t Y)
+{
+   a_Dicache_write_rows(url, version, buf, Y, 1, 0);
+}
+
+/*
+ * Write the consecutive scan lines y0 ... y0+nrows-1 into the Dicache entry
+ * buf   : first row
+ * stride: distance between two rows in buf
+ */
+void a_Dicache_write_rows(DilloUrl *url, int version, const uchar_t *buf,
+                          uint_t y0, uint_t nrows, uint_t stride)
 {
    DICacheEntry *DicEntry;
+   uint_t y;
 
-   _MSG("a_Dicache_write\n");
+   _MSG("a_Dicache_write_rows\n");
    DicEntry = a_Dicache_get_entry(url, version);
    dReturn_if_fail ( DicEntry != NULL );
    dReturn_if_fail ( DicEntry->width > 0 && DicEntry->height > 0 );
+   dReturn_if_fail ( nrows > 0 && y0 + nrows <= DicEntry->height );
+#ifdef D_IMG_THREADED
+   if (version == DIC_Worker) {
+      Dicache_job_write_rows((DICacheJob *)DicEntry, buf, y0, nrows, stride);
+      return;
+   }
+#endif
 
    /* update the common buffer in the imgbuf */
-   a_Imgbuf_update(DicEntry->v_imgbuf, buf, DicEntry->type,
-                   DicEntry->cmap, DicEntry->width, DicEntry->height, Y);
+   a_Imgbuf_update_rows(DicEntry->v_imgbuf, buf, DicEntry->type,
+                        DicEntry->cmap, DicEntry->width, DicEntry->height,
+                        y0, nrows, stride);
 
-   a_Bitvec_set_bit(DicEntry->BitVec, (int)Y);
+   for (y = y0; y < y0 + nrows; ++y)
+      a_Bitvec_set_bit(DicEntry->BitVec, (int)y);
    DicEntry->State = DIC_Write;
 }
 
+/*
+ * Give the frames of an animated image to the Dicache entry, when all of
+ * them have been decoded. They're played once the entry is closed.
+ */
+void a_Dicache_set_anim(DilloUrl *url, int version, DilloAnim *anim)
+{
+   DICacheEntry *DicEntry = a_Dicache_get_entry(url, version);
+
+   if (!DicEntry || version == DIC_Reload || DicEntry->State >= DIC_Close) {
+      a_Anim_free(anim);
+      return;
+   }
+   /* (For DIC_Worker, this is the job's entry; the main thread takes the
+    *  animation when the job is done) */
+   a_Anim_free(DicEntry->Anim);
+   DicEntry->Anim = anim;
+}
+
 /*
  * Implement the close method of the decoding process
  */
@@ -369,11 +666,14 @@ void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client)
    _MSG("a_Dicache_close RefCount=%d\n", DicEntry->RefCount - 1);
 
    if (DicEntry->State < DIC_Close) {
+      if (DicEntry->v_imgbuf)
+         Dicache_keep(DicEntry, Web->bw);
       DicEntry->State = DIC_Close;
       dFree(DicEntry->cmap);
       DicEntry->cmap = NULL;
       DicEntry->Decoder = NULL;
       DicEntry->DecoderData = NULL;
+      PERF_IMAGE(URL_STR(url), DicEntry->DecodeTime);
    }
    a_Dicache_unref(url, version);
 
@@ -383,7 +683,176 @@ void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client)
 /* ------------------------------------------------------------------------- */
 
 /*
- * Generic MIME handler for GIF, JPEG and PNG.
+ * Merge the display size wanted by a new client into the entry's hints.
+ * A client without hints wants the full-size image, and so does the
+ * entry from then on.
+ */
+static void Dicache_merge_hints(DICacheEntry *DicEntry, DilloImage *Image,
+                                int first)
+{
+   if (first) {
+      DicEntry->HintWidth = Image->hint_width;
+      DicEntry->HintHeight = Image->hint_height;
+   } else if (!DicEntry->HintWidth || !DicEntry->HintHeight) {
+      /* already unconstrained */
+   } else if (!Image->hint_width || !Image->hint_height) {
+      DicEntry->HintWidth = DicEntry->HintHeight = 0;
+   } else {
+      DicEntry->HintWidth = MAX(DicEntry->HintWidth, Image->hint_width);
+      DicEntry->HintHeight = MAX(DicEntry->HintHeight, Image->hint_height);
+   }
+}
+
+/*
+ * Whether a reduced-size decode is too small for this image client.
+ */
+static int Dicache_too_small(DICacheEntry *DicEntry, DilloImage *Image)
+{
+   if (DicEntry->ScaleDenom <= 1)
+      return 0;
+   if (!Image->hint_width || !Image->hint_height)
+      return 1;
+   return (DicEntry->width < Image->hint_width ||
+           DicEntry->height < Image->hint_height);
+}
+
+/* --- Decoders ----------------------------------------------------------- */
+
+/*
+ * For each format, the MIME types it's known by, and a sniffing function
+ * that tells whether the data starts as an image in it.
+ */
+#ifdef ENABLE_GIF
+static const char *const Dicache_gif_types[] =
+   { "image/gif", NULL };
+
+static int Dicache_sniff_gif(const uchar_t *buf, size_t size)
+{
+   return size >= 4 && !memcmp(buf, "GIF8", 4);
+}
+#endif
+
+#ifdef ENABLE_PNG
+static const char *const Dicache_png_types[] =
+   { "image/png", "image/x-png", NULL };   /* (x-png is deprecated) */
+
+static int Dicache_sniff_png(const uchar_t *buf, size_t size)
+{
+   return size >= 4 && !memcmp(buf, "\x89PNG", 4);
+}
+#endif
+
+#ifdef ENABLE_JPEG
+static const char *const Dicache_jpeg_types[] =
+   { "image/jpeg", "image/pjpeg", "image/jpg", NULL };
+
+static int Dicache_sniff_jpeg(const uchar_t *buf, size_t size)
+{
+   /* JPEG has the first 2 bytes set to 0xffd8 in BigEndian */
+   return size >= 2 && buf[0] == 0xff && buf[1] == 0xd8;
+}
+#endif
+
+#ifdef ENABLE_WEBP
+static const char *const Dicache_webp_types[] =
+   { "image/webp", NULL };
+
+static int Dicache_sniff_webp(const uchar_t *buf, size_t size)
+{
+   /* A RIFF container of WEBP data */
+   return size >= 12 && !memcmp(buf, "RIFF", 4) && !memcmp(buf + 8, "WEBP", 4);
+}
+#endif
+
+/*
+ * The image decoders compiled in. An image's "Format" is its index here.
+ */
+static const DilloImgDecoder Decoders[] = {
+#ifdef ENABLE_GIF
+   { "GIF", Dicache_gif_types, Dicache_sniff_gif,
+     a_Gif_new, (CA_Callback_t)a_Gif_callback },
+#endif
+#ifdef ENABLE_PNG
+   { "PNG", Dicache_png_types, Dicache_sniff_png,
+     a_Png_new, (CA_Callback_t)a_Png_callback },
+#endif
+#ifdef ENABLE_JPEG
+   { "JPEG", Dicache_jpeg_types, Dicache_sniff_jpeg,
+     a_Jpeg_new, (CA_Callback_t)a_Jpeg_callback },
+#endif
+#ifdef ENABLE_WEBP
+   { "WebP", Dicache_webp_types, Dicache_sniff_webp,
+     a_Webp_new, (CA_Callback_t)a_Webp_callback },
+#endif
+   { NULL, NULL, NULL, NULL, NULL }
+};
+
+/*
+ * Return the i-th image decoder (NULL after the last one).
+ */
+const DilloImgDecoder *a_Dicache_get_decoder(int i)
+{
+   dReturn_val_if_fail(i >= 0, NULL);
+   return Decoders[i].name ? &Decoders[i] : NULL;
+}
+
+/*
+ * Find the decoder (i.e., the Format) for a MIME type, or -1.
+ */
+static int Dicache_decoder_by_type(const char *Type)
+{
+   const DilloImgDecoder *dec;
+   size_t len;
+   int i, j;
+
+   /* (the type may have parameters) */
+   len = strcspn(Type, " ;\t");
+   for (i = 0; (dec = a_Dicache_get_decoder(i)); ++i)
+      for (j = 0; dec->mime_types[j]; ++j)
+         if (strlen(dec->mime_types[j]) == len &&
+             !dStrncasecmp(Type, dec->mime_types[j], len))
+            return i;
+   return -1;
+}
+
+/*
+ * Detect an image format from the first bytes of its data.
+ * Return value: its MIME type, or NULL if it isn't a known one.
+ */
+const char *a_Dicache_sniff_type(const void *Data, size_t Size)
+{
+   const DilloImgDecoder *dec;
+   int i;
+
+   for (i = 0; (dec = a_Dicache_get_decoder(i)); ++i)
+      if (dec->sniff(Data, Size))
+         return dec->mime_types[0];
+   return NULL;
+}
+
+/*
+ * Create the decoding data structure for an image format
+ */
+static void *Dicache_decoder_new(int Format, DilloImage *Image,
+                                 DilloUrl *url, int version)
+{
+   const DilloImgDecoder *dec = a_Dicache_get_decoder(Format);
+
+   return dec ? dec->create(Image, url, version) : NULL;
+}
+
+/*
+ * Return the decoding function for an image format
+ */
+static CA_Callback_t Dicache_decoder(int Format)
+{
+   const DilloImgDecoder *dec = a_Dicache_get_decoder(Format);
+
+   return dec ? dec->callback : NULL;
+}
+
+/*
+ * MIME handler for the image types there are decoders for.
  * Sets a_Dicache_callback as the cache-client,
  * and also sets the image decoder.
  *
@@ -393,13 +862,16 @@ void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client)
  *   Call: Dillo calls this with more data/eod
  *   Data: Decoding data structure
  */
-static void *Dicache_image(int ImgType, const char *MimeType, void *Ptr,
-                           CA_Callback_t *Call, void **Data)
+void *a_Dicache_image(const char *MimeType, void *Ptr, CA_Callback_t *Call,
+                      void **Data)
 {
    DilloWeb *web = Ptr;
    DICacheEntry *DicEntry;
+   int ImgType;
 
    dReturn_val_if_fail(MimeType && Ptr, NULL);
+   ImgType = Dicache_decoder_by_type(MimeType);
+   dReturn_val_if_fail(ImgType >= 0, NULL);
 
    if (!web->Image) {
       web->Image = a_Image_new(NULL, web->bgColor);
@@ -407,25 +879,29 @@ static void *Dicache_image(int ImgType, const char *MimeType, void *Ptr,
    }
 
    DicEntry = a_Dicache_get_entry(web->url, DIC_Last);
+   if (DicEntry && DicEntry->State >= DIC_SetParms &&
+       Dicache_too_small(DicEntry, web->Image)) {
+      /* It was decoded at a reduced size; decode it again in full */
+      _MSG("a_Dicache_image: full-size decode of %s\n", URL_STR(web->url));
+      a_Dicache_invalidate_entry(web->url);
+      DicEntry = NULL;
+   }
    if (!DicEntry) {
       /* Let's create an entry for this image... */
       DicEntry = Dicache_add_entry(web->url);
-      DicEntry->DecoderData =
-         (ImgType == DIC_Png) ?
-            a_Png_new(web->Image, DicEntry->url, DicEntry->version) :
-         (ImgType == DIC_Gif) ?
-            a_Gif_new(web->Image, DicEntry->url, DicEntry->version) :
-         (ImgType == DIC_Jpeg) ?
-            a_Jpeg_new(web->Image, DicEntry->url, DicEntry->version) :
-            NULL;
+      Dicache_merge_hints(DicEntry, web->Image, 1);
+      DicEntry->Format = ImgType;
+      DicEntry->bg_color = web->Image->bg_color;
+      DicEntry->DecoderData = Dicache_decoder_new(ImgType, web->Image,
+                                                  DicEntry->url,
+                                                  DicEntry->version);
+      DicEntry->Decoder = Dicache_decoder(ImgType);
    } else {
-      /* Repeated image */
+      /* Repeated image (its decoder may be a decoding job by now) */
       a_Dicache_ref(DicEntry->url, DicEntry->version);
+      if (DicEntry->State < DIC_SetParms)
+         Dicache_merge_hints(DicEntry, web->Image, 0);
    }
-   DicEntry->Decoder = (ImgType == DIC_Png)  ? (CA_Callback_t)a_Png_callback :
-                       (ImgType == DIC_Gif)  ? (CA_Callback_t)a_Gif_callback :
-                       (ImgType == DIC_Jpeg) ? (CA_Callback_t)a_Jpeg_callback:
-                                               NULL;
    *Data = DicEntry->DecoderData;
    *Call = (CA_Callback_t) a_Dicache_callback;
 
@@ -433,30 +909,48 @@ static void *Dicache_image(int ImgType, const char *MimeType, void *Ptr,
 }
 
 /*
- * PNG wrapper for Dicache_image()
+ * Bring an image client up to date with the entry's decoded rows.
  */
-void *a_Dicache_png_image(const char *Type, void *Ptr, CA_Callback_t *Call,
-                          void **Data)
+static void Dicache_sync_image(DICacheEntry *DicEntry, DilloImage *Image)
 {
-   return Dicache_image(DIC_Png, Type, Ptr, Call, Data);
-}
-
-/*
- * GIF wrapper for Dicache_image()
- */
-void *a_Dicache_gif_image(const char *Type, void *Ptr, CA_Callback_t *Call,
-                          void **Data)
-{
-   return Dicache_image(DIC_Gif, Type, Ptr, Call, Data);
-}
-
-/*
- * JPEG wrapper for Dicache_image()
- */
-void *a_Dicache_jpeg_image(const char *Type, void *Ptr, CA_Callback_t *Call,
-                           void **Data)
-{
-   return Dicache_image(DIC_Jpeg, Type, Ptr, Call, Data);
+   uint_t i, start;
+
+   if (Image->height == 0 && DicEntry->State >= DIC_SetParms) {
+      /* Set parms */
+      a_Image_set_parms(
+         Image, DicEntry->v_imgbuf, DicEntry->url,
+         DicEntry->version, DicEntry->width, DicEntry->height,
+         DicEntry->type);
+   }
+   if (DicEntry->State == DIC_Write) {
+      /* Write runs of consecutive rows at once */
+      if (DicEntry->ScanNumber == Image->ScanNumber) {
+         for (start = i = 0; i <= DicEntry->height; ++i) {
+            if (i < DicEntry->height &&
+                a_Bitvec_get_bit(DicEntry->BitVec, (int)i) &&
+                !a_Bitvec_get_bit(Image->BitVec, (int)i))
+               continue;
+            if (i > start)
+               a_Image_write_rows(Image, start, i - start);
+            start = i + 1;
+         }
+      } else {
+         for (start = i = 0; i <= DicEntry->height; ++i) {
+            if (i < DicEntry->height &&
+                (a_Bitvec_get_bit(DicEntry->BitVec, (int)i) ||
+                 !a_Bitvec_get_bit(Image->BitVec, (int)i)   ||
+                 DicEntry->ScanNumber > Image->ScanNumber + 1))
+               continue;
+            if (i > start)
+               a_Image_write_rows(Image, start, i - start);
+            start = i + 1;
+         }
+         for (i = 0; i < DicEntry->height; ++i)
+            if (!a_Bitvec_get_bit(DicEntry->BitVec, (int)i))
+               a_Bitvec_clear_bit(Image->BitVec, (int)i);
+         Image->ScanNumber = DicEntry->ScanNumber;
+      }
+   }
 }
 
 /*
@@ -464,10 +958,14 @@ void *a_Dicache_jpeg_image(const char *Type, void *Ptr, CA_Callback_t *Call,
  */
 void a_Dicache_callback(int Op, CacheClient_t *Client)
 {
-   uint_t i;
    DilloWeb *Web = Client->Web;
    DilloImage *Image = Web->Image;
-   DICacheEntry *DicEntry = a_Dicache_get_entry(Web->url, DIC_Last);
+   /* Stick to the version this client started with: a newer one may
+    * have been added meanwhile (e.g. for a full-size decode) */
+   DICacheEntry *DicEntry =
+      a_Dicache_get_entry(Web->url, Client->Version ? Client->Version :
+                                                      DIC_Last);
+   PERF_TIMER(t);
 
    dReturn_if_fail ( DicEntry != NULL );
 
@@ -475,10 +973,20 @@ void a_Dicache_callback(int Op, CacheClient_t *Client)
    if (Client->Version == 0)
       Client->Version = DicEntry->version;
 
+#ifdef D_IMG_THREADED
+   if (Op == CA_Send && Dicache_job_wait(DicEntry, Client))
+      return;
+#endif
+
    /* Only call the decoder when necessary */
    if (Op == CA_Send && DicEntry->State < DIC_Close &&
        DicEntry->DecodedSize < Client->BufSize) {
-      DicEntry->Decoder(Op, Client);
+      PERF_START(t);
+#ifdef D_IMG_THREADED
+      if (!Dicache_job_start(DicEntry, Client))
+#endif
+         DicEntry->Decoder(Op, Client);
+      PERF_ACCUM(DicEntry->DecodeTime, t);
       DicEntry->DecodedSize = Client->BufSize;
    } else if (Op == CA_Close || Op == CA_Abort) {
       if (DicEntry->State < DIC_Close) {
@@ -490,40 +998,911 @@ void a_Dicache_callback(int Op, CacheClient_t *Client)
 
    /* when the data stream is not an image 'v_imgbuf' remains NULL */
    if (Op == CA_Send && DicEntry->v_imgbuf) {
-      if (Image->height == 0 && DicEntry->State >= DIC_SetParms) {
-         /* Set parms */
-         a_Image_set_parms(
-            Image, DicEntry->v_imgbuf, DicEntry->url,
-            DicEntry->version, DicEntry->width, DicEntry->height,
-            DicEntry->type);
+      Dicache_sync_image(DicEntry, Image);
+   } else if ((Op == CA_Close || Op == CA_Abort) && Client->Web) {
+      /* (the client may have been taken over by a decoding job) */
+      a_Image_close(Image);
+      a_Bw_close_client(Web->bw, Client->Key);
+   }
+}
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef D_IMG_THREADED
+/*
+ * Image decoding threads.
+ *
+ * When the whole compressed image is in the cache as decoding starts,
+ * the decoding is done on a worker thread, and the main thread polls for
+ * the rows it produced (as the threaded DNS does for its answers).
+ * Decoding of an image still being transferred waits for the rest of it,
+ * up to D_IMG_WAIT_SIZE; images larger than that are decoded as they
+ * come in, as before.
+ */
+
+/*
+ * Free a job (main thread only)
+ */
+static void Dicache_job_free(DICacheJob *job)
+{
+   if (!job->Done && job->Decoder)
+      job->Decoder(CA_Abort, job->DecoderData);
+   a_Url_free(job->url);
+   a_Image_unref(job->Image);
+   a_Cache_release_buf(job->DataUrl, job->DataSerial);
+   a_Url_free(job->DataUrl);
+   dFree(job->Rows);
+   a_Bitvec_free(job->NewRows);
+   dFree(job->cmap);
+   a_Anim_free(job->entry.Anim);
+   dList_free(job->Clients);
+   dFree(job);
+}
+
+/*
+ * Release a cache client taken over by a job.
+ * 'close' tells whether it gets its image closed as if the data ended.
+ */
+static void Dicache_job_client_free(DICacheJobClient *jc, int close)
+{
+   if (close)
+      a_Image_close(jc->Web->Image);
+   a_Bw_close_client(jc->Web->bw, jc->Key);
+   a_Web_free(jc->Web);
+   dFree(jc);
+}
+
+/*
+ * Decoding thread: take jobs from the queue and feed each one's data to
+ * its decoder at once.
+ */
+static void *Dicache_worker(void *data)
+{
+   DICacheJob *job;
+   CacheClient_t Client;
+   PERF_TIMER(t);
+
+   (void) data;
+   pthread_mutex_lock(&JobMutex);
+   while (1) {
+      while (!(job = dList_nth_data(JobQueue, 0)))
+         pthread_cond_wait(&JobCond, &JobMutex);
+      dList_remove(JobQueue, job);
+      job->Running = 1;
+      pthread_mutex_unlock(&JobMutex);
+
+      pthread_setspecific(JobKey, &job->entry);
+      memset(&Client, 0, sizeof(Client));
+      Client.Url = job->url;
+      Client.Buf = job->Data;
+      Client.BufSize = job->DataSize;
+      Client.CbData = job->DecoderData;
+      PERF_START(t);
+      job->Decoder(CA_Send, &Client);
+      PERF_ACCUM(job->entry.DecodeTime, t);
+      job->Decoder(CA_Abort, job->DecoderData);
+      pthread_setspecific(JobKey, NULL);
+
+      pthread_mutex_lock(&JobMutex);
+      job->Running = 0;
+      job->Done = 1;
+   }
+   return NULL;
+}
+
+/*
+ * Start the decoding threads, the first time they're needed.
+ */
+static int Dicache_workers_init(void)
+{
+   static int started = 0;
+   pthread_attr_t attr;
+   pthread_t th;
+   int i;
+
+   if (!started) {
+      if (pthread_key_create(&JobKey, NULL) != 0)
+         return 0;
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+      for (i = 0; i < D_IMG_WORKERS; ++i)
+         if (pthread_create(&th, &attr, Dicache_worker, NULL) == 0)
+            ++started;
+      pthread_attr_destroy(&attr);
+   }
+   return started;
+}
+
+/*
+ * Close the entry of a finished job and its clients, and free the job.
+ */
+static void Dicache_job_finish(DICacheJob *job, DICacheEntry *DicEntry)
+{
+   DICacheJobClient *jc;
+   DilloUrl *url = job->url;
+   int version = job->version;
+
+   dList_remove(Jobs, job);
+   if (version == DIC_Reload) {
+      /* a kept image was decoded again */
+      DICacheKept *kept = dList_find_custom(Reloads, url,
+                                            Dicache_kept_by_url_cmp);
+
+      DicEntry->Decoder = NULL;
+      DicEntry->DecoderData = NULL;
+      Dicache_job_free(job);
+      Dicache_reload_done(kept);
+      return;
+   }
+   if (DicEntry->State < DIC_Close) {
+      if (job->entry.Anim) {
+         a_Anim_free(DicEntry->Anim);
+         DicEntry->Anim = job->entry.Anim;
+         job->entry.Anim = NULL;
       }
-      if (DicEntry->State == DIC_Write) {
-         if (DicEntry->ScanNumber == Image->ScanNumber) {
-            for (i = 0; i < DicEntry->height; ++i)
-               if (a_Bitvec_get_bit(DicEntry->BitVec, (int)i) &&
-                   !a_Bitvec_get_bit(Image->BitVec, (int)i) )
-                  a_Image_write(Image, i);
-         } else {
-            for (i = 0; i < DicEntry->height; ++i) {
-               if (a_Bitvec_get_bit(DicEntry->BitVec, (int)i) ||
-                   !a_Bitvec_get_bit(Image->BitVec, (int)i)   ||
-                   DicEntry->ScanNumber > Image->ScanNumber + 1) {
-                  a_Image_write(Image, i);
-               }
-               if (!a_Bitvec_get_bit(DicEntry->BitVec, (int)i))
-                  a_Bitvec_clear_bit(Image->BitVec, (int)i);
+      if (DicEntry->v_imgbuf) {
+         jc = dList_nth_data(job->Clients, 0);
+         Dicache_keep(DicEntry, jc ? jc->Web->bw : NULL);
+      }
+      DicEntry->State = DIC_Close;
+      dFree(DicEntry->cmap);
+      DicEntry->cmap = NULL;
+#ifdef ENABLE_PERF
+      /* (what the worker took, as measured there) */
+      DicEntry->DecodeTime += job->entry.DecodeTime;
+#endif
+      PERF_IMAGE(URL_STR(url), DicEntry->DecodeTime);
+   }
+   DicEntry->Decoder = NULL;
+   DicEntry->DecoderData = NULL;
+
+   job->url = NULL;
+   while ((jc = dList_nth_data(job->Clients, 0))) {
+      dList_remove_fast(job->Clients, jc);
+      Dicache_job_client_free(jc, 1);
+      /* may free DicEntry */
+      a_Dicache_unref(url, version);
+   }
+   a_Url_free(url);
+   Dicache_job_free(job);
+}
+
+/*
+ * Hand what a job decoded since the last time over to its dicache entry
+ * and to the clients that already got all their data.
+ * Return value: whether the job is finished (and freed).
+ */
+static int Dicache_job_hand_over(DICacheJob *job)
+{
+   DICacheEntry *DicEntry = a_Dicache_get_entry(job->url, job->version);
+   DicEntryState state;
+   DilloImgType type;
+   uint_t width, height, scale_denom, scan, row_size, start, y, n;
+   uint_t num_colors = 0, *runs = NULL;
+   int num_colors_max = 0, bg_index = 0, nruns = 0, i, done;
+   uchar_t *cmap = NULL, *rows = NULL, *row;
+
+   dReturn_val_if_fail(DicEntry != NULL, 0);
+
+   /* Copy what's new out of the job, so that the worker isn't held up
+    * while it's handed over */
+   pthread_mutex_lock(&JobMutex);
+   state = job->entry.State;
+   width = job->entry.width;
+   height = job->entry.height;
+   type = job->entry.type;
+   scale_denom = job->entry.ScaleDenom;
+   scan = job->entry.ScanNumber;
+   row_size = job->RowSize;
+   done = job->Done;
+   if (state >= DIC_SetParms) {
+      if (job->NewCmap) {
+         /* (the worker makes a new one each time) */
+         cmap = job->cmap;
+         job->cmap = NULL;
+         num_colors = job->num_colors;
+         num_colors_max = job->num_colors_max;
+         bg_index = job->bg_index;
+         job->NewCmap = 0;
+      }
+      for (n = y = 0; y < height; ++y)
+         if (a_Bitvec_get_bit(job->NewRows, (int)y))
+            ++n;
+      if (n > 0) {
+         /* the new rows, one after the other, and where each run starts
+          * and how long it is */
+         rows = row = dNew(uchar_t, n * row_size);
+         runs = dNew(uint_t, 2 * n);
+         for (start = y = 0; y <= height; ++y) {
+            if (y < height && a_Bitvec_get_bit(job->NewRows, (int)y)) {
+               a_Bitvec_clear_bit(job->NewRows, (int)y);
+               memcpy(row, job->Rows + y * row_size, row_size);
+               row += row_size;
+               continue;
+            }
+            if (y > start) {
+               runs[nruns++] = start;
+               runs[nruns++] = y - start;
             }
-            Image->ScanNumber = DicEntry->ScanNumber;
+            start = y + 1;
          }
       }
-   } else if (Op == CA_Close || Op == CA_Abort) {
-      a_Image_close(Image);
-      a_Bw_close_client(Web->bw, Client->Key);
    }
+   pthread_mutex_unlock(&JobMutex);
+
+   if (state >= DIC_SetParms) {
+      if (DicEntry->State < DIC_SetParms) {
+         a_Dicache_set_parms(job->url, job->version, job->Image,
+                             width, height, type);
+         DicEntry->ScaleDenom = scale_denom;
+      }
+      while (DicEntry->ScanNumber < scan)
+         a_Dicache_new_scan(job->url, job->version);
+
+      if (cmap) {
+         a_Dicache_set_cmap(job->url, job->version, job->Image, cmap,
+                            num_colors, num_colors_max, bg_index);
+         dFree(cmap);
+      }
+      for (row = rows, i = 0; i < nruns; i += 2) {
+         a_Dicache_write_rows(job->url, job->version, row,
+                              runs[i], runs[i + 1], row_size);
+         row += runs[i + 1] * row_size;
+      }
+      dFree(rows);
+      dFree(runs);
+
+      for (i = 0; i < dList_length(job->Clients); ++i) {
+         DICacheJobClient *jc = dList_nth_data(job->Clients, i);
+         Dicache_sync_image(DicEntry, jc->Web->Image);
+      }
+   }
+
+   if (done)
+      Dicache_job_finish(job, DicEntry);
+   return done;
+}
+
+/*
+ * Timeout callback: hand the decoded rows over to the main thread,
+ * and free the cancelled jobs whose worker is done with them.
+ */
+static void Dicache_job_poll(void *data)
+{
+   DICacheJob *job;
+   int i, done;
+
+   (void) data;
+   for (i = 0; i < dList_length(Jobs); ) {
+      job = dList_nth_data(Jobs, i);
+      if (job->Cancelled) {
+         pthread_mutex_lock(&JobMutex);
+         done = job->Done;
+         pthread_mutex_unlock(&JobMutex);
+         if (done) {
+            dList_remove(Jobs, job);
+            Dicache_job_free(job);
+            continue;
+         }
+      } else if (Dicache_job_hand_over(job)) {
+         continue;
+      }
+      ++i;
+   }
+
+   if (dList_length(Jobs)) {
+      a_Timeout_repeat(D_IMG_POLL_INTERVAL, Dicache_job_poll, NULL);
+   } else {
+      JobPollActive = 0;
+   }
+}
+
+/*
+ * Cancel a job whose dicache entry is being removed.
+ */
+static void Dicache_job_cancel(DICacheJob *job)
+{
+   DICacheJobClient *jc;
+   int queued;
+
+   pthread_mutex_lock(&JobMutex);
+   job->Cancelled = 1;
+   if ((queued = (!job->Running && !job->Done)))
+      dList_remove(JobQueue, job);
+   pthread_mutex_unlock(&JobMutex);
+
+   while ((jc = dList_nth_data(job->Clients, 0))) {
+      dList_remove_fast(job->Clients, jc);
+      Dicache_job_client_free(jc, 0);
+   }
+   if (queued) {
+      dList_remove(Jobs, job);
+      Dicache_job_free(job);
+   }
+}
+
+/*
+ * The dicache entry's decoder while a job decodes its image.
+ * The job already has all the data; cache clients that reach the end
+ * of it are taken over until the job is done.
+ */
+static void Dicache_job_callback(int Op, void *data)
+{
+   CacheClient_t *Client;
+   DilloWeb *Web;
+   DICacheEntry *DicEntry;
+   DICacheJobClient *jc;
+
+   if (Op == CA_Abort) {
+      Dicache_job_cancel(data);
+   } else if (Op == CA_Close) {
+      Client = data;
+      Web = Client->Web;
+      DicEntry = a_Dicache_get_entry(Web->url, Client->Version);
+      jc = dNew(DICacheJobClient, 1);
+      jc->Key = Client->Key;
+      jc->Web = Web;
+      Client->Web = NULL;
+      dList_append(((DICacheJob *)DicEntry->DecoderData)->Clients, jc);
+   }
+}
+
+/*
+ * Create a job decoding the complete data of 'DataUrl' in the cache for
+ * a dicache entry, and queue it for the workers. The worker reads the
+ * data in the cache, which is held (and doesn't change anymore) until
+ * the job is freed.
+ */
+static DICacheJob *Dicache_job_new(DICacheEntry *DicEntry, DilloImage *Image,
+                                   const DilloUrl *DataUrl)
+{
+   DICacheJob *job;
+
+   job = dNew0(DICacheJob, 1);
+   job->url = a_Url_dup(DicEntry->url);
+   job->version = DicEntry->version;
+   job->Image = Image;
+   a_Image_ref(job->Image);
+   job->DataUrl = a_Url_dup(DataUrl);
+   job->DataSerial = a_Cache_hold_buf(job->DataUrl);
+   a_Cache_get_held_buf(job->DataUrl, job->DataSerial,
+                        &job->Data, &job->DataSize);
+   job->Clients = dList_new(4);
+
+   job->entry.url = job->url;
+   job->entry.version = DIC_Worker;
+   job->entry.HintWidth = DicEntry->HintWidth;
+   job->entry.HintHeight = DicEntry->HintHeight;
+   job->entry.ScaleDenom = 1;
+   job->entry.type = DILLO_IMG_TYPE_NOTSET;
+   job->entry.Format = DicEntry->Format;
+   job->entry.bg_color = DicEntry->bg_color;
+   job->entry.State = DIC_Empty;
+   job->entry.RefCount = 1;
+   job->Decoder = Dicache_decoder(DicEntry->Format);
+   job->DecoderData = Dicache_decoder_new(DicEntry->Format, job->Image,
+                                          job->url, DIC_Worker);
+
+   _MSG("Dicache_job_new: %s\n", URL_STR(job->url));
+   dList_append(Jobs, job);
+   pthread_mutex_lock(&JobMutex);
+   dList_append(JobQueue, job);
+   pthread_cond_signal(&JobCond);
+   pthread_mutex_unlock(&JobMutex);
+
+   if (!JobPollActive) {
+      a_Timeout_add(D_IMG_POLL_INTERVAL, Dicache_job_poll, NULL);
+      JobPollActive = 1;
+   }
+   return job;
+}
+
+/*
+ * Whether to leave an entry undecoded for now, because its compressed
+ * data isn't complete yet but may be soon: once it is, a worker decodes
+ * it (see Dicache_job_start()).
+ */
+static int Dicache_job_wait(DICacheEntry *DicEntry, CacheClient_t *Client)
+{
+   DilloWeb *Web = Client->Web;
+
+   return (DicEntry->DecodedSize == 0 && DicEntry->State < DIC_Close &&
+           DicEntry->Format >= 0 && DicEntry->version >= 0 &&
+           Dicache_decoder(DicEntry->Format) &&
+           Client->BufSize < D_IMG_WAIT_SIZE &&
+           !(a_Capi_get_flags_with_redirection(Web->url) & CAPI_Completed) &&
+           Dicache_workers_init());
+}
+
+/*
+ * Move the decoding of an entry to a worker thread, when its compressed
+ * data is complete and nothing has been decoded yet.
+ * Return value: whether the job took over the decoding.
+ */
+static int Dicache_job_start(DICacheEntry *DicEntry, CacheClient_t *Client)
+{
+   DilloWeb *Web = Client->Web;
+   DICacheJob *job;
+
+   if (DicEntry->DecodedSize > 0 || DicEntry->Format < 0 ||
+       DicEntry->version < 0 || !Dicache_decoder(DicEntry->Format) ||
+       !(a_Capi_get_flags_with_redirection(Web->url) & CAPI_Completed) ||
+       !Dicache_workers_init())
+      return 0;
+
+   job = Dicache_job_new(DicEntry, Web->Image, Web->url);
+
+   /* The job replaces the decoder of the entry */
+   if (DicEntry->Decoder)
+      DicEntry->Decoder(CA_Abort, DicEntry->DecoderData);
+   DicEntry->Decoder = (CA_Callback_t) Dicache_job_callback;
+   DicEntry->DecoderData = job;
+   return 1;
+}
+
+#endif /* D_IMG_THREADED */
+
+/*
+ * Stop a cache client that a decoding job took over
+ * (a_Cache_stop_client() doesn't know about it anymore).
+ */
+void a_Dicache_stop_client(int Key)
+{
+#ifdef D_IMG_THREADED
+   int i, j;
+   DICacheJob *job;
+   DICacheJobClient *jc;
+
+   for (i = 0; i < dList_length(Jobs); ++i) {
+      job = dList_nth_data(Jobs, i);
+      for (j = 0; j < dList_length(job->Clients); ++j) {
+         jc = dList_nth_data(job->Clients, j);
+         if (jc->Key == Key) {
+            DilloUrl *url = a_Url_dup(job->url);
+            int version = job->version;
+
+            dList_remove(job->Clients, jc);
+            Dicache_job_client_free(jc, 0);
+            /* may cancel and free the job */
+            a_Dicache_unref(url, version);
+            a_Url_free(url);
+            return;
+         }
+      }
+   }
+#else
+   (void) Key;
+#endif
 }
 
 /* ------------------------------------------------------------------------- */
 
+/*
+ * Free a kept image, releasing its imgbuf reference.
+ */
+static void Dicache_kept_free(DICacheKept *kept)
+{
+   if (kept->Reload)
+      Dicache_reload_done(kept);
+   if (kept->Queued)
+      dList_remove(ReloadQueue, kept);
+   a_Anim_free(kept->Anim);
+   a_Imgbuf_unref(kept->v_imgbuf);
+   a_Url_free(kept->url);
+   dFree(kept);
+}
+
+/*
+ * Compare function to sort kept images, least recently drawn first.
+ */
+static int Dicache_kept_use_cmp(const void *v1, const void *v2)
+{
+   uint_t u1 = a_Imgbuf_last_use(((const DICacheKept *)v1)->v_imgbuf),
+          u2 = a_Imgbuf_last_use(((const DICacheKept *)v2)->v_imgbuf);
+
+   return (u1 < u2) ? -1 : (u1 > u2) ? 1 : 0;
+}
+
+/*
+ * Compare function for searching a kept image by imgbuf
+ */
+static int Dicache_kept_by_imgbuf_cmp(const void *v1, const void *v2)
+{
+   return ((const DICacheKept *)v1)->v_imgbuf != v2;
+}
+
+/*
+ * Compare function for searching a kept image by URL
+ */
+static int Dicache_kept_by_url_cmp(const void *v1, const void *v2)
+{
+   return a_Url_cmp(((const DICacheKept *)v1)->url, v2);
+}
+
+/*
+ * Forget the kept images nobody else refers to, and drop the pixel data
+ * of the least recently drawn ones until the rest fits in the budget.
+ * Images that are visible, were drawn in the current frame, or are being
+ * decoded again, are left alone. Images drawn later are decoded again by
+ * a_Dicache_reload().
+ */
+static void Dicache_trim(void)
+{
+   int i;
+   long size, budget = (long)prefs.image_cache_size * 1024;
+   DICacheKept *kept;
+
+   for (i = 0; i < dList_length(KeptIMGs); ) {
+      kept = dList_nth_data(KeptIMGs, i);
+      if (a_Imgbuf_last_reference(kept->v_imgbuf)) {
+         dList_remove_fast(KeptIMGs, kept);
+         Dicache_kept_free(kept);
+      } else {
+         ++i;
+      }
+   }
+
+   if (budget <= 0)
+      return;
+   for (size = 0, i = 0; i < dList_length(KeptIMGs); ++i) {
+      kept = dList_nth_data(KeptIMGs, i);
+      size += a_Imgbuf_data_size(kept->v_imgbuf);
+   }
+   if (size <= budget)
+      return;
+
+   dList_sort(KeptIMGs, Dicache_kept_use_cmp);
+   for (i = 0; i < dList_length(KeptIMGs) && size > budget; ++i) {
+      int data_size;
+
+      kept = dList_nth_data(KeptIMGs, i);
+      if (kept->Queued || kept->Reload ||
+          a_Imgbuf_is_visible(kept->v_imgbuf) ||
+          a_Imgbuf_drawn_in_frame(kept->v_imgbuf))
+         continue;
+      data_size = a_Imgbuf_data_size(kept->v_imgbuf);
+      /* Only when it can be decoded again from the cache */
+      if (data_size > 0 &&
+          (a_Capi_get_flags_with_redirection(kept->url) & CAPI_Completed)) {
+         _MSG("Dicache_trim: dropping %s (%d bytes)\n",
+              URL_STR(kept->url), data_size);
+         a_Imgbuf_drop_data(kept->v_imgbuf);
+         size -= data_size;
+      }
+   }
+}
+
+/*
+ * Keep a completely decoded image under the memory budget.
+ * 'bw' is the window it was fetched for (may be NULL).
+ */
+static void Dicache_keep(DICacheEntry *DicEntry, BrowserWindow *bw)
+{
+   DICacheKept *kept;
+
+   if (DicEntry->Format < 0 ||
+       dList_find_custom(KeptIMGs, DicEntry->v_imgbuf,
+                         Dicache_kept_by_imgbuf_cmp))
+      return;
+
+   kept = dNew0(DICacheKept, 1);
+   kept->v_imgbuf = DicEntry->v_imgbuf;
+   a_Imgbuf_ref(kept->v_imgbuf);
+   kept->url = a_Url_dup(DicEntry->url);
+   kept->bw = bw;
+   kept->Format = DicEntry->Format;
+   kept->bg_color = DicEntry->bg_color;
+   kept->type = DicEntry->type;
+   kept->width = DicEntry->width;
+   kept->height = DicEntry->height;
+   kept->ScaleDenom = DicEntry->ScaleDenom;
+   kept->Anim = DicEntry->Anim;
+   DicEntry->Anim = NULL;
+   if (kept->Anim)
+      a_Anim_start(kept->Anim, kept->v_imgbuf);
+   dList_append(KeptIMGs, kept);
+   /* (this may ask for it at full size already) */
+   a_Imgbuf_set_reloader(kept->v_imgbuf);
+
+   Dicache_trim();
+}
+
+/*
+ * Decoding kept images again.
+ *
+ * When a dropped image is drawn, it's queued, and decoded again later
+ * from the cached data: on a worker thread when there are any, or else
+ * from a timeout, one image at a time. The decoder writes into a
+ * temporary entry (DIC_Reload) which refers to the existing imgbuf, so
+ * a_Dicache_set_parms() doesn't create a new one. When the data has left
+ * the cache meanwhile, it's fetched again first.
+ */
+
+static void Dicache_reload_cb(void *data);
+
+/*
+ * Have Dicache_reload_cb() called after 'delay' seconds (or sooner, if
+ * it's already scheduled so).
+ */
+static void Dicache_reload_schedule(float delay)
+{
+   if (ReloadActive) {
+      if (delay > 0.0)
+         return;
+      a_Timeout_remove(Dicache_reload_cb, NULL);
+   }
+   a_Timeout_add(delay, Dicache_reload_cb, NULL);
+   ReloadActive = 1;
+}
+
+/*
+ * Record the new size of a kept image that was decoded again at another
+ * size, here and in the entry that decoded it first (if it's still there).
+ */
+static void Dicache_kept_resized(DICacheKept *kept, DICacheEntry *Reload)
+{
+   DICacheNode *node;
+   DICacheEntry *entry;
+   uint_t y;
+
+   kept->width = Reload->width;
+   kept->height = Reload->height;
+   kept->ScaleDenom = Reload->ScaleDenom;
+
+   node = dList_find_sorted(CachedIMGs, kept->url, Dicache_node_by_url_cmp);
+   for (entry = node ? node->first : NULL; entry; entry = entry->next) {
+      if (entry->v_imgbuf != kept->v_imgbuf)
+         continue;
+      dicache_size_total -= entry->TotalSize;
+      entry->TotalSize = entry->TotalSize / (entry->width * entry->height) *
+                         kept->width * kept->height;
+      dicache_size_total += entry->TotalSize;
+      entry->width = kept->width;
+      entry->height = kept->height;
+      entry->ScaleDenom = kept->ScaleDenom;
+      a_Bitvec_free(entry->BitVec);
+      entry->BitVec = a_Bitvec_new((int)entry->height);
+      for (y = 0; y < entry->height; ++y)
+         a_Bitvec_set_bit(entry->BitVec, (int)y);
+   }
+}
+
+/*
+ * Finish decoding a kept image again (or stop it), and free its
+ * temporary entry.
+ */
+static void Dicache_reload_done(DICacheKept *kept)
+{
+   DICacheEntry *entry = kept->Reload;
+
+   if (entry->Decoder)
+      entry->Decoder(CA_Abort, entry->DecoderData);
+   dList_remove(Reloads, kept);
+   kept->Reload = NULL;
+   kept->Refetched = 0;
+   if (entry->State >= DIC_SetParms &&
+       (entry->width != kept->width || entry->height != kept->height))
+      Dicache_kept_resized(kept, entry);
+   if (kept->WantFull && kept->ScaleDenom > 1) {
+      /* (asked for while it was decoded again at the reduced size) */
+      kept->Queued = 1;
+      dList_append(ReloadQueue, kept);
+   } else {
+      kept->WantFull = 0;
+   }
+   /* only the first frame of an animation is decoded again */
+   if (kept->Anim)
+      a_Anim_rewind(kept->Anim);
+   dFree(entry->cmap);
+   a_Bitvec_free(entry->BitVec);
+   dFree(entry);
+
+   /* (another version of the URL may be waiting) */
+   if (dList_length(ReloadQueue))
+      Dicache_reload_schedule(0.0);
+}
+
+/*
+ * Decode a kept image again right away.
+ */
+static void Dicache_reload_decode(DICacheKept *kept, DilloImage *Image)
+{
+   CacheClient_t Client;
+   CA_Callback_t Decoder;
+   char *buf;
+   int size;
+
+   if (!a_Cache_get_buf(kept->url, &buf, &size))
+      return;
+   if (buf) {
+      memset(&Client, 0, sizeof(Client));
+      Client.Url = kept->url;
+      Client.Buf = buf;
+      Client.BufSize = size;
+      Client.CbData =
+         Dicache_decoder_new(kept->Format, Image, kept->url, DIC_Reload);
+      Decoder = Dicache_decoder(kept->Format);
+      if (Client.CbData && Decoder) {
+         Decoder(CA_Send, &Client);
+         Decoder(CA_Abort, Client.CbData);
+      }
+   }
+   a_Cache_unref_buf(kept->url);
+}
+
+/*
+ * Start decoding a kept image again, from its complete data in the cache.
+ * Return value: whether it's done already (it was decoded right away).
+ */
+static int Dicache_reload_start(DICacheKept *kept)
+{
+   DICacheEntry *entry;
+   DilloImage Image;
+
+   _MSG("Dicache_reload_start: %s\n", URL_STR(kept->url));
+   entry = Dicache_entry_new();
+   entry->url = kept->url;
+   entry->version = DIC_Reload;
+   entry->v_imgbuf = kept->v_imgbuf;
+   entry->type = kept->type;
+   entry->Format = kept->Format;
+   entry->bg_color = kept->bg_color;
+   if (kept->WantFull) {
+      /* the decoder sets the full size (see a_Dicache_set_parms()) */
+      kept->WantFull = 0;
+   } else {
+      entry->width = kept->width;
+      entry->height = kept->height;
+      if (kept->ScaleDenom > 1) {
+         /* make the decoder choose the same reduced size */
+         entry->HintWidth = kept->width;
+         entry->HintHeight = kept->height;
+      }
+      entry->BitVec = a_Bitvec_new((int)kept->height);
+      entry->State = DIC_SetParms;
+   }
+   kept->Reload = entry;
+   dList_append(Reloads, kept);
+
+   /* (all the decoders need of an image client) */
+   memset(&Image, 0, sizeof(Image));
+   Image.bg_color = kept->bg_color;
+
+#ifdef D_IMG_THREADED
+   if (Dicache_workers_init()) {
+      DilloImage *JobImage = dNew(DilloImage, 1);
+
+      *JobImage = Image;
+      entry->Decoder = (CA_Callback_t) Dicache_job_callback;
+      entry->DecoderData = Dicache_job_new(entry, JobImage, kept->url);
+      return 0;
+   }
+#endif
+   Dicache_reload_decode(kept, &Image);
+   Dicache_reload_done(kept);
+   return 1;
+}
+
+/*
+ * Cache client for the data of a kept image that is fetched again: the
+ * queued reloads are looked at as soon as it's complete.
+ */
+static void Dicache_refetch_client(int Op, CacheClient_t *Client)
+{
+   (void) Client;
+   if (Op == CA_Close || Op == CA_Abort)
+      Dicache_reload_schedule(0.0);
+}
+
+/*
+ * Fetch the data of a kept image again through the cache, for the window
+ * it was fetched for if that's still open, or else for any.
+ */
+static void Dicache_refetch(DICacheKept *kept)
+{
+   BrowserWindow *bw = NULL;
+   DilloWeb *Web;
+   int i;
+
+   for (i = 0; i < a_Bw_num(); ++i)
+      if (!bw || a_Bw_get(i) == kept->bw)
+         bw = a_Bw_get(i);
+   kept->Refetched = 1;
+   if (!bw)
+      return;
+
+   _MSG("Dicache_refetch: %s\n", URL_STR(kept->url));
+   Web = a_Web_new(kept->url, NULL);
+   Web->bw = bw;
+   a_Capi_open_url(Web, Dicache_refetch_client, NULL);
+}
+
+/*
+ * Timeout callback: decode the queued kept images again, once their data
+ * is complete in the cache.
+ */
+static void Dicache_reload_cb(void *data)
+{
+   DICacheKept *kept;
+   int i, flags, waiting = 0;
+
+   (void) data;
+   ReloadActive = 0;
+   for (i = 0; i < dList_length(ReloadQueue); ) {
+      kept = dList_nth_data(ReloadQueue, i);
+      flags = a_Capi_get_flags_with_redirection(kept->url);
+      if (dList_find_custom(Reloads, kept->url, Dicache_kept_by_url_cmp)) {
+         /* another version of it first (this one is looked at again
+          * when that's done) */
+         ++i;
+      } else if (flags & CAPI_Completed) {
+         dList_remove(ReloadQueue, kept);
+         kept->Queued = 0;
+         if (Dicache_reload_start(kept)) {
+            /* one at a time, so that the rest isn't held up too long */
+            if (dList_length(ReloadQueue))
+               Dicache_reload_schedule(0.0);
+            return;
+         }
+      } else if (!(flags & CAPI_IsCached) && kept->Refetched) {
+         /* fetching it again failed; it keeps the placeholder */
+         MSG("a_Dicache_reload: %s is no longer cached\n",
+             URL_STR(kept->url));
+         dList_remove(ReloadQueue, kept);
+         kept->Queued = 0;
+      } else {
+         if (!(flags & CAPI_IsCached))
+            Dicache_refetch(kept);
+         waiting = 1;
+         ++i;
+      }
+   }
+   /* (not every answer makes it to Dicache_refetch_client(), e.g. a
+    *  redirection) */
+   if (waiting)
+      Dicache_reload_schedule(DICACHE_REFETCH_POLL);
+}
+
+/*
+ * Have a kept image that was decoded at a reduced size decoded again in
+ * full, since a larger size of it is wanted (e.g., set by CSS, or by
+ * zooming). Until then, it's shown scaled up.
+ */
+void a_Dicache_enlarge(void *v_imgbuf)
+{
+   DICacheKept *kept;
+
+   if (!(kept = dList_find_custom(KeptIMGs, v_imgbuf,
+                                  Dicache_kept_by_imgbuf_cmp)) ||
+       kept->ScaleDenom <= 1 || kept->WantFull)
+      return;
+   _MSG("a_Dicache_enlarge: %s\n", URL_STR(kept->url));
+   kept->WantFull = 1;
+   if (!kept->Queued && !kept->Reload) {
+      kept->Queued = 1;
+      dList_append(ReloadQueue, kept);
+      Dicache_reload_schedule(0.0);
+   }
+}
+
+/*
+ * Have a kept image decoded again, after its pixel data was dropped.
+ * This is called while the image is drawn, so it's only queued here; the
+ * imgbuf shows a placeholder until the rows arrive.
+ */
+void a_Dicache_reload(void *v_imgbuf)
+{
+   DICacheKept *kept;
+
+   if (!(kept = dList_find_custom(KeptIMGs, v_imgbuf,
+                                  Dicache_kept_by_imgbuf_cmp)) ||
+       kept->Queued || kept->Reload)
+      return;
+   kept->Queued = 1;
+   dList_append(ReloadQueue, kept);
+   Dicache_reload_schedule(0.0);
+}
+
 /*
  * Free the imgbuf (RGB data) of unused entries.
  */
@@ -534,6 +1913,7 @@ void a_Dicache_cleanup(void)
    DICacheEntry *entry;
 
    _MSG("a_Dicache_cleanup\n");
+   Dicache_trim();
    for (i = 0; i < dList_length(CachedIMGs); ++i) {
       node = dList_nth_data(CachedIMGs, i);
       /* iterate each entry of this node */
@@ -563,6 +1943,7 @@ void a_Dicache_freeall(void)
 {
    DICacheNode *node;
    DICacheEntry *entry;
+   DICacheKept *kept;
 
    /* Remove every dicache node and its entries */
    while ((node = dList_nth_data(CachedIMGs, 0))) {
@@ -570,6 +1951,7 @@ void a_Dicache_freeall(void)
          node->first = entry->next;
          dFree(entry->cmap);
          a_Bitvec_free(entry->BitVec);
+         a_Anim_free(entry->Anim);
          a_Imgbuf_unref(entry->v_imgbuf);
          dicache_size_total -= entry->TotalSize;
       }
@@ -578,4 +1960,14 @@ void a_Dicache_freeall(void)
       dFree(node);
    }
    dList_free(CachedIMGs);
+
+   while ((kept = dList_nth_data(KeptIMGs, 0))) {
+      dList_remove_fast(KeptIMGs, kept);
+      Dicache_kept_free(kept);
+   }
+   dList_free(KeptIMGs);
+   dList_free(ReloadQueue);
+   dList_free(Reloads);
+   if (ReloadActive)
+      a_Timeout_remove(Dicache_reload_cb, NULL);
 }
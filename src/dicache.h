@@ -9,9 +9,15 @@ extern "C" {
 #include "bitvec.h"
 #include "image.hh"
 #include "cache.h"
+#include "anim.h"
+#include "../lout/perf.h"
 
 /* Symbolic name to request the last version of an image */
 #define DIC_Last  -1
+/* Version of the temporary entry used to refill a dropped image */
+#define DIC_Reload  -2
+/* Version seen by decoders running on an image decoding thread */
+#define DIC_Worker  -3
 
 
 /* These will reflect the entry's "state" */
@@ -26,10 +32,27 @@ typedef enum {
 
 typedef struct _DICacheEntry DICacheEntry;
 
+/*
+ * An image decoder. The dicache keeps a table of them, which is where
+ * the MIME handlers and the content sniffer find the image formats.
+ */
+typedef struct {
+   const char *name;                /* Format name, for messages */
+   const char *const *mime_types;   /* Types it handles (NULL-terminated) */
+   int (*sniff)(const uchar_t *buf, size_t size); /* Data in this format? */
+   void *(*create)(DilloImage *Image, DilloUrl *url, int version);
+   CA_Callback_t callback;          /* Incremental decoding callback */
+} DilloImgDecoder;
+
 struct _DICacheEntry {
    DilloUrl *url;          /* Image URL for this entry */
    uint_t width, height;   /* As taken from image data */
+   uint_t HintWidth,       /* Display size wanted by the clients */
+          HintHeight;      /* (both 0 means unconstrained) */
+   uint_t ScaleDenom;      /* Reduction applied by the decoder (1 = none) */
    DilloImgType type;      /* Image type */
+   int Format;             /* Decoder to use (GIF, PNG or JPEG) */
+   int32_t bg_color;       /* Background color for transparency */
    uchar_t *cmap;          /* Color map */
    void *v_imgbuf;         /* Void pointer to an Imgbuf object */
    uint_t TotalSize;       /* Amount of memory the image takes up */
@@ -43,6 +66,10 @@ struct _DICacheEntry {
    CA_Callback_t Decoder;  /* Client function */
    void *DecoderData;      /* Client function data */
    uint_t DecodedSize;     /* Size of already decoded data */
+   DilloAnim *Anim;        /* Frames of an animated image (or NULL) */
+#ifdef ENABLE_PERF
+   int64_t DecodeTime;     /* Time spent decoding so far */
+#endif
 
    DICacheEntry *next;     /* Link to the next "newer" version */
 };
@@ -52,12 +79,10 @@ void a_Dicache_init (void);
 
 DICacheEntry *a_Dicache_get_entry(const DilloUrl *Url, int version);
 
-void *a_Dicache_png_image(const char *Type, void *Ptr, CA_Callback_t *Call,
-                          void **Data);
-void *a_Dicache_gif_image(const char *Type, void *Ptr, CA_Callback_t *Call,
-                          void **Data);
-void *a_Dicache_jpeg_image(const char *Type, void *Ptr, CA_Callback_t *Call,
-                           void **Data);
+const DilloImgDecoder *a_Dicache_get_decoder(int i);
+const char *a_Dicache_sniff_type(const void *Data, size_t Size);
+void *a_Dicache_image(const char *Type, void *Ptr, CA_Callback_t *Call,
+                      void **Data);
 void a_Dicache_callback(int Op, CacheClient_t *Client);
 
 void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
@@ -67,12 +92,18 @@ void a_Dicache_set_cmap(DilloUrl *url, int version, DilloImage *Image,
                         int num_colors_max, int bg_index);
 void a_Dicache_new_scan(const DilloUrl *url, int version);
 void a_Dicache_write(DilloUrl *url, int version, const uchar_t *buf, uint_t Y);
+void a_Dicache_write_rows(DilloUrl *url, int version, const uchar_t *buf,
+                          uint_t y0, uint_t nrows, uint_t stride);
+void a_Dicache_set_anim(DilloUrl *url, int version, DilloAnim *anim);
 void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client);
 
 void a_Dicache_invalidate_entry(const DilloUrl *Url);
 DICacheEntry* a_Dicache_ref(const DilloUrl *Url, int version);
 void a_Dicache_unref(const DilloUrl *Url, int version);
+void a_Dicache_stop_client(int Key);
 void a_Dicache_cleanup(void);
+void a_Dicache_reload(void *v_imgbuf);
+void a_Dicache_enlarge(void *v_imgbuf);
 void a_Dicache_freeall(void);
 
 
@@ -12,8 +12,19 @@
 /*
  * Downloads GUI
  * This is Dillo's simple built-in download manager.
+ *
+ * All the downloads share one curl multi handle, which tells us the sockets
+ * and the timeout to wait on; so a download is serviced exactly when its
+ * socket is ready, instead of being polled.
+ *
+ * A big download from a server that takes byte ranges is split into
+ * segments, which are fetched over parallel connections and written at
+ * their place in the (preallocated) file. A journal next to the file
+ * records how far each segment got, so that the download can be resumed.
  */
 
+#include <config.h>
+
 #ifdef ENABLE_DOWNLOADS
 
 /*
@@ -28,6 +39,12 @@
 #endif
 #include <curl/curl.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
 #include "download.hh"
 #include "prefs.h"
 #include "../dlib/dlib.h"
@@ -48,12 +65,34 @@
 
 #include "msg.h"
 #include "timeout.hh"
+#include "IO/iowatch.hh"
 
-// The download and cleanup callbacks are called on a short delay to prevent
-// Dillo from using 100% of the system CPU (like a true idle callback would).
-// Note that too long a timeout will limit your maximum download speed!
-const double DL_TIMEOUT = 0.01;
+// The cleanup callback is called on a short delay to prevent Dillo from
+// using 100% of the system CPU (like a true idle callback would).
 const double CLEANUP_TIMEOUT = 0.5;
+// Minimum time between updates of the progress display, so the numbers
+// don't change too quickly to read.
+const double PROGRESS_INTERVAL = 0.1;
+
+// Segmented downloads (prefs.download_segments is the most connections):
+// each segment is at least this big, and the journal is saved this often.
+const curl_off_t SEGMENT_MIN_SIZE = 1024 * 1024;
+const double JOURNAL_INTERVAL = 1.0;
+#define JOURNAL_EXT    ".dlj"
+#define JOURNAL_MAGIC  "dplus download journal 1"
+#define JOURNAL_MAX_SEGMENTS 64
+
+class DlGui;
+
+/*
+ * A byte range of a segmented download, and the connection fetching it.
+ */
+typedef struct {
+   CURL *handle;           // (NULL when not transferring)
+   int fd;                 // The output file
+   curl_off_t start, end;  // Range in the file: [start, end)
+   curl_off_t done;        // Bytes written from 'start' on
+} DlSegment;
 
 
 class DlGui : public Fl_Window
@@ -63,9 +102,11 @@ public:
    ~DlGui();
 
    void start();
+   void finish(CURL *handle, CURLcode result);
    void progress(double dlnow, double dltotal);
 
-   int pCounter;
+   double pShown;  // see Download_progress_callback
+   bool acceptRanges;  // see Download_probe_header_callback
 
 private:
    Fl_Box *urlLabel;
@@ -79,23 +120,43 @@ private:
    Fl_Check_Button *checkClose;
    Fl_Button *buttonClose;
 
-   CURLM *dl_multi;
+   enum { DL_SINGLE, DL_PROBE, DL_SEGMENTED } mode;
    CURL *dl_handle;
+   bool dl_active;   // dl_handle is in the multi handle
    char dl_error[CURL_ERROR_SIZE];
 
+   char *dlUrl;
+   char *dlFilename;
    FILE *outputFile;
    long resumeOffset;
-   int running_handles;
+
+   // Segmented mode
+   int dl_fd;
+   curl_off_t totalSize;
+   DlSegment *segs;
+   int nsegs;
+   char *journalName;
+   double journalSaved;
 
    char *szBasename;
    char *szTitle;
    int szTitleLength;
 
-   void mainloop();
    void complete();
    void setDlHandleOptions(char *url);
-
-   static void downloadCallback(void *cbdata);
+   void startSingle();
+   double speed();
+
+#ifdef HAVE_PWRITE
+   void probed(CURLcode result);
+   bool startSegments(curl_off_t size);
+   void startSegment(DlSegment *seg);
+   void finishSegment(DlSegment *seg, CURLcode result);
+   void stopSegments();
+   curl_off_t segmentsDone();
+   bool loadJournal(int fd);
+   void saveJournal();
+#endif /* HAVE_PWRITE */
 };
 
 void Download_cleanup_window(void *cbdata);
@@ -105,10 +166,32 @@ void Download_set_basic_options(CURL *dl_handle, const char *url);
 
 size_t Download_write_callback(void *ptr, size_t size, size_t nmemb,
                                void *userdata);
+size_t Download_segment_write_callback(void *ptr, size_t size, size_t nmemb,
+                                       void *userdata);
+size_t Download_probe_header_callback(char *ptr, size_t size, size_t nmemb,
+                                      void *userdata);
 int Download_progress_callback(void *clientp, double dltotal, double dlnow,
                                double ultotal, double ulnow);
 
 
+/*
+ * Local data
+ */
+static CURLM *Download_multi = NULL;  // Shared by all the downloads
+
+
+/*
+ * Current time, in seconds.
+ */
+static double Download_time()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
 /*
  * DlGui class constructor
  */
@@ -162,7 +245,7 @@ DlGui::DlGui(char *url, char *filename)
    buttonClose->callback(Download_close_window, (void*)this);
 
    end();
-   pCounter = 0;  // see Download_progress_callback
+   pShown = 0.0;  // see Download_progress_callback
 
    // to display progress in the window title
    char *szFilename = dStrdup(filename);
@@ -174,19 +257,41 @@ DlGui::DlGui(char *url, char *filename)
    szTitle = dNew0(char, szTitleLength);
 
    // open our output file
+   dlUrl = dStrdup(url);
+   dlFilename = dStrdup(filename);
    outputFile = fopen(filename, "ab");
 
    // how much of the file have we already downloaded?
    fseek(outputFile, 0L, SEEK_END);
    resumeOffset = ftell(outputFile);
 
-   // initialize CURL handles
-   dl_multi = curl_multi_init();
-   dl_handle = curl_easy_init();
+   dl_fd = -1;
+   totalSize = 0;
+   segs = NULL;
+   nsegs = 0;
+   journalName = dStrconcat(filename, JOURNAL_EXT, NULL);
+   journalSaved = 0.0;
+   acceptRanges = false;
 
-   running_handles = 0;
+   // initialize the CURL handle (it joins the multi handle on start())
+   dl_handle = curl_easy_init();
+   dl_active = false;
    setDlHandleOptions(url);
-   curl_multi_add_handle(dl_multi, dl_handle);
+
+   mode = DL_SINGLE;
+#ifdef HAVE_PWRITE
+   // A new download (or a segmented one to resume) may be segmented:
+   // ask the server first whether it takes byte ranges.
+   if (prefs.download_segments > 1 &&
+       (resumeOffset == 0 || access(journalName, F_OK) == 0)) {
+      mode = DL_PROBE;
+      curl_easy_setopt(dl_handle, CURLOPT_RESUME_FROM, 0L);
+      curl_easy_setopt(dl_handle, CURLOPT_NOBODY, 1L);
+      curl_easy_setopt(dl_handle, CURLOPT_HEADERFUNCTION,
+                       &Download_probe_header_callback);
+      curl_easy_setopt(dl_handle, CURLOPT_HEADERDATA, this);
+   }
+#endif /* HAVE_PWRITE */
 }
 
 /*
@@ -210,32 +315,57 @@ DlGui::~DlGui()
    dFree(szTitle);
    dFree(szBasename);
 
-   // clean up libcurl
-   if (dl_multi && dl_handle) curl_multi_remove_handle(dl_multi, dl_handle);
-   if (dl_handle)             curl_easy_cleanup(dl_handle);
-   if (dl_multi)              curl_multi_cleanup(dl_multi);
+   // clean up libcurl (this stops the download, if it's still going on)
+   if (dl_active)  curl_multi_remove_handle(Download_multi, dl_handle);
+   if (dl_handle)  curl_easy_cleanup(dl_handle);
 
    // in case there's still callbacks running...
    dl_handle = NULL;
-   dl_multi = NULL;
 
-   // remove download callback
-   a_Timeout_remove(DlGui::downloadCallback, (void*)this);
+#ifdef HAVE_PWRITE
+   if (mode == DL_SEGMENTED && segmentsDone() < totalSize) {
+      // cancelled: keep a note of what was got, to resume
+      stopSegments();
+      saveJournal();
+   }
+#endif /* HAVE_PWRITE */
+   if (dl_fd >= 0)
+      close(dl_fd);
+   dFree(segs);
+   dFree(journalName);
+   dFree(dlFilename);
+   dFree(dlUrl);
 }
 
 /*
- * Download data and update the progress display.
- * This is called periodically from DlGui::downloadCallback.
+ * A transfer is over: take it out of the multi handle, and tell the user.
+ * This is called from Download_check_done.
  */
-void DlGui::mainloop()
+void DlGui::finish(CURL *handle, CURLcode result)
 {
-   if (running_handles == 0)
-      return complete();  // download complete
+   curl_multi_remove_handle(Download_multi, handle);
 
-   CURLMcode retval = curl_multi_perform(dl_multi, &running_handles);
-   if (retval != CURLM_OK) {
-      fl_alert("Download Error: %s", dl_error);
+#ifdef HAVE_PWRITE
+   if (mode == DL_SEGMENTED) {
+      for (int i = 0; i < nsegs; i++)
+         if (segs[i].handle == handle)
+            finishSegment(&segs[i], result);
+      return;
+   }
+#endif /* HAVE_PWRITE */
+
+   dl_active = false;
+#ifdef HAVE_PWRITE
+   if (mode == DL_PROBE)
+      return probed(result);
+#endif /* HAVE_PWRITE */
+
+   if (result != CURLE_OK) {
+      fl_alert("Download Error: %s",
+               *dl_error ? dl_error : curl_easy_strerror(result));
       hide();
+   } else {
+      complete();
    }
 }
 
@@ -250,8 +380,6 @@ void DlGui::complete()
 
    if (checkClose->value())
       hide();  // close window when done
-
-   a_Timeout_remove(DlGui::downloadCallback, (void*)this);
 }
 
 /*
@@ -261,7 +389,9 @@ void DlGui::setDlHandleOptions(char *url)
 {
    Download_set_basic_options(dl_handle, url);
 
+   dl_error[0] = '\0';
    curl_easy_setopt(dl_handle, CURLOPT_ERRORBUFFER, dl_error);
+   curl_easy_setopt(dl_handle, CURLOPT_PRIVATE, this);
    curl_easy_setopt(dl_handle, CURLOPT_HEADER, 0);
    curl_easy_setopt(dl_handle, CURLOPT_RESUME_FROM, resumeOffset);
 
@@ -277,20 +407,323 @@ void DlGui::setDlHandleOptions(char *url)
 }
 
 /*
- * Download callback function.
- * This is called on a short delay to run the download and keep data moving.
+ * Download the whole file over one connection (resuming it if there's
+ * a part of it already).
  */
-void DlGui::downloadCallback(void *cbdata)
+void DlGui::startSingle()
 {
-   ((DlGui*)cbdata)->mainloop();
-   a_Timeout_repeat(DL_TIMEOUT, DlGui::downloadCallback, cbdata);
+   mode = DL_SINGLE;
+   if (access(journalName, F_OK) == 0) {
+      // the file was being written by segments: start it over
+      unlink(journalName);
+      fflush(outputFile);
+      if (ftruncate(fileno(outputFile), 0) == 0)
+         resumeOffset = 0;
+   }
+
+   if (dl_handle)
+      curl_easy_cleanup(dl_handle);
+   dl_handle = curl_easy_init();
+   setDlHandleOptions(dlUrl);
+
+   CURLMcode retval = curl_multi_add_handle(Download_multi, dl_handle);
+   if (retval != CURLM_OK) {
+      fl_alert("Download Error: %s\n", curl_multi_strerror(retval));
+      hide();
+   } else {
+      dl_active = true;
+   }
 }
 
+/*
+ * Current download speed (of all the connections).
+ */
+double DlGui::speed()
+{
+   double dlspeed = 0.0, s;
+
+   if (mode != DL_SEGMENTED) {
+      curl_easy_getinfo(dl_handle, CURLINFO_SPEED_DOWNLOAD, &dlspeed);
+   } else {
+      for (int i = 0; i < nsegs; i++)
+         if (segs[i].handle &&
+             curl_easy_getinfo(segs[i].handle, CURLINFO_SPEED_DOWNLOAD,
+                               &s) == CURLE_OK)
+            dlspeed += s;
+   }
+   return dlspeed;
+}
+
+#ifdef HAVE_PWRITE
+
+/*
+ * The server has answered the probe: download by segments if it can.
+ */
+void DlGui::probed(CURLcode result)
+{
+   double size = -1.0;
+
+   if (result == CURLE_OK)
+      curl_easy_getinfo(dl_handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &size);
+   _MSG("DlGui::probed: result=%d ranges=%d size=%.0f\n",
+        result, acceptRanges, size);
+
+   if (result != CURLE_OK || !acceptRanges ||
+       size < 2.0 * SEGMENT_MIN_SIZE || !startSegments((curl_off_t)size))
+      startSingle();
+}
+
+/*
+ * Set the output file up, and start the transfers of the segments: those
+ * in the journal, if it's for this same download, or new ones.
+ * Return value: false if the file can't be downloaded by segments.
+ */
+bool DlGui::startSegments(curl_off_t size)
+{
+   int fd;
+
+   if ((fd = open(dlFilename, O_RDWR | O_CREAT, 0666)) < 0)
+      return false;
+
+   totalSize = size;
+   if (!loadJournal(fd)) {
+      if (ftruncate(fd, size) != 0) {
+         close(fd);
+         return false;
+      }
+#ifdef HAVE_POSIX_FALLOCATE
+      // Get the disk space now, rather than finding out it's full later
+      if (posix_fallocate(fd, 0, size) == ENOSPC) {
+         fl_alert("Download Error: not enough disk space for %s",
+                  dlFilename);
+         close(fd);
+         hide();
+         return true;
+      }
+#endif /* HAVE_POSIX_FALLOCATE */
+
+      nsegs = (int)MIN(prefs.download_segments, size / SEGMENT_MIN_SIZE);
+      nsegs = MIN(nsegs, JOURNAL_MAX_SEGMENTS);
+      segs = dNew0(DlSegment, nsegs);
+      for (int i = 0; i < nsegs; i++) {
+         segs[i].start = size * i / nsegs;
+         segs[i].end = size * (i + 1) / nsegs;
+      }
+   }
+
+   mode = DL_SEGMENTED;
+   dl_fd = fd;
+   resumeOffset = 0;
+   saveJournal();
+   for (int i = 0; i < nsegs; i++) {
+      segs[i].fd = fd;
+      if (segs[i].done < segs[i].end - segs[i].start)
+         startSegment(&segs[i]);
+   }
+   if (segmentsDone() == totalSize)
+      finishSegment(NULL, CURLE_OK);  // it was all there
+   return true;
+}
+
+/*
+ * Start the transfer of what's left of a segment.
+ */
+void DlGui::startSegment(DlSegment *seg)
+{
+   char range[64];
+
+   snprintf(range, sizeof(range),
+            "%" CURL_FORMAT_CURL_OFF_T "-%" CURL_FORMAT_CURL_OFF_T,
+            seg->start + seg->done, seg->end - 1);
+
+   seg->handle = curl_easy_init();
+   Download_set_basic_options(seg->handle, dlUrl);
+   curl_easy_setopt(seg->handle, CURLOPT_ERRORBUFFER, dl_error);
+   curl_easy_setopt(seg->handle, CURLOPT_PRIVATE, this);
+   curl_easy_setopt(seg->handle, CURLOPT_RANGE, range);
+   curl_easy_setopt(seg->handle, CURLOPT_WRITEDATA, seg);
+   curl_easy_setopt(seg->handle, CURLOPT_WRITEFUNCTION,
+                    &Download_segment_write_callback);
+   curl_easy_setopt(seg->handle, CURLOPT_NOPROGRESS, 0L);
+   curl_easy_setopt(seg->handle, CURLOPT_PROGRESSFUNCTION,
+                    &Download_progress_callback);
+   curl_easy_setopt(seg->handle, CURLOPT_PROGRESSDATA, this);
+
+   if (curl_multi_add_handle(Download_multi, seg->handle) != CURLM_OK) {
+      curl_easy_cleanup(seg->handle);
+      seg->handle = NULL;
+   }
+}
+
+/*
+ * A segment's transfer is over ('seg' is NULL if none was needed).
+ * When all of them are, so is the download.
+ */
+void DlGui::finishSegment(DlSegment *seg, CURLcode result)
+{
+   if (seg) {
+      curl_easy_cleanup(seg->handle);
+      seg->handle = NULL;
+      if (result == CURLE_OK && seg->done < seg->end - seg->start)
+         result = CURLE_PARTIAL_FILE;
+      if (result != CURLE_OK) {
+         // what was got stays in the journal, for the next time
+         stopSegments();
+         saveJournal();
+         fl_alert("Download Error: %s",
+                  *dl_error ? dl_error : curl_easy_strerror(result));
+         hide();
+         return;
+      }
+   }
+
+   for (int i = 0; i < nsegs; i++)
+      if (segs[i].handle)
+         return;  // not yet
+
+   unlink(journalName);
+   progress(0.0, 0.0);
+   complete();
+}
+
+/*
+ * Stop the transfers of all the segments.
+ */
+void DlGui::stopSegments()
+{
+   for (int i = 0; i < nsegs; i++) {
+      if (segs[i].handle) {
+         curl_multi_remove_handle(Download_multi, segs[i].handle);
+         curl_easy_cleanup(segs[i].handle);
+         segs[i].handle = NULL;
+      }
+   }
+}
+
+/*
+ * Total of bytes got, in all the segments.
+ */
+curl_off_t DlGui::segmentsDone()
+{
+   curl_off_t done = 0;
+
+   for (int i = 0; i < nsegs; i++)
+      done += segs[i].done;
+   return done;
+}
+
+/*
+ * Read the journal of a segmented download of this same URL and size
+ * into the same file, if there's one.
+ * Return value: whether it was found.
+ */
+bool DlGui::loadJournal(int fd)
+{
+   FILE *fp;
+   char *line;
+   bool ok = false;
+   struct stat sb;
+   curl_off_t size = 0, pos = 0;
+   DlSegment seg;
+
+   if (fstat(fd, &sb) != 0 || sb.st_size != totalSize ||
+       !(fp = fopen(journalName, "r")))
+      return false;
+
+   if ((line = dGetline(fp)) && !strcmp(dStrstrip(line), JOURNAL_MAGIC)) {
+      dFree(line);
+      if ((line = dGetline(fp)) && !strcmp(dStrstrip(line), dlUrl)) {
+         dFree(line);
+         if ((line = dGetline(fp)) &&
+             sscanf(line, "%" CURL_FORMAT_CURL_OFF_T, &size) == 1 &&
+             size == totalSize)
+            ok = true;
+      }
+   }
+   dFree(line);
+
+   // The segments must cover the file, in order
+   while (ok && (line = dGetline(fp))) {
+      memset(&seg, 0, sizeof(seg));
+      seg.fd = fd;
+      if (sscanf(line, "%" CURL_FORMAT_CURL_OFF_T " %" CURL_FORMAT_CURL_OFF_T
+                 " %" CURL_FORMAT_CURL_OFF_T,
+                 &seg.start, &seg.end, &seg.done) != 3 ||
+          seg.start != pos || seg.end <= seg.start || seg.done < 0 ||
+          seg.done > seg.end - seg.start || nsegs == JOURNAL_MAX_SEGMENTS) {
+         ok = false;
+      } else {
+         if (!segs)
+            segs = dNew0(DlSegment, JOURNAL_MAX_SEGMENTS);
+         segs[nsegs++] = seg;
+         pos = seg.end;
+      }
+      dFree(line);
+   }
+   fclose(fp);
+
+   if (!ok || pos != totalSize) {
+      dFree(segs);
+      segs = NULL;
+      nsegs = 0;
+      return false;
+   }
+   MSG("Download: resuming %s in %d segments.\n", dlFilename, nsegs);
+   return true;
+}
+
+/*
+ * Save the journal: a new one is written, and then renamed over the old
+ * one, so there's always a complete one. The data goes to the disk first,
+ * or after a crash the journal could tell about data that was lost.
+ */
+void DlGui::saveJournal()
+{
+   char *tmpName = dStrconcat(journalName, ".tmp", NULL);
+   FILE *fp;
+
+#ifdef HAVE_FDATASYNC
+   fdatasync(dl_fd);
+#else
+   fsync(dl_fd);
+#endif /* HAVE_FDATASYNC */
+
+   if ((fp = fopen(tmpName, "w"))) {
+      fprintf(fp, "%s\n%s\n%" CURL_FORMAT_CURL_OFF_T "\n",
+              JOURNAL_MAGIC, dlUrl, totalSize);
+      for (int i = 0; i < nsegs; i++)
+         fprintf(fp, "%" CURL_FORMAT_CURL_OFF_T " %" CURL_FORMAT_CURL_OFF_T
+                 " %" CURL_FORMAT_CURL_OFF_T "\n",
+                 segs[i].start, segs[i].end, segs[i].done);
+      fflush(fp);
+      fsync(fileno(fp));
+      if (fclose(fp) == 0)
+         rename(tmpName, journalName);
+      else
+         unlink(tmpName);
+   }
+   dFree(tmpName);
+   journalSaved = Download_time();
+}
+
+#endif /* HAVE_PWRITE */
+
 /*
  * Update the progress bar.
  */
 void DlGui::progress(double dlnow, double dltotal)
 {
+#ifdef HAVE_PWRITE
+   if (mode == DL_SEGMENTED) {
+      // the progress of all the segments, rather than the caller's
+      dlnow = (double)segmentsDone();
+      dltotal = (double)totalSize;
+      if (Download_time() - journalSaved >= JOURNAL_INTERVAL &&
+          dlnow < dltotal)
+         saveJournal();
+   }
+#endif /* HAVE_PWRITE */
+
    dlnow += resumeOffset;     // so the file sizes will display correctly
    dltotal += resumeOffset;   // if we're resuming a previous download
 
@@ -306,8 +739,7 @@ void DlGui::progress(double dlnow, double dltotal)
       iconlabel(szTitle);
    }
 
-   double dlspeed;  // download speed
-   curl_easy_getinfo(dl_handle, CURLINFO_SPEED_DOWNLOAD, &dlspeed);
+   double dlspeed = speed();  // download speed
 
    // figure out appropriate units
    char siPrefix[5] = "kMGT";
@@ -360,27 +792,109 @@ void DlGui::progress(double dlnow, double dltotal)
  */
 void DlGui::start()
 {
-   CURLMcode retval = curl_multi_perform(dl_multi, &running_handles);
+   // the multi handle sets a timeout to get it going (for the probe, too)
+   CURLMcode retval = curl_multi_add_handle(Download_multi, dl_handle);
    if (retval != CURLM_OK) {
-      fl_alert("Download Error: %s\n", dl_error);
+      fl_alert("Download Error: %s\n", curl_multi_strerror(retval));
       hide();
-      return;
+   } else {
+      dl_active = true;
    }
 
-   // keep the data moving and update the progress display
-   a_Timeout_add(DL_TIMEOUT, DlGui::downloadCallback, (void*)this);
-
    // delete the download window after it's been closed
    a_Timeout_add(CLEANUP_TIMEOUT, Download_cleanup_window, (void*)this);
 }
 
 
 /*
- * Initialize libcurl.
+ * Let the downloads that are over know it.
+ */
+static void Download_check_done()
+{
+   CURLMsg *msg;
+   int pending;
+   char *dlgui;
+
+   while ((msg = curl_multi_info_read(Download_multi, &pending))) {
+      if (msg->msg == CURLMSG_DONE &&
+          curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE,
+                            &dlgui) == CURLE_OK && dlgui)
+         ((DlGui*)dlgui)->finish(msg->easy_handle, msg->data.result);
+   }
+}
+
+/*
+ * Let libcurl act on a socket that's ready.
+ */
+static void Download_socket_action(int fd, int ev_bitmask)
+{
+   int running;
+
+   curl_multi_socket_action(Download_multi, fd, ev_bitmask, &running);
+   Download_check_done();
+}
+
+/*
+ * IO watch callbacks for the sockets of the downloads.
+ */
+static void Download_read_cb(int fd, void *data)
+{
+   Download_socket_action(fd, CURL_CSELECT_IN);
+}
+
+static void Download_write_cb(int fd, void *data)
+{
+   Download_socket_action(fd, CURL_CSELECT_OUT);
+}
+
+/*
+ * Timeout callback: libcurl's timeout expired.
+ */
+static void Download_timeout_cb(void *data)
+{
+   Download_socket_action(CURL_SOCKET_TIMEOUT, 0);
+}
+
+/*
+ * libcurl tells which events to watch on a socket (CURLMOPT_SOCKETFUNCTION).
+ */
+static int Download_socket_callback(CURL *easy, curl_socket_t s, int what,
+                                    void *userp, void *socketp)
+{
+   int fd = (int)s;
+
+   a_IOwatch_remove_fd(fd, DIO_READ | DIO_WRITE);
+   if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)
+      a_IOwatch_add_fd(fd, DIO_READ, Download_read_cb, NULL);
+   if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT)
+      a_IOwatch_add_fd(fd, DIO_WRITE, Download_write_cb, NULL);
+   return 0;
+}
+
+/*
+ * libcurl tells how long it may wait for the sockets (-1 meaning forever)
+ * (CURLMOPT_TIMERFUNCTION).
+ */
+static int Download_timer_callback(CURLM *multi, long timeout_ms, void *userp)
+{
+   a_Timeout_remove(Download_timeout_cb, NULL);
+   if (timeout_ms >= 0)
+      a_Timeout_add(timeout_ms / 1000.0, Download_timeout_cb, NULL);
+   return 0;
+}
+
+/*
+ * Initialize libcurl, and the multi handle for the downloads.
  */
 void a_Download_init()
 {
    curl_global_init(CURL_GLOBAL_ALL);
+
+   Download_multi = curl_multi_init();
+   curl_multi_setopt(Download_multi, CURLMOPT_SOCKETFUNCTION,
+                     Download_socket_callback);
+   curl_multi_setopt(Download_multi, CURLMOPT_TIMERFUNCTION,
+                     Download_timer_callback);
 }
 
 /*
@@ -388,6 +902,9 @@ void a_Download_init()
  */
 void a_Download_freeall()
 {
+   a_Timeout_remove(Download_timeout_cb, NULL);
+   curl_multi_cleanup(Download_multi);
+   Download_multi = NULL;
    curl_global_cleanup();
 }
 
@@ -521,6 +1038,64 @@ size_t Download_write_callback(void *ptr, size_t size, size_t nmemb,
    return fwrite(ptr, size, nmemb, (FILE*)userdata);
 }
 
+#ifdef HAVE_PWRITE
+
+/*
+ * Write function callback for a segment: the data goes at its place in
+ * the file.
+ */
+size_t Download_segment_write_callback(void *ptr, size_t size, size_t nmemb,
+                                       void *userdata)
+{
+   DlSegment *seg = (DlSegment*)userdata;
+   size_t n = size * nmemb, written;
+   long code = 0;
+   ssize_t st;
+
+   // A server that doesn't send just the range would corrupt the file
+   curl_easy_getinfo(seg->handle, CURLINFO_RESPONSE_CODE, &code);
+   if (code != 206 || (curl_off_t)n > seg->end - seg->start - seg->done)
+      return 0;
+
+   for (written = 0; written < n; written += st) {
+      st = pwrite(seg->fd, (char*)ptr + written, n - written,
+                  seg->start + seg->done);
+      if (st < 0) {
+         if (errno == EINTR) {
+            st = 0;
+            continue;
+         }
+         return 0;
+      }
+      seg->done += st;
+   }
+   return n;
+}
+
+/*
+ * Header callback for the probe: does the server take byte ranges?
+ */
+size_t Download_probe_header_callback(char *ptr, size_t size, size_t nmemb,
+                                      void *userdata)
+{
+   DlGui *dlgui = (DlGui*)userdata;
+   size_t n = size * nmemb;
+   const char *name = "Accept-Ranges:";
+   size_t len = strlen(name);
+
+   if (n > 5 && !strncmp(ptr, "HTTP/", 5)) {
+      // a new response (after a redirection)
+      dlgui->acceptRanges = false;
+   } else if (n > len && !dStrncasecmp(ptr, name, len)) {
+      char *value = dStrndup(ptr + len, n - len);
+      dlgui->acceptRanges = !dStrcasecmp(dStrstrip(value), "bytes");
+      dFree(value);
+   }
+   return n;
+}
+
+#endif /* HAVE_PWRITE */
+
 /*
  * Download progress callback.
  * This is called periodically from libcurl while the download is running.
@@ -529,15 +1104,17 @@ int Download_progress_callback(void *clientp, double dltotal, double dlnow,
                                double ultotal, double ulnow)
 {
    DlGui *dlgui = (DlGui*)clientp;
+   double now = Download_time();
    (void)ultotal;
    (void)ulnow;
 
-   // Update the progress display on a slight delay so the numbers don't
-   // change too quickly to read.  This shouldn't be too long, or the download
-   // progress will feel slow; a delay of (8 * DL_TIMEOUT) seems about right:
-   if (++(dlgui->pCounter) == 8) {
+   // Update the progress display every PROGRESS_INTERVAL seconds at most,
+   // as libcurl calls this whenever data comes (or a second goes by).
+   // This shouldn't be too long, or the download progress will feel slow.
+   if (now - dlgui->pShown >= PROGRESS_INTERVAL ||
+       (dltotal > 0.0 && dlnow >= dltotal)) {
       dlgui->progress(dlnow, dltotal);
-      dlgui->pCounter = 0;
+      dlgui->pShown = now;
    }
 
    return 0;
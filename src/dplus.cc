@@ -58,6 +58,7 @@
 #include "dw/fltkcore.hh"
 
 #include "../dlib/dsock.h"
+#include "../lout/perf.h"
 
 /*
  * Command line options structure
@@ -70,6 +71,11 @@ typedef enum {
    DILLO_CLI_VERSION       = 1 << 3,
    DILLO_CLI_LOCAL         = 1 << 4,
    DILLO_CLI_GEOMETRY      = 1 << 5,
+#ifdef ENABLE_PERF
+   DILLO_CLI_RECORD        = 1 << 6,
+   DILLO_CLI_REPLAY        = 1 << 7,
+   DILLO_CLI_REPLAY_SCALE  = 1 << 8,
+#endif
    DILLO_CLI_ERROR         = 1 << 15,
 } OptID;
 
@@ -92,6 +98,17 @@ static const CLI_options Options[] = {
     "  -h, --help             Display this help text and exit."},
    {"-l", "--local",      0, DILLO_CLI_LOCAL,
     "  -l, --local            Don't load images for these URL(s)."},
+#ifdef ENABLE_PERF
+   {"-r", "--record",     1, DILLO_CLI_RECORD,
+    "  -r, --record FILE      Record what's read from the network into\n"
+    "                         FILE, for --replay."},
+   {"-R", "--replay",     1, DILLO_CLI_REPLAY,
+    "  -R, --replay FILE      Serve HTTP(S) from a FILE recorded with\n"
+    "                         --record; print the load times and exit."},
+   {"-S", "--replay-scale", 1, DILLO_CLI_REPLAY_SCALE,
+    "  -S, --replay-scale N   Multiply the replayed latencies by N\n"
+    "                         (0 serves everything at once)."},
+#endif
    {"-v", "--version",    0, DILLO_CLI_VERSION,
     "  -v, --version          Display version info and exit."},
    {"-x", "--xid",        1, DILLO_CLI_XID,
@@ -287,6 +304,10 @@ int main(int argc, char **argv)
        height = PREFS_GEOMETRY_DEFAULT_HEIGHT;
    char **opt_argv;
    FILE *fp;
+#ifdef ENABLE_PERF
+   const char *record_file = NULL, *replay_file = NULL;
+   float replay_scale = 1.0;
+#endif
 
    srand((uint_t)(time(0) ^ getpid()));
 
@@ -326,6 +347,25 @@ int main(int argc, char **argv)
             return 2;
          }
          break;
+#ifdef ENABLE_PERF
+      case DILLO_CLI_RECORD:
+         record_file = opt_argv[0];
+         break;
+      case DILLO_CLI_REPLAY:
+         replay_file = opt_argv[0];
+         break;
+      case DILLO_CLI_REPLAY_SCALE:
+      {
+         char *end;
+         replay_scale = strtod(opt_argv[0], &end);
+         if (*end || replay_scale < 0) {
+            fprintf(stderr, "replay scale \"%s\" not valid.\n",
+                    opt_argv[0]);
+            return 2;
+         }
+         break;
+      }
+#endif
       case DILLO_CLI_VERSION:
          puts("Dillo version " VERSION);
          return 0;
@@ -371,6 +411,11 @@ int main(int argc, char **argv)
    a_Bookmarks_init();
    a_Auth_init();
    a_Download_init();
+#ifdef ENABLE_PERF
+   if ((record_file && a_Replay_record_init(record_file) != 0) ||
+       (replay_file && a_Replay_play_init(replay_file, replay_scale) != 0))
+      return 2;
+#endif
 
    /* command line options override preferences */
    if (options_got & DILLO_CLI_FULLWINDOW)
@@ -460,12 +505,18 @@ int main(int argc, char **argv)
    a_Cache_freeall();
    a_Dicache_freeall();
    a_Http_freeall();
+#ifdef ENABLE_PERF
+   a_Replay_freeall();
+#endif
    a_Dns_freeall();
    a_History_freeall();
    a_Prefs_freeall();
    Keys::free();
    Paths::free();
    a_Sock_freeall();
+#ifdef ENABLE_PERF
+   a_Perf_freeall();
+#endif
    /* TODO: auth, css */
 
    MSG("Dillo: normal exit!\n");
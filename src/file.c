@@ -11,11 +11,15 @@
  */
 
 /*
- * Directory scanning is no longer streamed, but it gets sorted instead!
- * Directory entries on top, files next.
- * With new HTML layout.
+ * Directories are listed as they are read, a batch of entries at a time,
+ * so that huge ones don't hold up the browser. Small ones are sorted:
+ * directory entries on top, files next. With new HTML layout.
+ *
+ * Regular files are mapped into memory, where the cache takes them from,
+ * when the system can; other files are read bit by bit, without blocking.
  */
 
+#include <config.h>
 #include "file.h"
 
 /*
@@ -37,12 +41,16 @@
 #ifndef O_BINARY
 #  define O_BINARY 0
 #endif
+#ifndef O_NONBLOCK
+#  define O_NONBLOCK 0
+#endif
 
 #include <ctype.h>           /* for tolower */
 #include <errno.h>           /* for errno */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>           /* for INT_MAX */
 #include <fcntl.h>            /* for access() */
 #include <unistd.h>
 #include <sys/stat.h>
@@ -50,9 +58,17 @@
 #include <sys/time.h>
 #include <dirent.h>
 #include <time.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#  ifndef MAP_ANONYMOUS
+#     define MAP_ANONYMOUS MAP_ANON
+#  endif
+#endif
 
 #include "url.h"
 #include "msg.h"
+#include "prefs.h"
+#include "dicache.h"
 
 #include "../d_size.h"
 #include "../dlib/dlib.h"
@@ -60,6 +76,7 @@
 
 #define MAXNAMESIZE 30
 #define HIDE_DOTFILES TRUE
+#define DIR_BATCH 256      /* Entries read and sent at a time, unsorted */
 
 
 typedef enum {
@@ -79,7 +96,10 @@ typedef struct {
 
 typedef struct {
    char *dirname;
-   Dlist *flist;       /* List of files and subdirectories (for sorting) */
+   DIR *dir;           /* While there's more to read */
+   Dlist *flist;       /* Files and subdirectories read, not sent yet */
+   int sorted;         /* Whether the whole listing is being sorted */
+   int nrows;          /* Rows sent so far */
 } DilloDir;
 
 typedef struct {
@@ -89,10 +109,11 @@ typedef struct {
    char *filename;
    int file_fd;
    off_t file_sz;
+   mode_t file_mode;
    DilloDir *d_dir;
    FileState state;
    int err_code;
-   Dstr *data;
+   Dstr *data;         /* Where the answer goes (the caller's) */
 } ClientInfo;
 
 /*
@@ -231,7 +252,8 @@ static void File_close(int fd)
 /*
  * Detects 'Content-Type' when the server does not supply one.
  * It uses the magic(5) logic from file(1). Currently, it
- * only checks the few mime types that Dillo supports.
+ * only checks the few mime types that Dillo supports (for images,
+ * those the dicache has decoders for).
  *
  * 'Data' is a pointer to the first bytes of the raw data.
  * (this is based on a_Misc_get_content_type_from_data())
@@ -241,11 +263,11 @@ static const char *File_get_content_type_from_data(void *Data, size_t Size)
    static const char *Types[] = {
       "application/octet-stream",
       "text/html", "text/plain",
-      "image/gif", "image/png", "image/jpeg",
    };
    int Type = 0;
    char *p = Data;
    size_t i, non_ascci;
+   const char *ImgType;
 
    _MSG("File_get_content_type_from_data:: Size = %d\n", Size);
 
@@ -261,14 +283,8 @@ static const char *File_get_content_type_from_data(void *Data, size_t Size)
       Type = 1;
 
    /* Images */
-   } else if (Size >= 4 && !dStrncasecmp(p, "GIF8", 4)) {
-      Type = 3;
-   } else if (Size >= 4 && !dStrncasecmp(p, "\x89PNG", 4)) {
-      Type = 4;
-   } else if (Size >= 2 && !dStrncasecmp(p, "\xff\xd8", 2)) {
-      /* JPEG has the first 2 bytes set to 0xffd8 in BigEndian - looking
-       * at the character representation should be machine independent. */
-      Type = 5;
+   } else if ((ImgType = a_Dicache_sniff_type(p, Size))) {
+      return ImgType;
 
    /* Text */
    } else {
@@ -311,29 +327,40 @@ static int File_comp(const FileInfo *f1, const FileInfo *f2)
 }
 
 /*
- * Allocate a DilloDir structure, set safe values in it and sort the entries.
+ * Allocate a DilloDir structure, and set safe values in it.
+ * (the entries are read later, by File_dillodir_read())
  */
 static DilloDir *File_dillodir_new(char *dirname)
 {
-   struct stat sb;
-   struct dirent *de;
    DIR *dir;
    DilloDir *Ddir;
-   FileInfo *finfo;
-   char *fname;
-   int dirname_len;
 
    if (!(dir = opendir(dirname)))
       return NULL;
 
    Ddir = dNew(DilloDir, 1);
    Ddir->dirname = dStrdup(dirname);
-   Ddir->flist = dList_new(512);
+   Ddir->dir = dir;
+   Ddir->flist = dList_new(DIR_BATCH);
+   Ddir->sorted = (prefs.dir_sort_limit > 0);
+   Ddir->nrows = 0;
 
-   dirname_len = strlen(Ddir->dirname);
+   return Ddir;
+}
 
-   /* Scan every name and sort them */
-   while ((de = readdir(dir)) != 0) {
+/*
+ * Read up to 'max' more entries into Ddir->flist, and stat them.
+ * The directory is closed when there's no more.
+ */
+static void File_dillodir_read(DilloDir *Ddir, int max)
+{
+   struct stat sb;
+   struct dirent *de;
+   FileInfo *finfo;
+   char *fname;
+   int n, dirname_len = strlen(Ddir->dirname);
+
+   for (n = 0; n < max && (de = readdir(Ddir->dir)) != 0; ) {
       if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
          continue;              /* skip "." and ".." */
 
@@ -360,32 +387,39 @@ static DilloDir *File_dillodir_new(char *dirname)
       finfo->mtime = sb.st_mtime;
 
       dList_append(Ddir->flist, finfo);
+      ++n;
    }
 
-   closedir(dir);
-
-   /* sort the entries */
-   dList_sort(Ddir->flist, (dCompareFunc)File_comp);
-
-   return Ddir;
+   if (n < max) {
+      closedir(Ddir->dir);
+      Ddir->dir = NULL;
+   }
 }
 
 /*
- * Deallocate a DilloDir structure.
+ * Free the entries in Ddir->flist, and empty it.
  */
-static void File_dillodir_free(DilloDir *Ddir)
+static void File_dillodir_clear(DilloDir *Ddir)
 {
-   int i;
    FileInfo *finfo;
 
-   dReturn_if (Ddir == NULL);
-
-   for (i = 0; i < dList_length(Ddir->flist); ++i) {
-      finfo = dList_nth_data(Ddir->flist, i);
+   while ((finfo = dList_nth_data(Ddir->flist, 0))) {
+      dList_remove_fast(Ddir->flist, finfo);
       dFree(finfo->full_path);
       dFree(finfo);
    }
+}
+
+/*
+ * Deallocate a DilloDir structure.
+ */
+static void File_dillodir_free(DilloDir *Ddir)
+{
+   dReturn_if (Ddir == NULL);
 
+   if (Ddir->dir)
+      closedir(Ddir->dir);
+   File_dillodir_clear(Ddir);
    dList_free(Ddir->flist);
    dFree(Ddir->dirname);
    dFree(Ddir);
@@ -509,16 +543,13 @@ static void File_info2html(ClientInfo *client, FileInfo *finfo, int n)
 }
 
 /*
- * Send the HTML directory page in HTTP.
+ * Send the top of the HTML directory page, up to the table header.
  */
-static void File_send_dir(ClientInfo *client)
+static void File_send_dir_top(ClientInfo *client)
 {
-   int n;
    char *Hdirname, *Udirname, *HUdirname;
    DilloDir *Ddir = client->d_dir;
 
-   /* send HTTP header and HTML top part */
-
    /* Send page title */
    Udirname = Escape_uri_str(Ddir->dirname, NULL);
    HUdirname = Escape_html_str(Udirname);
@@ -553,16 +584,43 @@ static void File_send_dir(ClientInfo *client)
       "<th width='10\%' align='left' valign='bottom'>Size</th>\n\t\t"
       "<th width='22\%' align='left' valign='bottom'>Modified</th>\n\t"
       "</tr>\n");
+}
+
+/*
+ * Send the next part of the HTML directory page.
+ * The first time, the top of the page goes with the first entries; as
+ * long as the directory is not bigger than prefs.dir_sort_limit, that's
+ * all of them, sorted. Otherwise, the entries read so far are sent
+ * sorted, and the rest follow as they are read, DIR_BATCH at a time.
+ */
+static void File_send_dir(ClientInfo *client)
+{
+   int n;
+   DilloDir *Ddir = client->d_dir;
+
+   if (Ddir->nrows == 0 && dList_length(Ddir->flist) == 0) {
+      File_send_dir_top(client);
+      if (Ddir->sorted) {
+         /* (one more, to know whether it's within the limit) */
+         File_dillodir_read(Ddir, prefs.dir_sort_limit + 1);
+         dList_sort(Ddir->flist, (dCompareFunc)File_comp);
+         Ddir->sorted = (Ddir->dir == NULL);
+      }
+   }
+   if (Ddir->dir && dList_length(Ddir->flist) == 0)
+      File_dillodir_read(Ddir, DIR_BATCH);
 
    /* send directories as HTML contents */
    for (n = 0; n < dList_length(Ddir->flist); ++n) {
-      File_info2html(client, dList_nth_data(Ddir->flist,n), n+1);
+      File_info2html(client, dList_nth_data(Ddir->flist, n), ++Ddir->nrows);
    }
+   File_dillodir_clear(Ddir);
 
-   dStr_append(client->data, "</table>\n");
-
-   dStr_append(client->data, "</body>\n</html>");
-   client->state = st_content;
+   if (Ddir->dir == NULL) {
+      dStr_append(client->data, "</table>\n");
+      dStr_append(client->data, "</body>\n</html>");
+      client->state = st_content;
+   }
 }
 
 /*
@@ -584,6 +642,8 @@ static const char *File_ext(const char *filename)
       return "image/jpeg";
    } else if (!dStrcasecmp(e, "png")) {
       return "image/png";
+   } else if (!dStrcasecmp(e, "webp")) {
+      return "image/webp";
    } else if (!dStrcasecmp(e, "html") ||
               !dStrcasecmp(e, "htm") ||
               !dStrcasecmp(e, "shtml")) {
@@ -644,7 +704,7 @@ static void File_send_error_page(ClientInfo *client)
 }
 
 /*
- * Scan the directory, sort and prepare to send it enclosed in HTTP.
+ * Open the directory, and prepare to send it enclosed in HTTP.
  */
 static int File_prepare_send_dir(ClientInfo *client,
                                  const char *DirName, const char *orig_url)
@@ -683,13 +743,14 @@ static int File_prepare_send_file(ClientInfo *client,
    if (stat(filename, &sb) != 0) {
       /* prepare a file-not-found error */
       res = ENOENT;
-   } else if ((fd = open(filename, O_RDONLY | O_BINARY)) < 0) {
+   } else if ((fd = open(filename, O_RDONLY|O_BINARY|O_NONBLOCK)) < 0) {
       /* prepare an error message */
       res = errno;
    } else {
       /* looks ok, set things accordingly */
       client->file_fd = fd;
       client->file_sz = sb.st_size;
+      client->file_mode = sb.st_mode;
       client->d_dir = NULL;
       client->state = st_start;
       client->filename = dStrdup(filename);
@@ -734,7 +795,7 @@ static void File_get(ClientInfo *client, const char *filename,
 }
 
 /*
- * Send HTTP headers and then the file itself.
+ * Send the next chunk of the file (if there's one ready).
  */
 static int File_send_file(ClientInfo *client)
 {
@@ -749,8 +810,11 @@ static int File_send_file(ClientInfo *client)
       st = read(client->file_fd, buf, LBUF);
    } while (st < 0 && errno == EINTR);
    if (st < 0) {
-      MSG("\nERROR while reading from file '%s': %s\n\n",
-          client->filename, dStrerror(errno));
+      if (errno != EAGAIN) {
+         MSG("\nERROR while reading from file '%s': %s\n\n",
+             client->filename, dStrerror(errno));
+         client->state = st_content;
+      }
    } else if (st == 0) {
       client->state = st_content;
    } else {
@@ -855,10 +919,11 @@ static ClientInfo *File_add_client(void)
    new_client->filename = NULL;
    new_client->file_fd = -1;
    new_client->file_sz = 0;
+   new_client->file_mode = 0;
    new_client->d_dir = NULL;
    new_client->state = 0;
    new_client->err_code = 0;
-   new_client->data = dStr_new("");
+   new_client->data = NULL;
 
    return new_client;
 }
@@ -870,7 +935,6 @@ static void File_remove_client(ClientInfo *client)
 {
    _MSG("Closing Socket Handler\n");
    File_close(client->file_fd);
-   dStr_free(client->data, TRUE);
    dFree(client->orig_url);
    dFree(client->filename);
    File_dillodir_free(client->d_dir);
@@ -899,26 +963,76 @@ void *a_File_open(const char *url)
 }
 
 /*
- * Returns a pointer to a Dstr containing the file's
- * content, a directory listing, or an error message.
+ * Map a regular file into memory, read-only (it's copied from there).
+ * Returns the mapping (to be freed with a_File_unmap()) and sets 'size',
+ * or returns NULL if the file has to be read instead.
  */
-void *a_File_read(void *v_client)
+char *a_File_map(void *v_client, size_t *size)
 {
+#ifdef HAVE_SYS_MMAN_H
    ClientInfo *client = (ClientInfo*)v_client;
+   size_t sz;
+   char *map;
+
    dReturn_val_if_fail (client != NULL, NULL);
 
+   /* (files that say they're empty, as in /proc, are read) */
+   if (client->state != st_start || client->d_dir ||
+       !S_ISREG(client->file_mode) || client->file_sz <= 0 ||
+       client->file_sz >= INT_MAX)
+      return NULL;
+   sz = (size_t)client->file_sz;
+
+   map = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, client->file_fd, 0);
+   if (map == MAP_FAILED) {
+      MSG("a_File_map: can't map '%s': %s\n", client->filename,
+          dStrerror(errno));
+      return NULL;
+   }
+   File_close(client->file_fd);
+   client->file_fd = -1;
+   client->state = st_content;
+   *size = sz;
+   return map;
+#else
+   return NULL;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+/*
+ * Free a mapping made by a_File_map().
+ */
+void a_File_unmap(char *map, size_t size)
+{
+#ifdef HAVE_SYS_MMAN_H
+   munmap(map, size);
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+/*
+ * Append what can be read now to 'ds': the next chunk of the file's
+ * content or directory listing, or an error message.
+ * Returns 1 if there's more to come, 0 when done.
+ */
+int a_File_read(void *v_client, Dstr *ds)
+{
+   ClientInfo *client = (ClientInfo*)v_client;
+   dReturn_val_if_fail (client != NULL, 0);
+
    /* send our answer */
-   while (client->state != st_content) {
-      if (client->state == st_err) {
-         File_send_error_page(client);
-         break;
-      } else if (client->d_dir)
+   client->data = ds;
+   if (client->state == st_err) {
+      File_send_error_page(client);
+      client->state = st_done;
+   } else if (client->state == st_start) {
+      if (client->d_dir)
          File_send_dir(client);
       else
          File_send_file(client);
    }
+   client->data = NULL;
 
-   return (void*)client->data;
+   return (client->state == st_start);
 }
 
 /*
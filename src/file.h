@@ -6,12 +6,16 @@ extern "C" {
 #endif /* __cplusplus */
 
 
+#include "../dlib/dlib.h"
+
 #if defined(_WIN32) || defined(MSDOS)
 #  define HAVE_DRIVE_LETTERS
 #endif
 
 void *a_File_open(const char *url);
-void *a_File_read(void *v_client);
+char *a_File_map(void *v_client, size_t *size);
+void a_File_unmap(char *map, size_t size);
+int a_File_read(void *v_client, Dstr *ds);
 void a_File_close(void *v_client);
 
 const char *a_File_content_type(const char *url);
@@ -59,6 +59,15 @@
  * connection, if necessary).
  */
 
+/* Animations:
+ *
+ * The first frame goes to the dicache as it arrives, as for any GIF. The
+ * following ones are put together here, over the complete image left by
+ * the previous frame (as the Graphic Control Extension says), and each
+ * resulting image is handed to the anim module, which keeps just what
+ * changed. The frames are played once the whole GIF is decoded.
+ */
+
 #include <config.h>
 #ifdef ENABLE_GIF
 
@@ -69,6 +78,7 @@
 #include "image.hh"
 #include "cache.h"
 #include "dicache.h"
+#include "anim.h"
 
 #define INTERLACE      0x40
 #define LOCALCOLORMAP  0x80
@@ -109,15 +119,38 @@ typedef struct _DilloGif {
    uint_t AspectRatio;    /* AspectRatio (not used) */
 #endif
 
-   /* Gif89 extensions */
+   size_t GlobalMap_ofs;
+   uint_t GlobalNumColors;
+
+   /* Gif89 extensions (for the next image) */
    int transparent;
-#if 0
-   /* None are used: */
    int delayTime;
-   int inputFlag;
    int disposal;
+#if 0
+   /* Not used: */
+   int inputFlag;
 #endif
 
+   /* Animation */
+   int Animate;           /* Whether to decode the frames after the first */
+   int NumFrames;         /* Frames begun so far */
+   uint_t ImgWidth;       /* Size of the image (i.e. of the first frame) */
+   uint_t ImgHeight;
+   int FirstLeft, FirstTop;
+   int Left, Top;         /* Position of the current frame */
+   int FrameTransparent;  /* Gif89 extensions of the current frame */
+   int FrameDelay;        /* (in milliseconds) */
+   int FrameDisposal;
+   uchar_t FrameCmap[3 * MAXCOLORMAPSIZE];
+   uchar_t *Indices;      /* The current frame as color indices */
+   uint_t Bpp;            /* Bytes per pixel of the image */
+   uchar_t *Canvas;       /* The image after the previous frame */
+   uchar_t *Saved;        /* The image before the current frame */
+   int PrevDisposal;      /* How to dispose of the previous frame */
+   int PrevX, PrevY, PrevWidth, PrevHeight;
+   int Loops;
+   DilloAnim *Anim;
+
    /* state for the new push-oriented decoder */
    int packet_size;       /* The amount of the data block left to process */
    uint_t window;
@@ -143,6 +176,7 @@ typedef struct _DilloGif {
  */
 static void Gif_write(DilloGif *gif, void *Buf, uint_t BufSize);
 static void Gif_close(DilloGif *gif, CacheClient_t *Client);
+static void Gif_anim_end(DilloGif *gif);
 static size_t Gif_process_bytes(DilloGif *gif, const uchar_t *buf,
                                 int bufsize, void *Buf);
 
@@ -170,6 +204,19 @@ void *a_Gif_new(DilloImage *Image, DilloUrl *url, int version)
    gif->window = 0;
    gif->packet_size = 0;
    gif->ColorMap_ofs = 0;
+   gif->GlobalMap_ofs = 0;
+   gif->GlobalNumColors = 0;
+   gif->delayTime = 0;
+   gif->disposal = 0;
+
+   /* A reload only needs the first frame */
+   gif->Animate = (version != DIC_Reload);
+   gif->NumFrames = 0;
+   gif->Indices = NULL;
+   gif->Canvas = NULL;
+   gif->Saved = NULL;
+   gif->Loops = 0;
+   gif->Anim = NULL;
 
    return gif;
 }
@@ -189,6 +236,10 @@ static void Gif_free(DilloGif *gif)
          dFree(gif->spill_lines[i]);
       dFree(gif->spill_lines);
    }
+   dFree(gif->Indices);
+   dFree(gif->Canvas);
+   dFree(gif->Saved);
+   a_Anim_free(gif->Anim);
    dFree(gif);
 }
 
@@ -242,6 +293,8 @@ static void Gif_write(DilloGif *gif, void *Buf, uint_t BufSize)
 static void Gif_close(DilloGif *gif, CacheClient_t *Client)
 {
    _MSG("Gif_close: destroy gif %p\n", gif);
+   /* (The frames so far, if the trailer is missing) */
+   Gif_anim_end(gif);
    a_Dicache_close(gif->url, gif->version, Client);
    Gif_free(gif);
 }
@@ -314,13 +367,13 @@ static inline size_t
    Flags = Buf[0];
 
    /* The packed fields */
-#if 0
    gif->disposal = (Buf[0] >> 2) & 0x7;
+#if 0
    gif->inputFlag = (Buf[0] >> 1) & 0x1;
+#endif
 
    /* Delay time */
    gif->delayTime = LM_to_uint(Buf[1], Buf[2]);
-#endif
 
    /* Transparent color index, may not be valid  (unless flag is set) */
    if ((Flags & 0x1)) {
@@ -350,13 +403,155 @@ static size_t Gif_do_extension(DilloGif *gif, uint_t Label,
    case Cmt_Ext:                /* Comment extension */
       return Gif_data_blocks(buf, BSize);
 
-   case Txt_Ext:                /* Plain text Extension */
    case App_Ext:                /* Application Extension */
+      /* The loop count of animations */
+      if (BSize >= 16 && buf[0] == 11 &&
+          !memcmp(buf + 1, "NETSCAPE2.0", 11) && buf[12] >= 3 && buf[13] == 1)
+         gif->Loops = LM_to_uint(buf[14], buf[15]);
+      return Gif_do_generic_ext(buf, BSize);
+
+   case Txt_Ext:                /* Plain text Extension */
    default:
       return Gif_do_generic_ext(buf, BSize);    /*Ignore Extension */
    }
 }
 
+/* --- Animation ---------------------------------------------------------- */
+
+/*
+ * A second frame begins: start an animation with the first one.
+ */
+static void Gif_anim_begin(DilloGif *gif)
+{
+   uint_t i, n = gif->ImgWidth * gif->ImgHeight, bpp = gif->Bpp;
+   uchar_t *dst;
+
+   if (!gif->Indices)
+      return;
+   gif->Canvas = dNew(uchar_t, n * bpp);
+   for (i = 0, dst = gif->Canvas; i < n; ++i, dst += bpp) {
+      int c = gif->Indices[i];
+
+      /* As the dicache does for the first frame */
+      if (c == gif->FrameTransparent) {
+         memset(dst, 0, bpp);
+      } else {
+         memcpy(dst, gif->FrameCmap + 3 * c, 3);
+         if (bpp == 4)
+            dst[3] = 255;
+      }
+   }
+
+   gif->Anim = a_Anim_new(gif->ImgWidth, gif->ImgHeight, bpp);
+   a_Anim_add_frame(gif->Anim, gif->Canvas, gif->FrameDelay);
+   gif->PrevDisposal = gif->FrameDisposal;
+   gif->PrevX = gif->PrevY = 0;
+   gif->PrevWidth = gif->ImgWidth;
+   gif->PrevHeight = gif->ImgHeight;
+}
+
+/*
+ * Dispose of the previous frame, as it asked for.
+ */
+static void Gif_anim_dispose(DilloGif *gif)
+{
+   uint_t bpp = gif->Bpp, stride = gif->ImgWidth * bpp;
+   int32_t bg = gif->Image ? gif->Image->bg_color : 0xffffff;
+   int x, y;
+
+   for (y = gif->PrevY; y < gif->PrevY + gif->PrevHeight; ++y) {
+      uchar_t *dst = gif->Canvas + y * stride + gif->PrevX * bpp;
+
+      if (gif->PrevDisposal == 3 && gif->Saved) {
+         /* Restore to previous */
+         memcpy(dst, gif->Saved + y * stride + gif->PrevX * bpp,
+                gif->PrevWidth * bpp);
+      } else if (gif->PrevDisposal == 2 && bpp == 4) {
+         /* Restore to background (i.e. transparent) */
+         memset(dst, 0, gif->PrevWidth * bpp);
+      } else if (gif->PrevDisposal == 2) {
+         for (x = 0; x < gif->PrevWidth; ++x, dst += bpp) {
+            dst[0] = (bg >> 16) & 0xff;
+            dst[1] = (bg >> 8) & 0xff;
+            dst[2] = bg & 0xff;
+         }
+      }
+   }
+}
+
+/*
+ * Put the frame just decoded over the image left by the previous one,
+ * and add the result to the animation.
+ */
+static void Gif_anim_frame(DilloGif *gif)
+{
+   uint_t bpp = gif->Bpp, stride = gif->ImgWidth * bpp;
+   int fx = gif->Left - gif->FirstLeft, fy = gif->Top - gif->FirstTop;
+   int x0 = MAX(fx, 0), y0 = MAX(fy, 0);
+   int x1 = MIN(fx + (int)gif->Width, (int)gif->ImgWidth);
+   int y1 = MIN(fy + (int)gif->Height, (int)gif->ImgHeight);
+   int x, y;
+
+   if (!gif->Anim)
+      return;
+
+   Gif_anim_dispose(gif);
+   if (gif->FrameDisposal == 3) {
+      gif->Saved = dRealloc(gif->Saved, stride * gif->ImgHeight);
+      memcpy(gif->Saved, gif->Canvas, stride * gif->ImgHeight);
+   }
+
+   for (y = y0; y < y1; ++y) {
+      const uchar_t *src = gif->Indices + (y - fy) * gif->Width + (x0 - fx);
+      uchar_t *dst = gif->Canvas + y * stride + x0 * bpp;
+
+      for (x = x0; x < x1; ++x, ++src, dst += bpp) {
+         if (*src == gif->FrameTransparent)
+            continue;
+         memcpy(dst, gif->FrameCmap + 3 * *src, 3);
+         if (bpp == 4)
+            dst[3] = 255;
+      }
+   }
+   a_Anim_add_frame(gif->Anim, gif->Canvas, gif->FrameDelay);
+
+   gif->PrevDisposal = gif->FrameDisposal;
+   gif->PrevX = x0;
+   gif->PrevY = y0;
+   gif->PrevWidth = MAX(x1 - x0, 0);
+   gif->PrevHeight = MAX(y1 - y0, 0);
+}
+
+/*
+ * No more frames: give the animation, if any, to the dicache.
+ */
+static void Gif_anim_end(DilloGif *gif)
+{
+   if (gif->Anim) {
+      a_Anim_set_loops(gif->Anim, gif->Loops);
+      if (a_Anim_finish(gif->Anim))
+         a_Dicache_set_anim(gif->url, gif->version, gif->Anim);
+      else
+         a_Anim_free(gif->Anim);
+      gif->Anim = NULL;
+   }
+   dFree(gif->Indices);
+   dFree(gif->Canvas);
+   dFree(gif->Saved);
+   gif->Indices = gif->Canvas = gif->Saved = NULL;
+}
+
+/*
+ * The image data of a frame is over.
+ */
+static void Gif_frame_end(DilloGif *gif)
+{
+   if (gif->NumFrames > 1)
+      Gif_anim_frame(gif);
+   /* Go back to getting GIF blocks, for the next frame */
+   gif->state = gif->Animate ? 2 : 999;
+}
+
 /* --- General Image Decoder ----------------------------------------------- */
 /* Here begins the new push-oriented decoder. */
 
@@ -365,6 +560,13 @@ static size_t Gif_do_extension(DilloGif *gif, uint_t Label,
  */
 static void Gif_lwz_init(DilloGif *gif)
 {
+   int i;
+
+   /* (Those of a previous frame may be too short) */
+   for (i = 0; i < gif->num_spill_lines_max; i++)
+      dFree(gif->spill_lines[i]);
+   dFree(gif->spill_lines);
+
    gif->num_spill_lines_max = 1;
    gif->spill_lines = dMalloc(sizeof(uchar_t *) * gif->num_spill_lines_max);
 
@@ -387,7 +589,10 @@ static void Gif_lwz_init(DilloGif *gif)
  */
 static void Gif_emit_line(DilloGif *gif, const uchar_t *linebuf)
 {
-   a_Dicache_write(gif->url, gif->version, linebuf, gif->y);
+   if (gif->NumFrames == 1)
+      a_Dicache_write(gif->url, gif->version, linebuf, gif->y);
+   if (gif->Indices && gif->y < gif->Height)
+      memcpy(gif->Indices + gif->y * gif->Width, linebuf, gif->Width);
    if (gif->Flags & INTERLACE) {
       switch (gif->pass) {
       case 0:
@@ -674,8 +879,10 @@ static int Gif_decode(DilloGif *gif, const uchar_t *buf, size_t bsize)
                code_mask = (1 << code_size) - 1;
                break;
 
-            case 2:         /* End code... consume remaining data chunks..? */
-               goto error;  /* Could clean up better? */
+            case 2:         /* End code: skip the remaining data blocks */
+               gif->packet_size = packet_size;
+               gif->state = 4;
+               return bsize - bufsize;
             default:
                MSG("Gif_decode: error!\n");
                goto error;
@@ -694,7 +901,7 @@ static int Gif_decode(DilloGif *gif, const uchar_t *buf, size_t bsize)
       bufsize--;
       if (!(packet_size = *buf++)) {
          /* This is the "block terminator" -- the last data block */
-         gif->state = 999;     /* BUG: should Go back to getting GIF blocks. */
+         Gif_frame_end(gif);
          break;
       }
    }
@@ -710,6 +917,27 @@ static int Gif_decode(DilloGif *gif, const uchar_t *buf, size_t bsize)
    return bsize - bufsize;
 }
 
+/*
+ * Skip the data blocks left after the end code of a frame.
+ */
+static size_t Gif_skip_data(DilloGif *gif, const uchar_t *buf, size_t bsize)
+{
+   size_t n = 0, k;
+
+   while (n < bsize) {
+      if (gif->packet_size > 0) {
+         k = MIN((size_t)gif->packet_size, bsize - n);
+         n += k;
+         gif->packet_size -= k;
+      } else if (!(gif->packet_size = buf[n++])) {
+         /* block terminator */
+         Gif_frame_end(gif);
+         break;
+      }
+   }
+   return n;
+}
+
 /*
  * ?
  */
@@ -772,6 +1000,8 @@ static size_t Gif_get_descriptor(DilloGif *gif, void *Buf,
          return 0;
       Size += mysize;           /* Size of the color table that follows */
       gif->Background = buf[5];
+      gif->GlobalMap_ofs = gif->ColorMap_ofs;
+      gif->GlobalNumColors = gif->NumColors;
    }
    /*   gif->Width = LM_to_uint(buf[0], buf[1]);
         gif->Height = LM_to_uint(buf[2], buf[3]); */
@@ -794,44 +1024,79 @@ static size_t Gif_do_img_desc(DilloGif *gif, void *Buf,
 {
    uchar_t Flags;
    size_t Size = 9 + 1; /* image descriptor size + first byte of image data */
+   size_t LSize = 0;
+   uint_t Width, Height;
 
    if (bsize < 10)
       return 0;
 
-   gif->Width   = LM_to_uint(buf[4], buf[5]);
-   gif->Height  = LM_to_uint(buf[6], buf[7]);
+   Flags = buf[8];
+   if (Flags & LOCALCOLORMAP) {
+      LSize = Gif_do_color_table(
+                 gif, Buf, buf + 9, bsize - 9, Flags & (size_t)0x7);
+      /* (with the first byte of image data) */
+      if (!LSize || bsize < Size + LSize)
+         return 0;
+   } else {
+      gif->ColorMap_ofs = gif->GlobalMap_ofs;
+      gif->NumColors = gif->GlobalNumColors;
+   }
+
+   Width  = LM_to_uint(buf[4], buf[5]);
+   Height = LM_to_uint(buf[6], buf[7]);
 
    /* check max image size */
-   if (gif->Width <= 0 || gif->Height <= 0 ||
-       gif->Width > IMAGE_MAX_AREA / gif->Height) {
+   if (Width <= 0 || Height <= 0 || Width > IMAGE_MAX_AREA / Height) {
       MSG("Gif_do_img_desc: suspicious image size request %u x %u\n",
-          gif->Width, gif->Height);
+          Width, Height);
       gif->state = 999;
       return 0;
    }
 
-   a_Dicache_set_parms(gif->url, gif->version, gif->Image,
-                       gif->Width, gif->Height, DILLO_IMG_TYPE_INDEXED);
-
-   Flags = buf[8];
+   if (++gif->NumFrames == 2)
+      Gif_anim_begin(gif);
+   gif->Width = Width;
+   gif->Height = Height;
+   gif->Left = LM_to_uint(buf[0], buf[1]);
+   gif->Top = LM_to_uint(buf[2], buf[3]);
+
+   /* The Gif89 extensions only apply to this image */
+   gif->FrameTransparent = gif->transparent;
+   gif->FrameDelay = gif->delayTime * 10;
+   gif->FrameDisposal = gif->disposal;
+   gif->transparent = -1;
+   gif->delayTime = 0;
+   gif->disposal = 0;
+   memset(gif->FrameCmap, 0, sizeof(gif->FrameCmap));
+   if (gif->ColorMap_ofs)
+      memcpy(gif->FrameCmap, (uchar_t *) Buf + gif->ColorMap_ofs,
+             3 * gif->NumColors);
+
+   if (gif->NumFrames == 1) {
+      gif->ImgWidth = Width;
+      gif->ImgHeight = Height;
+      gif->FirstLeft = gif->Left;
+      gif->FirstTop = gif->Top;
+      gif->Bpp = (gif->FrameTransparent >= 0) ? 4 : 3;
+      a_Dicache_set_parms(gif->url, gif->version, gif->Image,
+                          gif->Width, gif->Height,
+                          gif->FrameTransparent >= 0 ?
+                             DILLO_IMG_TYPE_INDEXED_ALPHA :
+                             DILLO_IMG_TYPE_INDEXED);
+   }
+   if (gif->Animate) {
+      /* Keep the frame's pixels (the first one's too, as it may turn out
+       * to be the start of an animation) */
+      gif->Indices = dRealloc(gif->Indices, Width * Height);
+      memset(gif->Indices, MAX(gif->FrameTransparent, 0), Width * Height);
+   }
 
-   gif->Flags |= Flags & INTERLACE;
+   gif->Flags = (gif->Flags & ~INTERLACE) | (Flags & INTERLACE);
    gif->pass = 0;
-   bsize -= 9;
-   buf += 9;
-   if (Flags & LOCALCOLORMAP) {
-      size_t LSize = Gif_do_color_table(
-                        gif, Buf, buf, bsize, Flags & (size_t)0x7);
+   Size += LSize;
+   buf += 9 + LSize;
 
-      if (!LSize)
-         return 0;
-      Size += LSize;
-      buf += LSize;
-      bsize -= LSize;
-   }
    /* Finally, get the first byte of the LZW image data */
-   if (bsize < 1)
-      return 0;
    gif->input_code_size = *buf++;
    if (gif->input_code_size > 8) {
       gif->state = 999;
@@ -840,12 +1105,13 @@ static size_t Gif_do_img_desc(DilloGif *gif, void *Buf,
    gif->y = 0;
    Gif_lwz_init(gif);
    gif->spill_line_index = 0;
+   dFree(gif->linebuf);
    gif->linebuf = dMalloc(gif->Width);
    gif->state = 3;              /*Process the lzw data next */
-   if (gif->Image && gif->ColorMap_ofs) {
+   if (gif->NumFrames == 1 && gif->Image && gif->ColorMap_ofs) {
       a_Dicache_set_cmap(gif->url, gif->version, gif->Image,
                          (uchar_t *) Buf + gif->ColorMap_ofs,
-                         gif->NumColors, 256, gif->transparent);
+                         gif->NumColors, 256, gif->FrameTransparent);
    }
    return Size;
 }
@@ -925,6 +1191,7 @@ static size_t GIF_Block(DilloGif * gif, void *Buf,
          return Size;
 
       case Trailer:
+         Gif_anim_end(gif);
          gif->state = 999;      /* BUG: should close the rest of the file */
          return Size + 1;
          break;                 /* GIF terminator */
@@ -980,26 +1247,28 @@ static size_t Gif_process_bytes(DilloGif *gif, const uchar_t *ibuf,
       gif->state = 2;
 
    case 2:
-      /* Ok, this loop construction looks weird.  It implements the <Data>* of
-       * the GIF grammar.  All sorts of stuff is allocated to set up for the
-       * decode part (state ==2) and then there is the actual decode part (3)
-       */
-      mysize = GIF_Block(gif, Buf, ibuf, (size_t)tmp_bufsize);
-      if (!mysize)
-         break;
-      tmp_bufsize -= mysize;
-      ibuf += mysize;
-      if (gif->state != 3)
-         break;
-
    case 3:
-      /* get an image byte */
-      /* The users sees all of this stuff */
-      mysize = Gif_decode(gif, ibuf, (size_t)tmp_bufsize);
-      if (mysize == 0)
+   case 4:
+      /* This loop implements the <Data>* of the GIF grammar.  All sorts of
+       * stuff is allocated to set up for the decode part (state == 2), then
+       * there is the actual decode part (3), and the end of the image data
+       * is skipped (4), before going back for the next frame.
+       */
+      while (gif->state >= 2 && gif->state <= 4) {
+         if (gif->state == 2)
+            mysize = GIF_Block(gif, Buf, ibuf, (size_t)tmp_bufsize);
+         else if (gif->state == 3)
+            /* The users sees all of this stuff */
+            mysize = Gif_decode(gif, ibuf, (size_t)tmp_bufsize);
+         else
+            mysize = Gif_skip_data(gif, ibuf, (size_t)tmp_bufsize);
+         if (mysize == 0)
+            break;
+         tmp_bufsize -= mysize;
+         ibuf += mysize;
+      }
+      if (gif->state != 999)
          break;
-      ibuf += mysize;
-      tmp_bufsize -= mysize;
 
    default:
       /* error - just consume all input */
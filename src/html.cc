@@ -34,6 +34,7 @@
 #include "menu.hh"
 #include "prefs.h"
 #include "capi.h"
+#include "timeout.hh"
 #include "html.hh"
 #include "html_common.hh"
 #include "form.hh"
@@ -44,6 +45,7 @@
 #include "../dw/listitem.hh"
 #include "../dw/image.hh"
 #include "../dw/ruler.hh"
+#include "../lout/perf.h"
 
 /*-----------------------------------------------------------------------------
  * Defines
@@ -55,6 +57,9 @@
 
 #define TAB_SIZE 8
 
+/* How many deferred images may be fetched at a time */
+#define LAZY_IMAGES_MAX_FETCHES 4
+
 /*-----------------------------------------------------------------------------
  * Name spaces
  *---------------------------------------------------------------------------*/
@@ -104,9 +109,10 @@ static const char *Html_get_attr2(DilloHtml *html,
                                   const char *attrname,
                                   int tag_parsing_flags);
 static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof);
-static bool Html_load_image(BrowserWindow *bw, DilloUrl *url,
-                            const DilloUrl *requester, DilloImage *image);
+static int Html_load_image(BrowserWindow *bw, DilloUrl *url,
+                           const DilloUrl *requester, DilloImage *image);
 static void Html_callback(int Op, CacheClient_t *Client);
+static void Html_load_near_images_cb(void *data);
 static void Html_tag_cleanup_at_close(DilloHtml *html, int TagIdx);
 
 /*-----------------------------------------------------------------------------
@@ -300,14 +306,21 @@ static int Html_set_new_link(DilloHtml *html, DilloUrl **url)
 /*
  * Add a new image to our list.
  * image is NULL if dillo will try to load the image immediately.
+ * deferred is true if it's to be loaded once near the viewport.
  */
-static void Html_add_new_htmlimage(DilloHtml *html,
-                                   DilloUrl **url, DilloImage *image)
+static void Html_add_new_htmlimage(DilloHtml *html, DilloUrl **url,
+                                   DilloImage *image, bool deferred)
 {
    DilloHtmlImage *hi = dNew(DilloHtmlImage, 1);
    hi->url = *url;
    hi->image = image;
+   hi->deferred = deferred;
    a_Image_ref(image);
+   if (deferred) {
+      html->deferredImages++;
+      html->pendingImagesStale = true;
+      html->queueLoadNearImages();
+   }
 
    int n = html->images->size();
    html->images->increase();
@@ -409,9 +422,11 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    base_url = a_Url_dup(url);
    dw = NULL;
 
-   /* Init event receiver */
+   /* Init event receivers */
    linkReceiver.html = this;
    HT2LT(this)->connectLink (&linkReceiver);
+   layoutReceiver.html = this;
+   HT2LT(this)->connect (&layoutReceiver);
 
    a_Bw_add_doc(p_bw, this);
 
@@ -478,6 +493,12 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    inputs_outside_form = new misc::SimpleVector <DilloHtmlInput*> (1);
    links = new misc::SimpleVector <DilloUrl*> (64);
    images = new misc::SimpleVector <DilloHtmlImage*> (16);
+   deferredImages = 0;
+   nearImagesQueued = false;
+   pendingImages = new misc::SimpleVector <int> (8);
+   pendingImagesStale = true;
+   lazyClients = new misc::SimpleVector <int> (LAZY_IMAGES_MAX_FETCHES);
+   parseFinished = false;
 
    /* Initialize the main widget */
    initDw();
@@ -508,6 +529,8 @@ DilloHtml::~DilloHtml()
 
    freeParseData();
 
+   if (nearImagesQueued)
+      a_Timeout_remove(Html_load_near_images_cb, this);
    a_Bw_remove_doc(bw, this);
 
    a_Url_free(page_url);
@@ -536,6 +559,8 @@ DilloHtml::~DilloHtml()
       dFree(img);
    }
    delete (images);
+   delete (pendingImages);
+   delete (lazyClients);
 
    delete styleEngine;
 }
@@ -619,6 +644,13 @@ void DilloHtml::finishParsing(int ClientKey)
    }
    /* Remove this client from our active list */
    a_Bw_close_client(bw, ClientKey);
+   /* (the layout may not change anymore, and images that didn't get
+    * allocated may be fetched now) */
+   parseFinished = true;
+   if (deferredImages) {
+      pendingImagesStale = true;
+      queueLoadNearImages();
+   }
 }
 
 /*
@@ -678,11 +710,179 @@ void DilloHtml::loadImages (const DilloUrl *pattern)
                a_Image_unref (images->get(i)->image);
                images->get(i)->image = NULL;  // web owns it now
             }
+            if (images->get(i)->deferred) {
+               images->get(i)->deferred = false;
+               deferredImages--;
+            }
          }
       }
    }
 }
 
+/*
+ * Timeout callback for loadNearImages().
+ */
+static void Html_load_near_images_cb(void *data)
+{
+   DilloHtml *html = (DilloHtml*)data;
+
+   html->nearImagesQueued = false;
+   html->loadNearImages();
+}
+
+/*
+ * Check the deferred images soon (after the layout has had a chance to
+ * allocate them), or whether fetches of them have finished.
+ */
+void DilloHtml::queueLoadNearImages ()
+{
+   if (!nearImagesQueued) {
+      a_Timeout_add(0.1, Html_load_near_images_cb, this);
+      nearImagesQueued = true;
+   }
+}
+
+typedef struct {
+   int distance;
+   int index;
+} NearImage;
+
+/*
+ * Order near images by distance to the viewport, the farthest first
+ * (for qsort)
+ */
+static int Html_near_image_cmp(const void *v1, const void *v2)
+{
+   const NearImage *n1 = (const NearImage*)v1, *n2 = (const NearImage*)v2;
+
+   return (n1->distance != n2->distance) ? n2->distance - n1->distance :
+                                           n2->index - n1->index;
+}
+
+/*
+ * Fill pendingImages with the deferred images that are within
+ * "lazy_images_distance" viewport heights of the viewport, those nearest
+ * to it last (they're taken from the end). Once the page is parsed, the
+ * ones that never got allocated (e.g., "display:none") follow the others,
+ * so that they're fetched eventually as well.
+ */
+void DilloHtml::findNearImages ()
+{
+   Layout *layout = HT2LT(this);
+   int top = layout->getScrollPosY (), height = layout->getHeightViewport ();
+   int range = (int)(prefs.lazy_images_distance * height);
+   misc::SimpleVector<NearImage> nearImages (8);
+
+   pendingImages->setSize (0);
+   for (int i = images->size() - 1; i >= 0; i--) {
+      DilloHtmlImage *hi = images->get(i);
+
+      if (parseFinished && hi->deferred &&
+          !((Widget*) hi->image->dw)->wasAllocated()) {
+         pendingImages->increase ();
+         pendingImages->set (pendingImages->size() - 1, i);
+      }
+   }
+   for (int i = 0; i < images->size(); i++) {
+      DilloHtmlImage *hi = images->get(i);
+      Widget *widget;
+      Allocation *a;
+      int distance;
+
+      if (!hi->deferred ||
+          !(widget = (Widget*) hi->image->dw)->wasAllocated())
+         continue;
+      a = widget->getAllocation ();
+      if (a->y + a->ascent + a->descent < top)
+         distance = top - (a->y + a->ascent + a->descent);
+      else if (a->y > top + height)
+         distance = a->y - (top + height);
+      else
+         distance = 0;
+      if (distance <= range) {
+         nearImages.increase ();
+         nearImages.getRef(nearImages.size() - 1)->distance = distance;
+         nearImages.getRef(nearImages.size() - 1)->index = i;
+      }
+   }
+   qsort (nearImages.getArray (), nearImages.size (), sizeof (NearImage),
+          Html_near_image_cmp);
+   for (int i = 0; i < nearImages.size(); i++) {
+      pendingImages->increase ();
+      pendingImages->set (pendingImages->size() - 1,
+                          nearImages.get(i).index);
+   }
+   pendingImagesStale = false;
+   _MSG("findNearImages: %d of %d deferred images\n",
+        pendingImages->size(), deferredImages);
+}
+
+/*
+ * Fetch the pending deferred images, those nearest to the viewport first
+ * (requests to a server are served in order, so the ones that will be seen
+ * soonest come before the rest). Only a few are fetched at a time, and the
+ * next ones follow as these finish, so that images the user scrolls past
+ * meanwhile aren't fetched for nothing.
+ */
+void DilloHtml::loadNearImages ()
+{
+   dReturn_if (a_Bw_expecting(bw));
+
+   /* Forget the fetches that have finished (or were stopped) */
+   for (int i = lazyClients->size() - 1; i >= 0; i--) {
+      if (!a_Bw_has_client(bw, lazyClients->get(i))) {
+         lazyClients->set(i, lazyClients->get(lazyClients->size() - 1));
+         lazyClients->setSize(lazyClients->size() - 1);
+      }
+   }
+
+   if (deferredImages && pendingImagesStale)
+      findNearImages ();
+   while (lazyClients->size() < LAZY_IMAGES_MAX_FETCHES &&
+          pendingImages->size() > 0) {
+      DilloHtmlImage *hi =
+         images->get(pendingImages->get(pendingImages->size() - 1));
+      int key;
+
+      pendingImages->setSize(pendingImages->size() - 1);
+      if (!hi->deferred)
+         continue; /* loaded meanwhile */
+      if ((key = Html_load_image(bw, hi->url, page_url, hi->image))) {
+         a_Image_unref (hi->image);
+         hi->image = NULL;  // web owns it now
+         if (a_Bw_has_client(bw, key)) {
+            lazyClients->increase();
+            lazyClients->set(lazyClients->size() - 1, key);
+         }
+      }
+      hi->deferred = false;
+      deferredImages--;
+   }
+
+   /* Keep checking while fetches are under way, to go on with the next */
+   if (lazyClients->size() > 0)
+      queueLoadNearImages ();
+}
+
+void DilloHtml::HtmlLayoutReceiver::canvasSizeChanged (int width,
+                                                       int ascent,
+                                                       int descent)
+{
+   if (html->deferredImages) {
+      html->pendingImagesStale = true;
+      html->queueLoadNearImages ();
+   }
+}
+
+void DilloHtml::HtmlLayoutReceiver::viewportChanged (int x, int y,
+                                                     int width, int height)
+{
+   if (html->deferredImages) {
+      html->pendingImagesStale = true;
+      html->queueLoadNearImages ();
+   }
+}
+
 /*
  * Save URL in a vector (may be loaded later).
  */
@@ -2013,7 +2213,7 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag,
    CssLength l_w  = CSS_CREATE_LENGTH(0.0, CSS_LENGTH_TYPE_AUTO);
    CssLength l_h  = CSS_CREATE_LENGTH(0.0, CSS_LENGTH_TYPE_AUTO);
    int space, border, w = 0, h = 0;
-   bool load_now;
+   bool load_now, at_hand;
 
    if (prefs.show_tooltip &&
        (attrbuf = a_Html_get_attr(html, tag, tagsize, "title"))) {
@@ -2129,14 +2329,23 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag,
    Image = a_Image_new(alt_ptr, 0);
    if (HT2TB(html)->getBgColor())
       Image->bg_color = HT2TB(html)->getBgColor()->getColor();
-
-   load_now = prefs.load_images ||
-              !dStrcasecmp(URL_SCHEME(url), "data") ||
-              (a_Capi_get_flags_with_redirection(url) & CAPI_IsCached);
+   /* Let the decoders know how large the image will be shown, when both
+    * dimensions are given in pixels (a percentage, or a missing one, could
+    * be anything, so the image is decoded at full size then) */
+   if (width_ptr && height_ptr && w > 0 && h > 0) {
+      Image->hint_width = w;
+      Image->hint_height = h;
+   }
+
+   at_hand = !dStrcasecmp(URL_SCHEME(url), "data") ||
+             (a_Capi_get_flags_with_redirection(url) & CAPI_IsCached);
+   load_now = prefs.load_images || at_hand;
+   /* Images that must be fetched may wait until they're near the viewport */
+   bool deferred = load_now && !at_hand && prefs.lazy_images;
    bool loading = false;
-   if (load_now)
-      loading = Html_load_image(html->bw, url, html->page_url, Image);
-   Html_add_new_htmlimage(html, &url, loading ? NULL : Image);
+   if (load_now && !deferred)
+      loading = Html_load_image(html->bw, url, html->page_url, Image) != 0;
+   Html_add_new_htmlimage(html, &url, loading ? NULL : Image, deferred);
 
    dFree(width_ptr);
    dFree(height_ptr);
@@ -2146,9 +2355,10 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag,
 
 /*
  * Tell cache to retrieve image
+ * Return value: the cache client's key, 0 if none
  */
-static bool Html_load_image(BrowserWindow *bw, DilloUrl *url,
-                            const DilloUrl *requester, DilloImage *Image)
+static int Html_load_image(BrowserWindow *bw, DilloUrl *url,
+                           const DilloUrl *requester, DilloImage *Image)
 {
    DilloWeb *Web;
    int ClientKey;
@@ -2163,7 +2373,7 @@ static bool Html_load_image(BrowserWindow *bw, DilloUrl *url,
       a_Bw_add_client(bw, ClientKey, 0);
       a_Bw_add_url(bw, url);
    }
-   return ClientKey != 0;
+   return ClientKey;
 }
 
 /*
@@ -3163,7 +3373,7 @@ const TagInfo Tags[] = {
  {"center", B8(011110),'R',2, Html_tag_open_center, Html_tag_close_center},
  {"cite", B8(010101),'R',2, Html_tag_open_default, Html_tag_close_default},
  {"code", B8(010101),'R',2, Html_tag_open_default, Html_tag_close_default},
- /* col 010010 'F' */
+ {"col", B8(010010),'F',0, Html_tag_open_col, Html_tag_close_default},
  /* colgroup */
  {"dd", B8(011110),'O',1, Html_tag_open_dd, Html_tag_close_default},
  {"del", B8(011101),'R',2, Html_tag_open_default, Html_tag_close_default},
@@ -3736,7 +3946,9 @@ static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof)
 {
    char ch = 0, *p, *text;
    int token_start, buf_index;
+   PERF_TIMER(t);
 
+   PERF_START(t);
    /* Now, 'buf' and 'bufsize' define a buffer aligned to start at a token
     * boundary. Iterate through tokens until end of buffer is reached. */
    buf_index = 0;
@@ -3857,6 +4069,7 @@ static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof)
 
    HT2TB(html)->flush ();
 
+   PERF_STOP(PERF_HTML_WRITE, t);
    return token_start;
 }
 
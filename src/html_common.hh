@@ -96,6 +96,7 @@ typedef enum {
 struct _DilloHtmlImage {
    DilloUrl *url;
    DilloImage *image;
+   bool deferred;   /* to be loaded when it comes near the viewport */
 };
 
 struct _DilloHtmlState {
@@ -139,6 +140,15 @@ private:
    };
    HtmlLinkReceiver linkReceiver;
 
+   class HtmlLayoutReceiver: public dw::core::Layout::Receiver {
+   public:
+      DilloHtml *html;
+
+      void canvasSizeChanged (int width, int ascent, int descent);
+      void viewportChanged (int x, int y, int width, int height);
+   };
+   HtmlLayoutReceiver layoutReceiver;
+
 public:  //BUG: for now everything is public
 
    BrowserWindow *bw;
@@ -195,6 +205,13 @@ public:  //BUG: for now everything is public
    lout::misc::SimpleVector<DilloHtmlInput*> *inputs_outside_form;
    lout::misc::SimpleVector<DilloUrl*> *links;
    lout::misc::SimpleVector<DilloHtmlImage*> *images;
+   int deferredImages;    /* how many images wait for the viewport */
+   bool nearImagesQueued; /* a check for them is pending */
+   /* deferred images to fetch (indices in images), the nearest last */
+   lout::misc::SimpleVector<int> *pendingImages;
+   bool pendingImagesStale;  /* the viewport or layout changed since */
+   lout::misc::SimpleVector<int> *lazyClients; /* their fetches under way */
+   bool parseFinished;    /* the whole page has been parsed */
    dw::ImageMapsList maps;
 
 private:
@@ -214,6 +231,9 @@ public:
    DilloHtmlForm *getCurrentForm ();
    bool_t unloadedImages();
    void loadImages (const DilloUrl *pattern);
+   void queueLoadNearImages ();
+   void findNearImages ();
+   void loadNearImages ();
    void addCssUrl(const DilloUrl *url);
 };
 
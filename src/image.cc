@@ -38,6 +38,8 @@ DilloImage *a_Image_new(const char *alt_text, int32_t bg_color)
    Image->dw = (void*) new dw::Image(alt_text);
    Image->width = 0;
    Image->height = 0;
+   Image->hint_width = 0;
+   Image->hint_height = 0;
    Image->bg_color = bg_color;
    Image->ScanNumber = 0;
    Image->BitVec = NULL;
@@ -111,6 +113,23 @@ void a_Image_write(DilloImage *Image, uint_t y)
    Image->State = IMG_Write;
 }
 
+/*
+ * Implement the write method for the consecutive rows y0 ... y0+nrows-1
+ */
+void a_Image_write_rows(DilloImage *Image, uint_t y0, uint_t nrows)
+{
+   uint_t y;
+
+   _MSG("a_Image_write_rows\n");
+   dReturn_if_fail ( nrows > 0 && y0 + nrows <= Image->height );
+
+   /* Update the rows in DwImage */
+   I2DW(Image)->drawRows(y0, nrows);
+   for (y = y0; y < y0 + nrows; ++y)
+      a_Bitvec_set_bit(Image->BitVec, y);
+   Image->State = IMG_Write;
+}
+
 /*
  * Implement the close method
  */
@@ -30,6 +30,8 @@ typedef enum {
    DILLO_IMG_TYPE_RGB,
    DILLO_IMG_TYPE_GRAY,
    DILLO_IMG_TYPE_CMYK_INV,
+   DILLO_IMG_TYPE_RGBA,          /* RGB plus (not premultiplied) alpha */
+   DILLO_IMG_TYPE_INDEXED_ALPHA, /* Indexed with a transparent color */
    DILLO_IMG_TYPE_NOTSET    /* Initial value */
 } DilloImgType;
 
@@ -50,6 +52,10 @@ struct _DilloImage {
    uint_t width;
    uint_t height;
 
+   /* Display size requested by the page in pixels (both 0 if unknown) */
+   uint_t hint_width;
+   uint_t hint_height;
+
    int32_t bg_color;        /* Background color */
    bitvec_t *BitVec;        /* Bit vector for decoded rows */
    uint_t ScanNumber;       /* Current decoding scan */
@@ -70,6 +76,7 @@ void a_Image_set_parms(DilloImage *Image, void *v_imgbuf, DilloUrl *url,
                        int version, uint_t width, uint_t height,
                        DilloImgType type);
 void a_Image_write(DilloImage *Image, uint_t y);
+void a_Image_write_rows(DilloImage *Image, uint_t y0, uint_t nrows);
 void a_Image_close(DilloImage *Image);
 
 
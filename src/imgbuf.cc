@@ -9,63 +9,170 @@
  * (at your option) any later version.
  */
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#endif
+
 #include "msg.h"
 #include "imgbuf.hh"
+#include "dicache.h"
+#include "anim.h"
 #include "../dw/core.hh"
 #include "../dw/image.hh"
 
 using namespace dw::core;
 
+/*
+ * Refills dropped image buffers from the dicache
+ */
+class DicacheReloader: public Imgbuf::Reloader
+{
+public:
+   void reload (Imgbuf *imgbuf) { a_Dicache_reload(imgbuf); }
+   void enlarge (Imgbuf *imgbuf) { a_Dicache_enlarge(imgbuf); }
+};
+
+/*
+ * Resumes paused animations when their image gets drawn
+ */
+class AnimResumer: public Imgbuf::Animation
+{
+public:
+   void drawn (Imgbuf *imgbuf) { a_Anim_drawn(imgbuf); }
+};
+
+/* Rows converted to RGB at a time by a_Imgbuf_update_rows() */
+#define IMGBUF_BATCH_ROWS 16
+
 /*
  * Local data
  */
 static size_t linebuf_size = 0;
 static uchar_t *linebuf = NULL;
+static DicacheReloader reloader;
+static AnimResumer anim_resumer;
+
+
+/*
+ * Bytes per pixel of the imgbuf for an image type.
+ */
+static uint_t Imgbuf_bpp(DilloImgType type)
+{
+   return (type == DILLO_IMG_TYPE_RGBA ||
+           type == DILLO_IMG_TYPE_INDEXED_ALPHA) ? 4 : 3;
+}
+
+/*
+ * Gray to RGB.
+ * Each pixel is stored as a 32-bit word whose fourth byte is overwritten
+ * by the next pixel, so 'dst' needs a spare byte past the row.
+ */
+static void Imgbuf_gray_to_rgb(uchar_t *dst, const uchar_t *src,
+                               uint_t width)
+{
+   uint_t x = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+   for ( ; x + 16 <= width; x += 16) {
+      uint8x16x3_t rgb;
+      rgb.val[0] = rgb.val[1] = rgb.val[2] = vld1q_u8(src + x);
+      vst3q_u8(dst + x * 3, rgb);
+   }
+#endif
+   for ( ; x < width; x++) {
+      uint32_t v = src[x] * 0x01010101U;
+      memcpy(dst + x * 3, &v, 4);
+   }
+}
+
+/*
+ * Indexed to RGB.
+ * Both the pixels and the colormap entries are copied as 32-bit words,
+ * so 'dst' needs a spare byte past the row, and 'cmap' past its end.
+ */
+static void Imgbuf_indexed_to_rgb(uchar_t *dst, const uchar_t *src,
+                                  const uchar_t *cmap, uint_t width)
+{
+   uint_t x = 0;
 
+   for ( ; x + 4 <= width; x += 4, dst += 12) {
+      memcpy(dst, cmap + src[x] * 3, 4);
+      memcpy(dst + 3, cmap + src[x + 1] * 3, 4);
+      memcpy(dst + 6, cmap + src[x + 2] * 3, 4);
+      memcpy(dst + 9, cmap + src[x + 3] * 3, 4);
+   }
+   for ( ; x < width; x++, dst += 3)
+      memcpy(dst, cmap + src[x] * 3, 4);
+}
 
 /*
- * Decode 'buf' (an image line) into RGB format.
+ * Indexed to RGBA, with a colormap of RGBA entries.
  */
-static uchar_t *Imgbuf_rgb_line(const uchar_t *buf,
-                                DilloImgType type, uchar_t *cmap,
-                                uint_t width, uint_t y)
+static void Imgbuf_indexed_to_rgba(uchar_t *dst, const uchar_t *src,
+                                   const uchar_t *cmap, uint_t width)
 {
    uint_t x;
 
-   switch (type) {
-   case DILLO_IMG_TYPE_INDEXED:
-      if (cmap) {
-         for (x = 0; x < width; x++)
-            memcpy(linebuf + x * 3, cmap + buf[x] * 3, 3);
-      } else {
-         MSG_WARN("Gif:: image lacks a color map\n");
-      }
-      break;
-   case DILLO_IMG_TYPE_GRAY:
-      for (x = 0; x < width; x++)
-         memset(linebuf + x * 3, buf[x], 3);
-      break;
-   case DILLO_IMG_TYPE_CMYK_INV:
-      /*
-       * We treat CMYK as if it were "RGBW", and it works. Everyone who is
-       * trying to handle CMYK jpegs is confused by this, and supposedly
-       * the issue is that Adobe CMYK is "wrong" but ubiquitous.
-       */
-      for (x = 0; x < width; x++) {
-         uint_t white = buf[x * 4 + 3];
-         linebuf[x * 3] = buf[x * 4] * white / 0x100;
-         linebuf[x * 3 + 1] = buf[x * 4 + 1] * white / 0x100;
-         linebuf[x * 3 + 2] = buf[x * 4 + 2] * white / 0x100;
+   for (x = 0; x < width; x++, dst += 4)
+      memcpy(dst, cmap + src[x] * 4, 4);
+}
+
+/*
+ * Decode 'nrows' image lines, 'stride' bytes apart in 'buf', into
+ * consecutive RGB (or RGBA, for the alpha types) lines in linebuf.
+ */
+static void Imgbuf_rgb_rows(const uchar_t *buf, DilloImgType type,
+                            uchar_t *cmap, uint_t width, uint_t nrows,
+                            uint_t stride)
+{
+   uint_t x, y;
+   uchar_t *line;
+
+   for (y = 0; y < nrows; y++, buf += stride) {
+      line = linebuf + y * width * Imgbuf_bpp(type);
+      switch (type) {
+      case DILLO_IMG_TYPE_INDEXED:
+         if (cmap) {
+            Imgbuf_indexed_to_rgb(line, buf, cmap, width);
+         } else {
+            MSG_WARN("Gif:: image lacks a color map\n");
+         }
+         break;
+      case DILLO_IMG_TYPE_INDEXED_ALPHA:
+         if (cmap) {
+            Imgbuf_indexed_to_rgba(line, buf, cmap, width);
+         } else {
+            MSG_WARN("Gif:: image lacks a color map\n");
+         }
+         break;
+      case DILLO_IMG_TYPE_GRAY:
+         Imgbuf_gray_to_rgb(line, buf, width);
+         break;
+      case DILLO_IMG_TYPE_CMYK_INV:
+         /*
+          * We treat CMYK as if it were "RGBW", and it works. Everyone who
+          * is trying to handle CMYK jpegs is confused by this, and
+          * supposedly the issue is that Adobe CMYK is "wrong" but
+          * ubiquitous.
+          */
+         for (x = 0; x < width; x++) {
+            uint_t white = buf[x * 4 + 3];
+            line[x * 3] = buf[x * 4] * white / 0x100;
+            line[x * 3 + 1] = buf[x * 4 + 1] * white / 0x100;
+            line[x * 3 + 2] = buf[x * 4 + 2] * white / 0x100;
+         }
+         break;
+      case DILLO_IMG_TYPE_RGB:
+         memcpy(line, buf, width * 3);
+         break;
+      case DILLO_IMG_TYPE_RGBA:
+         memcpy(line, buf, width * 4);
+         break;
+      case DILLO_IMG_TYPE_NOTSET:
+         MSG_ERR("Imgbuf_rgb_rows: type not set...\n");
+         break;
       }
-      break;
-   case DILLO_IMG_TYPE_RGB:
-      /* avoid a memcpy here!  --Jcid */
-      return (uchar_t *)buf;
-   case DILLO_IMG_TYPE_NOTSET:
-      MSG_ERR("Imgbuf_rgb_line: type not set...\n");
-      break;
    }
-   return linebuf;
 }
 
 // Wrappers for Imgbuf -------------------------------------------------------
@@ -97,13 +204,16 @@ void *a_Imgbuf_new(void *v_dw, int img_type, uint_t width, uint_t height)
       MSG_ERR("a_Imgbuf_new: layout is NULL.\n");
       exit(1);
    }
-   // Assert linebuf is wide enough.
-   if (3 * width > linebuf_size) {
-      linebuf_size = 3 * width;
+   // Assert linebuf is wide enough (with a spare byte for the 32-bit
+   // copies).
+   if (4 * width * IMGBUF_BATCH_ROWS + 1 > linebuf_size) {
+      linebuf_size = 4 * width * IMGBUF_BATCH_ROWS + 1;
       linebuf = (uchar_t*) dRealloc(linebuf, linebuf_size);
    }
 
-   return (void*)layout->createImgbuf(Imgbuf::RGB, width, height);
+   return (void*)layout->createImgbuf(img_type == I_RGBA ? Imgbuf::RGBA :
+                                                          Imgbuf::RGB,
+                                      width, height);
 }
 
 /*
@@ -121,11 +231,35 @@ void a_Imgbuf_update(void *v_imgbuf, const uchar_t *buf, DilloImgType type,
                      uchar_t *cmap, uint_t width, uint_t height, uint_t y)
 
 {
-   dReturn_if_fail ( y < height );
+   a_Imgbuf_update_rows(v_imgbuf, buf, type, cmap, width, height, y, 1, 0);
+}
+
+/*
+ * Update the consecutive rows y0 ... y0+nrows-1 of the root buffer of an
+ * imgbuf. 'stride' is the distance between two rows in 'buf'.
+ */
+void a_Imgbuf_update_rows(void *v_imgbuf, const uchar_t *buf,
+                          DilloImgType type, uchar_t *cmap, uint_t width,
+                          uint_t height, uint_t y0, uint_t nrows,
+                          uint_t stride)
+{
+   Imgbuf *imgbuf = (Imgbuf*)v_imgbuf;
+   uint_t n;
+
+   dReturn_if_fail ( nrows > 0 && y0 + nrows <= height );
+
+   if (type == DILLO_IMG_TYPE_RGB || type == DILLO_IMG_TYPE_RGBA) {
+      /* avoid a memcpy here!  --Jcid */
+      imgbuf->copyRows(y0, nrows, (byte *)buf, stride);
+      return;
+   }
 
-   /* Decode 'buf' and copy it into the imgbuf */
-   uchar_t *newbuf = Imgbuf_rgb_line(buf, type, cmap, width, y);
-   ((Imgbuf*)v_imgbuf)->copyRow(y, (byte *)newbuf);
+   /* Decode 'buf' and copy it into the imgbuf, a batch at a time */
+   for ( ; nrows > 0; y0 += n, nrows -= n, buf += n * stride) {
+      n = MIN(nrows, IMGBUF_BATCH_ROWS);
+      Imgbuf_rgb_rows(buf, type, cmap, width, n, stride);
+      imgbuf->copyRows(y0, n, (byte *)linebuf, Imgbuf_bpp(type) * width);
+   }
 }
 
 /*
@@ -136,3 +270,77 @@ void a_Imgbuf_new_scan(void *v_imgbuf)
    ((Imgbuf*)v_imgbuf)->newScan();
 }
 
+/*
+ * Memory taken by the pixel data of a root imgbuf and its scaled buffers.
+ */
+int a_Imgbuf_data_size(void *v_imgbuf)
+{
+   return ((Imgbuf*)v_imgbuf)->getDataSize();
+}
+
+/*
+ * Counter value of the last time the imgbuf was drawn.
+ */
+uint_t a_Imgbuf_last_use(void *v_imgbuf)
+{
+   return ((Imgbuf*)v_imgbuf)->getLastUse();
+}
+
+/*
+ * Free the pixel data of a root imgbuf; it's reloaded when drawn again.
+ */
+void a_Imgbuf_drop_data(void *v_imgbuf)
+{
+   ((Imgbuf*)v_imgbuf)->dropData();
+}
+
+/*
+ * Let the dicache refill this imgbuf after its data is dropped.
+ */
+void a_Imgbuf_set_reloader(void *v_imgbuf)
+{
+   ((Imgbuf*)v_imgbuf)->setReloader(&reloader);
+}
+
+/*
+ * Change the size of a root imgbuf, to decode its image again at that size.
+ */
+void a_Imgbuf_set_root_size(void *v_imgbuf, uint_t width, uint_t height)
+{
+   ((Imgbuf*)v_imgbuf)->setRootSize(width, height);
+}
+
+/*
+ * Replace an area of a complete root imgbuf with RGB(A) data, and have
+ * it drawn again.
+ */
+void a_Imgbuf_update_area(void *v_imgbuf, const uchar_t *buf, uint_t x,
+                          uint_t y, uint_t width, uint_t height,
+                          uint_t stride)
+{
+   ((Imgbuf*)v_imgbuf)->copyArea(x, y, width, height, buf, stride);
+}
+
+/*
+ * Whether the imgbuf is shown in a visible part of a page.
+ */
+int a_Imgbuf_is_visible(void *v_imgbuf)
+{
+   return ((Imgbuf*)v_imgbuf)->isVisible();
+}
+
+/*
+ * Whether the imgbuf was drawn in the current frame.
+ */
+int a_Imgbuf_drawn_in_frame(void *v_imgbuf)
+{
+   return ((Imgbuf*)v_imgbuf)->isDrawnInFrame();
+}
+
+/*
+ * Tell (or stop telling) the animation module when the imgbuf is drawn.
+ */
+void a_Imgbuf_set_animated(void *v_imgbuf, int animated)
+{
+   ((Imgbuf*)v_imgbuf)->setAnimation(animated ? &anim_resumer : NULL);
+}
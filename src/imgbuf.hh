@@ -11,6 +11,10 @@ extern "C" {
 
 #include "image.hh"
 
+/* Imgbuf types for a_Imgbuf_new() */
+#define I_RGB  0
+#define I_RGBA 1
+
 /*
  * Function prototypes
  */
@@ -20,7 +24,22 @@ void *a_Imgbuf_new(void *v_dw, int img_type, uint_t width, uint_t height);
 int a_Imgbuf_last_reference(void *v_imgbuf);
 void a_Imgbuf_update(void *v_imgbuf, const uchar_t *buf, DilloImgType type,
                      uchar_t *cmap, uint_t width, uint_t height, uint_t y);
+void a_Imgbuf_update_rows(void *v_imgbuf, const uchar_t *buf,
+                          DilloImgType type, uchar_t *cmap, uint_t width,
+                          uint_t height, uint_t y0, uint_t nrows,
+                          uint_t stride);
 void a_Imgbuf_new_scan(void *v_imgbuf);
+int a_Imgbuf_data_size(void *v_imgbuf);
+uint_t a_Imgbuf_last_use(void *v_imgbuf);
+void a_Imgbuf_drop_data(void *v_imgbuf);
+void a_Imgbuf_set_reloader(void *v_imgbuf);
+void a_Imgbuf_set_root_size(void *v_imgbuf, uint_t width, uint_t height);
+void a_Imgbuf_update_area(void *v_imgbuf, const uchar_t *buf, uint_t x,
+                          uint_t y, uint_t width, uint_t height,
+                          uint_t stride);
+int a_Imgbuf_is_visible(void *v_imgbuf);
+int a_Imgbuf_drawn_in_frame(void *v_imgbuf);
+void a_Imgbuf_set_animated(void *v_imgbuf, int animated);
 
 #ifdef __cplusplus
 }
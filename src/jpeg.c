@@ -36,6 +36,9 @@
 #include "capi.h"       /* get cache entry status */
 #include "msg.h"
 
+/* Rows passed to the dicache at a time */
+#define JPEG_BATCH_ROWS 16
+
 typedef enum {
    DILLO_JPEG_INIT,
    DILLO_JPEG_STARTING,
@@ -233,15 +236,39 @@ void a_Jpeg_callback(int Op, void *data)
    }
 }
 
+/*
+ * Choose the largest DCT scaling denominator (1, 2, 4 or 8) that still
+ * yields an image at least as large as the clients want to show it. Only
+ * an image of which both display dimensions are known is scaled down.
+ */
+static uint_t Jpeg_scale_denom(DilloJpeg *jpeg)
+{
+   DICacheEntry *DicEntry = a_Dicache_get_entry(jpeg->url, jpeg->version);
+   uint_t w = jpeg->cinfo.image_width, h = jpeg->cinfo.image_height;
+   uint_t denom;
+
+   if (!DicEntry || !DicEntry->HintWidth || !DicEntry->HintHeight)
+      return 1;
+   for (denom = 8; denom > 1; denom /= 2) {
+      /* libjpeg rounds the scaled dimensions up */
+      if ((w + denom - 1) / denom >= DicEntry->HintWidth &&
+          (h + denom - 1) / denom >= DicEntry->HintHeight)
+         break;
+   }
+   return denom;
+}
+
 /*
  * Receive and process new chunks of JPEG image data
  */
 static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
 {
    DilloImgType type;
+   DICacheEntry *DicEntry;
    uchar_t *linebuf;
    JSAMPLE *array[1];
-   int num_read;
+   int num_read, n;
+   uint_t row_size;
 
    _MSG("Jpeg_write: (%p) Bytes in buff: %ld Ofs: %lu\n", jpeg,
         (long) BufSize, (ulong_t)jpeg->Start_Ofs);
@@ -282,8 +309,10 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
          /*
           * If a multiple-scan image is not completely in cache,
           * use progressive display, updating as it arrives.
+          * (a decoding thread always has the whole image)
           */
          if (jpeg_has_multiple_scans(&jpeg->cinfo) &&
+             jpeg->version != DIC_Worker &&
              !(a_Capi_get_flags(jpeg->url) & CAPI_Completed))
             jpeg->cinfo.buffered_image = TRUE;
 
@@ -298,9 +327,16 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
             return;
          }
 
+         /* Let libjpeg skip the detail that would be scaled away */
+         jpeg->cinfo.scale_num = 1;
+         jpeg->cinfo.scale_denom = Jpeg_scale_denom(jpeg);
+         jpeg_calc_output_dimensions(&jpeg->cinfo);
+
+         if ((DicEntry = a_Dicache_get_entry(jpeg->url, jpeg->version)))
+            DicEntry->ScaleDenom = jpeg->cinfo.scale_denom;
          a_Dicache_set_parms(jpeg->url, jpeg->version, jpeg->Image,
-                             (uint_t)jpeg->cinfo.image_width,
-                             (uint_t)jpeg->cinfo.image_height,
+                             (uint_t)jpeg->cinfo.output_width,
+                             (uint_t)jpeg->cinfo.output_height,
                              type);
 
          /* decompression step 4 (see libjpeg.doc) */
@@ -340,21 +376,27 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
    }
 
    if (jpeg->state == DILLO_JPEG_READ_IN_SCAN) {
-      linebuf = dMalloc(jpeg->cinfo.image_width *
-                         jpeg->cinfo.num_components);
-      array[0] = linebuf;
+      row_size = jpeg->cinfo.output_width * jpeg->cinfo.num_components;
+      linebuf = dMalloc(row_size * JPEG_BATCH_ROWS);
 
       while (1) {
-         num_read = jpeg_read_scanlines(&(jpeg->cinfo), array, 1);
+         /* Read the available rows of this scan, a batch at a time */
+         for (num_read = 0; num_read < JPEG_BATCH_ROWS &&
+              jpeg->y + num_read < jpeg->cinfo.output_height; num_read += n) {
+            array[0] = linebuf + num_read * row_size;
+            if ((n = jpeg_read_scanlines(&(jpeg->cinfo), array, 1)) == 0)
+               break;
+         }
          if (num_read == 0) {
             /* out of input */
             break;
          }
-         a_Dicache_write(jpeg->url, jpeg->version, linebuf, jpeg->y);
+         a_Dicache_write_rows(jpeg->url, jpeg->version, linebuf, jpeg->y,
+                              num_read, row_size);
 
-         jpeg->y++;
+         jpeg->y += num_read;
 
-         if (jpeg->y == jpeg->cinfo.image_height) {
+         if (jpeg->y == jpeg->cinfo.output_height) {
             /* end of scan */
             if (!jpeg->cinfo.buffered_image) {
                /* single scan */
@@ -18,6 +18,7 @@
 #include "utf8.hh"
 #include "msg.h"
 #include "misc.h"
+#include "dicache.h"
 
 /*
  * Escape characters as %XX sequences.
@@ -110,23 +111,22 @@ static const ContentType_t MimeTypes[] = {
    { "image/gif", 9 },
    { "image/png", 9 },
    { "image/jpeg", 10 },
+   { "image/webp", 10 },
    { NULL, 0 }
 };
 
 typedef enum {
    DT_OCTET_STREAM = 0,
    DT_TEXT_HTML,
-   DT_TEXT_PLAIN,
-   DT_IMAGE_GIF,
-   DT_IMAGE_PNG,
-   DT_IMAGE_JPG,
+   DT_TEXT_PLAIN
 } DetectedContentType;
 
 /*
  * Detects 'Content-Type' from a data stream sample.
  *
  * It uses the magic(5) logic from file(1). Currently, it
- * only checks the few mime types that Dillo supports.
+ * only checks the few mime types that Dillo supports (for images,
+ * those the dicache has decoders for).
  *
  * 'Data' is a pointer to the first bytes of the raw data.
  *
@@ -138,6 +138,7 @@ int a_Misc_get_content_type_from_data(void *Data, size_t Size, const char **PT)
    char *p = Data;
    int st = 1;      /* default to "doubt' */
    DetectedContentType Type = DT_OCTET_STREAM; /* default to binary */
+   const char *ImgType = NULL;
 
    /* HTML try */
    for (i = 0; i < Size && dIsspace(p[i]); ++i);
@@ -151,16 +152,7 @@ int a_Misc_get_content_type_from_data(void *Data, size_t Size, const char **PT)
       Type = DT_TEXT_HTML;
       st = 0;
    /* Images */
-   } else if (Size >= 4 && !dStrncasecmp(p, "GIF8", 4)) {
-      Type = DT_IMAGE_GIF;
-      st = 0;
-   } else if (Size >= 4 && !dStrncasecmp(p, "\x89PNG", 4)) {
-      Type = DT_IMAGE_PNG;
-      st = 0;
-   } else if (Size >= 2 && !dStrncasecmp(p, "\xff\xd8", 2)) {
-      /* JPEG has the first 2 bytes set to 0xffd8 in BigEndian - looking
-       * at the character representation should be machine independent. */
-      Type = DT_IMAGE_JPG;
+   } else if ((ImgType = a_Dicache_sniff_type(p, Size))) {
       st = 0;
 
    /* Text */
@@ -198,7 +190,7 @@ int a_Misc_get_content_type_from_data(void *Data, size_t Size, const char **PT)
          st = 0;
    }
 
-   *PT = MimeTypes[Type].str;
+   *PT = ImgType ? ImgType : MimeTypes[Type].str;
    return st;
 }
 
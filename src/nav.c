@@ -12,6 +12,8 @@
 /* Support for a navigation stack */
 
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include "msg.h"
 #include "nav.h"
@@ -533,26 +535,71 @@ void a_Nav_jump(BrowserWindow *bw, int offset, int new_bw)
 
 /* Specific methods -------------------------------------------------------- */
 
+/* Saved data is written in blocks of this size */
+#define NAV_SAVE_BLOCK  (64 * 1024)
+
+/*
+ * Write the data in the cache that hasn't been saved yet to the file,
+ * straight from the cache's buffer, and in whole blocks (but at the end,
+ * when 'all' is set). A failure is recorded in Web->SaveErrno.
+ */
+static void Nav_save_write(CacheClient_t *Client, int all)
+{
+   DilloWeb *Web = Client->Web;
+   int fd = fileno(Web->stream);
+   int Bytes = Client->BufSize - Web->SavedBytes, st;
+
+   if (!all)
+      Bytes -= Bytes % NAV_SAVE_BLOCK;
+   while (Bytes > 0) {
+      st = write(fd, (char*)Client->Buf + Web->SavedBytes, Bytes);
+      if (st < 0) {
+         if (errno == EINTR)
+            continue;
+         Web->SaveErrno = errno;
+         MSG_WARN("Cannot write to \"%s\": %s\n", Web->filename,
+                  dStrerror(errno));
+         break;
+      }
+      Web->SavedBytes += st;
+      Bytes -= st;
+   }
+}
+
+/*
+ * Timeout callback: stop a save that failed (its cache client can't be
+ * stopped from within its own callback).
+ */
+static void Nav_save_abort_cb(void *data)
+{
+   a_Capi_stop_client(VOIDP2INT(data), 1);
+}
+
 /*
  * Receive data from the cache and save it to a local file
+ * (what the cache has already goes at once, and then what arrives).
+ * When writing fails, the download is stopped and the error is shown.
  */
 static void Nav_save_cb(int Op, CacheClient_t *Client)
 {
    DilloWeb *Web = Client->Web;
-   int Bytes;
 
-   if (Op){
-      struct stat st;
+   if (Web->SaveErrno)
+      return;   /* failed, and waiting to be stopped */
+   Nav_save_write(Client, Op);
+   if (Web->SaveErrno || Op) {
+      if (fclose(Web->stream) != 0 && !Web->SaveErrno)
+         Web->SaveErrno = errno;
+      Web->stream = NULL;
+   }
 
-      fflush(Web->stream);
-      fstat(fileno(Web->stream), &st);
-      fclose(Web->stream);
-      a_UIcmd_set_msg(Web->bw, "File saved (%d Bytes)", st.st_size);
-   } else {
-      if ((Bytes = Client->BufSize - Web->SavedBytes) > 0) {
-         Bytes = fwrite(Client->Buf + Web->SavedBytes, 1, Bytes, Web->stream);
-         Web->SavedBytes += Bytes;
-      }
+   if (Web->SaveErrno) {
+      a_UIcmd_set_msg(Web->bw, "Can't save \"%s\": %s", Web->filename,
+                      dStrerror(Web->SaveErrno));
+      if (!Op)
+         a_Timeout_add(0.0, Nav_save_abort_cb, INT2VOIDP(Client->Key));
+   } else if (Op) {
+      a_UIcmd_set_msg(Web->bw, "File saved (%d Bytes)", Web->SavedBytes);
    }
 }
 
@@ -11,6 +11,9 @@
 
 /*
  * Module for decoding a text/plain object into a dw widget.
+ *
+ * The text isn't copied into the widget: it only indexes the lines, and
+ * reads them from the cache entry when they are to be shown.
  */
 
 #include "msg.h"
@@ -18,22 +21,18 @@
 #include "cache.h"
 #include "bw.h"
 #include "web.hh"
-#include "misc.h"
 #include "styleengine.hh"
 
 #include "uicmd.hh"
 
 #include "../dw/core.hh"
-#include "../dw/textblock.hh"
-
-// Dw to Textblock
-#define DW2TB(dw)  ((Textblock*)dw)
+#include "../dw/plaintext.hh"
 
 using namespace dw;
 using namespace dw::core;
 
 
-class DilloPlain {
+class DilloPlain: public PlainText::Source {
 private:
    class PlainLinkReceiver: public dw::core::Layout::LinkReceiver {
    public:
@@ -43,20 +42,21 @@ private:
    };
    PlainLinkReceiver plainReceiver;
 
-   void addLine(char *Buf, uint_t BufSize);
-
 public:
    BrowserWindow *bw;
+   DilloUrl *url;
+   int bufSerial;       /* Of the cache entry held (see a_Cache_hold_buf) */
 
-   Widget *dw;
+   PlainText *dw;
    style::Style *widgetStyle;
    size_t Start_Ofs;    /* Offset of where to start reading next */
    int state;
 
-   DilloPlain(BrowserWindow *bw);
+   DilloPlain(DilloWeb *web);
    ~DilloPlain();
 
    void write(void *Buf, uint_t BufSize, int Eof);
+   const char *getText(int *length);
 };
 
 /* FSM states */
@@ -83,17 +83,21 @@ void a_Plain_free(void *data);
 /*
  * Diplain constructor.
  */
-DilloPlain::DilloPlain(BrowserWindow *p_bw)
+DilloPlain::DilloPlain(DilloWeb *web)
 {
    /* Init event receiver */
    plainReceiver.plain = this;
 
    /* Init internal variables */
-   bw = p_bw;
-   dw = new Textblock (prefs.limit_text_width);
+   bw = web->bw;
+   url = a_Url_dup(web->url);
    Start_Ofs = 0;
    state = ST_SeekingEol;
 
+   /* The widget reads the text from the cache for as long as it's shown
+    * (even when the transfer is done, and the entry has no clients) */
+   bufSerial = a_Cache_hold_buf(url);
+
    Layout *layout = (Layout*) bw->render_layout;
    StyleEngine styleEngine (layout);
 
@@ -102,6 +106,8 @@ DilloPlain::DilloPlain(BrowserWindow *p_bw)
    widgetStyle = styleEngine.wordStyle ();
    widgetStyle->ref ();
 
+   dw = new PlainText (this, widgetStyle);
+
    /* The context menu */
    layout->connectLink (&plainReceiver);
 
@@ -116,6 +122,8 @@ DilloPlain::~DilloPlain()
 {
    _MSG("::~DilloPlain()\n");
    widgetStyle->unref();
+   a_Cache_release_buf(url, bufSerial);
+   a_Url_free(url);
 }
 
 /*
@@ -133,23 +141,15 @@ bool DilloPlain::PlainLinkReceiver::press (Widget *widget, int, int, int, int,
    return false;
 }
 
-void DilloPlain::addLine(char *Buf, uint_t BufSize)
+/*
+ * Give the widget the current text (it's taken from the cache every time,
+ * since the buffer moves as it grows).
+ */
+const char *DilloPlain::getText(int *length)
 {
-   int len;
-   char buf[128];
-   char *end = Buf + BufSize;
-
-   if (BufSize > 0) {
-      // Limit word length to avoid X11 coordinate
-      // overflow with extremely long lines.
-      while ((len = a_Misc_expand_tabs(&Buf, end, buf, sizeof(buf))))
-         DW2TB(dw)->addText(buf, len, widgetStyle);
-   } else {
-      // Add dummy word for empty lines - otherwise the parbreak is ignored.
-      DW2TB(dw)->addText("", 0, widgetStyle);
-   }
+   char *buf;
 
-   DW2TB(dw)->addParbreak(0, widgetStyle);
+   return a_Cache_get_held_buf(url, bufSerial, &buf, length) ? buf : NULL;
 }
 
 /*
@@ -176,7 +176,7 @@ void DilloPlain::write(void *Buf, uint_t BufSize, int Eof)
          }
          break;
       case ST_Eol:
-         addLine(Start + i - len, len);
+         dw->addLine((char*)Buf, Start_Ofs + i - len, Start_Ofs + i);
          if (Start[i] == '\r' && Start[i + 1] == '\n') ++i;
          if (i < MaxBytes) ++i;
          state = ST_SeekingEol;
@@ -186,11 +186,11 @@ void DilloPlain::write(void *Buf, uint_t BufSize, int Eof)
    }
    Start_Ofs += i - len;
    if (Eof && len) {
-      addLine(Start + i - len, len);
+      dw->addLine((char*)Buf, Start_Ofs, Start_Ofs + len);
       Start_Ofs += len;
    }
 
-   DW2TB(dw)->flush();
+   dw->flush();
 }
 
 /*
@@ -199,7 +199,7 @@ void DilloPlain::write(void *Buf, uint_t BufSize, int Eof)
 void *a_Plain_text(const char *type, void *P, CA_Callback_t *Call, void **Data)
 {
    DilloWeb *web = (DilloWeb*)P;
-   DilloPlain *plain = new DilloPlain(web->bw);
+   DilloPlain *plain = new DilloPlain(web);
 
    *Call = (CA_Callback_t)Plain_callback;
    *Data = (void*)plain;
@@ -26,6 +26,9 @@
 #include "cache.h"
 #include "dicache.h"
 
+/* Rows passed to the dicache at a time */
+#define PNG_BATCH_ROWS 16
+
 enum prog_state {
    IS_finished, IS_init, IS_nextdata
 };
@@ -93,7 +96,8 @@ struct _DilloPng {
 
    enum prog_state state;       /* FSM current state  */
 
-   uchar_t *linebuf;            /* o/p raster data */
+   png_uint_32 pending_row;     /* first decoded row not sent yet */
+   uint_t pending_rows;         /* number of consecutive rows not sent */
 
 } DilloPng;
 
@@ -203,12 +207,26 @@ Png_datainfo_callback(png_structp png_ptr, png_infop info_ptr)
    for (i = 0; i < png->height; i++)
       png->row_pointers[i] = png->image_data + (i * png->rowbytes);
 
-   png->linebuf = dMalloc(3 * png->width);
-
    /* Initialize the dicache-entry here */
    a_Dicache_set_parms(png->url, png->version, png->Image,
                        (uint_t)png->width, (uint_t)png->height,
-                       DILLO_IMG_TYPE_RGB);
+                       png->channels == 4 ? DILLO_IMG_TYPE_RGBA :
+                                            DILLO_IMG_TYPE_RGB);
+}
+
+/*
+ * Send the decoded rows not sent yet to the dicache, at once.
+ */
+static void Png_flush_rows(DilloPng *png)
+{
+   if (png->pending_rows == 0)
+      return;
+
+   a_Dicache_write_rows(png->url, png->version,
+                        png->image_data + png->pending_row * png->rowbytes,
+                        (uint_t)png->pending_row, png->pending_rows,
+                        (uint_t)png->rowbytes);
+   png->pending_rows = 0;
 }
 
 static void
@@ -216,7 +234,6 @@ static void
                       png_uint_32 row_num, int pass)
 {
    DilloPng *png;
-   uint_t i;
 
    if (!new_row)                /* work to do? */
       return;
@@ -228,6 +245,14 @@ static void
    png_progressive_combine_row(png_ptr, png->row_pointers[row_num], new_row);
 
    _MSG("png: row_num=%u previous_row=%u\n", row_num, png->previous_row);
+   /* Rows are sent in batches of consecutive ones */
+   if (png->pending_rows &&
+       (row_num != png->pending_row + png->pending_rows ||
+        png->pending_rows == PNG_BATCH_ROWS))
+      Png_flush_rows(png);
+   if (png->pending_rows == 0)
+      png->pending_row = row_num;
+
    if (row_num < png->previous_row) {
       a_Dicache_new_scan(png->url, png->version);
    }
@@ -235,47 +260,10 @@ static void
 
    switch (png->channels) {
    case 3:
-      a_Dicache_write(png->url, png->version,
-                      png->image_data + (row_num * png->rowbytes),
-                      (uint_t)row_num);
-      break;
    case 4:
-     {
-        /* TODO: get the backgound color from the parent
-         * of the image widget -- Livio.                 */
-        int a, bg_red, bg_green, bg_blue;
-        uchar_t *pl = png->linebuf;
-        uchar_t *data = png->image_data + (row_num * png->rowbytes);
-
-        /* TODO: maybe change prefs.bg_color to `a_Dw_widget_get_bg_color`,
-         * when background colors are correctly implementated */
-        bg_blue  = (png->Image->bg_color) & 0xFF;
-        bg_green = (png->Image->bg_color>>8) & 0xFF;
-        bg_red   = (png->Image->bg_color>>16) & 0xFF;
-
-        for (i = 0; i < png->width; i++) {
-           a = *(data+3);
-
-           if (a == 255) {
-              *(pl++) = *(data++);
-              *(pl++) = *(data++);
-              *(pl++) = *(data++);
-              data++;
-           } else if (a == 0) {
-              *(pl++) = bg_red;
-              *(pl++) = bg_green;
-              *(pl++) = bg_blue;
-              data += 4;
-           } else {
-              png_composite(*(pl++), *(data++), a, bg_red);
-              png_composite(*(pl++), *(data++), a, bg_green);
-              png_composite(*(pl++), *(data++), a, bg_blue);
-              data++;
-           }
-        }
-        a_Dicache_write(png->url, png->version, png->linebuf, (uint_t)row_num);
-        break;
-     }
+      /* (the alpha channel is kept; the image is composited when drawn) */
+      png->pending_rows++;
+      break;
    default:
       MSG("Png_datarow_callback: unexpected number of channels=%d pass=%d\n",
           png->channels, pass);
@@ -304,7 +292,6 @@ static void Png_free(DilloPng *png)
 
    dFree(png->image_data);
    dFree(png->row_pointers);
-   dFree(png->linebuf);
    if (setjmp(png->jmpbuf))
       MSG_WARN("PNG: can't destroy read structure\n");
    else if (png->png_ptr)
@@ -390,6 +377,7 @@ static void Png_write(DilloPng *png, void *Buf, uint_t BufSize)
          abort();
       }
    }
+   Png_flush_rows(png);
 }
 
 /*
@@ -443,10 +431,11 @@ void *a_Png_new(DilloImage *Image, DilloUrl *url, int version)
    png->ipbufstart = 0;
    png->ipbufsize = 0;
    png->state = IS_init;
-   png->linebuf = NULL;
    png->image_data = NULL;
    png->row_pointers = NULL;
    png->previous_row = 0;
+   png->pending_row = 0;
+   png->pending_rows = 0;
 
    return png;
 }
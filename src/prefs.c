@@ -54,6 +54,9 @@ void a_Prefs_init(void)
    prefs.buffered_drawing = 2;
    prefs.contrast_visited_color = TRUE;
    prefs.date_format = dStrdup(PREFS_DATE_FORMAT);
+   prefs.dir_sort_limit = 2000;
+   prefs.download_from_cache = TRUE;
+   prefs.download_segments = 4;
    prefs.enterpress_forces_submit = FALSE;
 
    /* PREFS_FILTER_SAME_DOMAIN is the mainline default,
@@ -86,8 +89,11 @@ void a_Prefs_init(void)
    prefs.http_proxyuser = NULL;
    prefs.http_referer = dStrdup(PREFS_HTTP_REFERER);
    prefs.http_user_agent = dStrdup(PREFS_HTTP_USER_AGENT);
+   prefs.image_cache_size = 65536;
    prefs.limit_text_width = FALSE;
    prefs.load_images=TRUE;
+   prefs.lazy_images = FALSE;
+   prefs.lazy_images_distance = 1.5;
    prefs.load_stylesheets=TRUE;
    prefs.middle_click_drags_page = TRUE;
    prefs.middle_click_opens_new_tab = TRUE;
@@ -116,6 +122,7 @@ void a_Prefs_init(void)
    prefs.show_zoom = TRUE;
    prefs.small_icons = FALSE;
    prefs.start_page = a_Url_new(PREFS_START_PAGE, NULL);
+   prefs.tile_cache_size = 16384;
    prefs.w3c_plus_heuristics = TRUE;
 
    /* Handy shortcut... */
@@ -74,10 +74,14 @@ struct _DilloPrefs {
    bool_t show_quit_dialog;
    bool_t fullwindow_start;
    bool_t load_images;
+   bool_t lazy_images;
+   double lazy_images_distance;
    bool_t load_stylesheets;
    bool_t parse_embedded_css;
    int filter_auto_requests;
    int32_t buffered_drawing;
+   int32_t tile_cache_size;
+   int32_t image_cache_size;
    char *font_serif;
    char *font_sans_serif;
    char *font_cursive;
@@ -94,6 +98,9 @@ struct _DilloPrefs {
    bool_t middle_click_drags_page;
    char *date_format;
    char *bookmarks_file;
+   int32_t download_segments;
+   bool_t download_from_cache;
+   int32_t dir_sort_limit;
 };
 
 /* Global Data */
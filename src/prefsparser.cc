@@ -48,6 +48,9 @@ const SymNode_t symbols[] = {
    { "buffered_drawing", &prefs.buffered_drawing, PREFS_INT32 },
    { "contrast_visited_color", &prefs.contrast_visited_color, PREFS_BOOL },
    { "date_format", &prefs.date_format, PREFS_STRING },
+   { "dir_sort_limit", &prefs.dir_sort_limit, PREFS_INT32 },
+   { "download_from_cache", &prefs.download_from_cache, PREFS_BOOL },
+   { "download_segments", &prefs.download_segments, PREFS_INT32 },
    { "enterpress_forces_submit", &prefs.enterpress_forces_submit,
      PREFS_BOOL },
    { "filter_auto_requests", &prefs.filter_auto_requests, PREFS_FILTER },
@@ -70,6 +73,9 @@ const SymNode_t symbols[] = {
    { "http_proxyuser", &prefs.http_proxyuser, PREFS_STRING },
    { "http_referer", &prefs.http_referer, PREFS_STRING },
    { "http_user_agent", &prefs.http_user_agent, PREFS_STRING },
+   { "image_cache_size", &prefs.image_cache_size, PREFS_INT32 },
+   { "lazy_images", &prefs.lazy_images, PREFS_BOOL },
+   { "lazy_images_distance", &prefs.lazy_images_distance, PREFS_DOUBLE },
    { "limit_text_width", &prefs.limit_text_width, PREFS_BOOL },
    { "load_images", &prefs.load_images, PREFS_BOOL },
    { "load_stylesheets", &prefs.load_stylesheets, PREFS_BOOL },
@@ -101,6 +107,7 @@ const SymNode_t symbols[] = {
    { "show_zoom", &prefs.show_zoom, PREFS_BOOL },
    { "small_icons", &prefs.small_icons, PREFS_BOOL },
    { "start_page", &prefs.start_page, PREFS_URL },
+   { "tile_cache_size", &prefs.tile_cache_size, PREFS_INT32 },
    { "w3c_plus_heuristics", &prefs.w3c_plus_heuristics, PREFS_BOOL },
 };
 
@@ -14,6 +14,7 @@
 #include "prefs.h"
 #include "html_common.hh"
 #include "styleengine.hh"
+#include "../lout/perf.h"
 
 using namespace lout::misc;
 using namespace dw::core::style;
@@ -450,6 +451,9 @@ void StyleEngine::apply (int i, StyleAttrs *attrs, CssPropertyList *props) {
          case CSS_PROPERTY_BORDER_COLLAPSE:
             attrs->borderCollapse = (BorderCollapse) p->value.intVal;
             break;
+         case CSS_PROPERTY_TABLE_LAYOUT:
+            attrs->tableLayout = (TableLayout) p->value.intVal;
+            break;
          case CSS_PROPERTY_BORDER_TOP_COLOR:
             attrs->borderColor.top = (p->type == CSS_TYPE_ENUM) ? NULL :
                                      Color::create (layout, p->value.intVal);
@@ -717,6 +721,8 @@ Style * StyleEngine::backgroundStyle () {
 Style * StyleEngine::style0 (int i) {
    CssPropertyList props, *styleAttrProperties, *styleAttrPropertiesImportant;
    CssPropertyList *nonCssProperties;
+   PERF_TIMER(t);
+   PERF_START(t);
    // get previous style from the stack
    StyleAttrs attrs = *stack->getRef (i - 1)->style;
 
@@ -748,6 +754,7 @@ Style * StyleEngine::style0 (int i) {
 
    stack->getRef (i)->style = Style::create (layout, &attrs);
 
+   PERF_STOP(PERF_STYLE, t);
    return stack->getRef (i)->style;
 }
 
@@ -144,6 +144,34 @@ void Html_tag_open_table(DilloHtml *html, const char *tag, int tagsize)
    S_TOP(html)->table = table;
 }
 
+/*
+ * <COL>
+ */
+void Html_tag_open_col(DilloHtml *html, const char *tag, int tagsize)
+{
+   const char *attrbuf;
+   dw::Table *table = (dw::Table*)S_TOP(html)->table;
+   int span = 1;
+
+   /* (the table mode is TOP again after </tr>, so the rows are counted) */
+   if (S_TOP(html)->table_mode == DILLO_HTML_TABLE_MODE_NONE ||
+       table->getNumRows () > 0) {
+      BUG_MSG("<col> outside <table>, or after the first row\n");
+      return;
+   }
+
+   /* The span is limited like colspan, see dw::Table::addCell */
+   if ((attrbuf = a_Html_get_attr(html, tag, tagsize, "span")))
+      span = MIN(MAX(1, strtol (attrbuf, NULL, 10)), 50);
+
+   if ((attrbuf = a_Html_get_attr(html, tag, tagsize, "width")))
+      html->styleEngine->setNonCssHint (CSS_PROPERTY_WIDTH,
+                                        CSS_TYPE_LENGTH_PERCENTAGE,
+                                        a_Html_parse_length (html, attrbuf));
+
+   table->addCol (html->styleEngine->style ()->width, span);
+}
+
 /*
  * <TR>
  */
@@ -12,6 +12,7 @@ class DilloHtml;
  */
 
 void Html_tag_open_table(DilloHtml *html, const char *tag, int tagsize);
+void Html_tag_open_col(DilloHtml *html, const char *tag, int tagsize);
 void Html_tag_open_tr(DilloHtml *html, const char *tag, int tagsize);
 void Html_tag_open_td(DilloHtml *html, const char *tag, int tagsize);
 void Html_tag_open_th(DilloHtml *html, const char *tag, int tagsize);
@@ -18,6 +18,7 @@
 #include "IO/mime.h"
 
 #include "../dw/core.hh"
+#include "../lout/perf.h"
 #include "styleengine.hh"
 #include "web.hh"
 
@@ -77,6 +78,7 @@ int a_Web_dispatch_by_type (const char *Type, DilloWeb *Web,
 
       /* This method frees the old dw if any */
       layout->setWidget(dw);
+      PERF_MARK(PERF_MARK_WIDGET);
 
       /* Set the page title with the bare filename (e.g. for images),
        * HTML pages with a <TITLE> tag will overwrite it later */
@@ -122,6 +124,7 @@ DilloWeb* a_Web_new(const DilloUrl *url, const DilloUrl *requester)
    web->filename = NULL;
    web->stream  = NULL;
    web->SavedBytes = 0;
+   web->SaveErrno = 0;
    web->bgColor = 0x000000; /* Dummy value will be overwritten
                              * in a_Web_dispatch_by_type. */
    dList_append(ValidWebs, (void *)web);
@@ -33,6 +33,7 @@ struct _DilloWeb {
   char *filename;             /* Variables for Local saving */
   FILE *stream;
   int SavedBytes;
+  int SaveErrno;              /* Why saving failed (0 if it didn't) */
 };
 
 void a_Web_init(void);
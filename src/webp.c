@@ -0,0 +1,199 @@
+/*
+ * File: webp.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The WebP decoder for dillo. It is responsible for decoding WebP data
+ * and transferring it to the dicache. It uses libwebp's incremental
+ * decoder, which is given all the data received so far each time (as the
+ * cache keeps it, so nothing is copied), and tells how many rows are done.
+ */
+
+#include <config.h>
+#ifdef ENABLE_WEBP
+
+#include <webp/decode.h>
+
+#include "image.hh"
+#include "cache.h"
+#include "dicache.h"
+#include "msg.h"
+
+typedef enum {
+   DILLO_WEBP_INIT,             /* Waiting for the headers */
+   DILLO_WEBP_DECODING,
+   DILLO_WEBP_DONE,
+   DILLO_WEBP_ERROR
+} DilloWebpState;
+
+typedef struct {
+   DilloImage *Image;           /* Image meta data */
+   DilloUrl *url;               /* Primary Key for the dicache */
+   int version;                 /* Secondary Key for the dicache */
+
+   DilloWebpState state;
+   WebPDecoderConfig config;    /* Features of the image, and output */
+   WebPIDecoder *idec;          /* libwebp's incremental decoder */
+   int y;                       /* Rows sent to the dicache so far */
+} DilloWebp;
+
+
+/*
+ * Free up the resources for this image.
+ */
+static void Webp_free(DilloWebp *webp)
+{
+   _MSG("Webp_free: webp=%p\n", webp);
+
+   if (webp->idec)
+      WebPIDelete(webp->idec);
+   WebPFreeDecBuffer(&webp->config.output);
+   dFree(webp);
+}
+
+/*
+ * Finish the decoding process (and free the memory)
+ */
+static void Webp_close(DilloWebp *webp, CacheClient_t *Client)
+{
+   _MSG("Webp_close\n");
+   /* Let dicache know decoding is over */
+   a_Dicache_close(webp->url, webp->version, Client);
+   Webp_free(webp);
+}
+
+/*
+ * Read the headers, and set the decoder up.
+ * Return value: whether the image can be decoded (so far).
+ */
+static int Webp_init(DilloWebp *webp, const uint8_t *buf, size_t size)
+{
+   WebPBitstreamFeatures *features = &webp->config.input;
+   VP8StatusCode status;
+   int w, h;
+
+   status = WebPGetFeatures(buf, size, features);
+   if (status == VP8_STATUS_NOT_ENOUGH_DATA)
+      return 1;                 /* need MORE data */
+   if (status != VP8_STATUS_OK) {
+      MSG_WARN("\"%s\" is not a WebP file.\n", URL_STR(webp->url));
+      return 0;
+   }
+   if (features->has_animation) {
+      MSG_WARN("\"%s\": animated WebP is not supported.\n",
+               URL_STR(webp->url));
+      return 0;
+   }
+
+   /* check max image size */
+   w = features->width;
+   h = features->height;
+   if (w <= 0 || h <= 0 || w > IMAGE_MAX_AREA / h) {
+      MSG("Webp_init: suspicious image size request %d x %d\n", w, h);
+      return 0;
+   }
+
+   /* (the alpha channel is kept; the image is composited when drawn) */
+   webp->config.output.colorspace = features->has_alpha ? MODE_RGBA : MODE_RGB;
+   if (!(webp->idec = WebPIDecode(NULL, 0, &webp->config)))
+      return 0;
+
+   /* Initialize the dicache-entry here */
+   a_Dicache_set_parms(webp->url, webp->version, webp->Image,
+                       (uint_t)w, (uint_t)h,
+                       features->has_alpha ? DILLO_IMG_TYPE_RGBA :
+                                             DILLO_IMG_TYPE_RGB);
+   webp->state = DILLO_WEBP_DECODING;
+   return 1;
+}
+
+/*
+ * Receive and process new chunks of WebP image data
+ */
+static void Webp_write(DilloWebp *webp, void *Buf, uint_t BufSize)
+{
+   VP8StatusCode status;
+   uint8_t *rgb;
+   int last_y, width, height, stride;
+
+   dReturn_if_fail ( Buf != NULL && BufSize > 0 );
+
+   if (webp->state == DILLO_WEBP_INIT && !Webp_init(webp, Buf, BufSize))
+      webp->state = DILLO_WEBP_ERROR;
+   if (webp->state != DILLO_WEBP_DECODING)
+      return;
+
+   status = WebPIUpdate(webp->idec, Buf, BufSize);
+   if (status == VP8_STATUS_OK) {
+      webp->state = DILLO_WEBP_DONE;
+   } else if (status != VP8_STATUS_SUSPENDED) {
+      MSG_WARN("WebP decoder: error %d in \"%s\".\n",
+               status, URL_STR(webp->url));
+      webp->state = DILLO_WEBP_ERROR;
+   }
+
+   /* Send the rows completed since the last time, at once */
+   rgb = WebPIDecGetRGB(webp->idec, &last_y, &width, &height, &stride);
+   if (rgb && last_y > webp->y) {
+      a_Dicache_write_rows(webp->url, webp->version,
+                           rgb + webp->y * stride, (uint_t)webp->y,
+                           (uint_t)(last_y - webp->y), (uint_t)stride);
+      webp->y = last_y;
+   }
+}
+
+/*
+ * Op:  Operation to perform.
+ *   If (Op == CA_Send)
+ *      start or continue processing an image if image data exists.
+ *   else
+ *      terminate processing, cleanup any allocated memory,
+ *      close down the decoding process.
+ *
+ * Client->CbData  : pointer to previously allocated DilloWebp work area.
+ * Client->Buf     : Pointer to data start.
+ * Client->BufSize : the size of the data buffer.
+ */
+void a_Webp_callback(int Op, void *data)
+{
+   if (Op == CA_Send) {
+      CacheClient_t *Client = data;
+      Webp_write(Client->CbData, Client->Buf, Client->BufSize);
+   } else if (Op == CA_Close) {
+      CacheClient_t *Client = data;
+      Webp_close(Client->CbData, Client);
+   } else if (Op == CA_Abort) {
+      Webp_free(data);
+   }
+}
+
+/*
+ * Create the image state data that must be kept between calls
+ */
+void *a_Webp_new(DilloImage *Image, DilloUrl *url, int version)
+{
+   DilloWebp *webp = dNew0(DilloWebp, 1);
+   _MSG("a_Webp_new: webp=%p\n", webp);
+
+   webp->Image = Image;
+   webp->url = url;
+   webp->version = version;
+   webp->state = DILLO_WEBP_INIT;
+   webp->idec = NULL;
+   webp->y = 0;
+   WebPInitDecoderConfig(&webp->config);
+
+   return webp;
+}
+
+#else /* ENABLE_WEBP */
+
+void *a_Webp_new() { return 0; }
+void a_Webp_callback() { return; }
+
+#endif /* ENABLE_WEBP */
@@ -0,0 +1,477 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Headless layout benchmark.
+ *
+ * Each HTML file given is handed to the HTML parser of src/html.cc as if
+ * it had come from the cache at once, laid out and drawn into a
+ * bench::NullView, which has deterministic font metrics and no display.
+ * The browser window, cache and UI functions the parser calls are
+ * replaced by the stubs below: nothing is fetched (no images, nor style
+ * sheets other than <style> elements) and nothing is shown. The time and
+ * the number of allocations (malloc and calloc calls, which operator new
+ * and dMalloc come to) of each phase are reported, one record per line,
+ * tab separated:
+ *
+ *    phase  <file>  <name>  <usec>  <allocs>  <bytes>
+ *    canvas <file>  <width> <height> <draw calls>
+ *
+ * where the phases are "parse" (tokenizing, styling and building the
+ * widgets, which the parser does together), "layout" (the resize idle),
+ * "draw" (an expose of the whole canvas) and "free". With "-n", each file
+ * is run several times and the fastest time of each phase is given.
+ *
+ * Allocations are only counted with glibc (and not under AddressSanitizer,
+ * which has an allocator of its own); the counts are 0 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "../dlib/dlib.h"
+#include "../dw/core.hh"
+#include "../src/prefs.h"
+#include "../src/url.h"
+#include "../src/bw.h"
+#include "../src/web.hh"
+#include "../src/capi.h"
+#include "../src/IO/mime.h"
+#include "../src/nav.h"
+#include "../src/uicmd.hh"
+#include "../src/history.h"
+#include "../src/dialog.hh"
+#include "../src/prefsui.hh"
+#include "../src/timeout.hh"
+#include "../src/dicache.h"
+#include "nullplatform.hh"
+
+using namespace dw::core;
+using namespace bench;
+
+/*
+ * Allocation counting
+ *
+ * malloc() and calloc() are replaced by ones that count the calls and
+ * pass them on to glibc's own. Growing a block with realloc() is not
+ * counted as an allocation, and free() is left alone.
+ */
+static long allocCount = 0, allocBytes = 0;
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+extern "C" {
+
+void *__libc_malloc (size_t size);
+void *__libc_calloc (size_t nmemb, size_t size);
+
+void *malloc (size_t size)
+{
+   allocCount++;
+   allocBytes += size;
+   return __libc_malloc (size);
+}
+
+void *calloc (size_t nmemb, size_t size)
+{
+   allocCount++;
+   allocBytes += nmemb * size;
+   return __libc_calloc (nmemb, size);
+}
+
+} /* extern "C" */
+#endif
+
+/*
+ * Browser hooks
+ *
+ * What the HTML parser needs from the rest of the browser. The browser
+ * window itself (src/bw.c) and the DilloWeb structures (src/web.cc) are
+ * the real ones.
+ */
+
+/* The cache has nothing but the document; there's no network */
+int a_Capi_open_url(DilloWeb *web, CA_Callback_t Call, void *CbData)
+{
+   a_Web_free (web);
+   return 0;
+}
+
+int a_Capi_get_buf(const DilloUrl *Url, char **PBuf, int *BufSize)
+{
+   *PBuf = NULL;
+   *BufSize = 0;
+   return 0;
+}
+
+void a_Capi_unref_buf(const DilloUrl *Url)
+{
+}
+
+const char *a_Capi_set_content_type(const DilloUrl *url, const char *ctype,
+                                    const char *from)
+{
+   return ctype;
+}
+
+int a_Capi_get_flags_with_redirection(const DilloUrl *Url)
+{
+   return 0;
+}
+
+void a_Capi_stop_client(int Key, int force)
+{
+}
+
+const char *a_Dicache_sniff_type(const void *Data, size_t Size)
+{
+   return NULL;
+}
+
+/* Only HTML is benchmarked */
+void *a_Mime_set_viewer(const char *content_type, void *Ptr,
+                        CA_Callback_t *Call, void **Data)
+{
+   return a_Html_text (content_type, Ptr, Call, Data);
+}
+
+/* Timeouts never fire: the page is laid out once everything is parsed */
+void a_Timeout_add(float t, TimeoutCb_t cb, void *cbdata)
+{
+}
+
+void a_Timeout_remove(TimeoutCb_t cb, void *cbdata)
+{
+}
+
+/* No history, and no UI */
+const char *a_History_get_title_by_url(const DilloUrl *url, int force)
+{
+   return NULL;
+}
+
+void a_History_set_title_by_url(const DilloUrl *url, const char *title)
+{
+}
+
+void a_Nav_expect_done(BrowserWindow *bw)
+{
+}
+
+void a_Dialog_msg(const char *msg)
+{
+}
+
+void a_PrefsUI_add_search(const char *label, const char *url)
+{
+}
+
+void a_UIcmd_open_url(BrowserWindow *bw, const DilloUrl *url)
+{
+}
+
+void a_UIcmd_open_url_nw(BrowserWindow *bw, const DilloUrl *url)
+{
+}
+
+void a_UIcmd_open_url_nt(void *vbw, const DilloUrl *url, int focus)
+{
+}
+
+void a_UIcmd_repush(void *vbw)
+{
+}
+
+void a_UIcmd_redirection0(void *vbw, const DilloUrl *url)
+{
+}
+
+const char *a_UIcmd_select_file()
+{
+   return NULL;
+}
+
+void a_UIcmd_page_popup(void *vbw, bool_t has_bugs, void *v_cssUrls)
+{
+}
+
+void a_UIcmd_link_popup(void *vbw, const DilloUrl *url)
+{
+}
+
+void a_UIcmd_image_popup(void *vbw, const DilloUrl *url, bool_t loaded_img,
+                         DilloUrl *page_url, DilloUrl *link_url)
+{
+}
+
+void a_UIcmd_form_popup(void *vbw, const DilloUrl *url, void *vform,
+                        bool_t showing_hiddens)
+{
+}
+
+void a_UIcmd_set_location_text(void *vbw, const char *text)
+{
+}
+
+void a_UIcmd_set_page_prog(BrowserWindow *bw, size_t nbytes, int cmd)
+{
+}
+
+void a_UIcmd_set_img_prog(BrowserWindow *bw, int n_img, int t_img, int cmd)
+{
+}
+
+void a_UIcmd_set_bug_prog(BrowserWindow *bw, int n_bug)
+{
+}
+
+void a_UIcmd_set_page_title(BrowserWindow *bw, const char *label)
+{
+}
+
+void a_UIcmd_set_msg(BrowserWindow *bw, const char *format, ...)
+{
+}
+
+void a_UIcmd_set_buttons_sens(BrowserWindow *bw)
+{
+}
+
+/*
+ * Phases
+ */
+enum {
+   PHASE_PARSE,
+   PHASE_LAYOUT,
+   PHASE_DRAW,
+   PHASE_FREE,
+   PHASE_NUM
+};
+
+static const char *const phaseNames[PHASE_NUM] = {
+   "parse", "layout", "draw", "free"
+};
+
+typedef struct {
+   int64_t usec;
+   long allocs, bytes;
+} Phase;
+
+/*
+ * Return the time in microseconds.
+ */
+static int64_t Bench_now ()
+{
+#ifdef CLOCK_MONOTONIC
+   struct timespec ts;
+
+   if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+      return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+   struct timeval tv;
+
+   gettimeofday (&tv, NULL);
+   return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * \brief Adds the time and allocations from its construction to its
+ *    destruction to a phase.
+ */
+class Measure
+{
+private:
+   Phase *phase;
+   int64_t start;
+   long allocs, bytes;
+
+public:
+   inline Measure (Phase *phase) {
+      this->phase = phase;
+      allocs = allocCount;
+      bytes = allocBytes;
+      start = Bench_now ();
+   }
+   inline ~Measure () {
+      phase->usec += Bench_now () - start;
+      phase->allocs += allocCount - allocs;
+      phase->bytes += allocBytes - bytes;
+   }
+};
+
+/*
+ * Run all phases on a document once.
+ */
+static void Bench_run (const DilloUrl *url, Dstr *html, int width,
+                       int height, Phase *phases, int *canvas)
+{
+   NullPlatform *platform = new NullPlatform ();
+   NullView *view = new NullView (width, height);
+   Layout *layout = new Layout (platform);
+   BrowserWindow *bw = a_Bw_new ();
+   CacheClient_t Client;
+   DilloWeb *web;
+
+   layout->attachView (view);
+   bw->render_layout = layout;
+
+   {
+      Measure m (&phases[PHASE_PARSE]);
+
+      /* What the cache does for a page that is there already */
+      web = a_Web_new (url, NULL);
+      web->bw = bw;
+      web->flags |= WEB_RootUrl;
+      memset (&Client, 0, sizeof (Client));
+      Client.Key = 1;
+      Client.Url = url;
+      Client.Web = web;
+      a_Bw_add_client (bw, Client.Key, 1);
+      if (a_Web_dispatch_by_type ("text/html", web, &Client.Callback,
+                                  &Client.CbData) == 1) {
+         Client.Buf = html->str;
+         Client.BufSize = html->len;
+         Client.Callback (CA_Send, &Client);
+         Client.Callback (CA_Close, &Client);
+      }
+      a_Web_free (web);
+   }
+
+   {
+      Measure m (&phases[PHASE_LAYOUT]);
+      platform->runIdles ();
+   }
+
+   {
+      Measure m (&phases[PHASE_DRAW]);
+      Rectangle area (0, 0, view->getCanvasWidth (),
+                      view->getCanvasHeight ());
+
+      layout->expose (view, &area);
+   }
+   canvas[0] = view->getCanvasWidth ();
+   canvas[1] = view->getCanvasHeight ();
+   canvas[2] = view->drawCount;
+
+   {
+      Measure m (&phases[PHASE_FREE]);
+      /* (this frees the DilloHtml too) */
+      delete layout;
+   }
+
+   a_Bw_free (bw);
+}
+
+/*
+ * Read a whole regular file, or return NULL.
+ */
+static Dstr *Bench_read_file (const char *file)
+{
+   FILE *fp;
+   Dstr *ds;
+   char buf[8192];
+   size_t n;
+   struct stat st;
+
+   if (stat (file, &st) != 0 || !S_ISREG (st.st_mode) ||
+       (fp = fopen (file, "rb")) == NULL)
+      return NULL;
+   ds = dStr_sized_new (sizeof (buf));
+   while ((n = fread (buf, 1, sizeof (buf), fp)) > 0)
+      dStr_append_l (ds, buf, n);
+   fclose (fp);
+   return ds;
+}
+
+static void Bench_usage (const char *argv0)
+{
+   fprintf (stderr, "Usage: %s [-n runs] [-w width] [-h height] file...\n",
+            argv0);
+   exit (2);
+}
+
+int main (int argc, char **argv)
+{
+   int i, j, p, runs = 1, width = 780, height = 580, status = 0;
+   int canvas[3];
+   Phase best[PHASE_NUM], phases[PHASE_NUM];
+   Dstr *html;
+   DilloUrl *url;
+   char *url_str;
+   int opt;
+
+   while ((opt = getopt (argc, argv, "n:w:h:")) != -1) {
+      switch (opt) {
+      case 'n':
+         runs = atoi (optarg);
+         break;
+      case 'w':
+         width = atoi (optarg);
+         break;
+      case 'h':
+         height = atoi (optarg);
+         break;
+      default:
+         Bench_usage (argv[0]);
+      }
+   }
+   if (optind == argc || runs < 1 || width < 1 || height < 1)
+      Bench_usage (argv[0]);
+
+   a_Prefs_init ();
+   prefs.load_images = FALSE;
+   prefs.load_stylesheets = FALSE;
+   prefs.show_msg = FALSE;
+   a_Bw_init ();
+   a_Web_init ();
+
+   for (i = optind; i < argc; i++) {
+      if ((html = Bench_read_file (argv[i])) == NULL) {
+         fprintf (stderr, "%s: can't read %s (or it's not a regular file)\n",
+                  argv[0], argv[i]);
+         status = 1;
+         continue;
+      }
+      url_str = dStrconcat ("file:", argv[i], NULL);
+      url = a_Url_new (url_str, NULL);
+
+      for (j = 0; j < runs; j++) {
+         memset (phases, 0, sizeof (phases));
+         Bench_run (url, html, width, height, phases, canvas);
+         for (p = 0; p < PHASE_NUM; p++)
+            if (j == 0 || phases[p].usec < best[p].usec)
+               best[p] = phases[p];
+      }
+
+      for (p = 0; p < PHASE_NUM; p++)
+         printf ("phase\t%s\t%s\t%lld\t%ld\t%ld\n", argv[i], phaseNames[p],
+                 (long long) best[p].usec, best[p].allocs, best[p].bytes);
+      printf ("canvas\t%s\t%d\t%d\t%d\n", argv[i],
+              canvas[0], canvas[1], canvas[2]);
+      fflush (stdout);
+      a_Url_free (url);
+      dFree (url_str);
+      dStr_free (html, 1);
+   }
+
+   a_Prefs_freeall ();
+   return status;
+}
@@ -0,0 +1,217 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Incremental sizing of a table with a rowspan cell.
+ *
+ * In a table like
+ *
+ *    +-----------+
+ *    | a         |
+ *    +------+----+
+ *    | span | b0 |
+ *    |      +----+
+ *    |      | b1 |
+ *    |      +----+
+ *    |      | b2 |
+ *    +------+----+
+ *    | c         |
+ *    +-----------+
+ *
+ * "span", a cell beside it, or one and then another, get more lines after
+ * the table has been laid out. The rows "span" spans, and the one below,
+ * must then come out as in a table that had these lines from the start.
+ * This runs without a display (see nullplatform.hh); the exit status
+ * tells whether the test passed.
+ */
+
+#include <stdio.h>
+
+#include "../dw/core.hh"
+#include "../dw/textblock.hh"
+#include "../dw/table.hh"
+#include "nullplatform.hh"
+
+using namespace dw;
+using namespace dw::core;
+using namespace dw::core::style;
+using namespace bench;
+
+enum { CELL_A, CELL_SPAN, CELL_B0, CELL_B1, CELL_B2, CELL_C, NUM_CELLS };
+
+static const char *const cellNames[NUM_CELLS] = {
+   "a", "span", "b0", "b1", "b2", "c"
+};
+
+typedef struct {
+   NullPlatform *platform;
+   Layout *layout;
+   Style *cellStyle, *wordStyle;
+   Textblock *cells[NUM_CELLS];
+} TestTable;
+
+/*
+ * Add lines of text to a cell.
+ */
+static void Test_add_lines (TestTable *t, Textblock *cell, int lines)
+{
+   for (int i = 0; i < lines; i++) {
+      cell->addText ("line", t->wordStyle);
+      cell->addLinebreak (t->wordStyle);
+   }
+   cell->flush ();
+}
+
+/*
+ * Add a cell with some lines.
+ */
+static Textblock *Test_add_cell (TestTable *t, Table *table, int colspan,
+                                 int rowspan, int lines)
+{
+   Textblock *cell = new Textblock (false);
+
+   cell->setStyle (t->cellStyle);
+   table->addCell (cell, colspan, rowspan);
+   Test_add_lines (t, cell, lines);
+   return cell;
+}
+
+/*
+ * Build the table, with the given number of lines in each cell, and lay
+ * it out.
+ */
+static void Test_table_new (TestTable *t, const int *lines)
+{
+   StyleAttrs styleAttrs;
+   FontAttrs fontAttrs;
+   Style *tableStyle;
+   Table *table;
+
+   t->platform = new NullPlatform ();
+   t->layout = new Layout (t->platform);
+   t->layout->attachView (new NullView (400, 300));
+
+   fontAttrs.name = "Helvetica";
+   fontAttrs.size = 14;
+   fontAttrs.weight = 400;
+   fontAttrs.style = FONT_STYLE_NORMAL;
+   fontAttrs.letterSpacing = 0;
+   fontAttrs.fontVariant = FONT_VARIANT_NORMAL;
+
+   styleAttrs.initValues ();
+   styleAttrs.font = Font::create (t->layout, &fontAttrs);
+   styleAttrs.color = Color::create (t->layout, 0x000000);
+   styleAttrs.hBorderSpacing = 2;
+   styleAttrs.vBorderSpacing = 2;
+   tableStyle = Style::create (t->layout, &styleAttrs);
+   styleAttrs.padding.setVal (3);
+   t->cellStyle = Style::create (t->layout, &styleAttrs);
+   styleAttrs.padding.setVal (0);
+   t->wordStyle = Style::create (t->layout, &styleAttrs);
+
+   table = new Table (false);
+   table->setStyle (tableStyle);
+   tableStyle->unref ();
+   t->layout->setWidget (table);
+
+   table->addRow (t->wordStyle);
+   t->cells[CELL_A] = Test_add_cell (t, table, 2, 1, lines[CELL_A]);
+   table->addRow (t->wordStyle);
+   t->cells[CELL_SPAN] = Test_add_cell (t, table, 1, 3, lines[CELL_SPAN]);
+   t->cells[CELL_B0] = Test_add_cell (t, table, 1, 1, lines[CELL_B0]);
+   table->addRow (t->wordStyle);
+   t->cells[CELL_B1] = Test_add_cell (t, table, 1, 1, lines[CELL_B1]);
+   table->addRow (t->wordStyle);
+   t->cells[CELL_B2] = Test_add_cell (t, table, 1, 1, lines[CELL_B2]);
+   table->addRow (t->wordStyle);
+   t->cells[CELL_C] = Test_add_cell (t, table, 2, 1, lines[CELL_C]);
+
+   t->platform->runIdles ();
+}
+
+/*
+ * Free the table and its layout.
+ */
+static void Test_table_free (TestTable *t)
+{
+   t->cellStyle->unref ();
+   t->wordStyle->unref ();
+   delete t->layout;
+}
+
+/*
+ * Give a cell of a laid out table more lines, and then (unless it's -1)
+ * another one, and compare the table with one built with these lines.
+ */
+static bool Test_grow (int cell, int moreLines, int cell2, int moreLines2)
+{
+   int lines[NUM_CELLS] = { 1, 1, 1, 1, 1, 1 };
+   TestTable grown, expected;
+   Allocation *span, *c;
+   int cY;
+   bool ok = true;
+
+   Test_table_new (&grown, lines);
+   cY = grown.cells[CELL_C]->getAllocation()->y;
+
+   Test_add_lines (&grown, grown.cells[cell], moreLines);
+   grown.platform->runIdles ();
+   lines[cell] += moreLines;
+   if (cell2 != -1) {
+      Test_add_lines (&grown, grown.cells[cell2], moreLines2);
+      grown.platform->runIdles ();
+      lines[cell2] += moreLines2;
+   }
+
+   Test_table_new (&expected, lines);
+
+   span = grown.cells[CELL_SPAN]->getAllocation ();
+   c = grown.cells[CELL_C]->getAllocation ();
+   if (c->y <= cY || c->y < span->y + span->ascent + span->descent) {
+      printf ("FAIL: growing %s: the row below the span was not moved down "
+              "(y = %d, was %d; span ends at %d)\n", cellNames[cell],
+              c->y, cY, span->y + span->ascent + span->descent);
+      ok = false;
+   }
+   for (int i = 0; i < NUM_CELLS; i++) {
+      Allocation *a = grown.cells[i]->getAllocation ();
+      Allocation *b = expected.cells[i]->getAllocation ();
+
+      if (a->y != b->y || a->ascent + a->descent != b->ascent + b->descent) {
+         printf ("FAIL: growing %s: %s is at y = %d, %d high "
+                 "(expected y = %d, %d high)\n", cellNames[cell],
+                 cellNames[i], a->y, a->ascent + a->descent,
+                 b->y, b->ascent + b->descent);
+         ok = false;
+      }
+   }
+
+   Test_table_free (&grown);
+   Test_table_free (&expected);
+   return ok;
+}
+
+int main (int argc, char **argv)
+{
+   bool ok = Test_grow (CELL_SPAN, 12, -1, 0);
+
+   ok = Test_grow (CELL_B2, 20, -1, 0) && ok;
+   ok = Test_grow (CELL_SPAN, 12, CELL_B2, 1) && ok;
+   ok = Test_grow (CELL_SPAN, 12, CELL_C, 1) && ok;
+   printf ("%s\n", ok ? "PASS" : "FAIL");
+   return ok ? 0 : 1;
+}
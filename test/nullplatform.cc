@@ -0,0 +1,744 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "../dlib/dlib.h"
+#include "nullplatform.hh"
+
+namespace bench {
+
+using namespace lout;
+using namespace dw::core;
+
+container::typed::HashTable <style::FontAttrs, NullFont>
+   *NullFont::fontsTable =
+      new container::typed::HashTable <style::FontAttrs, NullFont>
+         (false, false);
+
+container::typed::HashTable <style::ColorAttrs, NullColor>
+   *NullColor::colorsTable =
+      new container::typed::HashTable <style::ColorAttrs, NullColor>
+         (false, false);
+
+/*
+ * The metrics only depend on the size and the weight: glyphs are half as
+ * wide as the font is high (a bit more for bold), and the space a
+ * quarter.
+ */
+NullFont::NullFont (style::FontAttrs *attrs)
+{
+   copyAttrs (attrs);
+
+   glyphWidth = misc::max (1, (size * (weight >= 500 ? 11 : 10) + 10) / 20);
+   spaceWidth = misc::max (1, size / 4 + letterSpacing);
+   xHeight = size / 2;
+   ascent = (size * 4 + 2) / 5;
+   descent = size - ascent;
+}
+
+NullFont::~NullFont ()
+{
+   fontsTable->remove (this);
+}
+
+NullFont *NullFont::create (style::FontAttrs *attrs)
+{
+   NullFont *font = fontsTable->get (attrs);
+
+   if (font == NULL) {
+      font = new NullFont (attrs);
+      fontsTable->put (font, font);
+   }
+
+   return font;
+}
+
+NullColor::NullColor (int color): Color (color)
+{
+}
+
+NullColor::~NullColor ()
+{
+   colorsTable->remove (this);
+}
+
+NullColor *NullColor::create (int col)
+{
+   style::ColorAttrs attrs (col);
+   NullColor *color = colorsTable->get (&attrs);
+
+   if (color == NULL) {
+      color = new NullColor (col);
+      colorsTable->put (color, color);
+   }
+
+   return color;
+}
+
+// ----------------------------------------------------------------------
+
+NullLabelButtonResource::NullLabelButtonResource (const char *label)
+{
+   this->label = dStrdup (label);
+}
+
+NullLabelButtonResource::~NullLabelButtonResource ()
+{
+   dFree (label);
+}
+
+void NullLabelButtonResource::sizeRequest (Requisition *requisition)
+{
+   textSize (requisition, strlen (label), 1);
+}
+
+const char *NullLabelButtonResource::getLabel ()
+{
+   return label;
+}
+
+void NullLabelButtonResource::setLabel (const char *label)
+{
+   dFree (this->label);
+   this->label = dStrdup (label);
+   queueResize (true);
+}
+
+NullComplexButtonResource::NullComplexButtonResource (Widget *widget,
+                                                      bool relief)
+{
+   this->relief = relief;
+   init (widget);
+}
+
+/*
+ * The content of the button is in a layout of its own, whose idle
+ * functions never run; its size is asked from the widget directly.
+ */
+Platform *NullComplexButtonResource::createPlatform ()
+{
+   return new NullPlatform ();
+}
+
+void NullComplexButtonResource::setLayout (Layout *layout)
+{
+   layout->attachView (new NullView ());
+}
+
+int NullComplexButtonResource::reliefXThickness ()
+{
+   return relief ? RELIEF_THICKNESS : 0;
+}
+
+int NullComplexButtonResource::reliefYThickness ()
+{
+   return relief ? RELIEF_THICKNESS : 0;
+}
+
+NullEntryResource::NullEntryResource (int maxLength, const char *label)
+{
+   this->maxLength = maxLength;
+   this->label = label ? dStrdup (label) : NULL;
+   text = dStrdup ("");
+   editable = true;
+}
+
+NullEntryResource::~NullEntryResource ()
+{
+   dFree (text);
+   dFree (label);
+}
+
+void NullEntryResource::sizeRequest (Requisition *requisition)
+{
+   textSize (requisition,
+             (maxLength == UNLIMITED_MAX_LENGTH ? 10 : maxLength) +
+             (label ? strlen (label) : 0), 1);
+}
+
+const char *NullEntryResource::getText ()
+{
+   return text;
+}
+
+void NullEntryResource::setText (const char *text)
+{
+   dFree (this->text);
+   this->text = dStrdup (text);
+}
+
+bool NullEntryResource::isEditable ()
+{
+   return editable;
+}
+
+void NullEntryResource::setEditable (bool editable)
+{
+   this->editable = editable;
+}
+
+NullMultiLineTextResource::NullMultiLineTextResource (int cols, int rows)
+{
+   this->cols = cols;
+   this->rows = rows;
+   text = dStrdup ("");
+   editable = true;
+}
+
+NullMultiLineTextResource::~NullMultiLineTextResource ()
+{
+   dFree (text);
+}
+
+void NullMultiLineTextResource::sizeRequest (Requisition *requisition)
+{
+   textSize (requisition, cols, rows);
+}
+
+const char *NullMultiLineTextResource::getText ()
+{
+   return text;
+}
+
+void NullMultiLineTextResource::setText (const char *text)
+{
+   dFree (this->text);
+   this->text = dStrdup (text);
+}
+
+bool NullMultiLineTextResource::isEditable ()
+{
+   return editable;
+}
+
+void NullMultiLineTextResource::setEditable (bool editable)
+{
+   this->editable = editable;
+}
+
+NullCheckButtonResource::NullCheckButtonResource (bool activated)
+{
+   this->activated = activated;
+}
+
+/*
+ * Toggle buttons are square boxes as high as a line.
+ */
+void NullCheckButtonResource::sizeRequest (Requisition *requisition)
+{
+   textSize (requisition, 0, 1);
+   requisition->width += fontAscent + fontDescent;
+}
+
+bool NullCheckButtonResource::isActivated ()
+{
+   return activated;
+}
+
+void NullCheckButtonResource::setActivated (bool activated)
+{
+   this->activated = activated;
+}
+
+bool NullRadioButtonResource::NullGroupIterator::hasNext ()
+{
+   return index < group->size ();
+}
+
+ui::RadioButtonResource *NullRadioButtonResource::NullGroupIterator::getNext ()
+{
+   return group->get (index++);
+}
+
+void NullRadioButtonResource::NullGroupIterator::unref ()
+{
+   delete this;
+}
+
+NullRadioButtonResource::NullRadioButtonResource (NullRadioButtonResource
+                                                  *groupedWith,
+                                                  bool activated)
+{
+   group = groupedWith ? groupedWith->group :
+      new misc::SimpleVector <NullRadioButtonResource*> (4);
+   group->increase ();
+   group->set (group->size () - 1, this);
+   this->activated = false;
+   setActivated (activated);
+}
+
+NullRadioButtonResource::~NullRadioButtonResource ()
+{
+   int i;
+
+   for (i = 0; group->get (i) != this; i++)
+      ;
+   for (; i < group->size () - 1; i++)
+      group->set (i, group->get (i + 1));
+   group->setSize (group->size () - 1);
+   if (group->size () == 0)
+      delete group;
+}
+
+void NullRadioButtonResource::sizeRequest (Requisition *requisition)
+{
+   textSize (requisition, 0, 1);
+   requisition->width += fontAscent + fontDescent;
+}
+
+bool NullRadioButtonResource::isActivated ()
+{
+   return activated;
+}
+
+/*
+ * Activating a button deactivates the others of the group.
+ */
+void NullRadioButtonResource::setActivated (bool activated)
+{
+   if (activated)
+      for (int i = 0; i < group->size (); i++)
+         group->get(i)->activated = false;
+   this->activated = activated;
+}
+
+ui::RadioButtonResource::GroupIterator
+   *NullRadioButtonResource::groupIterator ()
+{
+   return new NullGroupIterator (group);
+}
+
+NullListResource::NullListResource (ListResource::SelectionMode
+                                    selectionMode, int rows):
+   NullSelectionResource <ui::ListResource> (selectionMode !=
+                                             SELECTION_MULTIPLE)
+{
+   this->rows = rows;
+}
+
+/*
+ * Lists show up to their number of rows, and a scrollbar.
+ */
+void NullListResource::sizeRequest (Requisition *requisition)
+{
+   int shown = misc::min (rows, getNumberOfItems ());
+
+   textSize (requisition, maxItemLength, misc::max (1, shown));
+   requisition->width += fontAscent + fontDescent;
+}
+
+NullOptionMenuResource::NullOptionMenuResource ():
+   NullSelectionResource <ui::OptionMenuResource> (true)
+{
+}
+
+/*
+ * Option menus show their widest item, and an arrow.
+ */
+void NullOptionMenuResource::sizeRequest (Requisition *requisition)
+{
+   textSize (requisition, maxItemLength, 1);
+   requisition->width += fontAscent + fontDescent;
+}
+
+/*
+ * When no item was selected, the first one is.
+ */
+bool NullOptionMenuResource::isSelected (int index)
+{
+   for (int i = 0; i < selected->size (); i++)
+      if (selected->get (i))
+         return i == index;
+   return index == 0;
+}
+
+ui::LabelButtonResource *NullResourceFactory::createLabelButtonResource
+   (const char *label)
+{
+   return new NullLabelButtonResource (label);
+}
+
+ui::ComplexButtonResource *NullResourceFactory::createComplexButtonResource
+   (Widget *widget, bool relief)
+{
+   return new NullComplexButtonResource (widget, relief);
+}
+
+ui::ListResource *NullResourceFactory::createListResource
+   (ui::ListResource::SelectionMode selectionMode, int rows)
+{
+   return new NullListResource (selectionMode, rows);
+}
+
+ui::OptionMenuResource *NullResourceFactory::createOptionMenuResource ()
+{
+   return new NullOptionMenuResource ();
+}
+
+ui::EntryResource *NullResourceFactory::createEntryResource (int maxLength,
+                                                            bool password,
+                                                            const char *label)
+{
+   return new NullEntryResource (maxLength, label);
+}
+
+ui::MultiLineTextResource *NullResourceFactory::createMultiLineTextResource
+   (int cols, int rows)
+{
+   return new NullMultiLineTextResource (cols, rows);
+}
+
+ui::CheckButtonResource *NullResourceFactory::createCheckButtonResource
+   (bool activated)
+{
+   return new NullCheckButtonResource (activated);
+}
+
+ui::RadioButtonResource *NullResourceFactory::createRadioButtonResource
+   (ui::RadioButtonResource *groupedWith, bool activated)
+{
+   return new NullRadioButtonResource ((NullRadioButtonResource*)groupedWith,
+                                       activated);
+}
+
+// ----------------------------------------------------------------------
+
+NullPlatform::NullPlatform ()
+{
+   layout = NULL;
+   idleQueue = new misc::SimpleVector <Idle> (4);
+   idleCounter = 0;
+}
+
+NullPlatform::~NullPlatform ()
+{
+   delete idleQueue;
+}
+
+/**
+ * \brief Call the queued idle functions, including those queued meanwhile,
+ *    and return how many there were.
+ */
+int NullPlatform::runIdles ()
+{
+   int i, n = 0;
+
+   for (i = 0; i < idleQueue->size (); i++) {
+      void (Layout::*func) () = idleQueue->getRef(i)->func;
+
+      if (func) {
+         idleQueue->getRef(i)->func = NULL;
+         (layout->*func) ();
+         n++;
+      }
+   }
+   idleQueue->setSize (0);
+
+   return n;
+}
+
+void NullPlatform::setLayout (Layout *layout)
+{
+   this->layout = layout;
+}
+
+void NullPlatform::attachView (View *view)
+{
+}
+
+void NullPlatform::detachView (View *view)
+{
+}
+
+int NullPlatform::textWidth (style::Font *font, const char *text, int len)
+{
+   int i, glyphs = 0;
+
+   for (i = 0; i < len; i++)
+      if ((text[i] & 0xc0) != 0x80)
+         glyphs++;
+
+   return glyphs * (((NullFont*)font)->glyphWidth + font->letterSpacing);
+}
+
+int NullPlatform::nextGlyph (const char *text, int idx)
+{
+   do
+      idx++;
+   while ((text[idx] & 0xc0) == 0x80);
+
+   return idx;
+}
+
+int NullPlatform::prevGlyph (const char *text, int idx)
+{
+   do
+      idx--;
+   while (idx > 0 && (text[idx] & 0xc0) == 0x80);
+
+   return idx;
+}
+
+float NullPlatform::dpiX ()
+{
+   return 96.0;
+}
+
+float NullPlatform::dpiY ()
+{
+   return 96.0;
+}
+
+int NullPlatform::addIdle (void (Layout::*func) ())
+{
+   idleQueue->increase ();
+   Idle *idle = idleQueue->getRef (idleQueue->size () - 1);
+   idle->id = ++idleCounter;
+   idle->func = func;
+
+   return idle->id;
+}
+
+void NullPlatform::removeIdle (int idleId)
+{
+   for (int i = 0; i < idleQueue->size (); i++) {
+      if (idleQueue->getRef(i)->id == idleId) {
+         idleQueue->getRef(i)->func = NULL;
+         break;
+      }
+   }
+}
+
+style::Font *NullPlatform::createFont (style::FontAttrs *attrs,
+                                       bool tryEverything)
+{
+   return NullFont::create (attrs);
+}
+
+bool NullPlatform::fontExists (const char *name)
+{
+   return true;
+}
+
+style::Color *NullPlatform::createColor (int color)
+{
+   return NullColor::create (color);
+}
+
+style::Tooltip *NullPlatform::createTooltip (const char *text)
+{
+   return new NullTooltip (text);
+}
+
+void NullPlatform::cancelTooltip ()
+{
+}
+
+Imgbuf *NullPlatform::createImgbuf (Imgbuf::Type type, int width, int height)
+{
+   return NULL;
+}
+
+void NullPlatform::copySelection (const char *text)
+{
+}
+
+void NullPlatform::copySelectionToClipboard ()
+{
+}
+
+ui::ResourceFactory *NullPlatform::getResourceFactory ()
+{
+   return &resourceFactory;
+}
+
+// ----------------------------------------------------------------------
+
+NullView::NullView (int width, int height)
+{
+   layout = NULL;
+   viewport = true;
+   this->width = width;
+   this->height = height;
+   canvasWidth = canvasHeight = 0;
+   drawCount = 0;
+}
+
+/*
+ * A view without a viewport, which shows the whole canvas (as the content
+ * of a button).
+ */
+NullView::NullView ()
+{
+   layout = NULL;
+   viewport = false;
+   width = height = 0;
+   canvasWidth = canvasHeight = 0;
+   drawCount = 0;
+}
+
+NullView::~NullView ()
+{
+}
+
+/*
+ * The layout learns the size of the viewport as soon as it's attached.
+ */
+void NullView::setLayout (Layout *layout)
+{
+   this->layout = layout;
+   if (viewport)
+      layout->viewportSizeChanged (this, width, height);
+}
+
+void NullView::setCanvasSize (int width, int ascent, int descent)
+{
+   canvasWidth = width;
+   canvasHeight = ascent + descent;
+}
+
+void NullView::setCursor (style::Cursor cursor)
+{
+}
+
+void NullView::setBgColor (style::Color *color)
+{
+}
+
+bool NullView::usesViewport ()
+{
+   return viewport;
+}
+
+int NullView::getHScrollbarThickness ()
+{
+   return 0;
+}
+
+int NullView::getVScrollbarThickness ()
+{
+   return 0;
+}
+
+void NullView::scrollTo (int x, int y)
+{
+}
+
+void NullView::setViewportSize (int width, int height,
+                                int hScrollbarThickness,
+                                int vScrollbarThickness)
+{
+}
+
+void NullView::startDrawing (Rectangle *area)
+{
+}
+
+void NullView::finishDrawing (Rectangle *area)
+{
+}
+
+void NullView::queueDraw (Rectangle *area)
+{
+}
+
+void NullView::queueDrawTotal ()
+{
+}
+
+void NullView::cancelQueueDraw ()
+{
+}
+
+void NullView::drawPoint (style::Color *color, style::Color::Shading shading,
+                          int x, int y)
+{
+   drawCount++;
+}
+
+void NullView::drawLine (style::Color *color, style::Color::Shading shading,
+                         int x1, int y1, int x2, int y2)
+{
+   drawCount++;
+}
+
+void NullView::drawTypedLine (style::Color *color,
+                              style::Color::Shading shading,
+                              style::LineType type, int width,
+                              int x1, int y1, int x2, int y2)
+{
+   drawCount++;
+}
+
+void NullView::drawRectangle (style::Color *color,
+                              style::Color::Shading shading, bool filled,
+                              int x, int y, int width, int height)
+{
+   drawCount++;
+}
+
+void NullView::drawArc (style::Color *color, style::Color::Shading shading,
+                        bool filled, int centerX, int centerY,
+                        int width, int height, int angle1, int angle2)
+{
+   drawCount++;
+}
+
+void NullView::drawPolygon (style::Color *color,
+                            style::Color::Shading shading,
+                            bool filled, bool convex, Point *points,
+                            int npoints)
+{
+   drawCount++;
+}
+
+void NullView::drawText (style::Font *font, style::Color *color,
+                         style::Color::Shading shading,
+                         int x, int y, const char *text, int len)
+{
+   drawCount++;
+}
+
+void NullView::drawSimpleWrappedText (style::Font *font, style::Color *color,
+                                      style::Color::Shading shading,
+                                      int x, int y, int w, int h,
+                                      const char *text)
+{
+   drawCount++;
+}
+
+void NullView::drawImage (Imgbuf *imgbuf, int xRoot, int yRoot,
+                          int x, int y, int width, int height,
+                          style::Color *bgColor)
+{
+   drawCount++;
+}
+
+/*
+ * Clipping is not needed, as nothing is drawn.
+ */
+View *NullView::getClippingView (int x, int y, int width, int height)
+{
+   return this;
+}
+
+void NullView::mergeClippingView (View *clippingView)
+{
+}
+
+} // namespace bench
@@ -0,0 +1,441 @@
+#ifndef __TEST_NULLPLATFORM_HH__
+#define __TEST_NULLPLATFORM_HH__
+
+#include <string.h>
+
+#include "../dw/core.hh"
+
+namespace bench {
+
+/**
+ * \brief A font with deterministic metrics.
+ *
+ * All glyphs are equally wide, depending only on the size and weight, so
+ * that layouts come out the same on every machine.
+ */
+class NullFont: public dw::core::style::Font
+{
+   static lout::container::typed::HashTable <dw::core::style::FontAttrs,
+                                             NullFont> *fontsTable;
+
+   NullFont (dw::core::style::FontAttrs *attrs);
+   ~NullFont ();
+
+public:
+   int glyphWidth;
+
+   static NullFont *create (dw::core::style::FontAttrs *attrs);
+};
+
+class NullColor: public dw::core::style::Color
+{
+   static lout::container::typed::HashTable <dw::core::style::ColorAttrs,
+                                             NullColor> *colorsTable;
+
+   NullColor (int color);
+   ~NullColor ();
+
+public:
+   static NullColor *create (int color);
+};
+
+class NullTooltip: public dw::core::style::Tooltip
+{
+public:
+   NullTooltip (const char *text): Tooltip (text) { }
+};
+
+/**
+ * \brief Common part of the embedded UI resources of bench::NullPlatform.
+ *
+ * The resources keep their state (texts, items, whether they're
+ * activated), but draw nothing. Their sizes are derived from the font of
+ * their style, roughly like the FLTK ones.
+ */
+template <class I> class NullResource: public I
+{
+private:
+   bool enabled;
+
+protected:
+   enum { RELIEF_THICKNESS = 3 };
+
+   int glyphWidth, fontAscent, fontDescent;
+
+   /**
+    * \brief The size of a resource showing \em columns glyphs in each of
+    *    \em rows lines, with a relief around.
+    */
+   void textSize (dw::core::Requisition *requisition, int columns, int rows)
+   {
+      requisition->width = glyphWidth * columns + 2 * RELIEF_THICKNESS;
+      requisition->ascent = fontAscent + RELIEF_THICKNESS +
+                            (fontAscent + fontDescent) * (rows - 1);
+      requisition->descent = fontDescent + RELIEF_THICKNESS;
+   }
+
+public:
+   NullResource ()
+   {
+      enabled = true;
+      glyphWidth = 7;
+      fontAscent = 11;
+      fontDescent = 3;
+   }
+
+   void setStyle (dw::core::style::Style *style)
+   {
+      NullFont *font = (NullFont*) style->font;
+
+      glyphWidth = font->glyphWidth;
+      fontAscent = font->ascent;
+      fontDescent = font->descent;
+   }
+
+   bool isEnabled () { return enabled; }
+   void setEnabled (bool enabled) { this->enabled = enabled; }
+};
+
+class NullLabelButtonResource:
+   public NullResource <dw::core::ui::LabelButtonResource>
+{
+private:
+   char *label;
+
+public:
+   NullLabelButtonResource (const char *label);
+   ~NullLabelButtonResource ();
+
+   void sizeRequest (dw::core::Requisition *requisition);
+   const char *getLabel ();
+   void setLabel (const char *label);
+};
+
+class NullComplexButtonResource:
+   public NullResource <dw::core::ui::ComplexButtonResource>
+{
+private:
+   bool relief;
+
+protected:
+   dw::core::Platform *createPlatform ();
+   void setLayout (dw::core::Layout *layout);
+   int reliefXThickness ();
+   int reliefYThickness ();
+
+public:
+   NullComplexButtonResource (dw::core::Widget *widget, bool relief);
+};
+
+class NullEntryResource: public NullResource <dw::core::ui::EntryResource>
+{
+private:
+   int maxLength;
+   char *text, *label;
+   bool editable;
+
+public:
+   NullEntryResource (int maxLength, const char *label);
+   ~NullEntryResource ();
+
+   void sizeRequest (dw::core::Requisition *requisition);
+   const char *getText ();
+   void setText (const char *text);
+   bool isEditable ();
+   void setEditable (bool editable);
+};
+
+class NullMultiLineTextResource:
+   public NullResource <dw::core::ui::MultiLineTextResource>
+{
+private:
+   int cols, rows;
+   char *text;
+   bool editable;
+
+public:
+   NullMultiLineTextResource (int cols, int rows);
+   ~NullMultiLineTextResource ();
+
+   void sizeRequest (dw::core::Requisition *requisition);
+   const char *getText ();
+   void setText (const char *text);
+   bool isEditable ();
+   void setEditable (bool editable);
+};
+
+class NullCheckButtonResource:
+   public NullResource <dw::core::ui::CheckButtonResource>
+{
+private:
+   bool activated;
+
+public:
+   NullCheckButtonResource (bool activated);
+
+   void sizeRequest (dw::core::Requisition *requisition);
+   bool isActivated ();
+   void setActivated (bool activated);
+};
+
+/**
+ * \brief A radio button; the buttons of a group share a list of them.
+ */
+class NullRadioButtonResource:
+   public NullResource <dw::core::ui::RadioButtonResource>
+{
+private:
+   class NullGroupIterator:
+      public dw::core::ui::RadioButtonResource::GroupIterator
+   {
+   private:
+      lout::misc::SimpleVector <NullRadioButtonResource*> *group;
+      int index;
+
+   public:
+      NullGroupIterator (lout::misc::SimpleVector <NullRadioButtonResource*>
+                         *group) { this->group = group; index = 0; }
+
+      bool hasNext ();
+      dw::core::ui::RadioButtonResource *getNext ();
+      void unref ();
+   };
+
+   lout::misc::SimpleVector <NullRadioButtonResource*> *group;
+   bool activated;
+
+public:
+   NullRadioButtonResource (NullRadioButtonResource *groupedWith,
+                            bool activated);
+   ~NullRadioButtonResource ();
+
+   void sizeRequest (dw::core::Requisition *requisition);
+   bool isActivated ();
+   void setActivated (bool activated);
+   GroupIterator *groupIterator ();
+};
+
+/**
+ * \brief Items of a list or an option menu, and which are selected.
+ */
+template <class I> class NullSelectionResource: public NullResource <I>
+{
+protected:
+   lout::misc::SimpleVector <bool> *selected;
+   int maxItemLength;
+   bool single;
+
+public:
+   NullSelectionResource (bool single)
+   {
+      selected = new lout::misc::SimpleVector <bool> (8);
+      maxItemLength = 1;
+      this->single = single;
+   }
+   ~NullSelectionResource () { delete selected; }
+
+   void addItem (const char *str, bool enabled, bool selected)
+   {
+      if (selected && single)
+         for (int i = 0; i < this->selected->size (); i++)
+            this->selected->set (i, false);
+      this->selected->increase ();
+      this->selected->set (this->selected->size () - 1, selected);
+      maxItemLength = lout::misc::max (maxItemLength, (int) strlen (str));
+      this->queueResize (true);
+   }
+   void pushGroup (const char *name, bool enabled) { }
+   void popGroup () { }
+   int getNumberOfItems () { return selected->size (); }
+   bool isSelected (int index) { return selected->get (index); }
+
+   dw::core::Iterator *iterator (dw::core::Content::Type mask, bool atEnd)
+   {
+      return new dw::core::EmptyIterator (this->getEmbed (), mask, atEnd);
+   }
+};
+
+class NullListResource:
+   public NullSelectionResource <dw::core::ui::ListResource>
+{
+private:
+   int rows;
+
+public:
+   NullListResource (ListResource::SelectionMode selectionMode, int rows);
+
+   void sizeRequest (dw::core::Requisition *requisition);
+};
+
+class NullOptionMenuResource:
+   public NullSelectionResource <dw::core::ui::OptionMenuResource>
+{
+public:
+   NullOptionMenuResource ();
+
+   void sizeRequest (dw::core::Requisition *requisition);
+   bool isSelected (int index);
+};
+
+class NullResourceFactory: public dw::core::ui::ResourceFactory
+{
+public:
+   dw::core::ui::LabelButtonResource *createLabelButtonResource
+      (const char *label);
+   dw::core::ui::ComplexButtonResource *createComplexButtonResource
+      (dw::core::Widget *widget, bool relief);
+   dw::core::ui::ListResource *createListResource
+      (dw::core::ui::ListResource::SelectionMode selectionMode, int rows);
+   dw::core::ui::OptionMenuResource *createOptionMenuResource ();
+   dw::core::ui::EntryResource *createEntryResource (int maxLength,
+                                                     bool password,
+                                                     const char *label);
+   dw::core::ui::MultiLineTextResource *createMultiLineTextResource (int cols,
+                                                                   int rows);
+   dw::core::ui::CheckButtonResource *createCheckButtonResource
+      (bool activated);
+   dw::core::ui::RadioButtonResource *createRadioButtonResource
+      (dw::core::ui::RadioButtonResource *groupedWith, bool activated);
+};
+
+/**
+ * \brief A dw::core::Platform without a display.
+ *
+ * Text is measured with bench::NullFont, there are no images, embedded
+ * UI resources draw nothing (see bench::NullResource), and idle
+ * functions are queued until runIdles() is called, so that the caller
+ * knows (and may time) when the layout work is done.
+ */
+class NullPlatform: public dw::core::Platform
+{
+private:
+   struct Idle
+   {
+      int id;
+      void (dw::core::Layout::*func) ();
+   };
+
+   dw::core::Layout *layout;
+   lout::misc::SimpleVector <Idle> *idleQueue;
+   int idleCounter;
+   NullResourceFactory resourceFactory;
+
+public:
+   NullPlatform ();
+   ~NullPlatform ();
+
+   int runIdles ();
+
+   void setLayout (dw::core::Layout *layout);
+
+   void attachView (dw::core::View *view);
+   void detachView (dw::core::View *view);
+
+   int textWidth (dw::core::style::Font *font, const char *text, int len);
+   int nextGlyph (const char *text, int idx);
+   int prevGlyph (const char *text, int idx);
+   float dpiX ();
+   float dpiY ();
+
+   int addIdle (void (dw::core::Layout::*func) ());
+   void removeIdle (int idleId);
+
+   dw::core::style::Font *createFont (dw::core::style::FontAttrs *attrs,
+                                      bool tryEverything);
+   bool fontExists (const char *name);
+   dw::core::style::Color *createColor (int color);
+   dw::core::style::Tooltip *createTooltip (const char *text);
+   void cancelTooltip ();
+
+   dw::core::Imgbuf *createImgbuf (dw::core::Imgbuf::Type type,
+                                   int width, int height);
+
+   void copySelection (const char *text);
+   void copySelectionToClipboard ();
+
+   dw::core::ui::ResourceFactory *getResourceFactory ();
+};
+
+/**
+ * \brief A dw::core::View which draws nowhere.
+ *
+ * It has a viewport of a fixed size (or none) and no scrollbars;
+ * everything drawn is only counted.
+ */
+class NullView: public dw::core::View
+{
+private:
+   dw::core::Layout *layout;
+   bool viewport;
+   int width, height;
+   int canvasWidth, canvasHeight;
+
+public:
+   int drawCount;
+
+   NullView (int width, int height);
+   NullView ();
+   ~NullView ();
+
+   inline int getCanvasWidth () { return canvasWidth; }
+   inline int getCanvasHeight () { return canvasHeight; }
+
+   void setLayout (dw::core::Layout *layout);
+   void setCanvasSize (int width, int ascent, int descent);
+   void setCursor (dw::core::style::Cursor cursor);
+   void setBgColor (dw::core::style::Color *color);
+
+   bool usesViewport ();
+   int getHScrollbarThickness ();
+   int getVScrollbarThickness ();
+   void scrollTo (int x, int y);
+   void setViewportSize (int width, int height,
+                         int hScrollbarThickness, int vScrollbarThickness);
+
+   void startDrawing (dw::core::Rectangle *area);
+   void finishDrawing (dw::core::Rectangle *area);
+   void queueDraw (dw::core::Rectangle *area);
+   void queueDrawTotal ();
+   void cancelQueueDraw ();
+
+   void drawPoint (dw::core::style::Color *color,
+                   dw::core::style::Color::Shading shading,
+                   int x, int y);
+   void drawLine (dw::core::style::Color *color,
+                  dw::core::style::Color::Shading shading,
+                  int x1, int y1, int x2, int y2);
+   void drawTypedLine (dw::core::style::Color *color,
+                       dw::core::style::Color::Shading shading,
+                       dw::core::style::LineType type, int width,
+                       int x1, int y1, int x2, int y2);
+   void drawRectangle (dw::core::style::Color *color,
+                       dw::core::style::Color::Shading shading, bool filled,
+                       int x, int y, int width, int height);
+   void drawArc (dw::core::style::Color *color,
+                 dw::core::style::Color::Shading shading, bool filled,
+                 int centerX, int centerY, int width, int height,
+                 int angle1, int angle2);
+   void drawPolygon (dw::core::style::Color *color,
+                     dw::core::style::Color::Shading shading,
+                     bool filled, bool convex, dw::core::Point *points,
+                     int npoints);
+   void drawText (dw::core::style::Font *font,
+                  dw::core::style::Color *color,
+                  dw::core::style::Color::Shading shading,
+                  int x, int y, const char *text, int len);
+   void drawSimpleWrappedText (dw::core::style::Font *font,
+                               dw::core::style::Color *color,
+                               dw::core::style::Color::Shading shading,
+                               int x, int y, int w, int h,
+                               const char *text);
+   void drawImage (dw::core::Imgbuf *imgbuf, int xRoot, int yRoot,
+                   int x, int y, int width, int height,
+                   dw::core::style::Color *bgColor);
+
+   dw::core::View *getClippingView (int x, int y, int width, int height);
+   void mergeClippingView (dw::core::View *clippingView);
+};
+
+} // namespace bench
+
+#endif // __TEST_NULLPLATFORM_HH__